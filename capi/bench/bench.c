@@ -0,0 +1,1013 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <sys/select.h>
+#include <assert.h>
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <string.h>
+
+#include "hyper.h"
+
+//
+// Benchmarks of the C API against a loopback server.
+//
+// A child process serves canned responses over HTTP/1.1 and HTTP/2 (prior
+// knowledge), and for each mode the parent sends requests on a single
+// connection, driving everything through `hyper_executor_poll` and
+// `hyper_io_new_fd`. HTTP/1.1 and HTTP/2 send each request with
+// `hyper_clientconn_send`, while pipelined HTTP/1.1 queues `depth` of them
+// at a time with `hyper_clientconn_send_batch`.
+//
+// For each mode, it reports:
+//
+// - req/s: requests completed per second.
+// - p50/p99: latency from sending a request to the end of its response body.
+// - allocs/req: heap allocations made by the client process, hyper included.
+// - api-copied/req: bytes copied across the C API only, which are the
+//   request URI and header values passed in, and the response body copied
+//   out by `hyper_body_read_into` (unless `-z` reads it with
+//   `hyper_body_data`). Copies hyper makes internally aren't counted.
+//
+
+#define MAX_DEPTH 256
+#define READ_BUF_SIZE 16384
+
+//
+// Allocation counting
+//
+// The functions below take precedence over the libc ones for the whole
+// process, including the hyper library, so every allocation passes through
+// here. This relies on the allocator entry points of glibc.
+//
+
+#if defined(__GLIBC__)
+#define COUNT_ALLOCS 1
+
+static uint64_t alloc_count = 0;
+
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t nmemb, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+extern void *__libc_memalign(size_t alignment, size_t size);
+
+static void count_alloc(void) {
+    __atomic_fetch_add(&alloc_count, 1, __ATOMIC_RELAXED);
+}
+
+void *malloc(size_t size) {
+    count_alloc();
+    return __libc_malloc(size);
+}
+
+void *calloc(size_t nmemb, size_t size) {
+    count_alloc();
+    return __libc_calloc(nmemb, size);
+}
+
+void *realloc(void *ptr, size_t size) {
+    count_alloc();
+    return __libc_realloc(ptr, size);
+}
+
+void *memalign(size_t alignment, size_t size) {
+    count_alloc();
+    return __libc_memalign(alignment, size);
+}
+
+void *aligned_alloc(size_t alignment, size_t size) {
+    count_alloc();
+    return __libc_memalign(alignment, size);
+}
+
+int posix_memalign(void **memptr, size_t alignment, size_t size) {
+    count_alloc();
+    void *ptr = __libc_memalign(alignment, size);
+    if (ptr == NULL) {
+        return ENOMEM;
+    }
+    *memptr = ptr;
+    return 0;
+}
+
+static uint64_t allocs(void) {
+    return __atomic_load_n(&alloc_count, __ATOMIC_RELAXED);
+}
+#else
+#define COUNT_ALLOCS 0
+
+static uint64_t allocs(void) {
+    return 0;
+}
+#endif
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static int write_all(int fd, const uint8_t *buf, size_t len) {
+    while (len > 0) {
+        ssize_t ret = write(fd, buf, len);
+        if (ret < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        buf += ret;
+        len -= ret;
+    }
+    return 0;
+}
+
+static void set_nodelay(int fd) {
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+}
+
+//
+// The loopback server
+//
+// It answers every request with the same response, without looking at
+// more of the request than needed to find where it ends. Responses to all
+// the requests found in one read are written together.
+//
+
+struct server {
+    const uint8_t *body;
+    size_t body_len;
+    uint8_t in[READ_BUF_SIZE + 9];
+    size_t in_start;
+    size_t in_end;
+    uint8_t *out;
+    size_t out_len;
+    size_t out_cap;
+};
+
+static void out_push(struct server *srv, const uint8_t *buf, size_t len) {
+    if (srv->out_len + len > srv->out_cap) {
+        while (srv->out_len + len > srv->out_cap) {
+            srv->out_cap *= 2;
+        }
+        srv->out = realloc(srv->out, srv->out_cap);
+        assert(srv->out != NULL);
+    }
+    memcpy(srv->out + srv->out_len, buf, len);
+    srv->out_len += len;
+}
+
+static int out_flush(struct server *srv, int fd) {
+    int ret = write_all(fd, srv->out, srv->out_len);
+    srv->out_len = 0;
+    return ret;
+}
+
+static void serve_h1(struct server *srv, int fd) {
+    static const uint8_t end[] = "\r\n\r\n";
+    char head[128];
+    int head_len = snprintf(head, sizeof(head),
+                            "HTTP/1.1 200 OK\r\ncontent-length: %zu\r\n\r\n", srv->body_len);
+    size_t matched = 0;
+
+    while (1) {
+        for (size_t i = srv->in_start; i < srv->in_end; i++) {
+            uint8_t c = srv->in[i];
+            if (c == end[matched]) {
+                matched++;
+            } else {
+                matched = c == '\r' ? 1 : 0;
+            }
+            if (matched == 4) {
+                out_push(srv, (const uint8_t *)head, head_len);
+                out_push(srv, srv->body, srv->body_len);
+                matched = 0;
+            }
+        }
+
+        if (out_flush(srv, fd) < 0) {
+            return;
+        }
+
+        ssize_t ret = read(fd, srv->in, READ_BUF_SIZE);
+        if (ret <= 0) {
+            return;
+        }
+        srv->in_start = 0;
+        srv->in_end = ret;
+    }
+}
+
+// HTTP/2 frame types and flags used by the server
+#define H2_DATA 0x0
+#define H2_HEADERS 0x1
+#define H2_SETTINGS 0x4
+#define H2_PING 0x6
+#define H2_GOAWAY 0x7
+#define H2_CONTINUATION 0x9
+
+#define H2_FLAG_ACK 0x1
+#define H2_FLAG_END_STREAM 0x1
+#define H2_FLAG_END_HEADERS 0x4
+
+#define H2_MAX_FRAME_SIZE 16384
+
+static void h2_frame(struct server *srv, uint8_t type, uint8_t flags, uint32_t stream,
+                     const uint8_t *payload, size_t len) {
+    uint8_t head[9] = {
+        (len >> 16) & 0xff, (len >> 8) & 0xff, len & 0xff,
+        type, flags,
+        (stream >> 24) & 0x7f, (stream >> 16) & 0xff, (stream >> 8) & 0xff, stream & 0xff,
+    };
+    out_push(srv, head, sizeof(head));
+    if (len > 0) {
+        out_push(srv, payload, len);
+    }
+}
+
+static void h2_respond(struct server *srv, uint32_t stream, const uint8_t *headers, size_t headers_len) {
+    if (srv->body_len == 0) {
+        h2_frame(srv, H2_HEADERS, H2_FLAG_END_HEADERS | H2_FLAG_END_STREAM, stream, headers, headers_len);
+        return;
+    }
+
+    h2_frame(srv, H2_HEADERS, H2_FLAG_END_HEADERS, stream, headers, headers_len);
+
+    size_t sent = 0;
+    while (sent < srv->body_len) {
+        size_t len = srv->body_len - sent;
+        uint8_t flags = 0;
+        if (len > H2_MAX_FRAME_SIZE) {
+            len = H2_MAX_FRAME_SIZE;
+        } else {
+            flags = H2_FLAG_END_STREAM;
+        }
+        h2_frame(srv, H2_DATA, flags, stream, srv->body + sent, len);
+        sent += len;
+    }
+}
+
+// Makes sure `len` bytes are buffered at `srv->in_start`, flushing the
+// pending output before blocking on a read.
+static int h2_fill(struct server *srv, int fd, size_t len) {
+    if (srv->in_end - srv->in_start >= len) {
+        return 0;
+    }
+
+    memmove(srv->in, srv->in + srv->in_start, srv->in_end - srv->in_start);
+    srv->in_end -= srv->in_start;
+    srv->in_start = 0;
+
+    if (out_flush(srv, fd) < 0) {
+        return -1;
+    }
+
+    while (srv->in_end < len) {
+        ssize_t ret = read(fd, srv->in + srv->in_end, sizeof(srv->in) - srv->in_end);
+        if (ret <= 0) {
+            return -1;
+        }
+        srv->in_end += ret;
+    }
+    return 0;
+}
+
+static void serve_h2(struct server *srv, int fd) {
+    // `:status: 200` from the static table, and a literal `content-length`
+    uint8_t headers[32] = { 0x88, 0x0f, 0x0d };
+    int digits = snprintf((char *)headers + 4, sizeof(headers) - 4, "%zu", srv->body_len);
+    headers[3] = digits;
+    size_t headers_len = 4 + digits;
+
+    // skip the connection preface; the peer's SETTINGS are handled below
+    srv->in_start += 24;
+    h2_frame(srv, H2_SETTINGS, 0, 0, NULL, 0);
+
+    while (1) {
+        if (h2_fill(srv, fd, 9) < 0) {
+            return;
+        }
+        const uint8_t *head = srv->in + srv->in_start;
+        size_t len = ((size_t) head[0] << 16) | ((size_t) head[1] << 8) | head[2];
+        uint8_t type = head[3];
+        uint8_t flags = head[4];
+        uint32_t stream = ((uint32_t) (head[5] & 0x7f) << 24) | ((uint32_t) head[6] << 16) |
+                          ((uint32_t) head[7] << 8) | head[8];
+
+        if (len > H2_MAX_FRAME_SIZE || h2_fill(srv, fd, 9 + len) < 0) {
+            return;
+        }
+        const uint8_t *payload = srv->in + srv->in_start + 9;
+        srv->in_start += 9 + len;
+
+        switch (type) {
+        case H2_SETTINGS:
+            if (!(flags & H2_FLAG_ACK)) {
+                h2_frame(srv, H2_SETTINGS, H2_FLAG_ACK, 0, NULL, 0);
+            }
+            break;
+        case H2_PING:
+            if (!(flags & H2_FLAG_ACK)) {
+                h2_frame(srv, H2_PING, H2_FLAG_ACK, 0, payload, len);
+            }
+            break;
+        case H2_HEADERS:
+        case H2_CONTINUATION:
+            if (flags & H2_FLAG_END_HEADERS) {
+                h2_respond(srv, stream, headers, headers_len);
+            }
+            break;
+        case H2_GOAWAY:
+            out_flush(srv, fd);
+            return;
+        default:
+            // WINDOW_UPDATE, RST_STREAM, ...
+            break;
+        }
+    }
+}
+
+static void serve(int listener, size_t body_len) {
+    struct server srv;
+    memset(&srv, 0, sizeof(srv));
+
+    uint8_t *body = malloc(body_len + 1);
+    memset(body, 'x', body_len);
+    srv.body = body;
+    srv.body_len = body_len;
+    srv.out_cap = 65536;
+    srv.out = malloc(srv.out_cap);
+
+    while (1) {
+        int fd = accept(listener, NULL, NULL);
+        if (fd < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+        set_nodelay(fd);
+
+        ssize_t ret = read(fd, srv.in, READ_BUF_SIZE);
+        if (ret > 0) {
+            srv.in_start = 0;
+            srv.in_end = ret;
+            srv.out_len = 0;
+            if (ret >= 24 && memcmp(srv.in, "PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n", 24) == 0) {
+                serve_h2(&srv, fd);
+            } else {
+                serve_h1(&srv, fd);
+            }
+        }
+        close(fd);
+    }
+
+    _exit(0);
+}
+
+static pid_t start_server(size_t body_len, uint16_t *port) {
+    int listener = socket(AF_INET, SOCK_STREAM, 0);
+    if (listener < 0) {
+        return -1;
+    }
+
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = 0;
+
+    socklen_t addr_len = sizeof(addr);
+    if (bind(listener, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+        listen(listener, 16) < 0 ||
+        getsockname(listener, (struct sockaddr *)&addr, &addr_len) < 0) {
+        close(listener);
+        return -1;
+    }
+    *port = ntohs(addr.sin_port);
+
+    pid_t pid = fork();
+    if (pid == 0) {
+        serve(listener, body_len);
+    }
+    close(listener);
+    return pid;
+}
+
+//
+// The client
+//
+
+struct conn_data {
+    int fd;
+    hyper_waker *read_waker;
+    hyper_waker *write_waker;
+};
+
+static void wait_cb(void *userdata, int fd, int interest, hyper_waker *waker) {
+    struct conn_data *conn = (struct conn_data *)userdata;
+    hyper_waker **slot = interest == HYPER_IO_READABLE ? &conn->read_waker : &conn->write_waker;
+
+    // register interest; hyper keeps the waker, and a NULL one clears it
+    *slot = waker;
+}
+
+// Waits on the connection's fd for whatever hyper registered interest in.
+static int wait_io(struct conn_data *conn) {
+    fd_set fds_read;
+    fd_set fds_write;
+
+    FD_ZERO(&fds_read);
+    FD_ZERO(&fds_write);
+
+    if (conn->read_waker) {
+        FD_SET(conn->fd, &fds_read);
+    }
+    if (conn->write_waker) {
+        FD_SET(conn->fd, &fds_write);
+    }
+
+    int sel_ret = select(conn->fd + 1, &fds_read, &fds_write, NULL, NULL);
+    if (sel_ret < 0) {
+        return errno == EINTR ? 0 : -1;
+    }
+
+    if (FD_ISSET(conn->fd, &fds_read)) {
+        hyper_waker_wake_by_ref(conn->read_waker);
+        conn->read_waker = NULL;
+    }
+    if (FD_ISSET(conn->fd, &fds_write)) {
+        hyper_waker_wake_by_ref(conn->write_waker);
+        conn->write_waker = NULL;
+    }
+    return 0;
+}
+
+static void print_error(const char *what, hyper_task *task) {
+    hyper_error *err = hyper_task_value(task);
+    char errbuf[256];
+    size_t errlen = hyper_error_print(err, (uint8_t *)errbuf, sizeof(errbuf));
+    fprintf(stderr, "%s error: %.*s\n", what, (int) errlen, errbuf);
+    hyper_error_free(err);
+    hyper_task_free(task);
+}
+
+typedef enum {
+    BENCH_HTTP1,
+    BENCH_HTTP1_PIPELINED,
+    BENCH_HTTP2,
+} bench_mode;
+
+static const char *mode_names[] = { "h1", "h1-pipelined", "h2" };
+
+struct config {
+    size_t requests;
+    size_t warmup;
+    size_t depth;
+    size_t body_len;
+    int zero_copy;
+    int cargo_output;
+    uint16_t port;
+};
+
+typedef enum {
+    SLOT_SEND = 1,
+    SLOT_BODY,
+} slot_phase;
+
+// One request in flight. Tasks for it have the slot as userdata.
+struct slot {
+    slot_phase phase;
+    uint64_t start;
+    hyper_body *body;
+    size_t filled;
+    uint8_t buf[READ_BUF_SIZE];
+};
+
+struct run {
+    const struct config *config;
+    const hyper_executor *exec;
+    hyper_clientconn *client;
+    struct conn_data *conn;
+    struct slot *slots;
+    struct slot **free_slots;
+    size_t free_len;
+    size_t depth;
+    int multiplexed;
+    int batched;
+    size_t sent;
+    size_t done;
+    uint64_t *latencies;
+    uint64_t copied;
+    uint64_t body_bytes;
+};
+
+static const char authority[] = "127.0.0.1";
+static const char path[] = "/bench";
+static const char user_agent[] = "hyper-capi-bench";
+
+#define STR_ARG(XX) (uint8_t *)XX, strlen(XX)
+
+static int count_header(void *userdata,
+                        const uint8_t *name,
+                        size_t name_len,
+                        const uint8_t *value,
+                        size_t value_len) {
+    (*(size_t *)userdata)++;
+    return HYPER_ITER_CONTINUE;
+}
+
+// Builds a request, taking a free slot for it. Returns NULL on errors.
+static hyper_request *new_request(struct run *run, struct slot **slot_out) {
+    hyper_request *req = hyper_request_new();
+    if (hyper_request_set_method(req, STR_ARG("GET")) ||
+        hyper_request_set_uri(req, STR_ARG(path))) {
+        fprintf(stderr, "error building request\n");
+        hyper_request_free(req);
+        return NULL;
+    }
+
+    hyper_headers *req_headers = hyper_request_headers(req);
+    hyper_headers_set(req_headers, STR_ARG("host"), STR_ARG(authority));
+    hyper_headers_set(req_headers, STR_ARG("user-agent"), STR_ARG(user_agent));
+    run->copied += strlen(path) + strlen(authority) + strlen(user_agent);
+
+    assert(run->free_len > 0);
+    struct slot *slot = run->free_slots[--run->free_len];
+    slot->phase = SLOT_SEND;
+    slot->start = now_ns();
+    *slot_out = slot;
+    return req;
+}
+
+static void push_send(struct run *run, hyper_task *send, struct slot *slot) {
+    hyper_task_set_userdata(send, slot);
+    hyper_executor_push(run->exec, send);
+    run->sent++;
+}
+
+static int send_request(struct run *run) {
+    struct slot *slot;
+    hyper_request *req = new_request(run, &slot);
+    if (req == NULL) {
+        return -1;
+    }
+
+    push_send(run, hyper_clientconn_send(run->client, req), slot);
+    return 0;
+}
+
+// Queues `len` requests on the connection at once.
+static int send_batch(struct run *run, size_t len) {
+    hyper_request *reqs[MAX_DEPTH] = { NULL };
+    struct slot *slots[MAX_DEPTH];
+    hyper_task *tasks[MAX_DEPTH];
+    assert(len <= MAX_DEPTH);
+
+    size_t built;
+    for (built = 0; built < len; built++) {
+        reqs[built] = new_request(run, &slots[built]);
+        if (reqs[built] == NULL) {
+            goto fail;
+        }
+    }
+
+    if (hyper_clientconn_send_batch(run->client, reqs, len, tasks) != HYPERE_OK) {
+        fprintf(stderr, "error sending batch\n");
+        goto fail;
+    }
+
+    for (size_t i = 0; i < len; i++) {
+        push_send(run, tasks[i], slots[i]);
+    }
+    return 0;
+
+fail:
+    // none of the requests were consumed
+    for (size_t i = 0; i < built; i++) {
+        hyper_request_free(reqs[i]);
+        run->free_slots[run->free_len++] = slots[i];
+    }
+    return -1;
+}
+
+static void read_body(struct run *run, struct slot *slot) {
+    hyper_task *task;
+    if (run->config->zero_copy) {
+        task = hyper_body_data(slot->body);
+    } else {
+        task = hyper_body_read_into(slot->body, slot->buf, sizeof(slot->buf), &slot->filled);
+    }
+    hyper_task_set_userdata(task, slot);
+    hyper_executor_push(run->exec, task);
+}
+
+static void finish_request(struct run *run, struct slot *slot) {
+    if (run->latencies) {
+        run->latencies[run->done] = now_ns() - slot->start;
+    }
+    run->done++;
+
+    hyper_body_free(slot->body);
+    slot->body = NULL;
+    run->free_slots[run->free_len++] = slot;
+}
+
+// Handles a completed task of a request. Returns -1 on errors.
+static int on_task(struct run *run, hyper_task *task) {
+    struct slot *slot = hyper_task_userdata(task);
+    hyper_task_return_type type = hyper_task_type(task);
+
+    if (slot == NULL) {
+        // A background task for hyper completed...
+        hyper_task_free(task);
+        return 0;
+    }
+
+    if (type == HYPER_TASK_ERROR) {
+        print_error(slot->phase == SLOT_SEND ? "send" : "body", task);
+        return -1;
+    }
+
+    if (slot->phase == SLOT_SEND) {
+        assert(type == HYPER_TASK_RESPONSE);
+        hyper_response *resp = hyper_task_value(task);
+        hyper_task_free(task);
+
+        if (hyper_response_status(resp) != 200) {
+            fprintf(stderr, "unexpected status %d\n", hyper_response_status(resp));
+            hyper_response_free(resp);
+            return -1;
+        }
+
+        size_t headers = 0;
+        hyper_headers_foreach(hyper_response_headers(resp), count_header, &headers);
+
+        slot->phase = SLOT_BODY;
+        slot->body = hyper_response_body(resp);
+        hyper_response_free(resp);
+        read_body(run, slot);
+        return 0;
+    }
+
+    if (type == HYPER_TASK_BUF) {
+        hyper_buf *chunk = hyper_task_value(task);
+        run->body_bytes += hyper_buf_len(chunk);
+        hyper_buf_free(chunk);
+        hyper_task_free(task);
+        read_body(run, slot);
+        return 0;
+    }
+
+    assert(type == HYPER_TASK_EMPTY);
+    hyper_task_free(task);
+
+    if (!run->config->zero_copy) {
+        run->body_bytes += slot->filled;
+        run->copied += slot->filled;
+        if (slot->filled == sizeof(slot->buf)) {
+            read_body(run, slot);
+            return 0;
+        }
+    }
+
+    finish_request(run, slot);
+    return 0;
+}
+
+// Sends `total` requests, keeping up to `run->depth` of them in flight.
+static int drive(struct run *run, size_t total) {
+    run->sent = 0;
+    run->done = 0;
+
+    while (1) {
+        hyper_task *task;
+        while ((task = hyper_executor_poll(run->exec)) != NULL) {
+            if (on_task(run, task) < 0) {
+                return -1;
+            }
+        }
+
+        if (run->done == total) {
+            return 0;
+        }
+
+        size_t in_flight = run->sent - run->done;
+        if (run->batched) {
+            // A pipelined batch is queued once the last one is done, so the
+            // connection is ready for its first request.
+            if (run->sent < total && in_flight == 0) {
+                size_t len = total - run->sent;
+                if (send_batch(run, len < run->depth ? len : run->depth) < 0) {
+                    return -1;
+                }
+                continue;
+            }
+        } else if (run->sent < total && in_flight < run->depth) {
+            // An HTTP/1 connection takes one request each time its
+            // dispatcher asks for the next, which it has done by the time
+            // the executor has nothing left to poll. HTTP/2 takes them all
+            // at once.
+            do {
+                if (send_request(run) < 0) {
+                    return -1;
+                }
+                in_flight++;
+            } while (run->multiplexed && run->sent < total && in_flight < run->depth);
+            continue;
+        }
+
+        if (wait_io(run->conn) < 0) {
+            fprintf(stderr, "select() error\n");
+            return -1;
+        }
+    }
+}
+
+static int compare_u64(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *)a;
+    uint64_t y = *(const uint64_t *)b;
+    return x < y ? -1 : x > y;
+}
+
+static int connect_loopback(uint16_t port) {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) {
+        return -1;
+    }
+
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons(port);
+
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+        fcntl(fd, F_SETFL, O_NONBLOCK) != 0) {
+        close(fd);
+        return -1;
+    }
+    set_nodelay(fd);
+    return fd;
+}
+
+static hyper_clientconn *handshake(const struct config *config, bench_mode mode,
+                                   const hyper_executor *exec, struct conn_data *conn) {
+    hyper_io *io = hyper_io_new_fd(conn->fd, wait_cb, conn);
+
+    hyper_clientconn_options *opts = hyper_clientconn_options_new();
+    hyper_clientconn_options_exec(opts, exec);
+    if (mode == BENCH_HTTP1_PIPELINED) {
+        hyper_clientconn_options_http1_pipeline_depth(opts, config->depth);
+    } else if (mode == BENCH_HTTP2) {
+        hyper_clientconn_options_http2(opts, 1);
+    }
+
+    hyper_task *task = hyper_clientconn_handshake(io, opts);
+    hyper_executor_push(exec, task);
+
+    while (1) {
+        while ((task = hyper_executor_poll(exec)) != NULL) {
+            if (hyper_task_type(task) == HYPER_TASK_ERROR) {
+                print_error("handshake", task);
+                return NULL;
+            }
+            if (hyper_task_type(task) == HYPER_TASK_CLIENTCONN) {
+                hyper_clientconn *client = hyper_task_value(task);
+                hyper_task_free(task);
+                return client;
+            }
+            hyper_task_free(task);
+        }
+
+        if (wait_io(conn) < 0) {
+            return NULL;
+        }
+    }
+}
+
+static int bench(const struct config *config, bench_mode mode) {
+    struct conn_data conn = { .fd = -1, .read_waker = NULL, .write_waker = NULL };
+    struct run run;
+    memset(&run, 0, sizeof(run));
+    run.config = config;
+    run.depth = mode == BENCH_HTTP1 ? 1 : config->depth;
+    run.multiplexed = mode == BENCH_HTTP2;
+    run.batched = mode == BENCH_HTTP1_PIPELINED;
+    run.conn = &conn;
+
+    int ret = -1;
+    run.slots = calloc(run.depth, sizeof(struct slot));
+    run.free_slots = calloc(run.depth, sizeof(struct slot *));
+    run.latencies = NULL;
+    uint64_t *latencies = calloc(config->requests, sizeof(uint64_t));
+    for (size_t i = 0; i < run.depth; i++) {
+        run.free_slots[run.free_len++] = &run.slots[i];
+    }
+
+    conn.fd = connect_loopback(config->port);
+    if (conn.fd < 0) {
+        fprintf(stderr, "connect failed\n");
+        goto out;
+    }
+
+    run.exec = hyper_executor_new();
+    run.client = handshake(config, mode, run.exec, &conn);
+    if (run.client == NULL) {
+        goto out;
+    }
+
+    if (drive(&run, config->warmup) < 0) {
+        goto out;
+    }
+
+    run.latencies = latencies;
+    run.copied = 0;
+    run.body_bytes = 0;
+    uint64_t allocs_before = allocs();
+    struct hyper_ffi_stats ffi_before;
+    int ffi_stats = hyper_stats_snapshot(&ffi_before) == HYPERE_OK;
+    uint64_t start = now_ns();
+
+    if (drive(&run, config->requests) < 0) {
+        goto out;
+    }
+
+    uint64_t elapsed = now_ns() - start;
+    uint64_t allocated = allocs() - allocs_before;
+    struct hyper_ffi_stats ffi_after;
+    if (ffi_stats) {
+        hyper_stats_snapshot(&ffi_after);
+    }
+
+    if (run.body_bytes != (uint64_t) config->requests * config->body_len) {
+        fprintf(stderr, "%s: expected %zu body bytes per request, got %.1f\n", mode_names[mode],
+                config->body_len, (double) run.body_bytes / config->requests);
+        goto out;
+    }
+
+    qsort(latencies, config->requests, sizeof(uint64_t), compare_u64);
+    uint64_t p50 = latencies[config->requests / 2];
+    uint64_t p99 = latencies[config->requests * 99 / 100];
+    double per_sec = (double) config->requests * 1e9 / elapsed;
+
+    printf("%-14s %10zu %12.0f %10.1f %10.1f", mode_names[mode], config->requests, per_sec,
+           p50 / 1e3, p99 / 1e3);
+    if (COUNT_ALLOCS) {
+        printf(" %12.2f", (double) allocated / config->requests);
+    } else {
+        printf(" %12s", "n/a");
+    }
+    printf(" %14.1f\n", (double) run.copied / config->requests);
+    if (ffi_stats) {
+        // only when hyper was built with the `ffi-stats` feature
+        double n = config->requests;
+        printf("%-14s boxes/req %.2f (%.2f reused), buf copies/req %.2f, wakers/req %.2f, "
+               "driver locks/req %.2f\n", "",
+               (ffi_after.boxes_allocated - ffi_before.boxes_allocated) / n,
+               (ffi_after.boxes_reused - ffi_before.boxes_reused) / n,
+               (ffi_after.buf_copies - ffi_before.buf_copies) / n,
+               (ffi_after.waker_clones - ffi_before.waker_clones) / n,
+               (ffi_after.driver_locks - ffi_before.driver_locks) / n);
+    }
+
+    if (config->cargo_output) {
+        printf("test capi_%s ... bench: %10llu ns/iter (+/- %llu)\n", mode_names[mode],
+               (unsigned long long) (elapsed / config->requests),
+               (unsigned long long) (p99 - p50));
+    }
+
+    ret = 0;
+
+out:
+    if (run.client) {
+        hyper_clientconn_free(run.client);
+    }
+    for (size_t i = 0; i < run.depth; i++) {
+        if (run.slots[i].body) {
+            hyper_body_free(run.slots[i].body);
+        }
+    }
+    if (run.exec) {
+        hyper_executor_free(run.exec);
+    }
+    if (conn.fd >= 0) {
+        close(conn.fd);
+    }
+    free(latencies);
+    free(run.free_slots);
+    free(run.slots);
+    return ret;
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr,
+            "usage: %s [-n requests] [-w warmup] [-d depth] [-b body_len] [-z] [-c] [mode ...]\n"
+            "\n"
+            "modes: h1, h1-pipelined, h2 (default: all of them)\n"
+            "\n"
+            "  -n  measured requests per mode (default 20000)\n"
+            "  -w  requests sent before measuring (default 1000)\n"
+            "  -d  requests in flight for h1-pipelined and h2 (default 16)\n"
+            "  -b  response body length (default 1024)\n"
+            "  -z  read bodies with hyper_body_data instead of hyper_body_read_into\n"
+            "  -c  also print results in the format of `cargo bench`\n",
+            prog);
+}
+
+int main(int argc, char *argv[]) {
+    struct config config = {
+        .requests = 20000,
+        .warmup = 1000,
+        .depth = 16,
+        .body_len = 1024,
+        .zero_copy = 0,
+        .cargo_output = 0,
+    };
+
+    int opt;
+    while ((opt = getopt(argc, argv, "n:w:d:b:zch")) != -1) {
+        switch (opt) {
+        case 'n':
+            config.requests = strtoul(optarg, NULL, 10);
+            break;
+        case 'w':
+            config.warmup = strtoul(optarg, NULL, 10);
+            break;
+        case 'd':
+            config.depth = strtoul(optarg, NULL, 10);
+            break;
+        case 'b':
+            config.body_len = strtoul(optarg, NULL, 10);
+            break;
+        case 'z':
+            config.zero_copy = 1;
+            break;
+        case 'c':
+            config.cargo_output = 1;
+            break;
+        default:
+            usage(argv[0]);
+            return opt == 'h' ? 0 : 1;
+        }
+    }
+
+    if (config.requests == 0 || config.depth == 0 || config.depth > MAX_DEPTH) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    int modes[3] = { 0, 0, 0 };
+    if (optind == argc) {
+        modes[BENCH_HTTP1] = modes[BENCH_HTTP1_PIPELINED] = modes[BENCH_HTTP2] = 1;
+    }
+    for (int i = optind; i < argc; i++) {
+        int found = 0;
+        for (int m = 0; m < 3; m++) {
+            if (strcmp(argv[i], mode_names[m]) == 0) {
+                modes[m] = found = 1;
+            }
+        }
+        if (!found) {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    // a server dying mid-run must not kill us with SIGPIPE
+    signal(SIGPIPE, SIG_IGN);
+
+    pid_t server = start_server(config.body_len, &config.port);
+    if (server < 0) {
+        fprintf(stderr, "failed to start the loopback server\n");
+        return 1;
+    }
+
+    printf("hyper v%s, %zu byte bodies, depth %zu, %s\n", hyper_version(), config.body_len,
+           config.depth, config.zero_copy ? "hyper_body_data" : "hyper_body_read_into");
+    printf("%-14s %10s %12s %10s %10s %12s %14s\n", "mode", "requests", "req/s", "p50 us",
+           "p99 us", "allocs/req", "api-copied/req");
+
+    int ret = 0;
+    for (int m = 0; m < 3; m++) {
+        if (modes[m] && bench(&config, (bench_mode) m) < 0) {
+            fprintf(stderr, "%s failed\n", mode_names[m]);
+            ret = 1;
+        }
+    }
+
+    kill(server, SIGTERM);
+    waitpid(server, NULL, 0);
+    return ret;
+}
@@ -20,58 +20,15 @@ struct conn_data {
     hyper_waker *write_waker;
 };
 
-static size_t read_cb(void *userdata, hyper_context *ctx, uint8_t *buf, size_t buf_len) {
+static void wait_cb(void *userdata, int fd, int interest, hyper_waker *waker) {
     struct conn_data *conn = (struct conn_data *)userdata;
-    ssize_t ret = read(conn->fd, buf, buf_len);
+    hyper_waker **slot = interest == HYPER_IO_READABLE ? &conn->read_waker : &conn->write_waker;
 
-    if (ret >= 0) {
-        return ret;
-    }
-
-    if (errno != EAGAIN) {
-        // kaboom
-        return HYPER_IO_ERROR;
-    }
-
-    // would block, register interest
-    if (conn->read_waker != NULL) {
-        hyper_waker_free(conn->read_waker);
-    }
-    conn->read_waker = hyper_context_waker(ctx);
-    return HYPER_IO_PENDING;
-}
-
-static size_t write_cb(void *userdata, hyper_context *ctx, const uint8_t *buf, size_t buf_len) {
-    struct conn_data *conn = (struct conn_data *)userdata;
-    ssize_t ret = write(conn->fd, buf, buf_len);
-
-    if (ret >= 0) {
-        return ret;
-    }
-
-    if (errno != EAGAIN) {
-        // kaboom
-        return HYPER_IO_ERROR;
-    }
-
-    // would block, register interest
-    if (conn->write_waker != NULL) {
-        hyper_waker_free(conn->write_waker);
-    }
-    conn->write_waker = hyper_context_waker(ctx);
-    return HYPER_IO_PENDING;
+    // register interest; hyper keeps the waker, and a NULL one clears it
+    *slot = waker;
 }
 
 static void free_conn_data(struct conn_data *conn) {
-    if (conn->read_waker) {
-        hyper_waker_free(conn->read_waker);
-        conn->read_waker = NULL;
-    }
-    if (conn->write_waker) {
-        hyper_waker_free(conn->write_waker);
-        conn->write_waker = NULL;
-    }
-
     free(conn);
 }
 
@@ -167,10 +124,7 @@ int main(int argc, char *argv[]) {
     conn->write_waker = NULL;
 
     // Hookup the IO
-    hyper_io *io = hyper_io_new();
-    hyper_io_set_userdata(io, (void *)conn);
-    hyper_io_set_read(io, read_cb);
-    hyper_io_set_write(io, write_cb);
+    hyper_io *io = hyper_io_new_fd(fd, wait_cb, (void *)conn);
 
     printf("http handshake (hyper v%s) ...\n", hyper_version());
 
@@ -315,12 +269,12 @@ int main(int argc, char *argv[]) {
         }
 
         if (FD_ISSET(conn->fd, &fds_read)) {
-            hyper_waker_wake(conn->read_waker);
+            hyper_waker_wake_by_ref(conn->read_waker);
             conn->read_waker = NULL;
         }
 
         if (FD_ISSET(conn->fd, &fds_write)) {
-            hyper_waker_wake(conn->write_waker);
+            hyper_waker_wake_by_ref(conn->write_waker);
             conn->write_waker = NULL;
         }
 
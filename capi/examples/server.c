@@ -0,0 +1,252 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/select.h>
+#include <assert.h>
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <string.h>
+
+#include "hyper.h"
+
+#define MAX_CONNS 64
+
+struct conn_data {
+    int fd;
+    hyper_waker *read_waker;
+    hyper_waker *write_waker;
+};
+
+struct hello_body {
+    const char *msg;
+    int sent;
+};
+
+static void wait_cb(void *userdata, int fd, int interest, hyper_waker *waker) {
+    struct conn_data *conn = (struct conn_data *)userdata;
+    hyper_waker **slot = interest == HYPER_IO_READABLE ? &conn->read_waker : &conn->write_waker;
+
+    // register interest; hyper keeps the waker, and a NULL one clears it
+    *slot = waker;
+}
+
+static void free_conn_data(struct conn_data *conn) {
+    close(conn->fd);
+    free(conn);
+}
+
+static int listen_on(const char *port) {
+    int sfd = socket(AF_INET, SOCK_STREAM, 0);
+    if (sfd == -1) {
+        return -1;
+    }
+
+    int one = 1;
+    setsockopt(sfd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(atoi(port));
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    if (bind(sfd, (struct sockaddr *)&addr, sizeof(addr)) != 0 || listen(sfd, 128) != 0) {
+        close(sfd);
+        return -1;
+    }
+
+    return sfd;
+}
+
+static int hello_data(void *userdata, hyper_context *ctx, hyper_buf **chunk) {
+    struct hello_body *body = (struct hello_body *)userdata;
+
+    if (!body->sent) {
+        *chunk = hyper_buf_copy((const uint8_t *)body->msg, strlen(body->msg));
+        body->sent = 1;
+    } else {
+        // the end of the body
+        *chunk = NULL;
+        free(body);
+    }
+    return HYPER_POLL_READY;
+}
+
+#define STR_ARG(XX) (uint8_t *)XX, strlen(XX)
+
+// Answers `POST`s with their own body, and anything else with a greeting.
+static void handle_request(void *userdata, hyper_request *req, hyper_response_channel *channel) {
+    size_t method_len;
+    const uint8_t *method = hyper_request_method(req, &method_len);
+    const uint8_t *path;
+    size_t path_len;
+    hyper_request_uri_parts(req, NULL, NULL, NULL, NULL, &path, &path_len);
+    printf("%.*s %.*s\n", (int) method_len, method, (int) path_len, path);
+
+    hyper_response *resp = hyper_response_new();
+    hyper_headers *headers = hyper_response_headers(resp);
+    hyper_headers_set(headers, STR_ARG("server"), STR_ARG("hyper-capi-example"));
+
+    if (method_len == 4 && memcmp(method, "POST", 4) == 0) {
+        hyper_response_set_body(resp, hyper_request_body(req));
+    } else {
+        struct hello_body *hello = malloc(sizeof(struct hello_body));
+        hello->msg = "hello from hyper\n";
+        hello->sent = 0;
+
+        hyper_body *body = hyper_body_new();
+        hyper_body_set_userdata(body, hello);
+        hyper_body_set_data_func(body, hello_data);
+        hyper_response_set_body(resp, body);
+
+        hyper_headers_set(headers, STR_ARG("content-type"), STR_ARG("text/plain"));
+    }
+
+    // The response could also be sent later, once it is ready.
+    hyper_request_free(req);
+    hyper_response_channel_send(channel, resp);
+}
+
+int main(int argc, char *argv[]) {
+    const char *port = argc > 1 ? argv[1] : "8080";
+
+    int listener = listen_on(port);
+    if (listener < 0) {
+        printf("failed to listen on port %s\n", port);
+        return 1;
+    }
+    printf("listening on 127.0.0.1:%s (hyper v%s) ...\n", port, hyper_version());
+
+    struct conn_data *conns[MAX_CONNS] = { 0 };
+
+    // We need an executor generally to poll futures
+    const hyper_executor *exec = hyper_executor_new();
+
+    fd_set fds_read;
+    fd_set fds_write;
+
+    // The polling state machine!
+    while (1) {
+        // Poll all ready tasks and act on them...
+        while (1) {
+            hyper_task *task = hyper_executor_poll(exec);
+            if (!task) {
+                break;
+            }
+
+            struct conn_data *conn = hyper_task_userdata(task);
+            if (conn == NULL) {
+                // A background task for hyper completed...
+                hyper_task_free(task);
+                continue;
+            }
+
+            // A connection is done.
+            if (hyper_task_type(task) == HYPER_TASK_ERROR) {
+                hyper_error *err = hyper_task_value(task);
+                uint8_t errbuf [256];
+                size_t errlen = hyper_error_print(err, errbuf, sizeof(errbuf));
+                printf("connection error: %.*s\n", (int) errlen, errbuf);
+                hyper_error_free(err);
+            }
+            hyper_task_free(task);
+
+            for (int i = 0; i < MAX_CONNS; i++) {
+                if (conns[i] == conn) {
+                    conns[i] = NULL;
+                }
+            }
+            free_conn_data(conn);
+        }
+
+        // All futures are pending on IO work, so select on the fds.
+        FD_ZERO(&fds_read);
+        FD_ZERO(&fds_write);
+        FD_SET(listener, &fds_read);
+        int maxfd = listener;
+
+        for (int i = 0; i < MAX_CONNS; i++) {
+            struct conn_data *conn = conns[i];
+            if (conn == NULL) {
+                continue;
+            }
+            if (conn->read_waker) {
+                FD_SET(conn->fd, &fds_read);
+            }
+            if (conn->write_waker) {
+                FD_SET(conn->fd, &fds_write);
+            }
+            if (conn->fd > maxfd) {
+                maxfd = conn->fd;
+            }
+        }
+
+        int sel_ret = select(maxfd + 1, &fds_read, &fds_write, NULL, NULL);
+        if (sel_ret < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            printf("select() error\n");
+            return 1;
+        }
+
+        for (int i = 0; i < MAX_CONNS; i++) {
+            struct conn_data *conn = conns[i];
+            if (conn == NULL) {
+                continue;
+            }
+            if (conn->read_waker && FD_ISSET(conn->fd, &fds_read)) {
+                hyper_waker_wake_by_ref(conn->read_waker);
+                conn->read_waker = NULL;
+            }
+            if (conn->write_waker && FD_ISSET(conn->fd, &fds_write)) {
+                hyper_waker_wake_by_ref(conn->write_waker);
+                conn->write_waker = NULL;
+            }
+        }
+
+        if (FD_ISSET(listener, &fds_read)) {
+            int fd = accept(listener, NULL, NULL);
+            if (fd < 0) {
+                continue;
+            }
+
+            int slot = -1;
+            for (int i = 0; i < MAX_CONNS; i++) {
+                if (conns[i] == NULL) {
+                    slot = i;
+                    break;
+                }
+            }
+            if (slot < 0 || fcntl(fd, F_SETFL, O_NONBLOCK) != 0) {
+                close(fd);
+                continue;
+            }
+
+            struct conn_data *conn = malloc(sizeof(struct conn_data));
+            conn->fd = fd;
+            conn->read_waker = NULL;
+            conn->write_waker = NULL;
+            conns[slot] = conn;
+
+            // Hookup the IO
+            hyper_io *io = hyper_io_new_fd(fd, wait_cb, (void *)conn);
+
+            hyper_serverconn_options *opts = hyper_serverconn_options_new();
+            hyper_serverconn_options_exec(opts, exec);
+
+            hyper_service *service = hyper_service_new(handle_request);
+
+            hyper_task *serve = hyper_serve_connection(io, opts, service);
+            hyper_task_set_userdata(serve, conn);
+            hyper_executor_push(exec, serve);
+        }
+    }
+
+    return 0;
+}
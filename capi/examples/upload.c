@@ -8,6 +8,7 @@
 
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
 #include <netdb.h>
 #include <string.h>
 
@@ -18,8 +19,20 @@ struct conn_data {
     int fd;
     hyper_waker *read_waker;
     hyper_waker *write_waker;
+    int want_read;
+    int want_write;
 };
 
+static void register_waker(hyper_waker **waker, int *want, hyper_context *ctx) {
+    // keep one waker per direction for the whole connection
+    if (*waker == NULL) {
+        *waker = hyper_context_waker(ctx);
+    } else {
+        hyper_waker_update(*waker, ctx);
+    }
+    *want = 1;
+}
+
 static size_t read_cb(void *userdata, hyper_context *ctx, uint8_t *buf, size_t buf_len) {
     struct conn_data *conn = (struct conn_data *)userdata;
     ssize_t ret = read(conn->fd, buf, buf_len);
@@ -34,10 +47,7 @@ static size_t read_cb(void *userdata, hyper_context *ctx, uint8_t *buf, size_t b
     }
 
     // would block, register interest
-    if (conn->read_waker != NULL) {
-        hyper_waker_free(conn->read_waker);
-    }
-    conn->read_waker = hyper_context_waker(ctx);
+    register_waker(&conn->read_waker, &conn->want_read, ctx);
     return HYPER_IO_PENDING;
 }
 
@@ -55,10 +65,26 @@ static size_t write_cb(void *userdata, hyper_context *ctx, const uint8_t *buf, s
     }
 
     // would block, register interest
-    if (conn->write_waker != NULL) {
-        hyper_waker_free(conn->write_waker);
+    register_waker(&conn->write_waker, &conn->want_write, ctx);
+    return HYPER_IO_PENDING;
+}
+
+static size_t write_vectored_cb(void *userdata, hyper_context *ctx, const hyper_iovec *iovs, size_t iovs_len) {
+    struct conn_data *conn = (struct conn_data *)userdata;
+    // hyper_iovec has the same layout as struct iovec
+    ssize_t ret = writev(conn->fd, (const struct iovec *)iovs, iovs_len);
+
+    if (ret >= 0) {
+        return ret;
     }
-    conn->write_waker = hyper_context_waker(ctx);
+
+    if (errno != EAGAIN) {
+        // kaboom
+        return HYPER_IO_ERROR;
+    }
+
+    // would block, register interest
+    register_waker(&conn->write_waker, &conn->want_write, ctx);
     return HYPER_IO_PENDING;
 }
 
@@ -114,21 +140,29 @@ static int connect_to(const char *host, const char *port) {
 
 struct upload_body {
     int fd;
-    char *buf;
     size_t len;
 };
 
+static void free_chunk(void *userdata, const uint8_t *buf, size_t len) {
+    free(userdata);
+}
+
 static int poll_req_upload(void *userdata,
                            hyper_context *ctx,
                            hyper_buf **chunk) {
     struct upload_body* upload = userdata;
 
-    ssize_t res = read(upload->fd, upload->buf, upload->len);
+    // hyper keeps a reference to the chunk until it has been written, so
+    // each chunk gets its own buffer, released through free_chunk.
+    uint8_t *buf = malloc(upload->len);
+    ssize_t res = read(upload->fd, buf, upload->len);
     if (res > 0) {
-        *chunk = hyper_buf_copy(upload->buf, res);
+        *chunk = hyper_buf_from_owned(buf, res, buf, free_chunk);
         return HYPER_POLL_READY;
     }
 
+    free(buf);
+
     if (res == 0) {
         // All done!
         *chunk = NULL;
@@ -196,7 +230,6 @@ int main(int argc, char *argv[]) {
     }
 
     upload.len = 8192;
-    upload.buf = malloc(upload.len);
 
     fd_set fds_read;
     fd_set fds_write;
@@ -207,6 +240,8 @@ int main(int argc, char *argv[]) {
     conn->fd = fd;
     conn->read_waker = NULL;
     conn->write_waker = NULL;
+    conn->want_read = 0;
+    conn->want_write = 0;
 
 
     // Hookup the IO
@@ -214,6 +249,7 @@ int main(int argc, char *argv[]) {
     hyper_io_set_userdata(io, (void *)conn);
     hyper_io_set_read(io, read_cb);
     hyper_io_set_write(io, write_cb);
+    hyper_io_set_write_vectored(io, write_vectored_cb);
 
     printf("http handshake (hyper v%s) ...\n", hyper_version());
 
@@ -269,8 +305,14 @@ int main(int argc, char *argv[]) {
                 }
 
                 hyper_headers *req_headers = hyper_request_headers(req);
-                hyper_headers_set(req_headers, STR_ARG("host"), STR_ARG(host));
-                hyper_headers_set(req_headers, STR_ARG("expect"), STR_ARG("100-continue"));
+                hyper_header_pair pairs[] = {
+                    { .name_id = HYPER_HEADER_HOST, .value = (const uint8_t *)host, .value_len = strlen(host) },
+                    { .name_id = HYPER_HEADER_EXPECT, .value = (const uint8_t *)"100-continue", .value_len = 12 },
+                };
+                if (hyper_headers_add_many(req_headers, pairs, sizeof(pairs) / sizeof(pairs[0]))) {
+                    printf("error setting headers\n");
+                    return 1;
+                }
 
                 // NOTE: We aren't handling *waiting* for the 100 Continue,
                 // the body is sent immediately. This will just print if any
@@ -354,7 +396,6 @@ int main(int argc, char *argv[]) {
                 // Cleaning up before exiting
                 hyper_executor_free(exec);
                 free_conn_data(conn);
-                free(upload.buf);
 
                 return 0;
             case EXAMPLE_NOT_SET:
@@ -370,10 +411,10 @@ int main(int argc, char *argv[]) {
         FD_ZERO(&fds_write);
         FD_ZERO(&fds_excep);
 
-        if (conn->read_waker) {
+        if (conn->want_read) {
             FD_SET(conn->fd, &fds_read);
         }
-        if (conn->write_waker) {
+        if (conn->want_write) {
             FD_SET(conn->fd, &fds_write);
         }
 
@@ -385,13 +426,13 @@ int main(int argc, char *argv[]) {
         }
 
         if (FD_ISSET(conn->fd, &fds_read)) {
-            hyper_waker_wake(conn->read_waker);
-            conn->read_waker = NULL;
+            hyper_waker_wake_by_ref(conn->read_waker);
+            conn->want_read = 0;
         }
 
         if (FD_ISSET(conn->fd, &fds_write)) {
-            hyper_waker_wake(conn->write_waker);
-            conn->write_waker = NULL;
+            hyper_waker_wake_by_ref(conn->write_waker);
+            conn->want_write = 0;
         }
     }
 
@@ -31,7 +31,7 @@ fi
 cp "$CAPI_DIR/include/hyper.h" "$header_file_backup"
 
 # Expand just the ffi module
-if ! RUSTFLAGS='--cfg hyper_unstable_ffi' cargo expand --features client,http1,http2,ffi ::ffi 2> $WORK_DIR/expand_stderr.err > $WORK_DIR/expanded.rs; then
+if ! RUSTFLAGS='--cfg hyper_unstable_ffi' cargo expand --features client,http1,http2,server,ffi ::ffi 2> $WORK_DIR/expand_stderr.err > $WORK_DIR/expanded.rs; then
     cat $WORK_DIR/expand_stderr.err
 fi
 
@@ -42,6 +42,406 @@
  */
 #define HYPER_HTTP_VERSION_2 20
 
+/*
+ Use the `name` of a `hyper_header_pair`, instead of a standard header.
+ */
+#define HYPER_HEADER_CUSTOM 0
+
+/*
+ The `accept` header.
+ */
+#define HYPER_HEADER_ACCEPT 1
+
+/*
+ The `accept-charset` header.
+ */
+#define HYPER_HEADER_ACCEPT_CHARSET 2
+
+/*
+ The `accept-encoding` header.
+ */
+#define HYPER_HEADER_ACCEPT_ENCODING 3
+
+/*
+ The `accept-language` header.
+ */
+#define HYPER_HEADER_ACCEPT_LANGUAGE 4
+
+/*
+ The `accept-ranges` header.
+ */
+#define HYPER_HEADER_ACCEPT_RANGES 5
+
+/*
+ The `access-control-allow-credentials` header.
+ */
+#define HYPER_HEADER_ACCESS_CONTROL_ALLOW_CREDENTIALS 6
+
+/*
+ The `access-control-allow-headers` header.
+ */
+#define HYPER_HEADER_ACCESS_CONTROL_ALLOW_HEADERS 7
+
+/*
+ The `access-control-allow-methods` header.
+ */
+#define HYPER_HEADER_ACCESS_CONTROL_ALLOW_METHODS 8
+
+/*
+ The `access-control-allow-origin` header.
+ */
+#define HYPER_HEADER_ACCESS_CONTROL_ALLOW_ORIGIN 9
+
+/*
+ The `access-control-expose-headers` header.
+ */
+#define HYPER_HEADER_ACCESS_CONTROL_EXPOSE_HEADERS 10
+
+/*
+ The `access-control-max-age` header.
+ */
+#define HYPER_HEADER_ACCESS_CONTROL_MAX_AGE 11
+
+/*
+ The `access-control-request-headers` header.
+ */
+#define HYPER_HEADER_ACCESS_CONTROL_REQUEST_HEADERS 12
+
+/*
+ The `access-control-request-method` header.
+ */
+#define HYPER_HEADER_ACCESS_CONTROL_REQUEST_METHOD 13
+
+/*
+ The `age` header.
+ */
+#define HYPER_HEADER_AGE 14
+
+/*
+ The `allow` header.
+ */
+#define HYPER_HEADER_ALLOW 15
+
+/*
+ The `alt-svc` header.
+ */
+#define HYPER_HEADER_ALT_SVC 16
+
+/*
+ The `authorization` header.
+ */
+#define HYPER_HEADER_AUTHORIZATION 17
+
+/*
+ The `cache-control` header.
+ */
+#define HYPER_HEADER_CACHE_CONTROL 18
+
+/*
+ The `connection` header.
+ */
+#define HYPER_HEADER_CONNECTION 19
+
+/*
+ The `content-disposition` header.
+ */
+#define HYPER_HEADER_CONTENT_DISPOSITION 20
+
+/*
+ The `content-encoding` header.
+ */
+#define HYPER_HEADER_CONTENT_ENCODING 21
+
+/*
+ The `content-language` header.
+ */
+#define HYPER_HEADER_CONTENT_LANGUAGE 22
+
+/*
+ The `content-length` header.
+ */
+#define HYPER_HEADER_CONTENT_LENGTH 23
+
+/*
+ The `content-location` header.
+ */
+#define HYPER_HEADER_CONTENT_LOCATION 24
+
+/*
+ The `content-range` header.
+ */
+#define HYPER_HEADER_CONTENT_RANGE 25
+
+/*
+ The `content-security-policy` header.
+ */
+#define HYPER_HEADER_CONTENT_SECURITY_POLICY 26
+
+/*
+ The `content-security-policy-report-only` header.
+ */
+#define HYPER_HEADER_CONTENT_SECURITY_POLICY_REPORT_ONLY 27
+
+/*
+ The `content-type` header.
+ */
+#define HYPER_HEADER_CONTENT_TYPE 28
+
+/*
+ The `cookie` header.
+ */
+#define HYPER_HEADER_COOKIE 29
+
+/*
+ The `dnt` header.
+ */
+#define HYPER_HEADER_DNT 30
+
+/*
+ The `date` header.
+ */
+#define HYPER_HEADER_DATE 31
+
+/*
+ The `etag` header.
+ */
+#define HYPER_HEADER_ETAG 32
+
+/*
+ The `expect` header.
+ */
+#define HYPER_HEADER_EXPECT 33
+
+/*
+ The `expires` header.
+ */
+#define HYPER_HEADER_EXPIRES 34
+
+/*
+ The `forwarded` header.
+ */
+#define HYPER_HEADER_FORWARDED 35
+
+/*
+ The `from` header.
+ */
+#define HYPER_HEADER_FROM 36
+
+/*
+ The `host` header.
+ */
+#define HYPER_HEADER_HOST 37
+
+/*
+ The `if-match` header.
+ */
+#define HYPER_HEADER_IF_MATCH 38
+
+/*
+ The `if-modified-since` header.
+ */
+#define HYPER_HEADER_IF_MODIFIED_SINCE 39
+
+/*
+ The `if-none-match` header.
+ */
+#define HYPER_HEADER_IF_NONE_MATCH 40
+
+/*
+ The `if-range` header.
+ */
+#define HYPER_HEADER_IF_RANGE 41
+
+/*
+ The `if-unmodified-since` header.
+ */
+#define HYPER_HEADER_IF_UNMODIFIED_SINCE 42
+
+/*
+ The `last-modified` header.
+ */
+#define HYPER_HEADER_LAST_MODIFIED 43
+
+/*
+ The `link` header.
+ */
+#define HYPER_HEADER_LINK 44
+
+/*
+ The `location` header.
+ */
+#define HYPER_HEADER_LOCATION 45
+
+/*
+ The `max-forwards` header.
+ */
+#define HYPER_HEADER_MAX_FORWARDS 46
+
+/*
+ The `origin` header.
+ */
+#define HYPER_HEADER_ORIGIN 47
+
+/*
+ The `pragma` header.
+ */
+#define HYPER_HEADER_PRAGMA 48
+
+/*
+ The `proxy-authenticate` header.
+ */
+#define HYPER_HEADER_PROXY_AUTHENTICATE 49
+
+/*
+ The `proxy-authorization` header.
+ */
+#define HYPER_HEADER_PROXY_AUTHORIZATION 50
+
+/*
+ The `public-key-pins` header.
+ */
+#define HYPER_HEADER_PUBLIC_KEY_PINS 51
+
+/*
+ The `public-key-pins-report-only` header.
+ */
+#define HYPER_HEADER_PUBLIC_KEY_PINS_REPORT_ONLY 52
+
+/*
+ The `range` header.
+ */
+#define HYPER_HEADER_RANGE 53
+
+/*
+ The `referer` header.
+ */
+#define HYPER_HEADER_REFERER 54
+
+/*
+ The `referrer-policy` header.
+ */
+#define HYPER_HEADER_REFERRER_POLICY 55
+
+/*
+ The `refresh` header.
+ */
+#define HYPER_HEADER_REFRESH 56
+
+/*
+ The `retry-after` header.
+ */
+#define HYPER_HEADER_RETRY_AFTER 57
+
+/*
+ The `sec-websocket-accept` header.
+ */
+#define HYPER_HEADER_SEC_WEBSOCKET_ACCEPT 58
+
+/*
+ The `sec-websocket-extensions` header.
+ */
+#define HYPER_HEADER_SEC_WEBSOCKET_EXTENSIONS 59
+
+/*
+ The `sec-websocket-key` header.
+ */
+#define HYPER_HEADER_SEC_WEBSOCKET_KEY 60
+
+/*
+ The `sec-websocket-protocol` header.
+ */
+#define HYPER_HEADER_SEC_WEBSOCKET_PROTOCOL 61
+
+/*
+ The `sec-websocket-version` header.
+ */
+#define HYPER_HEADER_SEC_WEBSOCKET_VERSION 62
+
+/*
+ The `server` header.
+ */
+#define HYPER_HEADER_SERVER 63
+
+/*
+ The `set-cookie` header.
+ */
+#define HYPER_HEADER_SET_COOKIE 64
+
+/*
+ The `strict-transport-security` header.
+ */
+#define HYPER_HEADER_STRICT_TRANSPORT_SECURITY 65
+
+/*
+ The `te` header.
+ */
+#define HYPER_HEADER_TE 66
+
+/*
+ The `trailer` header.
+ */
+#define HYPER_HEADER_TRAILER 67
+
+/*
+ The `transfer-encoding` header.
+ */
+#define HYPER_HEADER_TRANSFER_ENCODING 68
+
+/*
+ The `user-agent` header.
+ */
+#define HYPER_HEADER_USER_AGENT 69
+
+/*
+ The `upgrade` header.
+ */
+#define HYPER_HEADER_UPGRADE 70
+
+/*
+ The `upgrade-insecure-requests` header.
+ */
+#define HYPER_HEADER_UPGRADE_INSECURE_REQUESTS 71
+
+/*
+ The `vary` header.
+ */
+#define HYPER_HEADER_VARY 72
+
+/*
+ The `via` header.
+ */
+#define HYPER_HEADER_VIA 73
+
+/*
+ The `warning` header.
+ */
+#define HYPER_HEADER_WARNING 74
+
+/*
+ The `www-authenticate` header.
+ */
+#define HYPER_HEADER_WWW_AUTHENTICATE 75
+
+/*
+ The `x-content-type-options` header.
+ */
+#define HYPER_HEADER_X_CONTENT_TYPE_OPTIONS 76
+
+/*
+ The `x-dns-prefetch-control` header.
+ */
+#define HYPER_HEADER_X_DNS_PREFETCH_CONTROL 77
+
+/*
+ The `x-frame-options` header.
+ */
+#define HYPER_HEADER_X_FRAME_OPTIONS 78
+
+/*
+ The `x-xss-protection` header.
+ */
+#define HYPER_HEADER_X_XSS_PROTECTION 79
+
 /*
  Sentinel value to return from a read or write callback that the operation
  */
@@ -52,6 +452,18 @@
  */
 #define HYPER_IO_ERROR 4294967294
 
+/*
+ Passed to a `hyper_io_fd_wait_callback` when hyper is waiting for the file
+ descriptor to become readable.
+ */
+#define HYPER_IO_READABLE 1
+
+/*
+ Passed to a `hyper_io_fd_wait_callback` when hyper is waiting for the file
+ descriptor to become writable.
+ */
+#define HYPER_IO_WRITABLE 2
+
 /*
  Return in a poll function to indicate it was ready.
  */
@@ -101,6 +513,30 @@ typedef enum hyper_code {
   HYPERE_INVALID_PEER_MESSAGE,
 } hyper_code;
 
+/*
+ The state of a client connection, from `hyper_clientconn_state`.
+ */
+typedef enum hyper_conn_state {
+  /*
+   The connection can take another request now.
+   */
+  HYPER_CONN_READY,
+  /*
+   The connection is open, but can't take another request until the
+   ones in flight have made progress.
+   */
+  HYPER_CONN_BUSY,
+  /*
+   The connection will close once the current response has been
+   received, and won't take another request.
+   */
+  HYPER_CONN_CLOSING,
+  /*
+   The connection has closed.
+   */
+  HYPER_CONN_CLOSED,
+} hyper_conn_state;
+
 /*
  A descriptor for what type a `hyper_task` value is.
  */
@@ -125,6 +561,10 @@ typedef enum hyper_task_return_type {
    The value of this task is `hyper_buf *`.
    */
   HYPER_TASK_BUF,
+  /*
+   The value of this task is `hyper_io *`.
+   */
+  HYPER_TASK_IO,
 } hyper_task_return_type;
 
 /*
@@ -137,6 +577,11 @@ typedef struct hyper_body hyper_body;
  */
 typedef struct hyper_buf hyper_buf;
 
+/*
+ A pool of HTTP client connections, reused across requests.
+ */
+typedef struct hyper_client_pool hyper_client_pool;
+
 /*
  An HTTP client connection handle.
  */
@@ -147,6 +592,12 @@ typedef struct hyper_clientconn hyper_clientconn;
  */
 typedef struct hyper_clientconn_options hyper_clientconn_options;
 
+/*
+ A TCP connector, which resolves a host and connects to it without
+ blocking.
+ */
+typedef struct hyper_connector hyper_connector;
+
 /*
  An async context for a task that contains the related waker.
  */
@@ -162,6 +613,11 @@ typedef struct hyper_error hyper_error;
  */
 typedef struct hyper_executor hyper_executor;
 
+/*
+ A block of request headers, encoded once to send with many requests.
+ */
+typedef struct hyper_header_template hyper_header_template;
+
 /*
  An HTTP header map.
  */
@@ -182,28 +638,230 @@ typedef struct hyper_request hyper_request;
  */
 typedef struct hyper_response hyper_response;
 
+/*
+ The channel to send the response to one request with.
+ */
+typedef struct hyper_response_channel hyper_response_channel;
+
+/*
+ A service that answers the requests of a server connection.
+ */
+typedef struct hyper_service hyper_service;
+
+/*
+ An options builder to configure an HTTP server connection.
+ */
+typedef struct hyper_serverconn_options hyper_serverconn_options;
+
 /*
  An async task.
  */
 typedef struct hyper_task hyper_task;
 
 /*
- A waker that is saved and used to waken a pending task.
+ A waker that is saved and used to waken a pending task.
+ */
+typedef struct hyper_waker hyper_waker;
+
+/*
+ A header name and value, as returned by `hyper_headers_snapshot`.
+ */
+typedef struct hyper_header_entry {
+  /*
+   Pointer to the header name.
+   */
+  const uint8_t *name;
+  /*
+   The length of `name`.
+   */
+  size_t name_len;
+  /*
+   Pointer to the header value.
+   */
+  const uint8_t *value;
+  /*
+   The length of `value`.
+   */
+  size_t value_len;
+} hyper_header_entry;
+
+/*
+ A header name and value, to be added with `hyper_headers_add_many`.
+ */
+typedef struct hyper_header_pair {
+  /*
+   One of the `HYPER_HEADER_*` constants, or `HYPER_HEADER_CUSTOM` to
+   use `name` instead.
+   */
+  int name_id;
+  /*
+   Pointer to the header name, if `name_id` is `HYPER_HEADER_CUSTOM`.
+   */
+  const uint8_t *name;
+  /*
+   The length of `name`.
+   */
+  size_t name_len;
+  /*
+   Pointer to the header value.
+   */
+  const uint8_t *value;
+  /*
+   The length of `value`.
+   */
+  size_t value_len;
+} hyper_header_pair;
+
+/*
+ A buffer of bytes passed to a vectored write callback.
+ */
+typedef struct hyper_iovec {
+  /*
+   Pointer to the start of the bytes.
+   */
+  const void *iov_base;
+  /*
+   The number of bytes at `iov_base`.
+   */
+  size_t iov_len;
+} hyper_iovec;
+
+/*
+ Counters of a client connection's activity.
+ */
+typedef struct hyper_conn_stats {
+  /*
+   Nanoseconds from `hyper_clientconn_handshake` until the connection was ready.
+   */
+  uint64_t handshake_ns;
+  /*
+   Requests sent with `hyper_clientconn_send`.
+   */
+  uint64_t requests;
+  /*
+   Reads hyper asked of the transport, including those that were pending.
+   */
+  uint64_t read_calls;
+  /*
+   Writes hyper asked of the transport, including those that were pending.
+   */
+  uint64_t write_calls;
+  /*
+   Bytes read from the transport.
+   */
+  uint64_t bytes_read;
+  /*
+   Bytes written to the transport.
+   */
+  uint64_t bytes_written;
+  /*
+   Times the HTTP/1 read buffer had to grow to fit more data.
+   */
+  uint64_t read_buf_grows;
+  /*
+   Times the HTTP/1 buffer for message heads had to grow.
+   */
+  uint64_t write_buf_grows;
+} hyper_conn_stats;
+
+/*
+ Timings of a single request and its response.
+ */
+typedef struct hyper_request_timings {
+  /*
+   The request head was written to the transport.
+
+   For HTTP/2, this is when the request was handed to the connection's
+   send buffer.
+   */
+  uint64_t head_written_ns;
+  /*
+   The response head was received.
+   */
+  uint64_t headers_received_ns;
+  /*
+   The first bytes of the response body were received.
+   */
+  uint64_t first_body_ns;
+  /*
+   The whole response body was received.
+   */
+  uint64_t body_complete_ns;
+} hyper_request_timings;
+
+/*
+ Counts of the work done by the C API itself, across the whole process.
  */
-typedef struct hyper_waker hyper_waker;
+typedef struct hyper_ffi_stats {
+  /*
+   Boxes for a `hyper_task`, `hyper_buf`, `hyper_waker`, `hyper_request`
+   or `hyper_response` that were taken from the allocator.
+   */
+  uint64_t boxes_allocated;
+  /*
+   Boxes for those that reused the memory of a freed one instead.
+   */
+  uint64_t boxes_reused;
+  /*
+   Calls to `hyper_buf_copy`.
+   */
+  uint64_t buf_copies;
+  /*
+   Bytes copied by `hyper_buf_copy`.
+   */
+  uint64_t buf_copy_bytes;
+  /*
+   Wakers cloned by `hyper_context_waker` and `hyper_waker_update`.
+   */
+  uint64_t waker_clones;
+  /*
+   Tasks pushed onto an executor's spawn queue.
+   */
+  uint64_t tasks_spawned;
+  /*
+   Times an executor's driver was locked to poll its tasks.
+   */
+  uint64_t driver_locks;
+  /*
+   Times `hyper_executor_poll` skipped a shard of a pool executor, since
+   another thread was already polling it.
+   */
+  uint64_t driver_lock_contended;
+} hyper_ffi_stats;
 
 typedef int (*hyper_body_foreach_callback)(void*, const struct hyper_buf*);
 
 typedef int (*hyper_body_data_callback)(void*, struct hyper_context*, struct hyper_buf**);
 
+typedef void (*hyper_buf_release_callback)(void*, const uint8_t*, size_t);
+
 typedef void (*hyper_request_on_informational_callback)(void*, struct hyper_response*);
 
 typedef int (*hyper_headers_foreach_callback)(void*, const uint8_t*, size_t, const uint8_t*, size_t);
 
 typedef size_t (*hyper_io_read_callback)(void*, struct hyper_context*, uint8_t*, size_t);
 
+typedef int (*hyper_io_read_buf_callback)(void*, struct hyper_context*, struct hyper_buf**);
+
 typedef size_t (*hyper_io_write_callback)(void*, struct hyper_context*, const uint8_t*, size_t);
 
+typedef size_t (*hyper_io_write_vectored_callback)(void*,
+                                                   struct hyper_context*,
+                                                   const struct hyper_iovec*,
+                                                   size_t);
+
+typedef size_t (*hyper_io_sendfile_callback)(void*, struct hyper_context*, int, uint64_t, size_t);
+
+typedef void (*hyper_io_fd_wait_callback)(void*, int, int, struct hyper_waker*);
+
+typedef struct hyper_task *(*hyper_client_pool_connect_callback)(void*, const uint8_t*, size_t);
+
+typedef void (*hyper_service_callback)(void*,
+                                       struct hyper_request*,
+                                       struct hyper_response_channel*);
+
+typedef void (*hyper_executor_wake_callback)(void*);
+
 #ifdef __cplusplus
 extern "C" {
 #endif // __cplusplus
@@ -218,6 +876,11 @@ const char *hyper_version(void);
  */
 struct hyper_body *hyper_body_new(void);
 
+/*
+ Creates a body that sends `len` bytes of a file from `offset`, blocking the executor thread while reading.
+ */
+struct hyper_body *hyper_body_new_from_fd(int fd, uint64_t offset, uint64_t len);
+
 /*
  Free a body.
  */
@@ -228,6 +891,14 @@ void hyper_body_free(struct hyper_body *body);
  */
 struct hyper_task *hyper_body_data(struct hyper_body *body);
 
+/*
+ Creates a task that will fill a caller-provided buffer with response body data.
+ */
+struct hyper_task *hyper_body_read_into(struct hyper_body *body,
+                                        uint8_t *buf,
+                                        size_t len,
+                                        size_t *filled);
+
 /*
  Creates a task to execute the callback with each body chunk received.
  */
@@ -235,6 +906,11 @@ struct hyper_task *hyper_body_foreach(struct hyper_body *body,
                                       hyper_body_foreach_callback func,
                                       void *userdata);
 
+/*
+ Gets a reference to the trailers of this body, once they have been received.
+ */
+struct hyper_headers *hyper_body_trailers(struct hyper_body *body);
+
 /*
  Set userdata on this body, which will be passed to callback functions.
  */
@@ -245,11 +921,24 @@ void hyper_body_set_userdata(struct hyper_body *body, void *userdata);
  */
 void hyper_body_set_data_func(struct hyper_body *body, hyper_body_data_callback func);
 
+/*
+ Set the exact length of this body.
+ */
+enum hyper_code hyper_body_set_length(struct hyper_body *body, uint64_t len);
+
 /*
  Create a new `hyper_buf *` by copying the provided bytes.
  */
 struct hyper_buf *hyper_buf_copy(const uint8_t *buf, size_t len);
 
+/*
+ Create a new `hyper_buf *` that borrows the provided bytes without copying.
+ */
+struct hyper_buf *hyper_buf_from_owned(const uint8_t *buf,
+                                       size_t len,
+                                       void *userdata,
+                                       hyper_buf_release_callback release);
+
 /*
  Get a pointer to the bytes in this buffer.
  */
@@ -276,6 +965,25 @@ struct hyper_task *hyper_clientconn_handshake(struct hyper_io *io,
  */
 struct hyper_task *hyper_clientconn_send(struct hyper_clientconn *conn, struct hyper_request *req);
 
+/*
+ Creates a task for each of several requests sent at once.
+ */
+enum hyper_code hyper_clientconn_send_batch(struct hyper_clientconn *conn,
+                                            struct hyper_request *const *reqs,
+                                            size_t len,
+                                            struct hyper_task **tasks);
+
+/*
+ Copy the counters of the connection's activity so far into `stats`.
+ */
+enum hyper_code hyper_clientconn_stats(const struct hyper_clientconn *conn,
+                                       struct hyper_conn_stats *stats);
+
+/*
+ Get whether the connection can take another request.
+ */
+enum hyper_conn_state hyper_clientconn_state(const struct hyper_clientconn *conn);
+
 /*
  Free a `hyper_clientconn *`.
  */
@@ -314,12 +1022,129 @@ void hyper_clientconn_options_exec(struct hyper_clientconn_options *opts,
  */
 enum hyper_code hyper_clientconn_options_http2(struct hyper_clientconn_options *opts, int enabled);
 
+/*
+ Set the HTTP/2 stream-level flow control window.
+ */
+enum hyper_code hyper_clientconn_options_http2_initial_stream_window_size(struct hyper_clientconn_options *opts,
+                                                                          uint32_t size);
+
+/*
+ Set the HTTP/2 connection-level flow control window.
+ */
+enum hyper_code hyper_clientconn_options_http2_initial_connection_window_size(struct hyper_clientconn_options *opts,
+                                                                              uint32_t size);
+
+/*
+ Set whether HTTP/2 flow control windows adapt to the connection.
+ */
+enum hyper_code hyper_clientconn_options_http2_adaptive_window(struct hyper_clientconn_options *opts,
+                                                               int enabled);
+
+/*
+ Set the largest HTTP/2 frame the peer may send.
+ */
+enum hyper_code hyper_clientconn_options_http2_max_frame_size(struct hyper_clientconn_options *opts,
+                                                              uint32_t size);
+
+/*
+ Set the initial limit of concurrent HTTP/2 streams.
+ */
+enum hyper_code hyper_clientconn_options_http2_initial_max_send_streams(struct hyper_clientconn_options *opts,
+                                                                        size_t max);
+
+/*
+ Set the largest HTTP/2 header list accepted.
+ */
+enum hyper_code hyper_clientconn_options_http2_max_header_list_size(struct hyper_clientconn_options *opts,
+                                                                    uint32_t max);
+
+/*
+ Set the HTTP/2 write buffer size of each stream.
+ */
+enum hyper_code hyper_clientconn_options_http2_max_send_buf_size(struct hyper_clientconn_options *opts,
+                                                                 size_t max);
+
+/*
+ Set the most locally reset HTTP/2 streams tracked at once.
+ */
+enum hyper_code hyper_clientconn_options_http2_max_concurrent_reset_streams(struct hyper_clientconn_options *opts,
+                                                                            size_t max);
+
 /*
  Set whether HTTP/1 connections accept obsolete line folding for header values.
  */
 enum hyper_code hyper_clientconn_options_http1_allow_multiline_headers(struct hyper_clientconn_options *opts,
                                                                        int enabled);
 
+/*
+ Set how many HTTP/1 requests may be in flight at once.
+ */
+enum hyper_code hyper_clientconn_options_http1_pipeline_depth(struct hyper_clientconn_options *opts,
+                                                              size_t depth);
+
+/*
+ Set the most headers an HTTP/1 response may have.
+ */
+enum hyper_code hyper_clientconn_options_http1_max_headers(struct hyper_clientconn_options *opts,
+                                                           size_t max);
+
+/*
+ Set an exact size for the HTTP/1 read buffer.
+ */
+enum hyper_code hyper_clientconn_options_http1_read_buf_exact_size(struct hyper_clientconn_options *opts,
+                                                                   size_t size);
+
+/*
+ Set the largest the HTTP/1 buffers may grow.
+ */
+enum hyper_code hyper_clientconn_options_http1_max_buf_size(struct hyper_clientconn_options *opts,
+                                                            size_t max);
+
+/*
+ Set whether HTTP/1 writes queue buffers or flatten them.
+ */
+enum hyper_code hyper_clientconn_options_http1_writev(struct hyper_clientconn_options *opts,
+                                                      int enabled);
+
+/*
+ Set whether idle HTTP/1 connections free their buffers.
+ */
+enum hyper_code hyper_clientconn_options_http1_release_idle_buffers(struct hyper_clientconn_options *opts,
+                                                                    int enabled);
+
+/*
+ Creates a new TCP connector.
+ */
+struct hyper_connector *hyper_connector_new(hyper_io_fd_wait_callback wait, void *userdata);
+
+/*
+ Free a TCP connector.
+ */
+void hyper_connector_free(struct hyper_connector *connector);
+
+/*
+ Set how long to wait for an attempt before starting the next.
+ */
+void hyper_connector_set_happy_eyeballs_delay(struct hyper_connector *connector, uint64_t delay_ms);
+
+/*
+ Set how long a connect task may take in total.
+ */
+void hyper_connector_set_connect_timeout(struct hyper_connector *connector, uint64_t timeout_ms);
+
+/*
+ Set how long looked up addresses are reused.
+ */
+void hyper_connector_set_dns_cache_ttl(struct hyper_connector *connector, uint64_t ttl_ms);
+
+/*
+ Creates a task to connect to a host and port.
+ */
+struct hyper_task *hyper_connector_connect(const struct hyper_connector *connector,
+                                           const uint8_t *host,
+                                           size_t host_len,
+                                           uint16_t port);
+
 /*
  Frees a `hyper_error`.
  */
@@ -345,6 +1170,11 @@ struct hyper_request *hyper_request_new(void);
  */
 void hyper_request_free(struct hyper_request *req);
 
+/*
+ Reset a request to how `hyper_request_new` makes it.
+ */
+enum hyper_code hyper_request_reset(struct hyper_request *req);
+
 /*
  Set the HTTP Method of the request.
  */
@@ -375,6 +1205,27 @@ enum hyper_code hyper_request_set_uri_parts(struct hyper_request *req,
  */
 enum hyper_code hyper_request_set_version(struct hyper_request *req, int version);
 
+/*
+ Get the HTTP Method of this request.
+ */
+const uint8_t *hyper_request_method(const struct hyper_request *req, size_t *method_len);
+
+/*
+ Get the scheme, authority, and path/query of this request's URI.
+ */
+enum hyper_code hyper_request_uri_parts(const struct hyper_request *req,
+                                        const uint8_t **scheme,
+                                        size_t *scheme_len,
+                                        const uint8_t **authority,
+                                        size_t *authority_len,
+                                        const uint8_t **path_and_query,
+                                        size_t *path_and_query_len);
+
+/*
+ Get the HTTP version of this request.
+ */
+int hyper_request_version(const struct hyper_request *req);
+
 /*
  Gets a mutable reference to the HTTP headers of this request
  */
@@ -385,6 +1236,11 @@ struct hyper_headers *hyper_request_headers(struct hyper_request *req);
  */
 enum hyper_code hyper_request_set_body(struct hyper_request *req, struct hyper_body *body);
 
+/*
+ Take ownership of the body of this request.
+ */
+struct hyper_body *hyper_request_body(struct hyper_request *req);
+
 /*
  Set an informational (1xx) response callback.
  */
@@ -392,6 +1248,27 @@ enum hyper_code hyper_request_on_informational(struct hyper_request *req,
                                                hyper_request_on_informational_callback callback,
                                                void *data);
 
+/*
+ Add the headers of a template to the request.
+ */
+enum hyper_code hyper_request_set_header_template(struct hyper_request *req,
+                                                  const struct hyper_header_template *tmpl);
+
+/*
+ Construct a new HTTP response.
+ */
+struct hyper_response *hyper_response_new(void);
+
+/*
+ Set the HTTP-Status code of this response.
+ */
+enum hyper_code hyper_response_set_status(struct hyper_response *resp, uint16_t status);
+
+/*
+ Set the body of this response.
+ */
+enum hyper_code hyper_response_set_body(struct hyper_response *resp, struct hyper_body *body);
+
 /*
  Free an HTTP response.
  */
@@ -427,6 +1304,17 @@ struct hyper_headers *hyper_response_headers(struct hyper_response *resp);
  */
 struct hyper_body *hyper_response_body(struct hyper_response *resp);
 
+/*
+ Take ownership of the body of this response, decoding it.
+ */
+struct hyper_body *hyper_response_body_decoded(struct hyper_response *resp);
+
+/*
+ Copy the timings of this response's request so far into `timings`.
+ */
+enum hyper_code hyper_response_timings(const struct hyper_response *resp,
+                                       struct hyper_request_timings *timings);
+
 /*
  Iterates the headers passing each name and value pair to the callback.
  */
@@ -434,6 +1322,20 @@ void hyper_headers_foreach(const struct hyper_headers *headers,
                            hyper_headers_foreach_callback func,
                            void *userdata);
 
+/*
+ Gets a contiguous array of every header name and value pair.
+ */
+const struct hyper_header_entry *hyper_headers_snapshot(struct hyper_headers *headers,
+                                                        size_t *len);
+
+/*
+ Gets the first value of the header with the provided name.
+ */
+const uint8_t *hyper_headers_get(const struct hyper_headers *headers,
+                                 const uint8_t *name,
+                                 size_t name_len,
+                                 size_t *value_len);
+
 /*
  Sets the header with the provided name to the provided value.
  */
@@ -452,11 +1354,39 @@ enum hyper_code hyper_headers_add(struct hyper_headers *headers,
                                   const uint8_t *value,
                                   size_t value_len);
 
+/*
+ Adds many name and value pairs at once.
+ */
+enum hyper_code hyper_headers_add_many(struct hyper_headers *headers,
+                                       const struct hyper_header_pair *pairs,
+                                       size_t len);
+
+/*
+ Reserves capacity for at least `additional` more headers.
+ */
+enum hyper_code hyper_headers_reserve(struct hyper_headers *headers, size_t additional);
+
+/*
+ Create a header template from name and value pairs.
+ */
+struct hyper_header_template *hyper_header_template_new(const struct hyper_header_pair *pairs,
+                                                        size_t len);
+
+/*
+ Free a header template.
+ */
+void hyper_header_template_free(struct hyper_header_template *tmpl);
+
 /*
  Create a new IO type used to represent a transport.
  */
 struct hyper_io *hyper_io_new(void);
 
+/*
+ Create a new IO type that reads and writes a non-blocking file descriptor.
+ */
+struct hyper_io *hyper_io_new_fd(int fd, hyper_io_fd_wait_callback wait, void *userdata);
+
 /*
  Free an IO handle.
  */
@@ -472,16 +1402,160 @@ void hyper_io_set_userdata(struct hyper_io *io, void *data);
  */
 void hyper_io_set_read(struct hyper_io *io, hyper_io_read_callback func);
 
+/*
+ Set a read function that hands owned buffers to this IO transport.
+ */
+void hyper_io_set_read_buf(struct hyper_io *io, hyper_io_read_buf_callback func);
+
 /*
  Set the write function for this IO transport.
  */
 void hyper_io_set_write(struct hyper_io *io, hyper_io_write_callback func);
 
+/*
+ Set the vectored write function for this IO transport.
+ */
+void hyper_io_set_write_vectored(struct hyper_io *io, hyper_io_write_vectored_callback func);
+
+/*
+ Set a function that sends part of a file straight to this IO transport.
+ */
+void hyper_io_set_sendfile(struct hyper_io *io, hyper_io_sendfile_callback func);
+
+/*
+ Creates a new, empty connection pool.
+ */
+struct hyper_client_pool *hyper_client_pool_new(void);
+
+/*
+ Free a connection pool.
+ */
+void hyper_client_pool_free(struct hyper_client_pool *pool);
+
+/*
+ Set the callback used to create new connections.
+ */
+void hyper_client_pool_set_connect(struct hyper_client_pool *pool,
+                                   hyper_client_pool_connect_callback func,
+                                   void *userdata);
+
+/*
+ Set the most connections kept per key.
+ */
+void hyper_client_pool_set_max_idle_per_host(struct hyper_client_pool *pool, size_t max);
+
+/*
+ Set how long an unused connection is kept.
+ */
+void hyper_client_pool_set_idle_timeout(struct hyper_client_pool *pool, uint64_t timeout_ms);
+
+/*
+ Creates a task to send a request on a pooled connection.
+ */
+struct hyper_task *hyper_client_pool_send(struct hyper_client_pool *pool,
+                                          const uint8_t *key,
+                                          size_t key_len,
+                                          struct hyper_request *req);
+
+/*
+ Creates a new set of HTTP serverconn options to be used with
+ */
+struct hyper_serverconn_options *hyper_serverconn_options_new(void);
+
+/*
+ Free a set of HTTP serverconn options.
+ */
+void hyper_serverconn_options_free(struct hyper_serverconn_options *opts);
+
+/*
+ Set the executor for background tasks of the connection.
+ */
+void hyper_serverconn_options_exec(struct hyper_serverconn_options *opts,
+                                   const struct hyper_executor *exec);
+
+/*
+ Set whether HTTP/1 connections are kept alive between requests.
+ */
+enum hyper_code hyper_serverconn_options_http1_keep_alive(struct hyper_serverconn_options *opts,
+                                                          int enabled);
+
+/*
+ Set whether HTTP/1 connections answer requests after the client stopped sending.
+ */
+enum hyper_code hyper_serverconn_options_http1_half_close(struct hyper_serverconn_options *opts,
+                                                          int enabled);
+
+/*
+ Set whether responses to pipelined HTTP/1 requests are written together.
+ */
+enum hyper_code hyper_serverconn_options_http1_pipeline_flush(struct hyper_serverconn_options *opts,
+                                                              int enabled);
+
+/*
+ Set whether HTTP/1 header case is preserved.
+ */
+enum hyper_code hyper_serverconn_options_http1_preserve_header_case(struct hyper_serverconn_options *opts,
+                                                                    int enabled);
+
+/*
+ Set whether to serve HTTP/2.
+ */
+enum hyper_code hyper_serverconn_options_http2(struct hyper_serverconn_options *opts, int enabled);
+
+/*
+ Set the most concurrent HTTP/2 streams the client may open.
+ */
+enum hyper_code hyper_serverconn_options_http2_max_concurrent_streams(struct hyper_serverconn_options *opts,
+                                                                      uint32_t max);
+
+/*
+ Create a service from a callback.
+ */
+struct hyper_service *hyper_service_new(hyper_service_callback func);
+
+/*
+ Set the userdata passed to the service callback.
+ */
+void hyper_service_set_userdata(struct hyper_service *service, void *userdata);
+
+/*
+ Free a service.
+ */
+void hyper_service_free(struct hyper_service *service);
+
+/*
+ Send the response to the request.
+ */
+enum hyper_code hyper_response_channel_send(struct hyper_response_channel *channel,
+                                            struct hyper_response *resp);
+
+/*
+ Free a channel without responding.
+ */
+void hyper_response_channel_free(struct hyper_response_channel *channel);
+
+/*
+ Creates a task to serve HTTP on a connection.
+ */
+struct hyper_task *hyper_serve_connection(struct hyper_io *io,
+                                          struct hyper_serverconn_options *options,
+                                          struct hyper_service *service);
+
+/*
+ Copy the counters of the C API's own work so far into `stats`.
+ */
+enum hyper_code hyper_stats_snapshot(struct hyper_ffi_stats *stats);
+
 /*
  Creates a new task executor.
  */
 const struct hyper_executor *hyper_executor_new(void);
 
+/*
+ Creates a new task executor that can be polled from several threads at once.
+ */
+const struct hyper_executor *hyper_executor_new_pool(size_t threads);
+
 /*
  Frees an executor and any incomplete tasks still part of it.
  */
@@ -497,6 +1571,20 @@ enum hyper_code hyper_executor_push(const struct hyper_executor *exec, struct hy
  */
 struct hyper_task *hyper_executor_poll(const struct hyper_executor *exec);
 
+/*
+ Polls the executor, returning as many ready tasks as fit in the provided array.
+ */
+size_t hyper_executor_poll_batch(const struct hyper_executor *exec,
+                                 struct hyper_task **tasks,
+                                 size_t tasks_len);
+
+/*
+ Set a callback to be notified when the executor has work to do.
+ */
+enum hyper_code hyper_executor_set_wake_callback(const struct hyper_executor *exec,
+                                                 hyper_executor_wake_callback func,
+                                                 void *userdata);
+
 /*
  Free a task.
  */
@@ -537,6 +1625,16 @@ void hyper_waker_free(struct hyper_waker *waker);
  */
 void hyper_waker_wake(struct hyper_waker *waker);
 
+/*
+ Wake up the task associated with a waker, without consuming the waker.
+ */
+void hyper_waker_wake_by_ref(const struct hyper_waker *waker);
+
+/*
+ Update a waker to wake up the task associated with a context.
+ */
+void hyper_waker_update(struct hyper_waker *waker, struct hyper_context *cx);
+
 #ifdef __cplusplus
 } // extern "C"
 #endif // __cplusplus
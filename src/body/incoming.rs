@@ -169,6 +169,15 @@ impl Incoming {
         })
     }
 
+    /// Returns the C body, without turning other kinds into one.
+    #[cfg(all(feature = "ffi", unix))]
+    pub(crate) fn ffi_mut(&mut self) -> Option<&mut crate::ffi::UserBody> {
+        match self.kind {
+            Kind::Ffi(ref mut body) => Some(body),
+            _ => None,
+        }
+    }
+
     #[cfg(feature = "ffi")]
     pub(crate) fn as_ffi_mut(&mut self) -> &mut crate::ffi::UserBody {
         match self.kind {
@@ -286,7 +295,7 @@ impl Body for Incoming {
             #[cfg(all(feature = "http2", any(feature = "client", feature = "server")))]
             Kind::H2 { recv: ref h2, .. } => h2.is_end_stream(),
             #[cfg(feature = "ffi")]
-            Kind::Ffi(..) => false,
+            Kind::Ffi(ref body) => body.is_end_stream(),
         }
     }
 
@@ -310,7 +319,7 @@ impl Body for Incoming {
             #[cfg(all(feature = "http2", any(feature = "client", feature = "server")))]
             Kind::H2 { content_length, .. } => opt_len(content_length),
             #[cfg(feature = "ffi")]
-            Kind::Ffi(..) => SizeHint::default(),
+            Kind::Ffi(ref body) => body.size_hint(),
         }
     }
 }
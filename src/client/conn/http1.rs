@@ -71,6 +71,12 @@ where
         Parts { io, read_buf }
     }
 
+    /// Lets the connection use what its IO can do as a C API `hyper_io`.
+    #[cfg(feature = "ffi")]
+    pub(crate) fn set_ffi_transport(&mut self, get: crate::proto::h1::GetFfiTransport<T>) {
+        self.inner.set_ffi_transport(get);
+    }
+
     /// Poll the connection for completion, but without calling `shutdown`
     /// on the underlying IO.
     ///
@@ -114,6 +120,12 @@ pub struct Builder {
     h1_max_headers: Option<usize>,
     #[cfg(feature = "ffi")]
     h1_preserve_header_order: bool,
+    #[cfg(feature = "ffi")]
+    h1_pipeline_depth: usize,
+    #[cfg(feature = "ffi")]
+    h1_stats: Option<std::sync::Arc<crate::ffi::ConnStats>>,
+    #[cfg(feature = "ffi")]
+    h1_release_idle_buffers: bool,
     h1_read_buf_exact_size: Option<usize>,
     h1_max_buf_size: Option<usize>,
 }
@@ -183,7 +195,40 @@ where
         req: Request<B>,
     ) -> impl Future<Output = crate::Result<Response<IncomingBody>>> {
         let sent = self.dispatch.send(req);
+        Self::response(sent)
+    }
+
+    /// Sends several requests at once, pipelined behind one another.
+    ///
+    /// The first is sent as with `send_request`, and the rest are queued
+    /// behind it without waiting for the connection to ask for each, to be
+    /// written as its pipeline depth allows. If the first can't be sent,
+    /// none of them are.
+    #[cfg(feature = "ffi")]
+    pub(crate) fn send_pipelined<I>(
+        &mut self,
+        reqs: I,
+    ) -> Vec<impl Future<Output = crate::Result<Response<IncomingBody>>>>
+    where
+        I: IntoIterator<Item = Request<B>>,
+    {
+        let mut ready = None;
+        reqs.into_iter()
+            .map(|req| {
+                let sent = match ready {
+                    None => self.dispatch.send(req),
+                    Some(true) => self.dispatch.send_queued(req),
+                    Some(false) => Err(req),
+                };
+                ready = Some(sent.is_ok());
+                Self::response(sent)
+            })
+            .collect()
+    }
 
+    fn response(
+        sent: Result<dispatch::Promise<Response<IncomingBody>>, Request<B>>,
+    ) -> impl Future<Output = crate::Result<Response<IncomingBody>>> {
         async move {
             match sent {
                 Ok(rx) => match rx.await {
@@ -301,6 +346,12 @@ impl Builder {
             h1_max_headers: None,
             #[cfg(feature = "ffi")]
             h1_preserve_header_order: false,
+            #[cfg(feature = "ffi")]
+            h1_pipeline_depth: 1,
+            #[cfg(feature = "ffi")]
+            h1_stats: None,
+            #[cfg(feature = "ffi")]
+            h1_release_idle_buffers: false,
             h1_max_buf_size: None,
         }
     }
@@ -438,8 +489,9 @@ impl Builder {
     /// is returned.
     ///
     /// Note that headers is allocated on the stack by default, which has higher performance. After
-    /// setting this value, headers will be allocated in heap memory, that is, heap memory
-    /// allocation will occur for each response, and there will be a performance drop of about 5%.
+    /// setting this value above 100, headers will be allocated in heap memory. Part of that memory
+    /// is kept by the connection and reused, but some heap memory allocation will still occur for
+    /// each response, and there will be a performance drop of about 5%.
     ///
     /// Default is 100.
     pub fn max_headers(&mut self, val: usize) -> &mut Self {
@@ -460,6 +512,46 @@ impl Builder {
         self
     }
 
+    /// Set how many requests may be written before their responses are read.
+    ///
+    /// With a depth greater than 1, the connection is ready for another
+    /// request as soon as the previous one has been written, instead of
+    /// waiting for its response. Responses are matched to requests in the
+    /// order they were sent.
+    ///
+    /// Only use this with servers known to handle pipelining, and with
+    /// requests that are safe to send again, since a failure partway through
+    /// affects every pipelined request.
+    ///
+    /// Default is 1, which disables pipelining.
+    ///
+    /// # Panics
+    ///
+    /// The depth cannot be 0.
+    #[cfg(feature = "ffi")]
+    pub fn pipeline_depth(&mut self, depth: usize) -> &mut Builder {
+        assert!(depth > 0, "the pipeline depth cannot be 0");
+        self.h1_pipeline_depth = depth;
+        self
+    }
+
+    /// Set the counters the connection's buffers report their growth to.
+    #[cfg(feature = "ffi")]
+    pub(crate) fn stats(&mut self, stats: std::sync::Arc<crate::ffi::ConnStats>) -> &mut Builder {
+        self.h1_stats = Some(stats);
+        self
+    }
+
+    /// Set whether the connection frees its buffers while it is idle.
+    ///
+    /// This saves memory on connections that are kept alive but rarely
+    /// used, at the cost of allocating the buffers again for each request.
+    #[cfg(feature = "ffi")]
+    pub(crate) fn release_idle_buffers(&mut self, enabled: bool) -> &mut Builder {
+        self.h1_release_idle_buffers = enabled;
+        self
+    }
+
     /// Sets the exact size of the read buffer to *always* use.
     ///
     /// Note that setting this option unsets the `max_buf_size` option.
@@ -545,7 +637,20 @@ impl Builder {
             if let Some(max) = opts.h1_max_buf_size {
                 conn.set_max_buf_size(max);
             }
-            let cd = proto::h1::dispatch::Client::new(rx);
+            #[cfg(feature = "ffi")]
+            conn.set_pipeline_depth(opts.h1_pipeline_depth);
+            #[cfg(feature = "ffi")]
+            if let Some(stats) = opts.h1_stats {
+                conn.set_stats(stats);
+            }
+            #[cfg(feature = "ffi")]
+            if opts.h1_release_idle_buffers {
+                conn.set_release_idle_buffers();
+            }
+            #[cfg_attr(not(feature = "ffi"), allow(unused_mut))]
+            let mut cd = proto::h1::dispatch::Client::new(rx);
+            #[cfg(feature = "ffi")]
+            cd.set_pipeline_depth(opts.h1_pipeline_depth);
             let proto = proto::h1::Dispatcher::new(cd, conn);
 
             Ok((SendRequest { dispatch: tx }, Connection { inner: proto }))
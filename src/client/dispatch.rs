@@ -116,6 +116,18 @@ impl<T, U> Sender<T, U> {
             .map_err(|mut e| (e.0).0.take().expect("envelope not dropped").0)
     }
 
+    /// Sends without waiting for the Receiver to ask, to pipeline a message
+    /// behind one that `send` just let through. It waits in the channel
+    /// until the Receiver has room for it.
+    #[cfg(all(feature = "http1", feature = "ffi"))]
+    pub(crate) fn send_queued(&mut self, val: T) -> Result<Promise<U>, T> {
+        let (tx, rx) = oneshot::channel();
+        self.inner
+            .send(Envelope(Some((val, Callback::NoRetry(Some(tx))))))
+            .map(move |_| rx)
+            .map_err(|mut e| (e.0).0.take().expect("envelope not dropped").0)
+    }
+
     #[cfg(feature = "http2")]
     pub(crate) fn unbound(self) -> UnboundedSender<T, U> {
         UnboundedSender {
@@ -131,6 +131,16 @@ impl HeaderCaseMap {
         self.0.insert(name, orig);
     }
 
+    #[cfg(feature = "ffi")]
+    pub(crate) fn reserve(&mut self, additional: usize) {
+        self.0.reserve(additional);
+    }
+
+    #[cfg(feature = "ffi")]
+    pub(crate) fn remove(&mut self, name: &HeaderName) {
+        self.0.remove(name);
+    }
+
     #[cfg(any(feature = "client", feature = "server"))]
     pub(crate) fn append<N>(&mut self, name: N, orig: Bytes)
     where
@@ -191,6 +201,18 @@ impl OriginalHeaderOrder {
         self.entry_order.push((name, idx));
     }
 
+    pub(crate) fn reserve(&mut self, additional: usize) {
+        self.num_entries.reserve(additional);
+        self.entry_order.reserve(additional);
+    }
+
+    /// Forgets every entry with this name, keeping the order of the rest.
+    pub(crate) fn remove(&mut self, name: &HeaderName) {
+        if self.num_entries.remove(name).is_some() {
+            self.entry_order.retain(|(n, _)| n != name);
+        }
+    }
+
     // No doc test is run here because `RUSTFLAGS='--cfg hyper_unstable_ffi'`
     // is needed to compile. Once ffi is stablized `no_run` should be removed
     // here.
@@ -3,9 +3,17 @@ use std::mem::ManuallyDrop;
 use std::ptr;
 use std::task::{Context, Poll};
 
-use http_body_util::BodyExt as _;
+#[cfg(unix)]
+use bytes::{BufMut, BytesMut};
+use futures_util::ready;
+use http_body::{Body as _, SizeHint};
 use libc::{c_int, size_t};
 
+use super::decompress::Decoder;
+use super::error::hyper_code;
+use super::http_types::hyper_headers;
+use super::recycle::Recycle;
+use super::stats::{self, Counter, RequestStats};
 use super::task::{hyper_context, hyper_task, hyper_task_return_type, AsTaskType};
 use super::{UserDataPointer, HYPER_ITER_CONTINUE};
 use crate::body::{Bytes, Frame, Incoming as IncomingBody};
@@ -25,12 +33,27 @@ use crate::body::{Bytes, Frame, Incoming as IncomingBody};
 /// Methods:
 ///
 /// - hyper_body_new:           Create a new “empty” body.
+/// - hyper_body_new_from_fd:   Create a new body that sends a range of a file.
 /// - hyper_body_set_userdata:  Set userdata on this body, which will be passed to callback functions.
 /// - hyper_body_set_data_func: Set the data callback for this body.
+/// - hyper_body_set_length:    Set the exact length of this body.
 /// - hyper_body_data:          Creates a task that will poll a response body for the next buffer of data.
+/// - hyper_body_read_into:     Creates a task that will fill a caller-provided buffer with response body data.
 /// - hyper_body_foreach:       Creates a task to execute the callback with each body chunk received.
+/// - hyper_body_trailers:      Gets a reference to the trailers of this body, once they have been received.
 /// - hyper_body_free:          Free a body.
-pub struct hyper_body(pub(super) IncomingBody);
+pub struct hyper_body {
+    pub(super) body: IncomingBody,
+    /// The rest of a chunk that didn't fit in a `hyper_body_read_into` buffer.
+    leftover: Bytes,
+    /// Decodes the data, for a `hyper_response_body_decoded` body.
+    decoder: Option<Box<Decoder>>,
+    /// The trailers, once they have been received.
+    trailers: Option<Box<hyper_headers>>,
+    /// The timings of the request this is the response body of, for bodies
+    /// whose connection doesn't record them itself.
+    stats: Option<RequestStats>,
+}
 
 /// A buffer of bytes that is sent or received on a `hyper_body`.
 ///
@@ -40,17 +63,73 @@ pub struct hyper_body(pub(super) IncomingBody);
 ///
 /// Methods:
 ///
-/// - hyper_buf_bytes: Get a pointer to the bytes in this buffer.
-/// - hyper_buf_copy:  Create a new hyper_buf * by copying the provided bytes.
-/// - hyper_buf_free:  Free this buffer.
-/// - hyper_buf_len:   Get the length of the bytes this buffer contains.
+/// - hyper_buf_bytes:      Get a pointer to the bytes in this buffer.
+/// - hyper_buf_copy:       Create a new hyper_buf * by copying the provided bytes.
+/// - hyper_buf_from_owned: Create a new hyper_buf * that borrows caller memory without copying.
+/// - hyper_buf_free:       Free this buffer.
+/// - hyper_buf_len:        Get the length of the bytes this buffer contains.
 pub struct hyper_buf(pub(crate) Bytes);
 
 pub(crate) struct UserBody {
     data_func: hyper_body_data_callback,
     userdata: *mut c_void,
+    /// The state of the less common kinds of body, boxed so that it doesn't
+    /// grow every `Incoming`.
+    extra: Option<Box<Extra>>,
+}
+
+enum Extra {
+    /// The bytes the data callback has left to send, once the length was set
+    /// with `hyper_body_set_length`.
+    Length(u64),
+    /// A `hyper_body_new_from_fd` body, which reads a file instead of calling
+    /// the data callback.
+    #[cfg(unix)]
+    File(FileRange),
+    /// A body that was partly read before being set on a message, which is
+    /// sent on from where the reading stopped.
+    Forward(Box<hyper_body>),
+}
+
+/// The part of a file that a `hyper_body_new_from_fd` body has left to send.
+#[cfg(unix)]
+struct FileRange {
+    fd: c_int,
+    offset: u64,
+    remaining: u64,
+    /// What the file is read into, when it isn't sent with sendfile. Each
+    /// chunk is split off of it, and once hyper is done writing a chunk, its
+    /// memory is used again for the next one.
+    buf: BytesMut,
+}
+
+/// The file a `hyper_body_new_from_fd` body still has to send, put in the
+/// extensions of the message it was set on when the message is sent.
+///
+/// An HTTP/1 connection whose transport has a sendfile function takes it
+/// out while writing the head, and then sends the file itself, without
+/// polling the body.
+#[cfg(unix)]
+#[derive(Clone, Copy, Debug)]
+pub(crate) struct SendFile {
+    pub(crate) fd: c_int,
+    pub(crate) offset: u64,
+    pub(crate) len: u64,
+}
+
+#[cfg(unix)]
+impl SendFile {
+    /// Returns what a file body has left to send, so the message it is set
+    /// on can tell the connection without it looking into the body.
+    pub(super) fn of(body: &mut IncomingBody) -> Option<SendFile> {
+        body.ffi_mut().and_then(|body| body.send_file())
+    }
 }
 
+/// The most bytes a file body reads into a single chunk.
+#[cfg(unix)]
+const FILE_CHUNK_SIZE: usize = 64 * 1024;
+
 // ===== Body =====
 
 type hyper_body_foreach_callback = extern "C" fn(*mut c_void, *const hyper_buf) -> c_int;
@@ -58,6 +137,8 @@ type hyper_body_foreach_callback = extern "C" fn(*mut c_void, *const hyper_buf)
 type hyper_body_data_callback =
     extern "C" fn(*mut c_void, *mut hyper_context<'_>, *mut *mut hyper_buf) -> c_int;
 
+type hyper_buf_release_callback = extern "C" fn(*mut c_void, *const u8, size_t);
+
 ffi_fn! {
     /// Creates a new "empty" body.
     ///
@@ -66,7 +147,52 @@ ffi_fn! {
     /// To avoid a memory leak, the body must eventually be consumed by
     /// `hyper_body_free`, `hyper_body_foreach`, or `hyper_request_set_body`.
     fn hyper_body_new() -> *mut hyper_body {
-        Box::into_raw(Box::new(hyper_body(IncomingBody::ffi())))
+        Box::into_raw(Box::new(hyper_body::wrap(IncomingBody::ffi())))
+    } ?= ptr::null_mut()
+}
+
+ffi_fn! {
+    /// Creates a body that sends `len` bytes of a file from `offset`, blocking the executor thread while reading.
+    ///
+    /// The file is read on the thread polling the executor, with blocking
+    /// calls. That is quick for a regular file in the page cache, but a file
+    /// on slow or network storage stalls every other task of the executor
+    /// while it is read. For such files, use `hyper_body_set_data_func` with
+    /// a callback that reads the file somewhere else.
+    ///
+    /// Since the body's length is known, it is sent with a `content-length`
+    /// rather than chunked. If the transport has a sendfile function (see
+    /// `hyper_io_set_sendfile`), the file is handed to it once the head has
+    /// been written, and never enters userspace. Otherwise hyper reads the
+    /// file itself into a buffer it reuses for each chunk, instead of having
+    /// a `hyper_body_data_callback` copy each chunk into a `hyper_buf`.
+    ///
+    /// The file is read with `pread`, so its offset is left unchanged. The
+    /// `fd` is not closed by hyper, and must stay open until the body has been
+    /// sent or freed. If the file ends before `len` bytes were read, the body
+    /// fails with an error.
+    ///
+    /// Returns `NULL` if `offset + len` is too large for a file offset.
+    ///
+    /// This is only available on Unix platforms.
+    ///
+    /// To avoid a memory leak, the body must eventually be consumed by
+    /// `hyper_body_free`, `hyper_body_foreach`, or `hyper_request_set_body`.
+    #[cfg(unix)]
+    fn hyper_body_new_from_fd(fd: c_int, offset: u64, len: u64) -> *mut hyper_body {
+        match offset.checked_add(len) {
+            Some(end) if end <= libc::off_t::MAX as u64 => (),
+            _ => return ptr::null_mut(),
+        }
+
+        let mut body = IncomingBody::ffi();
+        body.as_ffi_mut().extra = Some(Box::new(Extra::File(FileRange {
+            fd,
+            offset,
+            remaining: len,
+            buf: BytesMut::new(),
+        })));
+        Box::into_raw(Box::new(hyper_body::wrap(body)))
     } ?= ptr::null_mut()
 }
 
@@ -111,23 +237,77 @@ ffi_fn! {
         let mut body = ManuallyDrop::new(non_null!(Box::from_raw(body) ?= ptr::null_mut()));
 
         Box::into_raw(hyper_task::boxed(async move {
-            loop {
-                match body.0.frame().await {
-                    Some(Ok(frame)) => {
-                        if let Ok(data) = frame.into_data() {
-                            return Ok(Some(hyper_buf(data)));
-                        } else {
-                            continue;
-                        }
-                    },
-                    Some(Err(e)) => return Err(e),
-                    None => return Ok(None),
-                }
+            match body.next_data().await {
+                Some(Ok(data)) => Ok(Some(hyper_buf(data))),
+                Some(Err(e)) => Err(e),
+                None => Ok(None),
             }
         }))
     } ?= ptr::null_mut()
 }
 
+ffi_fn! {
+    /// Creates a task that will fill a caller-provided buffer with response body data.
+    ///
+    /// The task copies as many chunks of the body as fit into the `len` bytes
+    /// at `buf`, and only completes once the buffer is full, or the body has
+    /// finished streaming data. The number of bytes written is then stored in
+    /// `filled`. It is less than `len` only at the end of the body, and `0`
+    /// once there is no more data.
+    ///
+    /// The task may have different types depending on the outcome:
+    ///
+    /// - `HYPER_TASK_EMPTY`: Success, and `filled` has been set.
+    /// - `HYPER_TASK_ERROR`: An error retrieving the data. `filled` is still
+    ///   set to the number of bytes written before the error.
+    ///
+    /// If a chunk doesn't fit in what is left of the buffer, the rest of it is
+    /// kept by the `hyper_body *`, and is the first data given to the next
+    /// `hyper_body_read_into`, `hyper_body_data`, or `hyper_body_foreach`.
+    /// So, a single task per buffer is allocated, no matter how the body was
+    /// split up on the wire.
+    ///
+    /// Returns `NULL` if a pointer is null, or if `len` is `0`, since filling
+    /// `0` bytes couldn't be told apart from the end of the body.
+    ///
+    /// To avoid a memory leak, the task must eventually be consumed by
+    /// `hyper_task_free`, or taken ownership of by `hyper_executor_push`
+    /// without subsequently being given back by `hyper_executor_poll`.
+    ///
+    /// This does not consume the `hyper_body *`, so it may be used again.
+    /// However, the `hyper_body *`, `buf` and `filled` MUST NOT be used or
+    /// freed until the related task is returned from `hyper_executor_poll`.
+    fn hyper_body_read_into(body: *mut hyper_body, buf: *mut u8, len: size_t, filled: *mut size_t) -> *mut hyper_task {
+        if len == 0 {
+            return ptr::null_mut();
+        }
+        // This doesn't take ownership of the Body, so don't allow destructor
+        let mut body = ManuallyDrop::new(non_null!(Box::from_raw(body) ?= ptr::null_mut()));
+        let filled = non_null!(&mut *filled ?= ptr::null_mut());
+        let dst = non_null!(buf, std::slice::from_raw_parts_mut(buf, len), ptr::null_mut());
+
+        Box::into_raw(hyper_task::boxed(async move {
+            let mut n = 0;
+            let result = loop {
+                if n == dst.len() {
+                    break Ok(());
+                }
+                let mut chunk = match body.next_data().await {
+                    Some(Ok(chunk)) => chunk,
+                    Some(Err(e)) => break Err(e),
+                    None => break Ok(()),
+                };
+                let cnt = chunk.len().min(dst.len() - n);
+                dst[n..n + cnt].copy_from_slice(&chunk.split_to(cnt));
+                n += cnt;
+                body.leftover = chunk;
+            };
+            *filled = n;
+            result
+        }))
+    } ?= ptr::null_mut()
+}
+
 ffi_fn! {
     /// Creates a task to execute the callback with each body chunk received.
     ///
@@ -151,12 +331,10 @@ ffi_fn! {
 
         Box::into_raw(hyper_task::boxed(async move {
             let _ = &userdata;
-            while let Some(item) = body.0.frame().await {
-                let frame = item?;
-                if let Ok(chunk) = frame.into_data() {
-                    if HYPER_ITER_CONTINUE != func(userdata.0, &hyper_buf(chunk)) {
-                        return Err(crate::Error::new_user_aborted_by_callback());
-                    }
+            while let Some(item) = body.next_data().await {
+                let chunk = item?;
+                if HYPER_ITER_CONTINUE != func(userdata.0, &hyper_buf(chunk)) {
+                    return Err(crate::Error::new_user_aborted_by_callback());
                 }
             }
             Ok(())
@@ -164,11 +342,29 @@ ffi_fn! {
     } ?= ptr::null_mut()
 }
 
+ffi_fn! {
+    /// Gets a reference to the trailers of this body, once they have been received.
+    ///
+    /// Trailers are sent after the data, such as the `grpc-status` of a gRPC
+    /// response. They are only known once `hyper_body_data` has given
+    /// `HYPER_TASK_EMPTY`, or `hyper_body_read_into` has filled `0` bytes.
+    /// Until then, and for bodies without trailers, this returns NULL.
+    ///
+    /// This is not an owned reference, so it should not be accessed after the
+    /// `hyper_body` has been freed.
+    fn hyper_body_trailers(body: *mut hyper_body) -> *mut hyper_headers {
+        match non_null!(&mut *body ?= ptr::null_mut()).trailers {
+            Some(ref mut trailers) => &mut **trailers,
+            None => ptr::null_mut(),
+        }
+    } ?= ptr::null_mut()
+}
+
 ffi_fn! {
     /// Set userdata on this body, which will be passed to callback functions.
     fn hyper_body_set_userdata(body: *mut hyper_body, userdata: *mut c_void) {
         let b = non_null!(&mut *body ?= ());
-        b.0.as_ffi_mut().userdata = userdata;
+        b.body.as_ffi_mut().userdata = userdata;
     }
 }
 
@@ -194,8 +390,188 @@ ffi_fn! {
     /// the body.
     fn hyper_body_set_data_func(body: *mut hyper_body, func: hyper_body_data_callback) {
         let b = non_null!{ &mut *body ?= () };
-        b.0.as_ffi_mut().data_func = func;
+        b.body.as_ffi_mut().data_func = func;
+    }
+}
+
+ffi_fn! {
+    /// Set the exact length of this body.
+    ///
+    /// A body with a known length is sent with a `content-length` instead of
+    /// chunked over HTTP/1, and HTTP/2 can end the stream with its last DATA
+    /// frame. The data callback must then provide exactly `len` bytes, or the
+    /// body fails with an error. Once it has, the callback isn't called again,
+    /// so it doesn't have to signal the end of the body, and a length of `0`
+    /// sends an empty body without calling it at all.
+    ///
+    /// Returns `HYPERE_INVALID_ARG` if the body is null, or was created with
+    /// `hyper_body_new_from_fd`, whose length is the length of its range.
+    fn hyper_body_set_length(body: *mut hyper_body, len: u64) -> hyper_code {
+        let b = non_null!(&mut *body ?= hyper_code::HYPERE_INVALID_ARG);
+        let user = b.body.as_ffi_mut();
+        match user.extra.as_deref_mut() {
+            Some(Extra::Length(remaining)) => *remaining = len,
+            None => user.extra = Some(Box::new(Extra::Length(len))),
+            #[cfg(unix)]
+            Some(Extra::File(_)) => return hyper_code::HYPERE_INVALID_ARG,
+            Some(Extra::Forward(_)) => return hyper_code::HYPERE_INVALID_ARG,
+        }
+        hyper_code::HYPERE_OK
+    }
+}
+
+impl hyper_body {
+    pub(super) fn wrap(body: IncomingBody) -> hyper_body {
+        hyper_body {
+            body,
+            leftover: Bytes::new(),
+            decoder: None,
+            trailers: None,
+            stats: None,
+        }
+    }
+
+    pub(super) fn decoded(body: IncomingBody, decoder: Decoder) -> hyper_body {
+        hyper_body {
+            decoder: Some(Box::new(decoder)),
+            ..hyper_body::wrap(body)
+        }
+    }
+
+    /// Records when the data of this body is received in `stats`.
+    pub(super) fn timed(mut self, stats: Option<RequestStats>) -> hyper_body {
+        self.stats = stats;
+        self
+    }
+
+    /// Gets the body to set on a message.
+    ///
+    /// If some of it was already read, the rest is sent on from there,
+    /// including what is left of a partly read chunk and any trailers. A
+    /// decoded body is sent decoded, since its headers no longer describe
+    /// the encoding.
+    pub(super) fn into_outgoing(self) -> IncomingBody {
+        if self.leftover.is_empty()
+            && self.decoder.is_none()
+            && self.trailers.is_none()
+            && self.stats.is_none()
+        {
+            return self.body;
+        }
+        let mut body = IncomingBody::ffi();
+        body.as_ffi_mut().extra = Some(Box::new(Extra::Forward(Box::new(self))));
+        body
+    }
+
+    /// Yields what is left of a partly read chunk, and then the data of each
+    /// following frame, decoded if the body has a decoder.
+    async fn next_data(&mut self) -> Option<crate::Result<Bytes>> {
+        futures_util::future::poll_fn(|cx| self.poll_next_data(cx)).await
+    }
+
+    fn poll_next_data(&mut self, cx: &mut Context<'_>) -> Poll<Option<crate::Result<Bytes>>> {
+        if !self.leftover.is_empty() {
+            return Poll::Ready(Some(Ok(std::mem::take(&mut self.leftover))));
+        }
+        let decoder = match self.decoder {
+            Some(ref mut decoder) => decoder,
+            None => {
+                return poll_frame_data(&mut self.body, &mut self.trailers, self.stats.as_ref(), cx)
+            }
+        };
+        loop {
+            if decoder.has_input() {
+                // The last chunk still has output left; return it first.
+                match decoder.decode_more() {
+                    Ok(out) if out.is_empty() => continue,
+                    decoded => return Poll::Ready(Some(decoded)),
+                }
+            }
+            let decoded = match ready!(poll_frame_data(
+                &mut self.body,
+                &mut self.trailers,
+                self.stats.as_ref(),
+                cx
+            )) {
+                Some(Ok(chunk)) => decoder.decode(chunk),
+                Some(Err(e)) => return Poll::Ready(Some(Err(e))),
+                None => {
+                    let rest = decoder.finish();
+                    self.decoder = None;
+                    return Poll::Ready(match rest {
+                        Ok(rest) if rest.is_empty() => None,
+                        rest => Some(rest),
+                    });
+                }
+            };
+            match decoded {
+                // Not enough input for any output yet.
+                Ok(out) if out.is_empty() => continue,
+                decoded => return Poll::Ready(Some(decoded)),
+            }
+        }
+    }
+
+    /// Polls for the next frame of a body being sent on, with its trailers
+    /// after the data.
+    fn poll_forward(&mut self, cx: &mut Context<'_>) -> Poll<Option<crate::Result<Frame<Bytes>>>> {
+        match ready!(self.poll_next_data(cx)) {
+            Some(data) => Poll::Ready(Some(data.map(Frame::data))),
+            None => Poll::Ready(
+                self.trailers
+                    .take()
+                    .map(|trailers| Ok(Frame::trailers(trailers.headers))),
+            ),
+        }
+    }
+
+    fn forward_size_hint(&self) -> SizeHint {
+        if self.decoder.is_some() {
+            return SizeHint::default();
+        }
+        let leftover = self.leftover.len() as u64;
+        let inner = self.body.size_hint();
+        let mut hint = SizeHint::new();
+        hint.set_lower(inner.lower() + leftover);
+        if let Some(upper) = inner.upper() {
+            hint.set_upper(upper + leftover);
+        }
+        hint
+    }
+}
+
+/// Polls for the data of each frame of the body, keeping the trailers aside.
+fn poll_frame_data(
+    body: &mut IncomingBody,
+    trailers: &mut Option<Box<hyper_headers>>,
+    stats: Option<&RequestStats>,
+    cx: &mut Context<'_>,
+) -> Poll<Option<crate::Result<Bytes>>> {
+    while let Some(item) = ready!(std::pin::Pin::new(&mut *body).poll_frame(cx)) {
+        let frame = match item {
+            Ok(frame) => frame,
+            Err(e) => return Poll::Ready(Some(Err(e))),
+        };
+        match frame.into_data() {
+            Ok(data) => {
+                if let Some(stats) = stats {
+                    stats.record_body_data();
+                }
+                return Poll::Ready(Some(Ok(data)));
+            }
+            Err(frame) => {
+                if let Ok(map) = frame.into_trailers() {
+                    let mut headers = hyper_headers::default();
+                    headers.headers = map;
+                    *trailers = Some(Box::new(headers));
+                }
+            }
+        }
+    }
+    if let Some(stats) = stats {
+        stats.record_body_complete();
     }
+    Poll::Ready(None)
 }
 
 // ===== impl UserBody =====
@@ -205,6 +581,41 @@ impl UserBody {
         UserBody {
             data_func: data_noop,
             userdata: std::ptr::null_mut(),
+            extra: None,
+        }
+    }
+
+    /// The part of the file a `hyper_body_new_from_fd` body has left to
+    /// send.
+    #[cfg(unix)]
+    pub(crate) fn send_file(&self) -> Option<SendFile> {
+        match self.extra.as_deref() {
+            Some(Extra::File(file)) if file.remaining > 0 => Some(SendFile {
+                fd: file.fd,
+                offset: file.offset,
+                len: file.remaining,
+            }),
+            _ => None,
+        }
+    }
+
+    pub(crate) fn is_end_stream(&self) -> bool {
+        match self.extra.as_deref() {
+            None => false,
+            Some(Extra::Length(remaining)) => *remaining == 0,
+            #[cfg(unix)]
+            Some(Extra::File(file)) => file.remaining == 0,
+            Some(Extra::Forward(_)) => false,
+        }
+    }
+
+    pub(crate) fn size_hint(&self) -> SizeHint {
+        match self.extra.as_deref() {
+            None => SizeHint::default(),
+            Some(Extra::Length(remaining)) => SizeHint::with_exact(*remaining),
+            #[cfg(unix)]
+            Some(Extra::File(file)) => SizeHint::with_exact(file.remaining),
+            Some(Extra::Forward(body)) => body.forward_size_hint(),
         }
     }
 
@@ -212,13 +623,38 @@ impl UserBody {
         &mut self,
         cx: &mut Context<'_>,
     ) -> Poll<Option<crate::Result<Frame<Bytes>>>> {
+        let remaining = match self.extra.as_deref_mut() {
+            None => None,
+            // The callback has sent all of the body's length.
+            Some(Extra::Length(0)) => return Poll::Ready(None),
+            Some(Extra::Length(remaining)) => Some(remaining),
+            #[cfg(unix)]
+            Some(Extra::File(file)) => return Poll::Ready(file.read_chunk().transpose()),
+            Some(Extra::Forward(body)) => return body.poll_forward(cx),
+        };
+
         let mut out = std::ptr::null_mut();
         match (self.data_func)(self.userdata, hyper_context::wrap(cx), &mut out) {
             super::task::HYPER_POLL_READY => {
                 if out.is_null() {
+                    if remaining.is_some() {
+                        return Poll::Ready(Some(Err(crate::Error::new_body_write(
+                            "body ended before its length",
+                        ))));
+                    }
                     Poll::Ready(None)
                 } else {
-                    let buf = unsafe { Box::from_raw(out) };
+                    let buf = hyper_buf::unbox(unsafe { Box::from_raw(out) });
+                    if let Some(remaining) = remaining {
+                        match remaining.checked_sub(buf.0.len() as u64) {
+                            Some(left) => *remaining = left,
+                            None => {
+                                return Poll::Ready(Some(Err(crate::Error::new_body_write(
+                                    "body is longer than its length",
+                                ))))
+                            }
+                        }
+                    }
                     Poll::Ready(Some(Ok(Frame::data(buf.0))))
                 }
             }
@@ -234,6 +670,51 @@ impl UserBody {
     }
 }
 
+#[cfg(unix)]
+impl FileRange {
+    fn read_chunk(&mut self) -> crate::Result<Option<Frame<Bytes>>> {
+        if self.remaining == 0 {
+            return Ok(None);
+        }
+
+        let want = self.remaining.min(FILE_CHUNK_SIZE as u64) as usize;
+        self.buf.reserve(want);
+        let dst = self.buf.chunk_mut().as_mut_ptr();
+        let read = loop {
+            let ret = unsafe {
+                libc::pread(
+                    self.fd,
+                    dst as *mut c_void,
+                    want,
+                    self.offset as libc::off_t,
+                )
+            };
+            if ret >= 0 {
+                break ret as usize;
+            }
+            let err = std::io::Error::last_os_error();
+            if err.kind() != std::io::ErrorKind::Interrupted {
+                return Err(crate::Error::new_body_write(err));
+            }
+        };
+        if read == 0 {
+            return Err(crate::Error::new_body_write(
+                "file ended before the body length",
+            ));
+        }
+
+        // Safety: pread initialized the first `read` bytes.
+        unsafe { self.buf.advance_mut(read) };
+        self.advance(read);
+        Ok(Some(Frame::data(self.buf.split().freeze())))
+    }
+
+    fn advance(&mut self, n: usize) {
+        self.offset += n as u64;
+        self.remaining -= n as u64;
+    }
+}
+
 /// cbindgen:ignore
 extern "C" fn data_noop(
     _userdata: *mut c_void,
@@ -262,7 +743,34 @@ ffi_fn! {
         let slice = unsafe {
             std::slice::from_raw_parts(buf, len)
         };
-        Box::into_raw(Box::new(hyper_buf(Bytes::copy_from_slice(slice))))
+        stats::count(Counter::BufCopies, 1);
+        stats::count(Counter::BufCopyBytes, len as u64);
+        Box::into_raw(hyper_buf::recycled(hyper_buf(Bytes::copy_from_slice(slice))))
+    } ?= ptr::null_mut()
+}
+
+ffi_fn! {
+    /// Create a new `hyper_buf *` that borrows the provided bytes without copying.
+    ///
+    /// The memory pointed to by `buf` must stay valid and unchanged until
+    /// hyper calls the `release` callback. It is passed the `userdata`, `buf`
+    /// and `len` arguments, and is called exactly once, when hyper no longer
+    /// needs the bytes: after they have been written to the transport, or
+    /// when the buffer is freed without being sent.
+    ///
+    /// The callback may be called from whichever thread drops the last
+    /// reference to the bytes, and it must not call back into hyper.
+    ///
+    /// To avoid a memory leak, the buffer must eventually be consumed by
+    /// `hyper_buf_free`, or returned from a `hyper_body_data_callback`.
+    fn hyper_buf_from_owned(buf: *const u8, len: size_t, userdata: *mut c_void, release: hyper_buf_release_callback) -> *mut hyper_buf {
+        let owned = OwnedBuf {
+            ptr: buf,
+            len,
+            userdata: UserDataPointer(userdata),
+            release,
+        };
+        Box::into_raw(hyper_buf::recycled(hyper_buf(Bytes::from_owner(owned))))
     } ?= ptr::null_mut()
 }
 
@@ -291,12 +799,328 @@ ffi_fn! {
     ///
     /// This should be used for any buffer once it is no longer needed.
     fn hyper_buf_free(buf: *mut hyper_buf) {
-        drop(unsafe { Box::from_raw(buf) });
+        hyper_buf::recycle(unsafe { Box::from_raw(buf) });
+    }
+}
+
+/// Caller-owned memory wrapped by `hyper_buf_from_owned`.
+struct OwnedBuf {
+    ptr: *const u8,
+    len: size_t,
+    userdata: UserDataPointer,
+    release: hyper_buf_release_callback,
+}
+
+impl AsRef<[u8]> for OwnedBuf {
+    fn as_ref(&self) -> &[u8] {
+        if self.len == 0 {
+            return &[];
+        }
+        unsafe { std::slice::from_raw_parts(self.ptr, self.len) }
+    }
+}
+
+impl Drop for OwnedBuf {
+    fn drop(&mut self) {
+        (self.release)(self.userdata.0, self.ptr, self.len);
     }
 }
 
+// The user promised the memory stays valid until `release` is called.
+unsafe impl Send for OwnedBuf {}
+
 unsafe impl AsTaskType for hyper_buf {
     fn as_task_type(&self) -> hyper_task_return_type {
         hyper_task_return_type::HYPER_TASK_BUF
     }
 }
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use crate::ffi::{
+        hyper_executor_free, hyper_executor_new, hyper_executor_poll, hyper_executor_push,
+        hyper_task_free, hyper_task_type,
+    };
+    use std::sync::atomic::{AtomicUsize, Ordering};
+
+    #[test]
+    fn test_buf_from_owned_releases_once() {
+        static RELEASED: AtomicUsize = AtomicUsize::new(0);
+
+        extern "C" fn release(userdata: *mut c_void, buf: *const u8, len: size_t) {
+            assert_eq!(userdata as usize, 42);
+            assert_eq!(unsafe { std::slice::from_raw_parts(buf, len) }, b"hello");
+            RELEASED.fetch_add(1, Ordering::SeqCst);
+        }
+
+        let data = b"hello";
+        let buf = hyper_buf_from_owned(data.as_ptr(), data.len(), 42 as *mut c_void, release);
+        assert_eq!(hyper_buf_bytes(buf), data.as_ptr());
+        assert_eq!(hyper_buf_len(buf), data.len());
+
+        // A clone held by hyper keeps the bytes alive.
+        let clone = unsafe { (*buf).0.clone() };
+        hyper_buf_free(buf);
+        assert_eq!(RELEASED.load(Ordering::SeqCst), 0);
+
+        drop(clone);
+        assert_eq!(RELEASED.load(Ordering::SeqCst), 1);
+    }
+
+    #[test]
+    fn test_body_read_into_fills_buffer() {
+        let (mut tx, incoming) = IncomingBody::channel();
+        tx.try_send_data("hello world".into()).expect("send");
+        drop(tx);
+
+        let body = Box::into_raw(Box::new(hyper_body::wrap(incoming)));
+        let exec = hyper_executor_new();
+        let mut read = |buf: &mut [u8]| {
+            let mut filled = usize::MAX;
+            let task = hyper_body_read_into(body, buf.as_mut_ptr(), buf.len(), &mut filled);
+            hyper_executor_push(exec, task);
+            let task = hyper_executor_poll(exec);
+            assert!(matches!(
+                hyper_task_type(task),
+                hyper_task_return_type::HYPER_TASK_EMPTY
+            ));
+            hyper_task_free(task);
+            filled
+        };
+
+        // A chunk bigger than the buffer is split across reads.
+        let mut buf = [0; 4];
+        assert_eq!(read(&mut buf), 4);
+        assert_eq!(&buf, b"hell");
+        assert_eq!(read(&mut buf), 4);
+        assert_eq!(&buf, b"o wo");
+        assert_eq!(read(&mut buf), 3);
+        assert_eq!(&buf[..3], b"rld");
+        assert_eq!(read(&mut buf), 0);
+
+        // Filling nothing would look like the end of the body.
+        let mut filled = 0;
+        assert!(hyper_body_read_into(body, buf.as_mut_ptr(), 0, &mut filled).is_null());
+
+        hyper_body_free(body);
+        hyper_executor_free(exec);
+    }
+
+    #[test]
+    fn test_body_set_after_read_sends_the_rest() {
+        use crate::ffi::{hyper_request_free, hyper_request_new, hyper_request_set_body};
+        use http_body::Body as _;
+
+        let (mut tx, incoming) = IncomingBody::channel();
+        tx.try_send_data("hello world".into()).expect("send");
+        let mut trailers = http::HeaderMap::new();
+        trailers.insert("grpc-status", http::HeaderValue::from_static("0"));
+        tx.try_send_trailers(trailers).expect("send trailers");
+        drop(tx);
+
+        // Read the start of the body, leaving the rest of the chunk.
+        let body = Box::into_raw(Box::new(hyper_body::wrap(incoming)));
+        let exec = hyper_executor_new();
+        let mut buf = [0; 4];
+        let mut filled = 0;
+        let task = hyper_body_read_into(body, buf.as_mut_ptr(), buf.len(), &mut filled);
+        hyper_executor_push(exec, task);
+        hyper_task_free(hyper_executor_poll(exec));
+        assert_eq!(&buf[..filled], b"hell");
+        hyper_executor_free(exec);
+
+        let req = hyper_request_new();
+        assert!(matches!(
+            hyper_request_set_body(req, body),
+            hyper_code::HYPERE_OK
+        ));
+
+        let outgoing = unsafe { (*req).0.body_mut() };
+        let mut cx = Context::from_waker(futures_util::task::noop_waker_ref());
+        let mut next = || match std::pin::Pin::new(&mut *outgoing).poll_frame(&mut cx) {
+            Poll::Ready(frame) => frame.map(|frame| frame.expect("frame")),
+            Poll::Pending => panic!("body not ready"),
+        };
+        assert_eq!(next().and_then(|f| f.into_data().ok()).unwrap(), "o world");
+        let trailers = next().and_then(|f| f.into_trailers().ok()).unwrap();
+        assert_eq!(trailers["grpc-status"], "0");
+        assert!(next().is_none());
+
+        hyper_request_free(req);
+    }
+
+    #[cfg(feature = "ffi-decompression")]
+    #[test]
+    fn test_body_set_decoded_sends_decoded() {
+        use crate::ffi::{hyper_request_free, hyper_request_new, hyper_request_set_body};
+        use flate2::write::GzEncoder;
+        use http_body::Body as _;
+        use std::io::Write;
+
+        let mut gz = GzEncoder::new(Vec::new(), flate2::Compression::default());
+        gz.write_all(b"hello world").unwrap();
+        let (mut tx, incoming) = IncomingBody::channel();
+        tx.try_send_data(gz.finish().unwrap().into()).expect("send");
+        drop(tx);
+
+        let decoder = Decoder::for_encoding(b"gzip").unwrap();
+        let body = Box::into_raw(Box::new(hyper_body::decoded(incoming, decoder)));
+        let req = hyper_request_new();
+        assert!(matches!(
+            hyper_request_set_body(req, body),
+            hyper_code::HYPERE_OK
+        ));
+
+        let outgoing = unsafe { (*req).0.body_mut() };
+        let mut cx = Context::from_waker(futures_util::task::noop_waker_ref());
+        let mut data = Vec::new();
+        while let Poll::Ready(Some(frame)) = std::pin::Pin::new(&mut *outgoing).poll_frame(&mut cx)
+        {
+            data.extend_from_slice(&frame.expect("frame").into_data().unwrap());
+        }
+        assert_eq!(data, b"hello world");
+
+        hyper_request_free(req);
+    }
+
+    #[test]
+    fn test_body_set_length() {
+        use http_body::Body as _;
+
+        extern "C" fn hello(
+            userdata: *mut c_void,
+            _: *mut hyper_context<'_>,
+            chunk: *mut *mut hyper_buf,
+        ) -> c_int {
+            let calls = unsafe { &mut *(userdata as *mut usize) };
+            *calls += 1;
+            let data = if *calls == 1 { &b"hello"[..] } else { &b""[..] };
+            unsafe { *chunk = hyper_buf_copy(data.as_ptr(), data.len()) };
+            crate::ffi::HYPER_POLL_READY
+        }
+
+        let exec = hyper_executor_new();
+        let mut read = |len: u64, calls: &mut usize| {
+            let body = hyper_body_new();
+            hyper_body_set_userdata(body, calls as *mut usize as *mut c_void);
+            hyper_body_set_data_func(body, hello);
+            assert!(matches!(
+                hyper_body_set_length(body, len),
+                hyper_code::HYPERE_OK
+            ));
+            assert_eq!(unsafe { &(*body).body }.size_hint().exact(), Some(len));
+
+            let mut buf = [0; 16];
+            let mut filled = 0;
+            let task = hyper_body_read_into(body, buf.as_mut_ptr(), buf.len(), &mut filled);
+            hyper_executor_push(exec, task);
+            let task = hyper_executor_poll(exec);
+            let ok = matches!(
+                hyper_task_type(task),
+                hyper_task_return_type::HYPER_TASK_EMPTY
+            );
+            hyper_task_free(task);
+            let end = unsafe { &(*body).body }.is_end_stream();
+            hyper_body_free(body);
+            (ok, filled, end)
+        };
+
+        // The callback isn't asked for more once the length has been sent.
+        let mut calls = 0;
+        assert_eq!(read(5, &mut calls), (true, 5, true));
+        assert_eq!(calls, 1);
+
+        // Nor at all for an empty body.
+        let mut calls = 0;
+        assert_eq!(read(0, &mut calls), (true, 0, true));
+        assert_eq!(calls, 0);
+
+        // A chunk past the length fails the body.
+        let mut calls = 0;
+        assert!(!read(3, &mut calls).0);
+
+        hyper_executor_free(exec);
+    }
+
+    #[cfg(unix)]
+    #[test]
+    fn test_body_from_fd_reads_range() {
+        use http_body::Body as _;
+        use std::io::Write as _;
+        use std::os::unix::io::AsRawFd;
+
+        let path = std::env::temp_dir().join(format!("hyper-ffi-body-{}", std::process::id()));
+        let mut file = std::fs::File::create(&path).expect("create");
+        file.write_all(b"hello world").expect("write");
+        let file = std::fs::File::open(&path).expect("open");
+        std::fs::remove_file(&path).expect("remove");
+
+        let body = hyper_body_new_from_fd(file.as_raw_fd(), 2, 7);
+        assert_eq!(unsafe { &(*body).body }.size_hint().exact(), Some(7));
+
+        let exec = hyper_executor_new();
+        let mut buf = [0; 16];
+        let mut filled = 0;
+        let task = hyper_body_read_into(body, buf.as_mut_ptr(), buf.len(), &mut filled);
+        hyper_executor_push(exec, task);
+        let task = hyper_executor_poll(exec);
+        assert!(matches!(
+            hyper_task_type(task),
+            hyper_task_return_type::HYPER_TASK_EMPTY
+        ));
+        hyper_task_free(task);
+        assert_eq!(&buf[..filled], b"llo wor");
+        assert!(unsafe { &(*body).body }.is_end_stream());
+
+        // A range past the end of the file fails.
+        let short = hyper_body_new_from_fd(file.as_raw_fd(), 8, 7);
+        let task = hyper_body_read_into(short, buf.as_mut_ptr(), buf.len(), &mut filled);
+        hyper_executor_push(exec, task);
+        let task = hyper_executor_poll(exec);
+        assert!(matches!(
+            hyper_task_type(task),
+            hyper_task_return_type::HYPER_TASK_ERROR
+        ));
+        hyper_task_free(task);
+        assert_eq!(&buf[..filled], b"rld");
+
+        assert!(hyper_body_new_from_fd(file.as_raw_fd(), u64::MAX, 1).is_null());
+
+        hyper_body_free(short);
+        hyper_body_free(body);
+        hyper_executor_free(exec);
+    }
+
+    #[cfg(unix)]
+    #[test]
+    fn test_body_from_fd_reuses_its_buffer() {
+        use std::io::Write as _;
+        use std::os::unix::io::AsRawFd;
+
+        let path = std::env::temp_dir().join(format!("hyper-ffi-body-buf-{}", std::process::id()));
+        let mut file = std::fs::File::create(&path).expect("create");
+        file.write_all(&[7; 2 * FILE_CHUNK_SIZE]).expect("write");
+        let file = std::fs::File::open(&path).expect("open");
+        std::fs::remove_file(&path).expect("remove");
+
+        let body = hyper_body_new_from_fd(file.as_raw_fd(), 0, 2 * FILE_CHUNK_SIZE as u64);
+        let mut cx = Context::from_waker(futures_util::task::noop_waker_ref());
+        let mut next = || match unsafe { &mut (*body).body }.as_ffi_mut().poll_data(&mut cx) {
+            Poll::Ready(Some(Ok(frame))) => frame.into_data().unwrap(),
+            _ => panic!("no chunk"),
+        };
+
+        // Once the first chunk is dropped, the second is read into its memory.
+        let first = next();
+        assert_eq!(first.len(), FILE_CHUNK_SIZE);
+        let first_ptr = first.as_ptr();
+        drop(first);
+        let second = next();
+        assert_eq!(second.len(), FILE_CHUNK_SIZE);
+        assert_eq!(second.as_ptr(), first_ptr);
+        drop(second);
+
+        hyper_body_free(body);
+    }
+}
@@ -1,14 +1,18 @@
+use std::future::Future;
 use std::ptr;
 use std::sync::Arc;
+use std::time::Instant;
 
-use libc::c_int;
+use libc::{c_int, size_t};
 
 use crate::client::conn;
 use crate::rt::Executor as _;
 
 use super::error::hyper_code;
-use super::http_types::{hyper_request, hyper_response};
+use super::http_types::{hyper_request, hyper_response, HeaderTemplate};
 use super::io::hyper_io;
+use super::recycle::Recycle;
+use super::stats::{hyper_conn_stats, ConnStats, RequestStats};
 use super::task::{hyper_executor, hyper_task, hyper_task_return_type, AsTaskType, WeakExec};
 
 /// An options builder to configure an HTTP client connection.
@@ -18,15 +22,43 @@ use super::task::{hyper_executor, hyper_task, hyper_task_return_type, AsTaskType
 /// - hyper_clientconn_options_new:     Creates a new set of HTTP clientconn options to be used in a handshake.
 /// - hyper_clientconn_options_exec:    Set the client background task executor.
 /// - hyper_clientconn_options_http2:   Set whether to use HTTP2.
+/// - hyper_clientconn_options_http2_initial_stream_window_size:     Set the HTTP/2 stream-level flow control window.
+/// - hyper_clientconn_options_http2_initial_connection_window_size: Set the HTTP/2 connection-level flow control window.
+/// - hyper_clientconn_options_http2_adaptive_window:               Set whether HTTP/2 flow control windows adapt to the connection.
+/// - hyper_clientconn_options_http2_max_frame_size:                Set the largest HTTP/2 frame the peer may send.
+/// - hyper_clientconn_options_http2_initial_max_send_streams:      Set the initial limit of concurrent HTTP/2 streams.
+/// - hyper_clientconn_options_http2_max_header_list_size:          Set the largest HTTP/2 header list accepted.
+/// - hyper_clientconn_options_http2_max_send_buf_size:             Set the HTTP/2 write buffer size of each stream.
+/// - hyper_clientconn_options_http2_max_concurrent_reset_streams:  Set the most locally reset HTTP/2 streams tracked at once.
 /// - hyper_clientconn_options_set_preserve_header_case:  Set whether header case is preserved.
 /// - hyper_clientconn_options_set_preserve_header_order: Set whether header order is preserved.
 /// - hyper_clientconn_options_http1_allow_multiline_headers: Set whether HTTP/1 connections accept obsolete line folding for header values.
+/// - hyper_clientconn_options_http1_pipeline_depth: Set how many HTTP/1 requests may be in flight at once.
+/// - hyper_clientconn_options_http1_max_headers: Set the most headers an HTTP/1 response may have.
+/// - hyper_clientconn_options_http1_read_buf_exact_size: Set an exact size for the HTTP/1 read buffer.
+/// - hyper_clientconn_options_http1_max_buf_size: Set the largest the HTTP/1 buffers may grow.
+/// - hyper_clientconn_options_http1_writev: Set whether HTTP/1 writes queue buffers or flatten them.
+/// - hyper_clientconn_options_http1_release_idle_buffers: Set whether idle HTTP/1 connections free their buffers.
 /// - hyper_clientconn_options_free:    Free a set of HTTP clientconn options.
 pub struct hyper_clientconn_options {
     http1_allow_obsolete_multiline_headers_in_responses: bool,
     http1_preserve_header_case: bool,
     http1_preserve_header_order: bool,
+    http1_pipeline_depth: usize,
+    http1_max_headers: Option<usize>,
+    http1_read_buf_exact_size: Option<usize>,
+    http1_max_buf_size: Option<usize>,
+    http1_writev: Option<bool>,
+    http1_release_idle_buffers: bool,
     http2: bool,
+    http2_initial_stream_window_size: Option<u32>,
+    http2_initial_connection_window_size: Option<u32>,
+    http2_adaptive_window: bool,
+    http2_max_frame_size: Option<u32>,
+    http2_initial_max_send_streams: Option<usize>,
+    http2_max_header_list_size: Option<u32>,
+    http2_max_send_buf_size: Option<usize>,
+    http2_max_concurrent_reset_streams: Option<usize>,
     /// Use a `Weak` to prevent cycles.
     exec: WeakExec,
 }
@@ -68,12 +100,33 @@ pub struct hyper_clientconn_options {
 ///
 /// - hyper_clientconn_handshake:  Creates an HTTP client handshake task.
 /// - hyper_clientconn_send:       Creates a task to send a request on the client connection.
+/// - hyper_clientconn_send_batch: Creates a task for each of several requests sent at once.
+/// - hyper_clientconn_stats:      Copy the counters of the connection's activity so far.
+/// - hyper_clientconn_state:      Get whether the connection can take another request.
 /// - hyper_clientconn_free:       Free a hyper_clientconn *.
 pub struct hyper_clientconn {
-    tx: Tx,
+    pub(super) tx: Tx,
+    stats: Arc<ConnStats>,
+    /// How many requests an HTTP/1 batch may have.
+    http1_pipeline_depth: usize,
 }
 
-enum Tx {
+/// The state of a client connection, from `hyper_clientconn_state`.
+#[repr(C)]
+pub enum hyper_conn_state {
+    /// The connection can take another request now.
+    HYPER_CONN_READY,
+    /// The connection is open, but can't take another request until the
+    /// ones in flight have made progress.
+    HYPER_CONN_BUSY,
+    /// The connection will close once the current response has been
+    /// received, and won't take another request.
+    HYPER_CONN_CLOSING,
+    /// The connection has closed.
+    HYPER_CONN_CLOSED,
+}
+
+pub(super) enum Tx {
     #[cfg(feature = "http1")]
     Http1(conn::http1::SendRequest<crate::body::Incoming>),
     #[cfg(feature = "http2")]
@@ -96,35 +149,85 @@ ffi_fn! {
     /// without subsequently being given back by `hyper_executor_poll`.
     fn hyper_clientconn_handshake(io: *mut hyper_io, options: *mut hyper_clientconn_options) -> *mut hyper_task {
         let options = non_null! { Box::from_raw(options) ?= ptr::null_mut() };
-        let io = non_null! { Box::from_raw(io) ?= ptr::null_mut() };
+        let mut io = non_null! { Box::from_raw(io) ?= ptr::null_mut() };
+
+        let started = Instant::now();
+        let stats = Arc::new(ConnStats::default());
+        io.set_stats(stats.clone());
 
         Box::into_raw(hyper_task::boxed(async move {
             #[cfg(feature = "http2")]
             {
             if options.http2 {
-                return conn::http2::Builder::new(options.exec.clone())
+                let mut builder = conn::http2::Builder::new(options.exec.clone());
+                builder
+                    .initial_stream_window_size(options.http2_initial_stream_window_size)
+                    .initial_connection_window_size(options.http2_initial_connection_window_size)
+                    .max_frame_size(options.http2_max_frame_size)
+                    .initial_max_send_streams(options.http2_initial_max_send_streams);
+                if options.http2_adaptive_window {
+                    builder.adaptive_window(true);
+                }
+                if let Some(max) = options.http2_max_header_list_size {
+                    builder.max_header_list_size(max);
+                }
+                if let Some(max) = options.http2_max_send_buf_size {
+                    builder.max_send_buf_size(max);
+                }
+                if let Some(max) = options.http2_max_concurrent_reset_streams {
+                    builder.max_concurrent_reset_streams(max);
+                }
+                return builder
                     .handshake::<_, crate::body::Incoming>(io)
                     .await
                     .map(|(tx, conn)| {
                         options.exec.execute(Box::pin(async move {
                             let _ = conn.await;
                         }));
-                        hyper_clientconn { tx: Tx::Http2(tx) }
+                        stats.record_handshake(started);
+                        hyper_clientconn {
+                            tx: Tx::Http2(tx),
+                            stats,
+                            http1_pipeline_depth: 1,
+                        }
                     });
                 }
             }
 
-            conn::http1::Builder::new()
+            let mut builder = conn::http1::Builder::new();
+            builder
                 .allow_obsolete_multiline_headers_in_responses(options.http1_allow_obsolete_multiline_headers_in_responses)
                 .preserve_header_case(options.http1_preserve_header_case)
                 .preserve_header_order(options.http1_preserve_header_order)
+                .pipeline_depth(options.http1_pipeline_depth)
+                .release_idle_buffers(options.http1_release_idle_buffers)
+                .stats(stats.clone());
+            if let Some(max) = options.http1_max_headers {
+                builder.max_headers(max);
+            }
+            if let Some(sz) = options.http1_read_buf_exact_size {
+                builder.read_buf_exact_size(Some(sz));
+            }
+            if let Some(max) = options.http1_max_buf_size {
+                builder.max_buf_size(max);
+            }
+            if let Some(writev) = options.http1_writev {
+                builder.writev(writev);
+            }
+            builder
                 .handshake::<_, crate::body::Incoming>(io)
                 .await
-                .map(|(tx, conn)| {
+                .map(|(tx, mut conn)| {
+                    conn.set_ffi_transport(hyper_io::ffi_transport);
                     options.exec.execute(Box::pin(async move {
                         let _ = conn.await;
                     }));
-                    hyper_clientconn { tx: Tx::Http1(tx) }
+                    stats.record_handshake(started);
+                    hyper_clientconn {
+                        tx: Tx::Http1(tx),
+                        stats,
+                        http1_pipeline_depth: options.http1_pipeline_depth,
+                    }
                 })
         }))
     } ?= std::ptr::null_mut()
@@ -143,22 +246,121 @@ ffi_fn! {
     /// `hyper_task_free`, or taken ownership of by `hyper_executor_push`
     /// without subsequently being given back by `hyper_executor_poll`.
     fn hyper_clientconn_send(conn: *mut hyper_clientconn, req: *mut hyper_request) -> *mut hyper_task {
-        let mut req = non_null! { Box::from_raw(req) ?= ptr::null_mut() };
+        let req = hyper_request::unbox(non_null! { Box::from_raw(req) ?= ptr::null_mut() });
+        let conn = non_null! { &mut *conn ?= ptr::null_mut() };
+        conn.stats.record_request();
+        let fut = conn.tx.send_request(req);
+        Box::into_raw(hyper_task::boxed(fut))
+    } ?= std::ptr::null_mut()
+}
+
+ffi_fn! {
+    /// Creates a task for each of several requests sent at once.
+    ///
+    /// All `len` requests in `reqs` are queued on the connection in a single
+    /// call, and a task for each response is written to the same index of
+    /// `tasks`, which must have room for `len` tasks. Each task yields a
+    /// `hyper_response *` when ready, as with `hyper_clientconn_send`, so the
+    /// responses can be handled as they arrive.
+    ///
+    /// On HTTP/2, requests queued together are opened on the connection the
+    /// next time it is polled, so their HEADERS frames are usually written to
+    /// the transport together.
+    ///
+    /// On HTTP/1, the requests are pipelined in order, without waiting for
+    /// the connection to be polled between them, so a batch may have at most
+    /// as many requests as `hyper_clientconn_options_http1_pipeline_depth`
+    /// allows in flight. The first is sent as with `hyper_clientconn_send`,
+    /// and if the connection isn't ready for it, every task of the batch
+    /// fails.
+    ///
+    /// This consumes every request. Returns `HYPERE_INVALID_ARG` without
+    /// consuming any of them if a pointer is null, or if an HTTP/1 batch is
+    /// larger than the pipeline depth.
+    ///
+    /// To avoid a memory leak, each task must eventually be consumed by
+    /// `hyper_task_free`, or taken ownership of by `hyper_executor_push`
+    /// without subsequently being given back by `hyper_executor_poll`.
+    fn hyper_clientconn_send_batch(conn: *mut hyper_clientconn, reqs: *const *mut hyper_request, len: size_t, tasks: *mut *mut hyper_task) -> hyper_code {
+        let conn = non_null! { &mut *conn ?= hyper_code::HYPERE_INVALID_ARG };
+        if matches!(conn.tx, Tx::Http1(_)) && len > conn.http1_pipeline_depth {
+            return hyper_code::HYPERE_INVALID_ARG;
+        }
+        if len == 0 {
+            return hyper_code::HYPERE_OK;
+        }
+        if reqs.is_null() || tasks.is_null() {
+            return hyper_code::HYPERE_INVALID_ARG;
+        }
 
-        // Update request with original-case map of headers
-        req.finalize_request();
+        let reqs = unsafe { std::slice::from_raw_parts(reqs, len) };
+        if reqs.iter().any(|req| req.is_null()) {
+            return hyper_code::HYPERE_INVALID_ARG;
+        }
+        let tasks = unsafe { std::slice::from_raw_parts_mut(tasks, len) };
 
-        let fut = match non_null! { &mut *conn ?= ptr::null_mut() }.tx {
-            Tx::Http1(ref mut tx) => futures_util::future::Either::Left(tx.send_request(req.0)),
-            Tx::Http2(ref mut tx) => futures_util::future::Either::Right(tx.send_request(req.0)),
-        };
+        let reqs = reqs.iter().map(|&req| {
+            conn.stats.record_request();
+            hyper_request::unbox(unsafe { Box::from_raw(req) })
+        });
+        for (sent, task) in conn.tx.send_batch(reqs).into_iter().zip(tasks) {
+            *task = Box::into_raw(sent);
+        }
+        hyper_code::HYPERE_OK
+    }
+}
 
-        let fut = async move {
-            fut.await.map(hyper_response::wrap)
-        };
+ffi_fn! {
+    /// Copy the counters of the connection's activity so far into `stats`.
+    ///
+    /// This includes how long the handshake took, how many requests were
+    /// sent, and how many reads and writes of the transport it took, along
+    /// with the bytes they moved. For HTTP/1 connections, it also counts how
+    /// often the connection's buffers had to grow, which suggests a larger
+    /// initial buffer would help.
+    ///
+    /// The timings of individual requests are available from their responses,
+    /// with `hyper_response_timings`.
+    ///
+    /// Returns `HYPERE_INVALID_ARG` if either pointer is null.
+    fn hyper_clientconn_stats(conn: *const hyper_clientconn, stats: *mut hyper_conn_stats) -> hyper_code {
+        let conn = non_null! { &*conn ?= hyper_code::HYPERE_INVALID_ARG };
+        let stats = non_null! { &mut *stats ?= hyper_code::HYPERE_INVALID_ARG };
+        *stats = conn.stats.snapshot();
+        hyper_code::HYPERE_OK
+    }
+}
 
-        Box::into_raw(hyper_task::boxed(fut))
-    } ?= std::ptr::null_mut()
+ffi_fn! {
+    /// Get whether the connection can take another request.
+    ///
+    /// This only checks the connection's state, so it is cheap enough to call
+    /// before every request, and doesn't need a task.
+    ///
+    /// A new HTTP/1 connection is `HYPER_CONN_BUSY` until the executor has
+    /// polled it once after the handshake, though it can already be sent its
+    /// first request.
+    ///
+    /// An HTTP/1 connection is `HYPER_CONN_CLOSING` as soon as a response
+    /// head says it won't be kept alive, such as with `connection: close`,
+    /// so a pool can start connecting a replacement while the body is still
+    /// being read. An HTTP/2 connection is `HYPER_CONN_CLOSED` once it has
+    /// shut down, such as after a `GOAWAY` from the server and the streams
+    /// it allowed to finish have finished.
+    ///
+    /// Returns `HYPER_CONN_CLOSED` if the pointer is null.
+    fn hyper_clientconn_state(conn: *const hyper_clientconn) -> hyper_conn_state {
+        let conn = non_null! { &*conn ?= hyper_conn_state::HYPER_CONN_CLOSED };
+        if conn.tx.is_closed() {
+            hyper_conn_state::HYPER_CONN_CLOSED
+        } else if conn.stats.is_closing() {
+            hyper_conn_state::HYPER_CONN_CLOSING
+        } else if conn.tx.is_ready() {
+            hyper_conn_state::HYPER_CONN_READY
+        } else {
+            hyper_conn_state::HYPER_CONN_BUSY
+        }
+    } ?= hyper_conn_state::HYPER_CONN_CLOSED
 }
 
 ffi_fn! {
@@ -170,6 +372,105 @@ ffi_fn! {
     }
 }
 
+impl Tx {
+    pub(super) fn send_request(
+        &mut self,
+        mut req: hyper_request,
+    ) -> impl Future<Output = crate::Result<hyper_response>> {
+        let stats = start_request(&mut req);
+        let fut = match *self {
+            Tx::Http1(ref mut tx) => futures_util::future::Either::Left(tx.send_request(req.0)),
+            Tx::Http2(ref mut tx) => {
+                // There's no message head to copy the template into, so its
+                // headers join the request's own.
+                if let Some(template) = req.0.extensions_mut().remove::<HeaderTemplate>() {
+                    template.append_to(req.0.headers_mut());
+                }
+                futures_util::future::Either::Right(tx.send_request(req.0))
+            }
+        };
+
+        with_stats(fut, stats)
+    }
+
+    /// Sends several requests at once, returning a task for each response.
+    ///
+    /// HTTP/1 requests are pipelined behind the first.
+    pub(super) fn send_batch<I>(&mut self, reqs: I) -> Vec<Box<hyper_task>>
+    where
+        I: IntoIterator<Item = hyper_request>,
+    {
+        match *self {
+            Tx::Http1(ref mut tx) => {
+                let mut stats = Vec::new();
+                let reqs = reqs
+                    .into_iter()
+                    .map(|mut req| {
+                        stats.push(start_request(&mut req));
+                        req.0
+                    })
+                    .collect::<Vec<_>>();
+                tx.send_pipelined(reqs)
+                    .into_iter()
+                    .zip(stats)
+                    .map(|(fut, stats)| hyper_task::boxed(with_stats(fut, stats)))
+                    .collect()
+            }
+            Tx::Http2(_) => reqs
+                .into_iter()
+                .map(|req| hyper_task::boxed(self.send_request(req)))
+                .collect(),
+        }
+    }
+
+    pub(super) fn is_ready(&self) -> bool {
+        match *self {
+            Tx::Http1(ref tx) => tx.is_ready(),
+            Tx::Http2(ref tx) => tx.is_ready(),
+        }
+    }
+
+    pub(super) fn is_closed(&self) -> bool {
+        match *self {
+            Tx::Http1(ref tx) => tx.is_closed(),
+            Tx::Http2(ref tx) => tx.is_closed(),
+        }
+    }
+
+    /// Returns another handle to the same connection, if it can be shared
+    /// between requests in flight (HTTP/2).
+    pub(super) fn try_clone(&self) -> Option<Tx> {
+        match *self {
+            Tx::Http1(_) => None,
+            Tx::Http2(ref tx) => Some(Tx::Http2(tx.clone())),
+        }
+    }
+}
+
+/// Readies a request to be sent, returning the timings it will record.
+fn start_request(req: &mut hyper_request) -> RequestStats {
+    // Update request with original-case map of headers
+    req.finalize_request();
+
+    let stats = RequestStats::new();
+    req.0.extensions_mut().insert(stats.clone());
+    stats
+}
+
+fn with_stats<F>(fut: F, stats: RequestStats) -> impl Future<Output = crate::Result<hyper_response>>
+where
+    F: Future<Output = crate::Result<crate::Response<crate::body::Incoming>>>,
+{
+    async move {
+        fut.await.map(|mut res| {
+            // The connection has recorded when the head was received, and
+            // the `hyper_body` of an HTTP/2 response times its data.
+            res.extensions_mut().insert(stats);
+            hyper_response::wrap(res)
+        })
+    }
+}
+
 unsafe impl AsTaskType for hyper_clientconn {
     fn as_task_type(&self) -> hyper_task_return_type {
         hyper_task_return_type::HYPER_TASK_CLIENTCONN
@@ -188,7 +489,21 @@ ffi_fn! {
             http1_allow_obsolete_multiline_headers_in_responses: false,
             http1_preserve_header_case: false,
             http1_preserve_header_order: false,
+            http1_pipeline_depth: 1,
+            http1_max_headers: None,
+            http1_read_buf_exact_size: None,
+            http1_max_buf_size: None,
+            http1_writev: None,
+            http1_release_idle_buffers: false,
             http2: false,
+            http2_initial_stream_window_size: None,
+            http2_initial_connection_window_size: None,
+            http2_adaptive_window: false,
+            http2_max_frame_size: None,
+            http2_initial_max_send_streams: None,
+            http2_max_header_list_size: None,
+            http2_max_send_buf_size: None,
+            http2_max_concurrent_reset_streams: None,
             exec: WeakExec::new(),
         }))
     } ?= std::ptr::null_mut()
@@ -260,6 +575,122 @@ ffi_fn! {
     }
 }
 
+ffi_fn! {
+    /// Set the HTTP/2 stream-level flow control window.
+    ///
+    /// This is the `SETTINGS_INITIAL_WINDOW_SIZE` sent to the server, and
+    /// limits how many bytes of each response body it may send before hyper
+    /// has to grant more. Raise it on links with a high bandwidth-delay
+    /// product. It cannot be larger than `2^31 - 1`.
+    ///
+    /// Setting this turns off the adaptive window.
+    fn hyper_clientconn_options_http2_initial_stream_window_size(opts: *mut hyper_clientconn_options, size: u32) -> hyper_code {
+        if size > MAX_WINDOW_SIZE {
+            return hyper_code::HYPERE_INVALID_ARG;
+        }
+        set_http2_option(opts, |opts| {
+            opts.http2_initial_stream_window_size = Some(size);
+            opts.http2_adaptive_window = false;
+        })
+    }
+}
+
+ffi_fn! {
+    /// Set the HTTP/2 connection-level flow control window.
+    ///
+    /// This limits how many bytes the server may send, across all streams,
+    /// before hyper has to grant more. It cannot be larger than `2^31 - 1`.
+    ///
+    /// Setting this turns off the adaptive window.
+    fn hyper_clientconn_options_http2_initial_connection_window_size(opts: *mut hyper_clientconn_options, size: u32) -> hyper_code {
+        if size > MAX_WINDOW_SIZE {
+            return hyper_code::HYPERE_INVALID_ARG;
+        }
+        set_http2_option(opts, |opts| {
+            opts.http2_initial_connection_window_size = Some(size);
+            opts.http2_adaptive_window = false;
+        })
+    }
+}
+
+ffi_fn! {
+    /// Set whether HTTP/2 flow control windows adapt to the connection.
+    ///
+    /// When enabled, hyper estimates the bandwidth-delay product from ping
+    /// round trips and grows both windows to match, overriding any window
+    /// sizes set before.
+    ///
+    /// Pass `0` to disable (default), `1` to enable.
+    fn hyper_clientconn_options_http2_adaptive_window(opts: *mut hyper_clientconn_options, enabled: c_int) -> hyper_code {
+        set_http2_option(opts, |opts| {
+            opts.http2_adaptive_window = enabled != 0;
+        })
+    }
+}
+
+ffi_fn! {
+    /// Set the largest HTTP/2 frame the peer may send.
+    ///
+    /// The size must be between `16384` and `16777215`, inclusive.
+    fn hyper_clientconn_options_http2_max_frame_size(opts: *mut hyper_clientconn_options, size: u32) -> hyper_code {
+        if !(MIN_FRAME_SIZE..=MAX_FRAME_SIZE).contains(&size) {
+            return hyper_code::HYPERE_INVALID_ARG;
+        }
+        set_http2_option(opts, |opts| {
+            opts.http2_max_frame_size = Some(size);
+        })
+    }
+}
+
+ffi_fn! {
+    /// Set the initial limit of concurrent HTTP/2 streams.
+    ///
+    /// This is how many requests may be in flight before the server's
+    /// `SETTINGS_MAX_CONCURRENT_STREAMS` is known. The server's setting
+    /// replaces it once received.
+    fn hyper_clientconn_options_http2_initial_max_send_streams(opts: *mut hyper_clientconn_options, max: size_t) -> hyper_code {
+        set_http2_option(opts, |opts| {
+            opts.http2_initial_max_send_streams = Some(max);
+        })
+    }
+}
+
+ffi_fn! {
+    /// Set the largest HTTP/2 header list accepted.
+    ///
+    /// Responses with larger headers are refused. Default is currently 16KB.
+    fn hyper_clientconn_options_http2_max_header_list_size(opts: *mut hyper_clientconn_options, max: u32) -> hyper_code {
+        set_http2_option(opts, |opts| {
+            opts.http2_max_header_list_size = Some(max);
+        })
+    }
+}
+
+ffi_fn! {
+    /// Set the HTTP/2 write buffer size of each stream.
+    ///
+    /// Default is currently 1MB. It cannot be larger than `UINT32_MAX`.
+    fn hyper_clientconn_options_http2_max_send_buf_size(opts: *mut hyper_clientconn_options, max: size_t) -> hyper_code {
+        if max > u32::MAX as size_t {
+            return hyper_code::HYPERE_INVALID_ARG;
+        }
+        set_http2_option(opts, |opts| {
+            opts.http2_max_send_buf_size = Some(max);
+        })
+    }
+}
+
+ffi_fn! {
+    /// Set the most locally reset HTTP/2 streams tracked at once.
+    ///
+    /// The default is determined by the `h2` crate.
+    fn hyper_clientconn_options_http2_max_concurrent_reset_streams(opts: *mut hyper_clientconn_options, max: size_t) -> hyper_code {
+        set_http2_option(opts, |opts| {
+            opts.http2_max_concurrent_reset_streams = Some(max);
+        })
+    }
+}
+
 ffi_fn! {
     /// Set whether HTTP/1 connections accept obsolete line folding for header values.
     ///
@@ -273,3 +704,994 @@ ffi_fn! {
         hyper_code::HYPERE_OK
     }
 }
+
+ffi_fn! {
+    /// Set how many HTTP/1 requests may be in flight at once.
+    ///
+    /// With a depth greater than `1`, requests are pipelined: the connection
+    /// is ready for the next `hyper_clientconn_send` as soon as the previous
+    /// request has been written, without waiting for its response. To write
+    /// several requests without polling in between, send them together with
+    /// `hyper_clientconn_send_batch`. Responses are matched to requests in the
+    /// order they were sent.
+    ///
+    /// Only enable this for servers known to handle pipelining, and for
+    /// requests that are safe to retry, such as `GET`. If the connection
+    /// fails, every pipelined request fails with it.
+    ///
+    /// The default is `1`, which disables pipelining. Passing `0` returns
+    /// `HYPERE_INVALID_ARG`. This has no effect on HTTP/2 connections.
+    fn hyper_clientconn_options_http1_pipeline_depth(opts: *mut hyper_clientconn_options, depth: size_t) -> hyper_code {
+        let opts = non_null! { &mut *opts ?= hyper_code::HYPERE_INVALID_ARG };
+        if depth == 0 {
+            return hyper_code::HYPERE_INVALID_ARG;
+        }
+        opts.http1_pipeline_depth = depth;
+        hyper_code::HYPERE_OK
+    }
+}
+
+ffi_fn! {
+    /// Set the most headers an HTTP/1 response may have.
+    ///
+    /// A response with more headers than this fails with a "message head is
+    /// too large" error. Up to `100` headers are parsed on the stack; above
+    /// that, the connection keeps a heap buffer for them, allocated when the
+    /// first response arrives.
+    ///
+    /// The default is `100`. This has no effect on HTTP/2 connections.
+    fn hyper_clientconn_options_http1_max_headers(opts: *mut hyper_clientconn_options, max: size_t) -> hyper_code {
+        let opts = non_null! { &mut *opts ?= hyper_code::HYPERE_INVALID_ARG };
+        opts.http1_max_headers = Some(max);
+        hyper_code::HYPERE_OK
+    }
+}
+
+ffi_fn! {
+    /// Set an exact size for the HTTP/1 read buffer.
+    ///
+    /// By default, the read buffer starts at 8 KB and adapts to how much each
+    /// read returns. With an exact size, every read asks the transport for up
+    /// to `size` bytes, which suits connections that mostly receive large
+    /// bodies.
+    ///
+    /// This unsets `hyper_clientconn_options_http1_max_buf_size`. Passing `0`
+    /// returns `HYPERE_INVALID_ARG`. This has no effect on HTTP/2 connections.
+    fn hyper_clientconn_options_http1_read_buf_exact_size(opts: *mut hyper_clientconn_options, size: size_t) -> hyper_code {
+        let opts = non_null! { &mut *opts ?= hyper_code::HYPERE_INVALID_ARG };
+        if size == 0 {
+            return hyper_code::HYPERE_INVALID_ARG;
+        }
+        opts.http1_read_buf_exact_size = Some(size);
+        opts.http1_max_buf_size = None;
+        hyper_code::HYPERE_OK
+    }
+}
+
+ffi_fn! {
+    /// Set the largest the HTTP/1 buffers may grow.
+    ///
+    /// The adaptive read buffer grows up to this size, and a response head
+    /// that doesn't fit in it fails the request. Writes are flushed before
+    /// the write buffer grows past it. The default is about 400 KB.
+    ///
+    /// This unsets `hyper_clientconn_options_http1_read_buf_exact_size`.
+    /// Passing less than `8192` returns `HYPERE_INVALID_ARG`. This has no
+    /// effect on HTTP/2 connections.
+    fn hyper_clientconn_options_http1_max_buf_size(opts: *mut hyper_clientconn_options, max: size_t) -> hyper_code {
+        let opts = non_null! { &mut *opts ?= hyper_code::HYPERE_INVALID_ARG };
+        if max < crate::proto::h1::MINIMUM_MAX_BUFFER_SIZE {
+            return hyper_code::HYPERE_INVALID_ARG;
+        }
+        opts.http1_max_buf_size = Some(max);
+        opts.http1_read_buf_exact_size = None;
+        hyper_code::HYPERE_OK
+    }
+}
+
+ffi_fn! {
+    /// Set whether HTTP/1 writes queue buffers or flatten them.
+    ///
+    /// Pass `1` to queue the message head and body chunks as separate
+    /// buffers, written together with vectored writes, or `0` to copy them
+    /// into a single buffer first. By default, hyper queues them if the
+    /// transport supports vectored writes, such as with
+    /// `hyper_io_set_write_vectored` or `hyper_io_new_fd`, and flattens them
+    /// otherwise.
+    fn hyper_clientconn_options_http1_writev(opts: *mut hyper_clientconn_options, enabled: c_int) -> hyper_code {
+        let opts = non_null! { &mut *opts ?= hyper_code::HYPERE_INVALID_ARG };
+        opts.http1_writev = Some(enabled != 0);
+        hyper_code::HYPERE_OK
+    }
+}
+
+ffi_fn! {
+    /// Set whether idle HTTP/1 connections free their buffers.
+    ///
+    /// When enabled, a kept-alive connection frees its read and write
+    /// buffers while it waits for the next request, instead of keeping them
+    /// allocated. This suits many connections that are mostly idle, at the
+    /// cost of allocating the buffers again for each request.
+    ///
+    /// Pass `0` to disable (default), `1` to enable.
+    fn hyper_clientconn_options_http1_release_idle_buffers(opts: *mut hyper_clientconn_options, enabled: c_int) -> hyper_code {
+        let opts = non_null! { &mut *opts ?= hyper_code::HYPERE_INVALID_ARG };
+        opts.http1_release_idle_buffers = enabled != 0;
+        hyper_code::HYPERE_OK
+    }
+}
+
+/// The largest flow control window allowed by the HTTP/2 spec.
+const MAX_WINDOW_SIZE: u32 = (1 << 31) - 1;
+/// The smallest and largest `SETTINGS_MAX_FRAME_SIZE` allowed by the
+/// HTTP/2 spec.
+const MIN_FRAME_SIZE: u32 = 1 << 14;
+const MAX_FRAME_SIZE: u32 = (1 << 24) - 1;
+
+fn set_http2_option(
+    opts: *mut hyper_clientconn_options,
+    set: impl FnOnce(&mut hyper_clientconn_options),
+) -> hyper_code {
+    #[cfg(feature = "http2")]
+    {
+        let opts = non_null! { &mut *opts ?= hyper_code::HYPERE_INVALID_ARG };
+        set(opts);
+        hyper_code::HYPERE_OK
+    }
+
+    #[cfg(not(feature = "http2"))]
+    {
+        drop(opts);
+        drop(set);
+        hyper_code::HYPERE_FEATURE_NOT_ENABLED
+    }
+}
+
+#[cfg(all(test, unix))]
+pub(super) mod tests {
+    use std::ffi::c_void;
+
+    use super::*;
+    use crate::ffi::{
+        hyper_body_data, hyper_buf_free, hyper_executor_free, hyper_executor_new,
+        hyper_executor_poll, hyper_executor_push, hyper_io_new_fd, hyper_request_new,
+        hyper_request_set_method, hyper_request_set_uri, hyper_response_body, hyper_response_free,
+        hyper_response_headers, hyper_response_timings, hyper_task_free, hyper_task_type,
+        hyper_task_value, hyper_waker, hyper_waker_free, hyper_waker_wake, hyper_waker_wake_by_ref,
+    };
+    use crate::ffi::{hyper_body_free, hyper_request_timings};
+
+    // The waker is hyper's. It is NULL once hyper is done with the fd.
+    pub(crate) extern "C" fn wait(
+        userdata: *mut c_void,
+        _fd: c_int,
+        _interest: c_int,
+        waker: *mut hyper_waker,
+    ) {
+        let slot = unsafe { &mut *(userdata as *mut *mut hyper_waker) };
+        *slot = waker;
+    }
+
+    pub(crate) fn poll_task(
+        exec: *const hyper_executor,
+        expected: hyper_task_return_type,
+    ) -> *mut c_void {
+        let task = hyper_executor_poll(exec);
+        assert!(!task.is_null());
+        assert_eq!(hyper_task_type(task) as c_int, expected as c_int);
+        let value = hyper_task_value(task);
+        hyper_task_free(task);
+        value
+    }
+
+    /// Creates a connected pair of non-blocking sockets.
+    pub(crate) fn socketpair() -> [c_int; 2] {
+        let mut fds = [0 as c_int; 2];
+        let ret =
+            unsafe { libc::socketpair(libc::AF_UNIX, libc::SOCK_STREAM, 0, fds.as_mut_ptr()) };
+        assert_eq!(ret, 0);
+        for &fd in &fds {
+            let ret = unsafe { libc::fcntl(fd, libc::F_SETFL, libc::O_NONBLOCK) };
+            assert_eq!(ret, 0);
+        }
+        fds
+    }
+
+    /// A client connection, handshaken on its own executor.
+    ///
+    /// Made with `Harness::new`, the connection is on one end of a
+    /// socketpair, and the test answers it on the `peer` end.
+    pub(crate) struct Harness {
+        pub(crate) exec: *const hyper_executor,
+        pub(crate) conn: *mut hyper_clientconn,
+        fds: Option<[c_int; 2]>,
+        read_waker: Box<*mut hyper_waker>,
+    }
+
+    impl Harness {
+        pub(crate) fn new() -> Harness {
+            Harness::with_options(|_| {})
+        }
+
+        pub(crate) fn with_options(
+            configure: impl FnOnce(*mut hyper_clientconn_options),
+        ) -> Harness {
+            let fds = socketpair();
+            let mut read_waker = Box::new(ptr::null_mut());
+            let io = hyper_io_new_fd(fds[0], wait, &mut *read_waker as *mut _ as *mut c_void);
+            let mut harness = Harness::with_io(io, configure);
+            harness.fds = Some(fds);
+            harness.read_waker = read_waker;
+            harness
+        }
+
+        /// Handshakes on a transport the test provides itself.
+        pub(crate) fn with_io(
+            io: *mut hyper_io,
+            configure: impl FnOnce(*mut hyper_clientconn_options),
+        ) -> Harness {
+            let exec = hyper_executor_new();
+            let opts = hyper_clientconn_options_new();
+            hyper_clientconn_options_exec(opts, exec);
+            configure(opts);
+            hyper_executor_push(exec, hyper_clientconn_handshake(io, opts));
+            let conn = poll_task(exec, hyper_task_return_type::HYPER_TASK_CLIENTCONN)
+                as *mut hyper_clientconn;
+            Harness {
+                exec,
+                conn,
+                fds: None,
+                read_waker: Box::new(ptr::null_mut()),
+            }
+        }
+
+        pub(crate) fn poll(&self, expected: hyper_task_return_type) -> *mut c_void {
+            poll_task(self.exec, expected)
+        }
+
+        /// Sends a `GET /`, returning what was written for it.
+        pub(crate) fn get(&self) -> Vec<u8> {
+            let req = hyper_request_new();
+            hyper_request_set_method(req, b"GET".as_ptr(), 3);
+            hyper_request_set_uri(req, b"/".as_ptr(), 1);
+            self.send(req)
+        }
+
+        /// Sends a request, returning what was written for it.
+        pub(crate) fn send(&self, req: *mut hyper_request) -> Vec<u8> {
+            hyper_executor_push(self.exec, hyper_clientconn_send(self.conn, req));
+            assert!(hyper_executor_poll(self.exec).is_null());
+
+            let mut written = [0u8; 256];
+            let n = unsafe {
+                libc::read(
+                    self.peer(),
+                    written.as_mut_ptr() as *mut c_void,
+                    written.len(),
+                )
+            };
+            assert!(n > 0);
+            written[..n as usize].to_vec()
+        }
+
+        /// Writes `res` to the connection, and wakes it to read it.
+        pub(crate) fn respond(&mut self, res: &[u8]) {
+            let ret = unsafe { libc::write(self.peer(), res.as_ptr() as *const c_void, res.len()) };
+            assert_eq!(ret, res.len() as isize);
+            assert!(!self.read_waker.is_null());
+            hyper_waker_wake_by_ref(*self.read_waker);
+            *self.read_waker = ptr::null_mut();
+        }
+
+        fn peer(&self) -> c_int {
+            self.fds.expect("a socketpair harness")[1]
+        }
+    }
+
+    impl Drop for Harness {
+        fn drop(&mut self) {
+            hyper_clientconn_free(self.conn);
+            hyper_executor_free(self.exec);
+            for &fd in self.fds.iter().flatten() {
+                unsafe { libc::close(fd) };
+            }
+        }
+    }
+
+    #[test]
+    fn test_clientconn_stats_and_response_timings() {
+        let mut h = Harness::new();
+
+        // The request has been written, answer it.
+        let written = h.get();
+        assert!(written.starts_with(b"GET / HTTP/1.1\r\n"));
+        let res = b"HTTP/1.1 200 OK\r\ncontent-length: 5\r\n\r\nhello";
+        h.respond(res);
+
+        let resp = h.poll(hyper_task_return_type::HYPER_TASK_RESPONSE) as *mut hyper_response;
+        let body = hyper_response_body(resp);
+        hyper_executor_push(h.exec, hyper_body_data(body));
+        hyper_buf_free(h.poll(hyper_task_return_type::HYPER_TASK_BUF) as *mut _);
+        hyper_executor_push(h.exec, hyper_body_data(body));
+        h.poll(hyper_task_return_type::HYPER_TASK_EMPTY);
+
+        let mut timings = hyper_request_timings::default();
+        assert!(matches!(
+            hyper_response_timings(resp, &mut timings),
+            hyper_code::HYPERE_OK
+        ));
+        assert_ne!(timings.head_written_ns, 0);
+        assert!(timings.headers_received_ns >= timings.head_written_ns);
+        assert!(timings.first_body_ns >= timings.headers_received_ns);
+        assert!(timings.body_complete_ns >= timings.first_body_ns);
+
+        let mut stats = hyper_conn_stats::default();
+        assert!(matches!(
+            hyper_clientconn_stats(h.conn, &mut stats),
+            hyper_code::HYPERE_OK
+        ));
+        assert_eq!(stats.requests, 1);
+        assert_eq!(stats.bytes_written, written.len() as u64);
+        assert_eq!(stats.bytes_read, res.len() as u64);
+        assert!(stats.read_calls >= 2);
+        assert!(stats.write_calls >= 1);
+
+        hyper_body_free(body);
+        hyper_response_free(resp);
+    }
+
+    #[test]
+    fn test_clientconn_read_buf_body_not_copied() {
+        use crate::ffi::{
+            hyper_buf, hyper_buf_bytes, hyper_buf_copy, hyper_buf_from_owned, hyper_buf_len,
+            hyper_context, hyper_context_waker, hyper_io_new, hyper_io_set_read_buf,
+            hyper_io_set_userdata, hyper_io_set_write, HYPER_POLL_PENDING, HYPER_POLL_READY,
+        };
+
+        static HEAD: &[u8] = b"HTTP/1.1 200 OK\r\ncontent-length: 5\r\n\r\n";
+        static BODY: [u8; 5] = *b"hello";
+
+        struct Transport {
+            written: bool,
+            reads: usize,
+            read_waker: *mut hyper_waker,
+        }
+
+        extern "C" fn release(_: *mut c_void, _: *const u8, _: size_t) {}
+
+        // Serves the response head, then the body in a buffer of its own,
+        // once the request has been written.
+        extern "C" fn read_buf(
+            userdata: *mut c_void,
+            cx: *mut hyper_context<'_>,
+            out: *mut *mut hyper_buf,
+        ) -> c_int {
+            let transport = unsafe { &mut *(userdata as *mut Transport) };
+            if !transport.written || transport.reads == 2 {
+                if !transport.read_waker.is_null() {
+                    hyper_waker_free(transport.read_waker);
+                }
+                transport.read_waker = hyper_context_waker(cx);
+                return HYPER_POLL_PENDING;
+            }
+            transport.reads += 1;
+            let buf = match transport.reads {
+                1 => hyper_buf_copy(HEAD.as_ptr(), HEAD.len()),
+                _ => hyper_buf_from_owned(BODY.as_ptr(), BODY.len(), ptr::null_mut(), release),
+            };
+            unsafe { *out = buf };
+            HYPER_POLL_READY
+        }
+
+        extern "C" fn write(
+            userdata: *mut c_void,
+            _: *mut hyper_context<'_>,
+            _: *const u8,
+            len: size_t,
+        ) -> size_t {
+            let transport = unsafe { &mut *(userdata as *mut Transport) };
+            transport.written = true;
+            if !transport.read_waker.is_null() {
+                hyper_waker_wake(std::mem::replace(
+                    &mut transport.read_waker,
+                    ptr::null_mut(),
+                ));
+            }
+            len
+        }
+
+        let mut transport = Transport {
+            written: false,
+            reads: 0,
+            read_waker: ptr::null_mut(),
+        };
+        let io = hyper_io_new();
+        hyper_io_set_userdata(io, &mut transport as *mut Transport as *mut c_void);
+        hyper_io_set_read_buf(io, read_buf);
+        hyper_io_set_write(io, write);
+        let h = Harness::with_io(io, |_| {});
+
+        let req = hyper_request_new();
+        hyper_request_set_method(req, b"GET".as_ptr(), 3);
+        hyper_request_set_uri(req, b"/".as_ptr(), 1);
+        hyper_executor_push(h.exec, hyper_clientconn_send(h.conn, req));
+        let resp = h.poll(hyper_task_return_type::HYPER_TASK_RESPONSE) as *mut hyper_response;
+
+        // The body is the transport's own buffer, not a copy of it.
+        let body = hyper_response_body(resp);
+        hyper_executor_push(h.exec, hyper_body_data(body));
+        let buf = h.poll(hyper_task_return_type::HYPER_TASK_BUF) as *mut hyper_buf;
+        assert_eq!(hyper_buf_bytes(buf), BODY.as_ptr());
+        assert_eq!(hyper_buf_len(buf), BODY.len());
+
+        hyper_buf_free(buf);
+        hyper_body_free(body);
+        hyper_response_free(resp);
+        drop(h);
+        if !transport.read_waker.is_null() {
+            hyper_waker_free(transport.read_waker);
+        }
+    }
+
+    #[test]
+    fn test_clientconn_send_fd_body_with_sendfile() {
+        use crate::ffi::{
+            hyper_body_new_from_fd, hyper_context, hyper_context_waker, hyper_io_new,
+            hyper_io_set_read, hyper_io_set_sendfile, hyper_io_set_userdata, hyper_io_set_write,
+            hyper_request_set_body, HYPER_IO_PENDING,
+        };
+        use std::io::Write as _;
+        use std::os::unix::io::AsRawFd;
+
+        static RESPONSE: &[u8] = b"HTTP/1.1 200 OK\r\ncontent-length: 0\r\n\r\n";
+
+        struct Transport {
+            written: Vec<u8>,
+            sendfiles: Vec<(c_int, u64, size_t)>,
+            sent: usize,
+            responded: bool,
+            read_waker: *mut hyper_waker,
+        }
+
+        // Answers once the whole body was sent.
+        extern "C" fn read(
+            userdata: *mut c_void,
+            cx: *mut hyper_context<'_>,
+            buf: *mut u8,
+            len: size_t,
+        ) -> size_t {
+            let transport = unsafe { &mut *(userdata as *mut Transport) };
+            if transport.sent < 7 || transport.responded {
+                if !transport.read_waker.is_null() {
+                    hyper_waker_free(transport.read_waker);
+                }
+                transport.read_waker = hyper_context_waker(cx);
+                return HYPER_IO_PENDING;
+            }
+            transport.responded = true;
+            assert!(len >= RESPONSE.len());
+            unsafe { ptr::copy_nonoverlapping(RESPONSE.as_ptr(), buf, RESPONSE.len()) };
+            RESPONSE.len()
+        }
+
+        extern "C" fn write(
+            userdata: *mut c_void,
+            _: *mut hyper_context<'_>,
+            buf: *const u8,
+            len: size_t,
+        ) -> size_t {
+            let transport = unsafe { &mut *(userdata as *mut Transport) };
+            let buf = unsafe { std::slice::from_raw_parts(buf, len) };
+            transport.written.extend_from_slice(buf);
+            len
+        }
+
+        // Sends at most 4 bytes at a time, to see the rest asked for again.
+        extern "C" fn sendfile(
+            userdata: *mut c_void,
+            _: *mut hyper_context<'_>,
+            fd: c_int,
+            offset: u64,
+            len: size_t,
+        ) -> size_t {
+            let transport = unsafe { &mut *(userdata as *mut Transport) };
+            transport.sendfiles.push((fd, offset, len));
+            let mut buf = [0u8; 4];
+            let want = len.min(buf.len());
+            let n = unsafe {
+                libc::pread(
+                    fd,
+                    buf.as_mut_ptr() as *mut c_void,
+                    want,
+                    offset as libc::off_t,
+                )
+            };
+            assert_eq!(n, want as isize);
+            transport.written.extend_from_slice(&buf[..want]);
+            transport.sent += want;
+            if transport.sent == 7 && !transport.read_waker.is_null() {
+                hyper_waker_wake(std::mem::replace(
+                    &mut transport.read_waker,
+                    ptr::null_mut(),
+                ));
+            }
+            want
+        }
+
+        let path = std::env::temp_dir().join(format!("hyper-ffi-sendfile-{}", std::process::id()));
+        let mut file = std::fs::File::create(&path).expect("create");
+        file.write_all(b"hello world").expect("write");
+        let file = std::fs::File::open(&path).expect("open");
+        std::fs::remove_file(&path).expect("remove");
+        let fd = file.as_raw_fd();
+
+        let mut transport = Transport {
+            written: Vec::new(),
+            sendfiles: Vec::new(),
+            sent: 0,
+            responded: false,
+            read_waker: ptr::null_mut(),
+        };
+        let io = hyper_io_new();
+        hyper_io_set_userdata(io, &mut transport as *mut Transport as *mut c_void);
+        hyper_io_set_read(io, read);
+        hyper_io_set_write(io, write);
+        hyper_io_set_sendfile(io, sendfile);
+        let h = Harness::with_io(io, |_| {});
+
+        let req = hyper_request_new();
+        hyper_request_set_method(req, b"POST".as_ptr(), 4);
+        hyper_request_set_uri(req, b"/".as_ptr(), 1);
+        hyper_request_set_body(req, hyper_body_new_from_fd(fd, 2, 7));
+        hyper_executor_push(h.exec, hyper_clientconn_send(h.conn, req));
+        let resp = h.poll(hyper_task_return_type::HYPER_TASK_RESPONSE) as *mut hyper_response;
+
+        // The head was written, then the whole range handed to sendfile.
+        assert_eq!(transport.sendfiles, [(fd, 2, 7), (fd, 6, 3)]);
+        let written = String::from_utf8(transport.written.clone()).unwrap();
+        assert!(written.starts_with("POST / HTTP/1.1\r\n"), "{:?}", written);
+        assert!(written.contains("content-length: 7\r\n"), "{:?}", written);
+        assert!(written.ends_with("\r\n\r\nllo wor"), "{:?}", written);
+
+        hyper_response_free(resp);
+        drop(h);
+        if !transport.read_waker.is_null() {
+            hyper_waker_free(transport.read_waker);
+        }
+    }
+
+    #[test]
+    fn test_clientconn_options_http1_buf_sizes() {
+        let opts = hyper_clientconn_options_new();
+        assert!(matches!(
+            hyper_clientconn_options_http1_read_buf_exact_size(opts, 0),
+            hyper_code::HYPERE_INVALID_ARG
+        ));
+        assert!(matches!(
+            hyper_clientconn_options_http1_max_buf_size(opts, 1024),
+            hyper_code::HYPERE_INVALID_ARG
+        ));
+
+        // Setting one of the two buffer strategies unsets the other.
+        assert!(matches!(
+            hyper_clientconn_options_http1_max_buf_size(opts, 64 * 1024),
+            hyper_code::HYPERE_OK
+        ));
+        assert!(matches!(
+            hyper_clientconn_options_http1_read_buf_exact_size(opts, 16 * 1024),
+            hyper_code::HYPERE_OK
+        ));
+        {
+            let opts = unsafe { &*opts };
+            assert_eq!(opts.http1_read_buf_exact_size, Some(16 * 1024));
+            assert_eq!(opts.http1_max_buf_size, None);
+        }
+        hyper_clientconn_options_free(opts);
+    }
+
+    #[test]
+    fn test_clientconn_http1_max_headers() {
+        let mut h = Harness::with_options(|opts| {
+            assert!(matches!(
+                hyper_clientconn_options_http1_max_headers(opts, 150),
+                hyper_code::HYPERE_OK
+            ));
+        });
+
+        let mut res = b"HTTP/1.1 200 OK\r\ncontent-length: 0\r\n".to_vec();
+        for i in 0..120 {
+            res.extend_from_slice(format!("x-header-{}: {}\r\n", i, i).as_bytes());
+        }
+        res.extend_from_slice(b"\r\n");
+
+        // More headers than the default limit, on two responses in a row,
+        // the second reusing the connection's header buffer.
+        for _ in 0..2 {
+            assert!(h.get().starts_with(b"GET / HTTP/1.1\r\n"));
+            h.respond(&res);
+
+            let resp = h.poll(hyper_task_return_type::HYPER_TASK_RESPONSE) as *mut hyper_response;
+            assert_eq!(unsafe { &*hyper_response_headers(resp) }.headers.len(), 121);
+            hyper_response_free(resp);
+        }
+    }
+
+    #[test]
+    fn test_clientconn_http1_pipelined_on_informational() {
+        use crate::ffi::{hyper_request_on_informational, hyper_response_status};
+
+        extern "C" fn on_informational(data: *mut c_void, resp: *mut hyper_response) {
+            let seen = unsafe { &mut *(data as *mut Vec<u16>) };
+            seen.push(hyper_response_status(resp));
+        }
+
+        let mut h = Harness::with_options(|opts| {
+            hyper_clientconn_options_http1_pipeline_depth(opts, 2);
+        });
+
+        // The second request is written while the first is in flight, and
+        // keeps its own callback until its response is read.
+        let mut seen = [Vec::<u16>::new(), Vec::new()];
+        for seen in seen.iter_mut() {
+            let req = hyper_request_new();
+            hyper_request_set_method(req, b"GET".as_ptr(), 3);
+            hyper_request_set_uri(req, b"/".as_ptr(), 1);
+            hyper_request_on_informational(req, on_informational, seen as *mut _ as *mut c_void);
+            assert!(h.send(req).starts_with(b"GET / HTTP/1.1\r\n"));
+        }
+
+        h.respond(
+            b"HTTP/1.1 103 Early Hints\r\n\r\nHTTP/1.1 200 OK\r\ncontent-length: 0\r\n\r\n\
+              HTTP/1.1 102 Processing\r\n\r\nHTTP/1.1 200 OK\r\ncontent-length: 0\r\n\r\n",
+        );
+        for _ in 0..2 {
+            let resp = h.poll(hyper_task_return_type::HYPER_TASK_RESPONSE) as *mut hyper_response;
+            assert_eq!(hyper_response_status(resp), 200);
+            hyper_response_free(resp);
+        }
+        assert_eq!(seen, [vec![103], vec![102]]);
+    }
+
+    #[test]
+    fn test_clientconn_send_header_template() {
+        use crate::ffi::{
+            hyper_header_pair, hyper_header_template_free, hyper_header_template_new,
+            hyper_request_set_header_template, HYPER_HEADER_CONTENT_LENGTH, HYPER_HEADER_CUSTOM,
+            HYPER_HEADER_USER_AGENT,
+        };
+
+        let pair = |name_id, name: &'static [u8], value: &'static [u8]| hyper_header_pair {
+            name_id,
+            name: name.as_ptr(),
+            name_len: name.len(),
+            value: value.as_ptr(),
+            value_len: value.len(),
+        };
+        let framing = [pair(HYPER_HEADER_CONTENT_LENGTH, b"", b"5")];
+        assert!(hyper_header_template_new(framing.as_ptr(), framing.len()).is_null());
+
+        let pairs = [
+            pair(HYPER_HEADER_USER_AGENT, b"", b"hyper-test"),
+            pair(HYPER_HEADER_CUSTOM, b"X-Token", b"abc"),
+        ];
+        let template = hyper_header_template_new(pairs.as_ptr(), pairs.len());
+        assert!(!template.is_null());
+
+        let h = Harness::new();
+        let req = hyper_request_new();
+        hyper_request_set_method(req, b"GET".as_ptr(), 3);
+        hyper_request_set_uri(req, b"/".as_ptr(), 1);
+        assert!(matches!(
+            hyper_request_set_header_template(req, template),
+            hyper_code::HYPERE_OK
+        ));
+        // Requests keep the template alive on their own.
+        hyper_header_template_free(template);
+        assert_eq!(
+            h.send(req),
+            &b"GET / HTTP/1.1\r\nuser-agent: hyper-test\r\nX-Token: abc\r\n\r\n"[..]
+        );
+    }
+
+    #[test]
+    fn test_clientconn_state_and_body_trailers() {
+        use crate::ffi::{hyper_body_trailers, hyper_task_set_userdata, hyper_task_userdata};
+
+        let mut h = Harness::new();
+        let exec = h.exec;
+        assert!(hyper_executor_poll(exec).is_null());
+        assert!(matches!(
+            hyper_clientconn_state(h.conn),
+            hyper_conn_state::HYPER_CONN_READY
+        ));
+
+        assert!(h.get().starts_with(b"GET / HTTP/1.1\r\n"));
+        assert!(matches!(
+            hyper_clientconn_state(h.conn),
+            hyper_conn_state::HYPER_CONN_BUSY
+        ));
+
+        h.respond(
+            b"HTTP/1.1 200 OK\r\nconnection: close\r\ntransfer-encoding: chunked\r\n\r\n\
+              5\r\nhello\r\n0\r\ngrpc-status: 0\r\n\r\n",
+        );
+
+        // Known to be closing from the response head, before the body is read.
+        let resp = h.poll(hyper_task_return_type::HYPER_TASK_RESPONSE) as *mut hyper_response;
+        assert!(matches!(
+            hyper_clientconn_state(h.conn),
+            hyper_conn_state::HYPER_CONN_CLOSING
+        ));
+
+        // Reading the rest of the body lets the connection finish, and its
+        // background task may be returned first.
+        let body = hyper_response_body(resp);
+        let next_data = |expected: hyper_task_return_type| loop {
+            let task = hyper_body_data(body);
+            hyper_task_set_userdata(task, body as *mut c_void);
+            hyper_executor_push(exec, task);
+            let task = hyper_executor_poll(exec);
+            assert!(!task.is_null());
+            if hyper_task_userdata(task).is_null() {
+                hyper_task_free(task);
+                continue;
+            }
+            assert_eq!(hyper_task_type(task) as c_int, expected as c_int);
+            let value = hyper_task_value(task);
+            hyper_task_free(task);
+            break value;
+        };
+        hyper_buf_free(next_data(hyper_task_return_type::HYPER_TASK_BUF) as *mut _);
+        assert!(hyper_body_trailers(body).is_null());
+        next_data(hyper_task_return_type::HYPER_TASK_EMPTY);
+
+        let trailers = hyper_body_trailers(body);
+        assert!(!trailers.is_null());
+        let trailers = &unsafe { &*trailers }.headers;
+        assert_eq!(trailers.len(), 1);
+        assert_eq!(trailers["grpc-status"], "0");
+
+        loop {
+            let task = hyper_executor_poll(exec);
+            if task.is_null() {
+                break;
+            }
+            hyper_task_free(task);
+        }
+        assert!(matches!(
+            hyper_clientconn_state(h.conn),
+            hyper_conn_state::HYPER_CONN_CLOSED
+        ));
+
+        hyper_body_free(body);
+        hyper_response_free(resp);
+    }
+
+    #[cfg(feature = "ffi-decompression")]
+    #[test]
+    fn test_clientconn_response_body_decoded() {
+        use std::io::Write;
+
+        use crate::ffi::{hyper_buf_bytes, hyper_buf_len, hyper_response_body_decoded};
+        use flate2::write::GzEncoder;
+        use flate2::Compression;
+
+        let mut h = Harness::new();
+
+        let plain = b"hello from hyper, ".repeat(100);
+        let mut gz = GzEncoder::new(Vec::new(), Compression::default());
+        gz.write_all(&plain).unwrap();
+        let gz = gz.finish().unwrap();
+
+        let mut gzip_res = format!(
+            "HTTP/1.1 200 OK\r\ncontent-encoding: gzip\r\ncontent-length: {}\r\n\r\n",
+            gz.len()
+        )
+        .into_bytes();
+        gzip_res.extend_from_slice(&gz);
+        let br_res = b"HTTP/1.1 200 OK\r\ncontent-encoding: br\r\ncontent-length: 1\r\n\r\nx";
+
+        for res in [&gzip_res[..], &br_res[..]] {
+            assert!(h.get().starts_with(b"GET / HTTP/1.1\r\n"));
+            h.respond(res);
+
+            let resp = h.poll(hyper_task_return_type::HYPER_TASK_RESPONSE) as *mut hyper_response;
+            let body = hyper_response_body_decoded(resp);
+            let body = if res == &br_res[..] {
+                // Unsupported, the body is left in the response.
+                assert!(body.is_null());
+                hyper_response_body(resp)
+            } else {
+                let headers = &unsafe { &*hyper_response_headers(resp) }.headers;
+                assert!(!headers.contains_key("content-encoding"));
+                assert!(!headers.contains_key("content-length"));
+                body
+            };
+
+            let mut out = Vec::new();
+            loop {
+                hyper_executor_push(h.exec, hyper_body_data(body));
+                let task = hyper_executor_poll(h.exec);
+                assert!(!task.is_null());
+                if let hyper_task_return_type::HYPER_TASK_EMPTY = hyper_task_type(task) {
+                    hyper_task_free(task);
+                    break;
+                }
+                let buf = hyper_task_value(task) as *mut crate::ffi::hyper_buf;
+                hyper_task_free(task);
+                out.extend_from_slice(unsafe {
+                    std::slice::from_raw_parts(hyper_buf_bytes(buf), hyper_buf_len(buf))
+                });
+                hyper_buf_free(buf);
+            }
+            if res == &br_res[..] {
+                assert_eq!(out, b"x");
+            } else {
+                assert_eq!(out, plain);
+            }
+
+            hyper_body_free(body);
+            hyper_response_free(resp);
+        }
+    }
+
+    #[cfg(all(feature = "http2", feature = "server"))]
+    #[test]
+    fn test_clientconn_send_batch_http2() {
+        send_batch(true);
+    }
+
+    #[cfg(feature = "server")]
+    #[test]
+    fn test_clientconn_send_batch_http1_pipelined() {
+        send_batch(false);
+    }
+
+    #[cfg(feature = "server")]
+    fn send_batch(http2: bool) {
+        use crate::ffi::{
+            hyper_request_free, hyper_response_channel, hyper_response_channel_send,
+            hyper_response_new, hyper_response_status, hyper_serve_connection,
+            hyper_serverconn_options_exec, hyper_serverconn_options_http2,
+            hyper_serverconn_options_new, hyper_service_new, hyper_task_set_userdata,
+            hyper_task_userdata, HYPER_IO_READABLE,
+        };
+
+        // Keeps a waker per interest, so both sides can wait on reads and
+        // writes at once.
+        extern "C" fn wait_either(
+            userdata: *mut c_void,
+            _fd: c_int,
+            interest: c_int,
+            waker: *mut hyper_waker,
+        ) {
+            let slots = unsafe { &mut *(userdata as *mut [*mut hyper_waker; 2]) };
+            slots[(interest == HYPER_IO_READABLE) as usize] = waker;
+        }
+
+        extern "C" fn no_content(
+            _userdata: *mut c_void,
+            req: *mut hyper_request,
+            channel: *mut hyper_response_channel,
+        ) {
+            hyper_request_free(req);
+            hyper_response_channel_send(channel, hyper_response_new());
+        }
+
+        let fds = socketpair();
+        let mut wakers = [[ptr::null_mut::<hyper_waker>(); 2]; 2];
+        let exec = hyper_executor_new();
+
+        let opts = hyper_serverconn_options_new();
+        hyper_serverconn_options_exec(opts, exec);
+        hyper_serverconn_options_http2(opts, http2 as c_int);
+        let io = hyper_io_new_fd(fds[1], wait_either, &mut wakers[1] as *mut _ as *mut c_void);
+        hyper_executor_push(
+            exec,
+            hyper_serve_connection(io, opts, hyper_service_new(no_content)),
+        );
+
+        let opts = hyper_clientconn_options_new();
+        hyper_clientconn_options_exec(opts, exec);
+        const N: usize = 20;
+        hyper_clientconn_options_http2(opts, http2 as c_int);
+        hyper_clientconn_options_http1_pipeline_depth(opts, N);
+        let io = hyper_io_new_fd(fds[0], wait_either, &mut wakers[0] as *mut _ as *mut c_void);
+        hyper_executor_push(exec, hyper_clientconn_handshake(io, opts));
+        let conn =
+            poll_task(exec, hyper_task_return_type::HYPER_TASK_CLIENTCONN) as *mut hyper_clientconn;
+
+        let mut reqs = [ptr::null_mut::<hyper_request>(); N];
+        for req in reqs.iter_mut() {
+            *req = hyper_request_new();
+            hyper_request_set_method(*req, b"GET".as_ptr(), 3);
+            hyper_request_set_uri(*req, b"http://x/".as_ptr(), 9);
+        }
+
+        // A null request fails the whole batch, consuming none of them.
+        let mut tasks = [ptr::null_mut::<hyper_task>(); N + 1];
+        let mut with_null = [ptr::null_mut::<hyper_request>(); N + 1];
+        with_null[..N].copy_from_slice(&reqs);
+        assert!(matches!(
+            hyper_clientconn_send_batch(conn, with_null.as_ptr(), N + 1, tasks.as_mut_ptr()),
+            hyper_code::HYPERE_INVALID_ARG
+        ));
+
+        // So does an HTTP/1 batch deeper than the pipeline.
+        if !http2 {
+            let mut too_deep = with_null;
+            too_deep[N] = hyper_request_new();
+            assert!(matches!(
+                hyper_clientconn_send_batch(conn, too_deep.as_ptr(), N + 1, tasks.as_mut_ptr()),
+                hyper_code::HYPERE_INVALID_ARG
+            ));
+            hyper_request_free(too_deep[N]);
+        }
+
+        assert!(matches!(
+            hyper_clientconn_send_batch(conn, reqs.as_ptr(), N, tasks.as_mut_ptr()),
+            hyper_code::HYPERE_OK
+        ));
+        for (i, &task) in tasks[..N].iter().enumerate() {
+            assert!(!task.is_null());
+            hyper_task_set_userdata(task, (i + 1) as *mut c_void);
+            hyper_executor_push(exec, task);
+        }
+
+        let mut statuses = [0u16; N];
+        for _ in 0..1000 {
+            loop {
+                let task = hyper_executor_poll(exec);
+                if task.is_null() {
+                    break;
+                }
+                let i = hyper_task_userdata(task) as usize;
+                if i != 0 {
+                    assert!(matches!(
+                        hyper_task_type(task),
+                        hyper_task_return_type::HYPER_TASK_RESPONSE
+                    ));
+                    let resp = hyper_task_value(task) as *mut hyper_response;
+                    statuses[i - 1] = hyper_response_status(resp);
+
+                    // Both record the response head in the connection.
+                    let mut timings = hyper_request_timings::default();
+                    assert!(matches!(
+                        hyper_response_timings(resp, &mut timings),
+                        hyper_code::HYPERE_OK
+                    ));
+                    assert_ne!(timings.head_written_ns, 0);
+                    assert!(timings.headers_received_ns >= timings.head_written_ns);
+                    hyper_response_free(resp);
+                }
+                hyper_task_free(task);
+            }
+            if statuses.iter().all(|&status| status != 0) {
+                break;
+            }
+            for slot in wakers.iter_mut().flatten() {
+                if !slot.is_null() {
+                    hyper_waker_wake_by_ref(*slot);
+                    *slot = ptr::null_mut();
+                }
+            }
+        }
+        assert_eq!(statuses, [200; N]);
+
+        // The requests' heads shared writes.
+        let mut stats = hyper_conn_stats::default();
+        assert!(matches!(
+            hyper_clientconn_stats(conn, &mut stats),
+            hyper_code::HYPERE_OK
+        ));
+        assert_eq!(stats.requests, N as u64);
+        assert!(stats.write_calls < N as u64);
+
+        hyper_clientconn_free(conn);
+        hyper_executor_free(exec);
+        unsafe {
+            libc::close(fds[0]);
+            libc::close(fds[1]);
+        }
+    }
+}
@@ -0,0 +1,1040 @@
+use std::collections::{BTreeMap, HashMap, VecDeque};
+use std::ffi::c_void;
+use std::future::Future;
+use std::io;
+use std::net::{IpAddr, SocketAddr, ToSocketAddrs};
+use std::pin::Pin;
+use std::ptr;
+use std::sync::{Arc, Condvar, Mutex, Weak};
+use std::task::{Context, Poll, Waker};
+use std::thread::JoinHandle;
+use std::time::{Duration, Instant};
+
+use libc::{c_int, size_t};
+
+use super::io::{hyper_io, hyper_io_fd_wait_callback, FdWait, HYPER_IO_WRITABLE};
+use super::task::hyper_task;
+use super::UserDataPointer;
+
+/// A TCP connector, which resolves a host and connects to it without
+/// blocking.
+///
+/// Each `hyper_connector_connect` task looks up the host on one of a few
+/// shared background threads, and then races connection attempts to its
+/// addresses, as described by "Happy Eyeballs" (RFC 8305). IPv6 and IPv4 addresses are interleaved,
+/// and if an attempt hasn't connected after a short delay, the next one is
+/// started alongside it. The first to connect wins, and the others are
+/// closed.
+///
+/// The connected socket is given back as a `hyper_io *` from
+/// `hyper_io_new_fd`, which owns and eventually closes it.
+///
+/// Look ups and delays finish on background threads, which wake the task
+/// from there. All connectors share a single timer thread and up to four
+/// lookup threads, which are started when first needed, and stopped and
+/// joined once every connector and connect task has been freed. An
+/// application that sleeps in its polling mechanism between calls to
+/// `hyper_executor_poll` should use `hyper_executor_set_wake_callback` to be
+/// woken up for those, and that callback is then called from those threads.
+///
+/// Methods:
+///
+/// - hyper_connector_new:                      Creates a new TCP connector.
+/// - hyper_connector_set_happy_eyeballs_delay: Set how long to wait for an attempt before starting the next.
+/// - hyper_connector_set_connect_timeout:      Set how long a connect task may take in total.
+/// - hyper_connector_set_dns_cache_ttl:        Set how long looked up addresses are reused.
+/// - hyper_connector_connect:                  Creates a task to connect to a host and port.
+/// - hyper_connector_free:                     Free a TCP connector.
+pub struct hyper_connector {
+    wait: hyper_io_fd_wait_callback,
+    userdata: UserDataPointer,
+    happy_eyeballs_delay: Duration,
+    connect_timeout: Option<Duration>,
+    dns_cache_ttl: Duration,
+    dns_cache: Arc<Mutex<HashMap<(String, u16), Resolved>>>,
+    background: Arc<Background>,
+}
+
+struct Resolved {
+    addrs: Vec<SocketAddr>,
+    expires: Instant,
+}
+
+ffi_fn! {
+    /// Creates a new TCP connector.
+    ///
+    /// The `wait` callback and `userdata` are used exactly like those of
+    /// `hyper_io_new_fd`, both while connecting and by the `hyper_io *` of
+    /// each connection. While connecting, hyper only waits for sockets to
+    /// become writable.
+    ///
+    /// By default, the next attempt is started after 250 milliseconds, there
+    /// is no overall timeout, and looked up addresses are not cached.
+    ///
+    /// This is only available on Unix platforms.
+    ///
+    /// To avoid a memory leak, the connector must eventually be consumed by
+    /// `hyper_connector_free`.
+    fn hyper_connector_new(wait: hyper_io_fd_wait_callback, userdata: *mut c_void) -> *mut hyper_connector {
+        Box::into_raw(Box::new(hyper_connector {
+            wait,
+            userdata: UserDataPointer(userdata),
+            happy_eyeballs_delay: Duration::from_millis(250),
+            connect_timeout: None,
+            dns_cache_ttl: Duration::ZERO,
+            dns_cache: Arc::new(Mutex::new(HashMap::new())),
+            background: Background::get(),
+        }))
+    } ?= ptr::null_mut()
+}
+
+ffi_fn! {
+    /// Free a TCP connector.
+    ///
+    /// Connect tasks already created with it are not affected. Freeing the
+    /// last connector, or the last of its connect tasks if freed after it,
+    /// stops the background threads, which may wait for a look up that is
+    /// in progress to finish.
+    fn hyper_connector_free(connector: *mut hyper_connector) {
+        drop(non_null!(Box::from_raw(connector) ?= ()));
+    }
+}
+
+ffi_fn! {
+    /// Set how long to wait for an attempt before starting the next.
+    ///
+    /// This is the "Connection Attempt Delay" of RFC 8305. An attempt that
+    /// fails starts the next one right away. Pass `0` to try all addresses at
+    /// once.
+    fn hyper_connector_set_happy_eyeballs_delay(connector: *mut hyper_connector, delay_ms: u64) {
+        non_null!(&mut *connector ?= ()).happy_eyeballs_delay = Duration::from_millis(delay_ms);
+    }
+}
+
+ffi_fn! {
+    /// Set how long a connect task may take in total.
+    ///
+    /// A connect task that hasn't connected after `timeout_ms` milliseconds,
+    /// including the time spent looking up the host, fails with a timeout
+    /// error. Pass `0` to never time out.
+    fn hyper_connector_set_connect_timeout(connector: *mut hyper_connector, timeout_ms: u64) {
+        non_null!(&mut *connector ?= ()).connect_timeout = if timeout_ms == 0 {
+            None
+        } else {
+            Some(Duration::from_millis(timeout_ms))
+        };
+    }
+}
+
+ffi_fn! {
+    /// Set how long looked up addresses are reused.
+    ///
+    /// A host that was looked up less than `ttl_ms` milliseconds ago is
+    /// connected to without looking it up again. Pass `0` to look up every
+    /// host each time.
+    fn hyper_connector_set_dns_cache_ttl(connector: *mut hyper_connector, ttl_ms: u64) {
+        let connector = non_null!(&mut *connector ?= ());
+        connector.dns_cache_ttl = Duration::from_millis(ttl_ms);
+        if ttl_ms == 0 {
+            connector.dns_cache.lock().unwrap().clear();
+        }
+    }
+}
+
+ffi_fn! {
+    /// Creates a task to connect to a host and port.
+    ///
+    /// The `host` is a domain name, or an IPv4 or IPv6 address, which is
+    /// connected to without a look up. It is not null-terminated.
+    ///
+    /// Returns a task that needs to be polled until it is ready. When ready,
+    /// the task yields a `hyper_io *` for the connected socket, which can be
+    /// passed to `hyper_clientconn_handshake`. Returns `NULL` if the host is
+    /// not valid UTF-8.
+    ///
+    /// To avoid a memory leak, the task must eventually be consumed by
+    /// `hyper_task_free`, or taken ownership of by `hyper_executor_push`
+    /// without subsequently being given back by `hyper_executor_poll`.
+    fn hyper_connector_connect(connector: *const hyper_connector, host: *const u8, host_len: size_t, port: u16) -> *mut hyper_task {
+        let connector = non_null!(&*connector ?= ptr::null_mut());
+        let host = non_null!(host, std::slice::from_raw_parts(host, host_len), ptr::null_mut());
+        let host = match std::str::from_utf8(host) {
+            Ok(host) => host.trim_start_matches('[').trim_end_matches(']').to_owned(),
+            Err(_) => return ptr::null_mut(),
+        };
+
+        let wait = connector.wait;
+        let userdata = connector.userdata.clone();
+        let delay = connector.happy_eyeballs_delay;
+        let timeout = connector.connect_timeout;
+        let ttl = connector.dns_cache_ttl;
+        let cache = connector.dns_cache.clone();
+        let background = connector.background.clone();
+
+        Box::into_raw(hyper_task::boxed(async move {
+            let connect = async {
+                let addrs = resolve(&background, &cache, ttl, host, port).await?;
+                Connecting::new(&background, addrs, delay, wait, userdata.clone()).await
+            };
+            let connected = match timeout {
+                Some(timeout) => match Timeout::new(&background, connect, timeout) {
+                    Ok(connect) => connect.await,
+                    Err(err) => Err(err),
+                },
+                None => connect.await,
+            };
+            match connected {
+                Ok(waits) => Ok(hyper_io::owned_fd(waits)),
+                Err(err) => Err(crate::Error::new_io(err)),
+            }
+        }))
+    } ?= ptr::null_mut()
+}
+
+// ===== impl Resolve =====
+
+/// Looks up the addresses of `host`, using the cache when it is still fresh.
+async fn resolve(
+    background: &Background,
+    cache: &Mutex<HashMap<(String, u16), Resolved>>,
+    ttl: Duration,
+    host: String,
+    port: u16,
+) -> io::Result<VecDeque<SocketAddr>> {
+    if let Ok(ip) = host.parse::<IpAddr>() {
+        return Ok(VecDeque::from(vec![SocketAddr::new(ip, port)]));
+    }
+
+    let key = (host, port);
+    if let Some(resolved) = cache.lock().unwrap().get(&key) {
+        if resolved.expires > Instant::now() {
+            return Ok(interleave(resolved.addrs.clone()));
+        }
+    }
+
+    let name = key.clone();
+    let addrs = Lookup::new(background, name)?.await?;
+    if ttl > Duration::ZERO {
+        let mut cache = cache.lock().unwrap();
+        let now = Instant::now();
+        cache.retain(|_, resolved| resolved.expires > now);
+        cache.insert(
+            key,
+            Resolved {
+                addrs: addrs.clone(),
+                expires: now + ttl,
+            },
+        );
+    }
+    Ok(interleave(addrs))
+}
+
+/// Orders addresses by alternating between address families, starting with
+/// the family of the first one, as RFC 8305 section 4 describes.
+fn interleave(addrs: Vec<SocketAddr>) -> VecDeque<SocketAddr> {
+    let first_is_v6 = addrs.first().map_or(false, SocketAddr::is_ipv6);
+    let (preferred, fallback): (Vec<_>, Vec<_>) = addrs
+        .into_iter()
+        .partition(|addr| addr.is_ipv6() == first_is_v6);
+
+    let mut out = VecDeque::with_capacity(preferred.len() + fallback.len());
+    let mut preferred = preferred.into_iter();
+    let mut fallback = fallback.into_iter();
+    loop {
+        match (preferred.next(), fallback.next()) {
+            (None, None) => return out,
+            (a, b) => {
+                out.extend(a);
+                out.extend(b);
+            }
+        }
+    }
+}
+
+// ===== impl Connecting =====
+
+/// Races connection attempts to a list of addresses.
+struct Connecting {
+    background: Arc<Background>,
+    addrs: VecDeque<SocketAddr>,
+    attempts: Vec<Attempt>,
+    delay: Duration,
+    next_attempt: Option<Sleep>,
+    /// The last attempt failed, so the next shouldn't wait for the delay.
+    start_next_now: bool,
+    last_err: Option<io::Error>,
+    wait: hyper_io_fd_wait_callback,
+    userdata: UserDataPointer,
+}
+
+impl Connecting {
+    fn new(
+        background: &Arc<Background>,
+        addrs: VecDeque<SocketAddr>,
+        delay: Duration,
+        wait: hyper_io_fd_wait_callback,
+        userdata: UserDataPointer,
+    ) -> Connecting {
+        Connecting {
+            background: background.clone(),
+            addrs,
+            attempts: Vec::new(),
+            delay,
+            next_attempt: None,
+            start_next_now: false,
+            last_err: None,
+            wait,
+            userdata,
+        }
+    }
+}
+
+impl Future for Connecting {
+    /// The connected socket, with the wakers it was waited on with.
+    type Output = io::Result<FdWait>;
+
+    fn poll(self: Pin<&mut Self>, cx: &mut Context<'_>) -> Poll<Self::Output> {
+        let me = self.get_mut();
+        loop {
+            let mut i = 0;
+            while i < me.attempts.len() {
+                match me.attempts[i].poll(cx) {
+                    Poll::Ready(Ok(())) => {
+                        return Poll::Ready(Ok(me.attempts.swap_remove(i).take()))
+                    }
+                    Poll::Ready(Err(err)) => {
+                        me.attempts.swap_remove(i);
+                        me.last_err = Some(err);
+                        me.start_next_now = true;
+                    }
+                    Poll::Pending => i += 1,
+                }
+            }
+
+            let due = match me.next_attempt {
+                _ if me.attempts.is_empty() || me.start_next_now => true,
+                Some(ref mut delay) => Pin::new(delay).poll(cx).is_ready(),
+                None => false,
+            };
+            if !due {
+                return Poll::Pending;
+            }
+
+            me.start_next_now = false;
+            me.next_attempt = None;
+            match me.addrs.pop_front() {
+                Some(addr) => match Attempt::start(addr, me.wait, me.userdata.0) {
+                    Ok(attempt) => {
+                        me.attempts.push(attempt);
+                        if !me.addrs.is_empty() {
+                            me.next_attempt = Some(Sleep::new(&me.background, me.delay)?);
+                        }
+                    }
+                    Err(err) => {
+                        me.last_err = Some(err);
+                        me.start_next_now = true;
+                    }
+                },
+                None if me.attempts.is_empty() => {
+                    return Poll::Ready(Err(me.last_err.take().unwrap_or_else(|| {
+                        io::Error::new(io::ErrorKind::NotFound, "no addresses to connect to")
+                    })));
+                }
+                None => return Poll::Pending,
+            }
+        }
+    }
+}
+
+/// A socket with a connect in progress, closed when dropped.
+struct Attempt {
+    fd: c_int,
+    waits: FdWait,
+}
+
+impl Attempt {
+    fn start(
+        addr: SocketAddr,
+        wait: hyper_io_fd_wait_callback,
+        userdata: *mut c_void,
+    ) -> io::Result<Attempt> {
+        let domain = if addr.is_ipv6() {
+            libc::AF_INET6
+        } else {
+            libc::AF_INET
+        };
+        let fd = unsafe { libc::socket(domain, libc::SOCK_STREAM, 0) };
+        if fd < 0 {
+            return Err(io::Error::last_os_error());
+        }
+        let attempt = Attempt {
+            fd,
+            waits: FdWait::new(fd, wait, userdata),
+        };
+
+        unsafe {
+            if libc::fcntl(fd, libc::F_SETFD, libc::FD_CLOEXEC) < 0
+                || libc::fcntl(fd, libc::F_SETFL, libc::O_NONBLOCK) < 0
+            {
+                return Err(io::Error::last_os_error());
+            }
+        }
+
+        let (storage, len) = sockaddr(addr);
+        let ret = unsafe {
+            libc::connect(
+                fd,
+                &storage as *const libc::sockaddr_storage as *const libc::sockaddr,
+                len,
+            )
+        };
+        if ret < 0 {
+            let err = io::Error::last_os_error();
+            if err.raw_os_error() != Some(libc::EINPROGRESS) {
+                return Err(err);
+            }
+        }
+        Ok(attempt)
+    }
+
+    /// Waits for the socket to become writable, which is when the connect
+    /// has finished, successfully or not.
+    fn poll(&mut self, cx: &mut Context<'_>) -> Poll<io::Result<()>> {
+        let mut pollfd = libc::pollfd {
+            fd: self.fd,
+            events: libc::POLLOUT,
+            revents: 0,
+        };
+        match unsafe { libc::poll(&mut pollfd, 1, 0) } {
+            0 => {
+                self.waits.register(cx, HYPER_IO_WRITABLE);
+                return Poll::Pending;
+            }
+            n if n < 0 => return Poll::Ready(Err(io::Error::last_os_error())),
+            _ => (),
+        }
+
+        let mut err: c_int = 0;
+        let mut len = std::mem::size_of::<c_int>() as libc::socklen_t;
+        let ret = unsafe {
+            libc::getsockopt(
+                self.fd,
+                libc::SOL_SOCKET,
+                libc::SO_ERROR,
+                &mut err as *mut c_int as *mut c_void,
+                &mut len,
+            )
+        };
+        if ret < 0 {
+            Poll::Ready(Err(io::Error::last_os_error()))
+        } else if err != 0 {
+            Poll::Ready(Err(io::Error::from_raw_os_error(err)))
+        } else {
+            Poll::Ready(Ok(()))
+        }
+    }
+
+    /// Gives up ownership of the connected socket, keeping the waker it was
+    /// waited on with for its transport.
+    fn take(self) -> FdWait {
+        let me = std::mem::ManuallyDrop::new(self);
+        // Safety: `me` is never dropped, so `waits` is only moved out once.
+        unsafe { std::ptr::read(&me.waits) }
+    }
+}
+
+impl Drop for Attempt {
+    fn drop(&mut self) {
+        // The callback must forget the fd before its number is reused.
+        self.waits.release();
+        unsafe { libc::close(self.fd) };
+    }
+}
+
+fn sockaddr(addr: SocketAddr) -> (libc::sockaddr_storage, libc::socklen_t) {
+    let mut storage: libc::sockaddr_storage = unsafe { std::mem::zeroed() };
+    let len = match addr {
+        SocketAddr::V4(addr) => {
+            let sin = unsafe { &mut *(&mut storage as *mut _ as *mut libc::sockaddr_in) };
+            sin.sin_family = libc::AF_INET as libc::sa_family_t;
+            sin.sin_port = addr.port().to_be();
+            sin.sin_addr.s_addr = u32::from_ne_bytes(addr.ip().octets());
+            std::mem::size_of::<libc::sockaddr_in>()
+        }
+        SocketAddr::V6(addr) => {
+            let sin6 = unsafe { &mut *(&mut storage as *mut _ as *mut libc::sockaddr_in6) };
+            sin6.sin6_family = libc::AF_INET6 as libc::sa_family_t;
+            sin6.sin6_port = addr.port().to_be();
+            sin6.sin6_flowinfo = addr.flowinfo();
+            sin6.sin6_addr.s6_addr = addr.ip().octets();
+            sin6.sin6_scope_id = addr.scope_id();
+            std::mem::size_of::<libc::sockaddr_in6>()
+        }
+    };
+    (storage, len as libc::socklen_t)
+}
+
+// ===== impl Background =====
+
+/// The background threads of the connectors that are alive, if any.
+static BACKGROUND: Mutex<Option<Weak<Background>>> = Mutex::new(None);
+
+/// The timer thread and lookup threads, shared by every connector and the
+/// connect tasks created with them.
+///
+/// The threads are started the first time they are needed. Once the last
+/// connector and the last of its tasks are freed, they are told to stop and
+/// are joined. A lookup thread can't be interrupted in `getaddrinfo`, so that
+/// waits for a look up in progress to finish.
+struct Background {
+    shared: Arc<Shared>,
+    threads: Mutex<Vec<JoinHandle<()>>>,
+}
+
+/// The state the background threads work on.
+struct Shared {
+    timers: Mutex<Timers>,
+    /// Notified when a delay is added, which may be sooner than the one the
+    /// timer thread is waiting for, and when stopping.
+    timers_changed: Condvar,
+    lookups: Mutex<Lookups>,
+    /// Notified when a look up is queued, and when stopping.
+    lookups_queued: Condvar,
+}
+
+impl Background {
+    /// Returns the background threads of the connectors alive, or new ones if
+    /// there are none.
+    fn get() -> Arc<Background> {
+        let mut current = BACKGROUND.lock().unwrap();
+        if let Some(background) = current.as_ref().and_then(Weak::upgrade) {
+            return background;
+        }
+        let background = Background::new();
+        *current = Some(Arc::downgrade(&background));
+        background
+    }
+
+    fn new() -> Arc<Background> {
+        Arc::new(Background {
+            shared: Arc::new(Shared {
+                timers: Mutex::new(Timers {
+                    pending: BTreeMap::new(),
+                    next_id: 0,
+                    started: false,
+                    stopping: false,
+                }),
+                timers_changed: Condvar::new(),
+                lookups: Mutex::new(Lookups {
+                    queue: VecDeque::new(),
+                    threads: 0,
+                    idle: 0,
+                    stopping: false,
+                }),
+                lookups_queued: Condvar::new(),
+            }),
+            threads: Mutex::new(Vec::new()),
+        })
+    }
+
+    fn spawn(&self, name: &str, run: fn(&Shared)) -> io::Result<()> {
+        let shared = self.shared.clone();
+        let handle = std::thread::Builder::new()
+            .name(name.into())
+            .spawn(move || run(&shared))?;
+        self.threads.lock().unwrap().push(handle);
+        Ok(())
+    }
+}
+
+impl Drop for Background {
+    fn drop(&mut self) {
+        self.shared.timers.lock().unwrap().stopping = true;
+        self.shared.timers_changed.notify_all();
+        self.shared.lookups.lock().unwrap().stopping = true;
+        self.shared.lookups_queued.notify_all();
+
+        // A background thread can't join itself, if it ends up dropping the
+        // last reference. It stops on its own all the same.
+        let current = std::thread::current().id();
+        for handle in self.threads.get_mut().unwrap().drain(..) {
+            if handle.thread().id() != current {
+                let _ = handle.join();
+            }
+        }
+    }
+}
+
+// ===== impl Sleep =====
+
+/// The delays waiting on the timer thread, ordered by deadline.
+struct Timers {
+    /// Keyed by deadline, and then by an id to tell equal deadlines apart.
+    pending: BTreeMap<(Instant, u64), Weak<Mutex<Signal>>>,
+    next_id: u64,
+    started: bool,
+    stopping: bool,
+}
+
+#[derive(Default)]
+struct Signal {
+    done: bool,
+    waker: Option<Waker>,
+}
+
+/// Completes once a duration has passed.
+///
+/// All delays share one timer thread. A delay that is dropped before its
+/// deadline is taken off the timer thread.
+struct Sleep {
+    background: Arc<Background>,
+    key: (Instant, u64),
+    signal: Arc<Mutex<Signal>>,
+}
+
+impl Sleep {
+    fn new(background: &Arc<Background>, dur: Duration) -> io::Result<Sleep> {
+        let shared = &background.shared;
+        let signal = Arc::new(Mutex::new(Signal::default()));
+        let mut timers = shared.timers.lock().unwrap();
+        if !timers.started {
+            background.spawn("hyper-ffi-timer", run_timers)?;
+            timers.started = true;
+        }
+        let key = (Instant::now() + dur, timers.next_id);
+        timers.next_id += 1;
+        timers.pending.insert(key, Arc::downgrade(&signal));
+        shared.timers_changed.notify_one();
+        Ok(Sleep {
+            background: background.clone(),
+            key,
+            signal,
+        })
+    }
+}
+
+impl Future for Sleep {
+    type Output = ();
+
+    fn poll(self: Pin<&mut Self>, cx: &mut Context<'_>) -> Poll<()> {
+        poll_signal(&self.signal, cx)
+    }
+}
+
+impl Drop for Sleep {
+    fn drop(&mut self) {
+        let shared = &self.background.shared;
+        shared.timers.lock().unwrap().pending.remove(&self.key);
+    }
+}
+
+fn run_timers(shared: &Shared) {
+    let mut expired = Vec::new();
+    let mut timers = shared.timers.lock().unwrap();
+    while !timers.stopping {
+        let now = Instant::now();
+        while let Some(&key) = timers.pending.keys().next() {
+            if key.0 > now {
+                break;
+            }
+            expired.extend(timers.pending.remove(&key));
+        }
+        let wait = timers
+            .pending
+            .keys()
+            .next()
+            .map(|&(deadline, _)| deadline - now);
+
+        // Wake outside of the lock, since waking may call back into C.
+        if !expired.is_empty() {
+            drop(timers);
+            for signal in expired.drain(..) {
+                if let Some(signal) = signal.upgrade() {
+                    finish(&signal);
+                }
+            }
+            timers = shared.timers.lock().unwrap();
+            continue;
+        }
+
+        timers = match wait {
+            Some(wait) => shared.timers_changed.wait_timeout(timers, wait).unwrap().0,
+            None => shared.timers_changed.wait(timers).unwrap(),
+        };
+    }
+}
+
+/// Marks a signal done and wakes its task.
+fn finish(signal: &Mutex<Signal>) {
+    let waker = {
+        let mut signal = signal.lock().unwrap();
+        signal.done = true;
+        signal.waker.take()
+    };
+    if let Some(waker) = waker {
+        waker.wake();
+    }
+}
+
+fn poll_signal(signal: &Mutex<Signal>, cx: &mut Context<'_>) -> Poll<()> {
+    let mut signal = signal.lock().unwrap();
+    if signal.done {
+        return Poll::Ready(());
+    }
+    match signal.waker {
+        Some(ref waker) if waker.will_wake(cx.waker()) => (),
+        _ => signal.waker = Some(cx.waker().clone()),
+    }
+    Poll::Pending
+}
+
+// ===== impl Lookup =====
+
+/// The most threads looking up hosts at once.
+const MAX_LOOKUP_THREADS: usize = 4;
+
+/// The look ups waiting for a lookup thread, oldest first.
+struct Lookups {
+    queue: VecDeque<Queued>,
+    threads: usize,
+    idle: usize,
+    stopping: bool,
+}
+
+struct Queued {
+    name: (String, u16),
+    lookup: Weak<LookupState>,
+}
+
+struct LookupState {
+    signal: Mutex<Signal>,
+    addrs: Mutex<Option<io::Result<Vec<SocketAddr>>>>,
+}
+
+/// A look up of a host, done by the blocking `getaddrinfo` on one of a few
+/// shared threads.
+///
+/// A look up that is dropped before a thread picks it up is never done. One
+/// that has started can't be interrupted, so its thread finishes it and
+/// throws the result away.
+struct Lookup {
+    state: Arc<LookupState>,
+}
+
+impl Lookup {
+    fn new(background: &Background, name: (String, u16)) -> io::Result<Lookup> {
+        let shared = &background.shared;
+        let state = Arc::new(LookupState {
+            signal: Mutex::new(Signal::default()),
+            addrs: Mutex::new(None),
+        });
+        let mut lookups = shared.lookups.lock().unwrap();
+        if lookups.queue.len() >= lookups.idle && lookups.threads < MAX_LOOKUP_THREADS {
+            match background.spawn("hyper-ffi-lookup", run_lookups) {
+                Ok(()) => lookups.threads += 1,
+                // The threads already running will get to it.
+                Err(_) if lookups.threads > 0 => (),
+                Err(err) => return Err(err),
+            }
+        }
+        lookups.queue.push_back(Queued {
+            name,
+            lookup: Arc::downgrade(&state),
+        });
+        shared.lookups_queued.notify_one();
+        Ok(Lookup { state })
+    }
+}
+
+impl Future for Lookup {
+    type Output = io::Result<Vec<SocketAddr>>;
+
+    fn poll(self: Pin<&mut Self>, cx: &mut Context<'_>) -> Poll<Self::Output> {
+        if poll_signal(&self.state.signal, cx).is_pending() {
+            return Poll::Pending;
+        }
+        Poll::Ready(
+            self.state
+                .addrs
+                .lock()
+                .unwrap()
+                .take()
+                .unwrap_or_else(|| Err(io::Error::new(io::ErrorKind::Other, "look up failed"))),
+        )
+    }
+}
+
+fn run_lookups(shared: &Shared) {
+    let mut lookups = shared.lookups.lock().unwrap();
+    while !lookups.stopping {
+        let queued = match lookups.queue.pop_front() {
+            Some(queued) => queued,
+            None => {
+                lookups.idle += 1;
+                lookups = shared.lookups_queued.wait(lookups).unwrap();
+                lookups.idle -= 1;
+                continue;
+            }
+        };
+        if queued.lookup.strong_count() == 0 {
+            continue;
+        }
+
+        drop(lookups);
+        let addrs = queued.name.to_socket_addrs().map(|addrs| addrs.collect());
+        if let Some(lookup) = queued.lookup.upgrade() {
+            *lookup.addrs.lock().unwrap() = Some(addrs);
+            finish(&lookup.signal);
+        }
+        lookups = shared.lookups.lock().unwrap();
+    }
+}
+
+/// Fails a future with a timeout error if it takes longer than a duration.
+struct Timeout<F> {
+    future: Pin<Box<F>>,
+    delay: Sleep,
+}
+
+impl<F: Future> Timeout<F> {
+    fn new(background: &Arc<Background>, future: F, dur: Duration) -> io::Result<Timeout<F>> {
+        Ok(Timeout {
+            future: Box::pin(future),
+            delay: Sleep::new(background, dur)?,
+        })
+    }
+}
+
+impl<F, T> Future for Timeout<F>
+where
+    F: Future<Output = io::Result<T>>,
+{
+    type Output = io::Result<T>;
+
+    fn poll(mut self: Pin<&mut Self>, cx: &mut Context<'_>) -> Poll<Self::Output> {
+        if let Poll::Ready(out) = self.future.as_mut().poll(cx) {
+            return Poll::Ready(out);
+        }
+        match Pin::new(&mut self.delay).poll(cx) {
+            Poll::Ready(()) => Poll::Ready(Err(io::Error::new(
+                io::ErrorKind::TimedOut,
+                "connect timed out",
+            ))),
+            Poll::Pending => Poll::Pending,
+        }
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use std::net::TcpListener;
+    use std::os::unix::io::AsRawFd;
+
+    use crate::ffi::{
+        hyper_executor_free, hyper_executor_new, hyper_executor_poll, hyper_executor_push,
+        hyper_io_free, hyper_task_free, hyper_task_return_type, hyper_task_type, hyper_task_value,
+        hyper_waker, hyper_waker_wake_by_ref,
+    };
+
+    thread_local! {
+        static WAKERS: std::cell::RefCell<Vec<(c_int, *mut hyper_waker)>> = Default::default();
+    }
+
+    /// Wakes the task on the next turn of `run`, so that a task that is
+    /// never done still lets `run` give up.
+    extern "C" fn wake_later(_: *mut c_void, fd: c_int, _: c_int, waker: *mut hyper_waker) {
+        WAKERS.with(|wakers| {
+            let mut wakers = wakers.borrow_mut();
+            if waker.is_null() {
+                wakers.retain(|&(waiting, _)| waiting != fd);
+            } else {
+                wakers.push((fd, waker));
+            }
+        });
+    }
+
+    fn connect(host: &str, port: u16) -> *mut hyper_task {
+        let connector = hyper_connector_new(wake_later, ptr::null_mut());
+        let task = hyper_connector_connect(connector, host.as_ptr(), host.len(), port);
+        hyper_connector_free(connector);
+        run(task)
+    }
+
+    fn run(task: *mut hyper_task) -> *mut hyper_task {
+        let deadline = Instant::now() + Duration::from_secs(10);
+        let exec = hyper_executor_new();
+        hyper_executor_push(exec, task);
+        let task = loop {
+            let task = hyper_executor_poll(exec);
+            if !task.is_null() {
+                break task;
+            }
+            assert!(Instant::now() < deadline, "connect didn't finish");
+            for (_, waker) in WAKERS.with(|wakers| wakers.take()) {
+                hyper_waker_wake_by_ref(waker);
+            }
+        };
+        hyper_executor_free(exec);
+        task
+    }
+
+    #[test]
+    fn test_connector_connects() {
+        let listener = std::net::TcpListener::bind("127.0.0.1:0").unwrap();
+        let port = listener.local_addr().unwrap().port();
+
+        let task = connect("127.0.0.1", port);
+        assert!(matches!(
+            hyper_task_type(task),
+            hyper_task_return_type::HYPER_TASK_IO
+        ));
+        let io = hyper_task_value(task) as *mut hyper_io;
+        hyper_task_free(task);
+        listener.accept().unwrap();
+        hyper_io_free(io);
+
+        // Looked up on a lookup thread, and maybe tried over IPv6 first.
+        let task = connect("localhost", port);
+        assert!(matches!(
+            hyper_task_type(task),
+            hyper_task_return_type::HYPER_TASK_IO
+        ));
+        let io = hyper_task_value(task) as *mut hyper_io;
+        hyper_task_free(task);
+        listener.accept().unwrap();
+        hyper_io_free(io);
+
+        drop(listener);
+        let task = connect("127.0.0.1", port);
+        assert!(matches!(
+            hyper_task_type(task),
+            hyper_task_return_type::HYPER_TASK_ERROR
+        ));
+        hyper_task_free(task);
+    }
+
+    #[test]
+    fn test_connecting_starts_next_after_failure() {
+        // A listener with a full accept queue drops new connects, like an
+        // address that is blackholed.
+        let blackholed = TcpListener::bind("127.0.0.1:0").unwrap();
+        assert_eq!(unsafe { libc::listen(blackholed.as_raw_fd(), 0) }, 0);
+        let blackholed_addr = blackholed.local_addr().unwrap();
+        let _fill = (0..3)
+            .map(|_| Attempt::start(blackholed_addr, wake_later, ptr::null_mut()).unwrap())
+            .collect::<Vec<_>>();
+        std::thread::sleep(Duration::from_millis(100));
+
+        let refused_addr = TcpListener::bind("127.0.0.1:0")
+            .unwrap()
+            .local_addr()
+            .unwrap();
+        let good = TcpListener::bind("127.0.0.1:0").unwrap();
+
+        // The second attempt is refused once the delay has passed, which
+        // must start the third right away, while the first still hangs.
+        let addrs = VecDeque::from(vec![
+            blackholed_addr,
+            refused_addr,
+            good.local_addr().unwrap(),
+        ]);
+        let connecting = Connecting::new(
+            &Background::get(),
+            addrs,
+            Duration::from_millis(50),
+            wake_later,
+            UserDataPointer(ptr::null_mut()),
+        );
+        let task = Box::into_raw(hyper_task::boxed(async move {
+            match connecting.await {
+                Ok(waits) => Ok(hyper_io::owned_fd(waits)),
+                Err(err) => Err(crate::Error::new_io(err)),
+            }
+        }));
+
+        let task = run(task);
+        assert!(matches!(
+            hyper_task_type(task),
+            hyper_task_return_type::HYPER_TASK_IO
+        ));
+        let io = hyper_task_value(task) as *mut hyper_io;
+        hyper_task_free(task);
+        good.accept().unwrap();
+        hyper_io_free(io);
+    }
+
+    #[test]
+    fn test_sleep_shares_timer_thread() {
+        let start = Instant::now();
+        let background = Background::get();
+        let mut long = Sleep::new(&background, Duration::from_secs(60)).unwrap();
+        let mut short = Sleep::new(&background, Duration::from_millis(20)).unwrap();
+
+        let task = Box::into_raw(hyper_task::boxed(async move {
+            (&mut short).await;
+            // The later deadline doesn't hold up the sooner one.
+            assert!(Pin::new(&mut long)
+                .poll(&mut Context::from_waker(
+                    futures_util::task::noop_waker_ref()
+                ))
+                .is_pending());
+        }));
+        let task = run(task);
+        assert!(matches!(
+            hyper_task_type(task),
+            hyper_task_return_type::HYPER_TASK_EMPTY
+        ));
+        hyper_task_free(task);
+        assert!(start.elapsed() >= Duration::from_millis(20));
+    }
+
+    #[test]
+    fn test_background_threads_stop_when_dropped() {
+        let background = Background::new();
+        let shared = Arc::downgrade(&background.shared);
+
+        // A dropped delay doesn't linger on the timer thread.
+        drop(Sleep::new(&background, Duration::from_secs(60)).unwrap());
+        assert!(background.shared.timers.lock().unwrap().pending.is_empty());
+
+        let lookup = Lookup::new(&background, ("localhost".into(), 80)).unwrap();
+        let task = run(Box::into_raw(hyper_task::boxed(async move {
+            let _ = lookup.await;
+        })));
+        hyper_task_free(task);
+        assert_eq!(background.threads.lock().unwrap().len(), 2);
+
+        // Both threads are joined, and let go of their state.
+        drop(background);
+        assert_eq!(shared.strong_count(), 0);
+    }
+
+    #[test]
+    fn test_interleave_families() {
+        let addrs = [
+            "[::1]:80",
+            "[::2]:80",
+            "1.1.1.1:80",
+            "[::3]:80",
+            "2.2.2.2:80",
+        ]
+        .iter()
+        .map(|addr| addr.parse().unwrap())
+        .collect();
+        let ordered = interleave(addrs)
+            .into_iter()
+            .map(|addr| addr.to_string())
+            .collect::<Vec<_>>();
+        assert_eq!(
+            ordered,
+            [
+                "[::1]:80",
+                "1.1.1.1:80",
+                "[::2]:80",
+                "2.2.2.2:80",
+                "[::3]:80"
+            ]
+        );
+    }
+}
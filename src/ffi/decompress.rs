@@ -0,0 +1,229 @@
+//! Decoding of compressed response bodies, for `hyper_response_body_decoded`.
+//!
+//! Decoders are only available with the `ffi-decompression` feature. Without
+//! it, `Decoder` has no variants, so no body is ever decoded.
+
+#[cfg(feature = "ffi-decompression")]
+use std::io::{self, Write};
+
+#[cfg(feature = "ffi-decompression")]
+use bytes::buf::Writer;
+#[cfg(feature = "ffi-decompression")]
+use bytes::{Buf, BufMut, BytesMut};
+#[cfg(feature = "ffi-decompression")]
+use flate2::write::{GzDecoder, ZlibDecoder};
+
+use crate::body::Bytes;
+
+/// The size the output buffer of a decoder starts with.
+#[cfg(feature = "ffi-decompression")]
+const INIT_OUTPUT_SIZE: usize = 8192;
+
+/// Once this much output is ready, decoding stops until it's been returned.
+///
+/// A small compressed chunk can inflate to a huge amount of data, so the
+/// chunk is decoded piece by piece instead of all at once. A piece can go
+/// over this by the size of the decoder's own buffer (32 KiB), which each
+/// write moves into the output before decoding more.
+#[cfg(feature = "ffi-decompression")]
+const MAX_OUTPUT_SIZE: usize = 64 * 1024;
+
+/// Decodes a body with one content coding.
+///
+/// The output is written into a single buffer, which each decoded chunk is
+/// split off of. Once the C side frees a chunk, its memory is used again
+/// for the next one.
+pub(super) struct Decoder {
+    stream: Stream,
+    /// The part of the last chunk that hasn't been decoded yet.
+    input: Bytes,
+}
+
+enum Stream {
+    #[cfg(feature = "ffi-decompression")]
+    Gzip(GzDecoder<Writer<BytesMut>>),
+    #[cfg(feature = "ffi-decompression")]
+    Deflate(ZlibDecoder<Writer<BytesMut>>),
+}
+
+impl Decoder {
+    /// Returns a decoder for a `content-encoding`, or `None` if it isn't
+    /// supported.
+    #[cfg_attr(not(feature = "ffi-decompression"), allow(unused_variables))]
+    pub(super) fn for_encoding(encoding: &[u8]) -> Option<Decoder> {
+        #[cfg(feature = "ffi-decompression")]
+        {
+            let output = BytesMut::with_capacity(INIT_OUTPUT_SIZE).writer();
+            let stream = if encoding.eq_ignore_ascii_case(b"gzip")
+                || encoding.eq_ignore_ascii_case(b"x-gzip")
+            {
+                Stream::Gzip(GzDecoder::new(output))
+            } else if encoding.eq_ignore_ascii_case(b"deflate") {
+                Stream::Deflate(ZlibDecoder::new(output))
+            } else {
+                return None;
+            };
+            Some(Decoder {
+                stream,
+                input: Bytes::new(),
+            })
+        }
+        #[cfg(not(feature = "ffi-decompression"))]
+        None
+    }
+
+    /// Whether part of the last chunk is still left for `decode_more`.
+    pub(super) fn has_input(&self) -> bool {
+        !self.input.is_empty()
+    }
+
+    /// Decodes the next chunk of the body, returning the output that's ready.
+    ///
+    /// The output may be empty, if the chunk didn't complete a block. If the
+    /// chunk decodes to more than `MAX_OUTPUT_SIZE`, the rest is kept for
+    /// `decode_more`, which must be called before the next chunk.
+    pub(super) fn decode(&mut self, chunk: Bytes) -> crate::Result<Bytes> {
+        debug_assert!(!self.has_input(), "decode called with input left");
+        self.input = chunk;
+        self.decode_more()
+    }
+
+    /// Decodes more of the last chunk, returning the output that's ready.
+    pub(super) fn decode_more(&mut self) -> crate::Result<Bytes> {
+        #[cfg(feature = "ffi-decompression")]
+        {
+            while !self.input.is_empty() && self.stream.output().len() < MAX_OUTPUT_SIZE {
+                match self.stream.writer().write(&self.input) {
+                    Ok(0) => {
+                        // Data after the end of the compressed stream.
+                        let err = io::Error::from(io::ErrorKind::WriteZero);
+                        return Err(crate::Error::new_body(err));
+                    }
+                    Ok(n) => self.input.advance(n),
+                    Err(ref err) if err.kind() == io::ErrorKind::Interrupted => {}
+                    Err(err) => return Err(crate::Error::new_body(err)),
+                }
+            }
+            Ok(self.stream.output().split().freeze())
+        }
+        #[cfg(not(feature = "ffi-decompression"))]
+        match self.stream {}
+    }
+
+    /// Finishes decoding once the body has ended, returning the rest of the
+    /// output.
+    ///
+    /// Fails if the body ended in the middle of the compressed stream.
+    pub(super) fn finish(&mut self) -> crate::Result<Bytes> {
+        debug_assert!(!self.has_input(), "finish called with input left");
+        match self.stream {
+            #[cfg(feature = "ffi-decompression")]
+            Stream::Gzip(ref mut gz) => {
+                gz.try_finish().map_err(crate::Error::new_body)?;
+            }
+            #[cfg(feature = "ffi-decompression")]
+            Stream::Deflate(ref mut zlib) => {
+                zlib.try_finish().map_err(crate::Error::new_body)?;
+            }
+        }
+        #[cfg(feature = "ffi-decompression")]
+        Ok(self.stream.output().split().freeze())
+    }
+}
+
+#[cfg(feature = "ffi-decompression")]
+impl Stream {
+    fn writer(&mut self) -> &mut dyn Write {
+        match *self {
+            Stream::Gzip(ref mut gz) => gz,
+            Stream::Deflate(ref mut zlib) => zlib,
+        }
+    }
+
+    fn output(&mut self) -> &mut BytesMut {
+        match *self {
+            Stream::Gzip(ref mut gz) => gz.get_mut().get_mut(),
+            Stream::Deflate(ref mut zlib) => zlib.get_mut().get_mut(),
+        }
+    }
+}
+
+#[cfg(all(test, feature = "ffi-decompression"))]
+mod tests {
+    use super::*;
+    use flate2::write::{GzEncoder, ZlibEncoder};
+    use flate2::Compression;
+
+    fn decode_in_chunks(mut decoder: Decoder, encoded: &[u8], chunk_size: usize) -> Vec<u8> {
+        let mut out = Vec::new();
+        for chunk in encoded.chunks(chunk_size) {
+            out.extend_from_slice(&decoder.decode(Bytes::copy_from_slice(chunk)).unwrap());
+            while decoder.has_input() {
+                out.extend_from_slice(&decoder.decode_more().unwrap());
+            }
+        }
+        out.extend_from_slice(&decoder.finish().unwrap());
+        out
+    }
+
+    #[test]
+    fn test_decode_gzip_and_deflate() {
+        let plain = b"hello from hyper, ".repeat(1000);
+
+        let mut gz = GzEncoder::new(Vec::new(), Compression::default());
+        gz.write_all(&plain).unwrap();
+        let gz = gz.finish().unwrap();
+        let decoder = Decoder::for_encoding(b"GZIP").unwrap();
+        assert_eq!(decode_in_chunks(decoder, &gz, 7), plain);
+
+        let mut zlib = ZlibEncoder::new(Vec::new(), Compression::default());
+        zlib.write_all(&plain).unwrap();
+        let zlib = zlib.finish().unwrap();
+        let decoder = Decoder::for_encoding(b"deflate").unwrap();
+        assert_eq!(decode_in_chunks(decoder, &zlib, 1024), plain);
+
+        assert!(Decoder::for_encoding(b"br").is_none());
+    }
+
+    #[test]
+    fn test_decode_truncated_gzip_fails() {
+        let mut gz = GzEncoder::new(Vec::new(), Compression::default());
+        gz.write_all(b"hello").unwrap();
+        let gz = gz.finish().unwrap();
+
+        let mut decoder = Decoder::for_encoding(b"gzip").unwrap();
+        decoder.decode(Bytes::copy_from_slice(&gz[..5])).unwrap();
+        assert!(decoder.finish().is_err());
+    }
+
+    #[test]
+    fn test_decode_large_output_in_pieces() {
+        // 16 MiB of zeros compress to a few KiB, all sent as one chunk.
+        let plain = vec![0u8; 16 * 1024 * 1024];
+        let mut gz = GzEncoder::new(Vec::new(), Compression::best());
+        gz.write_all(&plain).unwrap();
+        let gz = Bytes::from(gz.finish().unwrap());
+        assert!(gz.len() < 64 * 1024);
+
+        let mut decoder = Decoder::for_encoding(b"gzip").unwrap();
+        let mut out = decoder.decode(gz).unwrap();
+        let mut total = 0;
+        let mut pieces = 0;
+        loop {
+            assert!(
+                out.len() <= MAX_OUTPUT_SIZE + 32 * 1024,
+                "piece of {}",
+                out.len()
+            );
+            total += out.len();
+            pieces += 1;
+            if !decoder.has_input() {
+                break;
+            }
+            out = decoder.decode_more().unwrap();
+        }
+        total += decoder.finish().unwrap().len();
+        assert_eq!(total, plain.len());
+        assert!(pieces > 100);
+    }
+}
@@ -1,14 +1,20 @@
 use bytes::Bytes;
 use libc::{c_int, size_t};
 use std::ffi::c_void;
+use std::sync::Arc;
 
 use super::body::hyper_body;
+#[cfg(unix)]
+use super::body::SendFile;
+use super::decompress::Decoder;
 use super::error::hyper_code;
+use super::recycle::{self, Recycle};
+use super::stats::{hyper_request_timings, RequestStats};
 use super::task::{hyper_task_return_type, AsTaskType};
 use super::{UserDataPointer, HYPER_ITER_CONTINUE};
 use crate::body::Incoming as IncomingBody;
 use crate::ext::{HeaderCaseMap, OriginalHeaderOrder, ReasonPhrase};
-use crate::header::{HeaderName, HeaderValue};
+use crate::header::{self, HeaderName, HeaderValue};
 use crate::{HeaderMap, Method, Request, Response, Uri};
 
 /// An HTTP request.
@@ -16,16 +22,25 @@ use crate::{HeaderMap, Method, Request, Response, Uri};
 /// Once you've finished constructing a request, you can send it with
 /// `hyper_clientconn_send`.
 ///
+/// A server connection passes each request it receives to its
+/// `hyper_service`.
+///
 /// Methods:
 ///
 /// - hyper_request_new:              Construct a new HTTP request.
+/// - hyper_request_reset:            Reset a request to how `hyper_request_new` makes it.
+/// - hyper_request_method:           Get the HTTP Method of this request.
+/// - hyper_request_uri_parts:        Get the scheme, authority, and path/query of this request's URI.
+/// - hyper_request_version:          Get the HTTP version of this request.
 /// - hyper_request_headers:          Gets a mutable reference to the HTTP headers of this request
+/// - hyper_request_body:             Take ownership of the body of this request.
 /// - hyper_request_set_body:         Set the body of the request.
 /// - hyper_request_set_method:       Set the HTTP Method of the request.
 /// - hyper_request_set_uri:          Set the URI of the request.
 /// - hyper_request_set_uri_parts:    Set the URI of the request with separate scheme, authority, and path/query strings.
 /// - hyper_request_set_version:      Set the preferred HTTP version of the request.
 /// - hyper_request_on_informational: Set an informational (1xx) response callback.
+/// - hyper_request_set_header_template: Add the headers of a template to the request.
 /// - hyper_request_free:             Free an HTTP request.
 pub struct hyper_request(pub(super) Request<IncomingBody>);
 
@@ -38,14 +53,22 @@ pub struct hyper_request(pub(super) Request<IncomingBody>);
 /// previously have set to an application-specific identifier for the
 /// request.
 ///
+/// To answer a request received by a server connection, construct one with
+/// `hyper_response_new` and send it with `hyper_response_channel_send`.
+///
 /// Methods:
 ///
+/// - hyper_response_new:               Construct a new HTTP response.
+/// - hyper_response_set_status:        Set the HTTP-Status code of this response.
+/// - hyper_response_set_body:          Set the body of this response.
 /// - hyper_response_status:            Get the HTTP-Status code of this response.
 /// - hyper_response_version:           Get the HTTP version used by this response.
 /// - hyper_response_reason_phrase:     Get a pointer to the reason-phrase of this response.
 /// - hyper_response_reason_phrase_len: Get the length of the reason-phrase of this response.
 /// - hyper_response_headers:           Gets a reference to the HTTP headers of this response.
 /// - hyper_response_body:              Take ownership of the body of this response.
+/// - hyper_response_body_decoded:      Take ownership of the body of this response, decoding it.
+/// - hyper_response_timings:           Copy the timings of this response's request so far.
 /// - hyper_response_free:              Free an HTTP response.
 pub struct hyper_response(pub(super) Response<IncomingBody>);
 
@@ -58,16 +81,358 @@ pub struct hyper_response(pub(super) Response<IncomingBody>);
 ///
 /// Methods:
 ///
-/// - hyper_headers_add:     Adds the provided value to the list of the provided name.
-/// - hyper_headers_foreach: Iterates the headers passing each name and value pair to the callback.
-/// - hyper_headers_set:     Sets the header with the provided name to the provided value.
+/// - hyper_headers_add:      Adds the provided value to the list of the provided name.
+/// - hyper_headers_add_many: Adds many name and value pairs at once.
+/// - hyper_headers_foreach:  Iterates the headers passing each name and value pair to the callback.
+/// - hyper_headers_get:      Gets the first value of the header with the provided name.
+/// - hyper_headers_reserve:  Reserves capacity for at least `additional` more headers.
+/// - hyper_headers_set:      Sets the header with the provided name to the provided value.
+/// - hyper_headers_snapshot: Gets a contiguous array of every header name and value pair.
 #[derive(Clone)]
 pub struct hyper_headers {
     pub(super) headers: HeaderMap,
     orig_casing: HeaderCaseMap,
     orig_order: OriginalHeaderOrder,
+    snapshot: Snapshot,
+}
+
+/// A header name and value, as returned by `hyper_headers_snapshot`.
+#[repr(C)]
+pub struct hyper_header_entry {
+    /// Pointer to the header name.
+    pub name: *const u8,
+    /// The length of `name`.
+    pub name_len: size_t,
+    /// Pointer to the header value.
+    pub value: *const u8,
+    /// The length of `value`.
+    pub value_len: size_t,
+}
+
+/// The entries last returned by `hyper_headers_snapshot`, pointing into the
+/// headers that own it.
+#[derive(Default)]
+struct Snapshot(Vec<hyper_header_entry>);
+
+/// A header name and value, to be added with `hyper_headers_add_many`.
+#[repr(C)]
+pub struct hyper_header_pair {
+    /// One of the `HYPER_HEADER_*` constants, or `HYPER_HEADER_CUSTOM` to
+    /// use `name` instead.
+    pub name_id: c_int,
+    /// Pointer to the header name, if `name_id` is `HYPER_HEADER_CUSTOM`.
+    pub name: *const u8,
+    /// The length of `name`.
+    pub name_len: size_t,
+    /// Pointer to the header value.
+    pub value: *const u8,
+    /// The length of `value`.
+    pub value_len: size_t,
+}
+
+/// A block of request headers, encoded once to send with many requests.
+///
+/// The headers are validated and encoded when the template is created.
+///
+/// Methods:
+///
+/// - hyper_header_template_new:  Create a header template from name and value pairs.
+/// - hyper_header_template_free: Free a header template.
+pub struct hyper_header_template(HeaderTemplate);
+
+/// The headers of a `hyper_header_template`, carried in the extensions of
+/// each request it is added to.
+#[derive(Clone)]
+pub(crate) struct HeaderTemplate(Arc<TemplateHeaders>);
+
+struct TemplateHeaders {
+    /// For HTTP/2, which needs them in the request's `HeaderMap`.
+    headers: Vec<(HeaderName, HeaderValue)>,
+    /// Every header line, as the HTTP/1 encoder writes it.
+    encoded: Vec<u8>,
 }
 
+/// Use the `name` of a `hyper_header_pair`, instead of a standard header.
+pub const HYPER_HEADER_CUSTOM: c_int = 0;
+/// The `accept` header.
+pub const HYPER_HEADER_ACCEPT: c_int = 1;
+/// The `accept-charset` header.
+pub const HYPER_HEADER_ACCEPT_CHARSET: c_int = 2;
+/// The `accept-encoding` header.
+pub const HYPER_HEADER_ACCEPT_ENCODING: c_int = 3;
+/// The `accept-language` header.
+pub const HYPER_HEADER_ACCEPT_LANGUAGE: c_int = 4;
+/// The `accept-ranges` header.
+pub const HYPER_HEADER_ACCEPT_RANGES: c_int = 5;
+/// The `access-control-allow-credentials` header.
+pub const HYPER_HEADER_ACCESS_CONTROL_ALLOW_CREDENTIALS: c_int = 6;
+/// The `access-control-allow-headers` header.
+pub const HYPER_HEADER_ACCESS_CONTROL_ALLOW_HEADERS: c_int = 7;
+/// The `access-control-allow-methods` header.
+pub const HYPER_HEADER_ACCESS_CONTROL_ALLOW_METHODS: c_int = 8;
+/// The `access-control-allow-origin` header.
+pub const HYPER_HEADER_ACCESS_CONTROL_ALLOW_ORIGIN: c_int = 9;
+/// The `access-control-expose-headers` header.
+pub const HYPER_HEADER_ACCESS_CONTROL_EXPOSE_HEADERS: c_int = 10;
+/// The `access-control-max-age` header.
+pub const HYPER_HEADER_ACCESS_CONTROL_MAX_AGE: c_int = 11;
+/// The `access-control-request-headers` header.
+pub const HYPER_HEADER_ACCESS_CONTROL_REQUEST_HEADERS: c_int = 12;
+/// The `access-control-request-method` header.
+pub const HYPER_HEADER_ACCESS_CONTROL_REQUEST_METHOD: c_int = 13;
+/// The `age` header.
+pub const HYPER_HEADER_AGE: c_int = 14;
+/// The `allow` header.
+pub const HYPER_HEADER_ALLOW: c_int = 15;
+/// The `alt-svc` header.
+pub const HYPER_HEADER_ALT_SVC: c_int = 16;
+/// The `authorization` header.
+pub const HYPER_HEADER_AUTHORIZATION: c_int = 17;
+/// The `cache-control` header.
+pub const HYPER_HEADER_CACHE_CONTROL: c_int = 18;
+/// The `connection` header.
+pub const HYPER_HEADER_CONNECTION: c_int = 19;
+/// The `content-disposition` header.
+pub const HYPER_HEADER_CONTENT_DISPOSITION: c_int = 20;
+/// The `content-encoding` header.
+pub const HYPER_HEADER_CONTENT_ENCODING: c_int = 21;
+/// The `content-language` header.
+pub const HYPER_HEADER_CONTENT_LANGUAGE: c_int = 22;
+/// The `content-length` header.
+pub const HYPER_HEADER_CONTENT_LENGTH: c_int = 23;
+/// The `content-location` header.
+pub const HYPER_HEADER_CONTENT_LOCATION: c_int = 24;
+/// The `content-range` header.
+pub const HYPER_HEADER_CONTENT_RANGE: c_int = 25;
+/// The `content-security-policy` header.
+pub const HYPER_HEADER_CONTENT_SECURITY_POLICY: c_int = 26;
+/// The `content-security-policy-report-only` header.
+pub const HYPER_HEADER_CONTENT_SECURITY_POLICY_REPORT_ONLY: c_int = 27;
+/// The `content-type` header.
+pub const HYPER_HEADER_CONTENT_TYPE: c_int = 28;
+/// The `cookie` header.
+pub const HYPER_HEADER_COOKIE: c_int = 29;
+/// The `dnt` header.
+pub const HYPER_HEADER_DNT: c_int = 30;
+/// The `date` header.
+pub const HYPER_HEADER_DATE: c_int = 31;
+/// The `etag` header.
+pub const HYPER_HEADER_ETAG: c_int = 32;
+/// The `expect` header.
+pub const HYPER_HEADER_EXPECT: c_int = 33;
+/// The `expires` header.
+pub const HYPER_HEADER_EXPIRES: c_int = 34;
+/// The `forwarded` header.
+pub const HYPER_HEADER_FORWARDED: c_int = 35;
+/// The `from` header.
+pub const HYPER_HEADER_FROM: c_int = 36;
+/// The `host` header.
+pub const HYPER_HEADER_HOST: c_int = 37;
+/// The `if-match` header.
+pub const HYPER_HEADER_IF_MATCH: c_int = 38;
+/// The `if-modified-since` header.
+pub const HYPER_HEADER_IF_MODIFIED_SINCE: c_int = 39;
+/// The `if-none-match` header.
+pub const HYPER_HEADER_IF_NONE_MATCH: c_int = 40;
+/// The `if-range` header.
+pub const HYPER_HEADER_IF_RANGE: c_int = 41;
+/// The `if-unmodified-since` header.
+pub const HYPER_HEADER_IF_UNMODIFIED_SINCE: c_int = 42;
+/// The `last-modified` header.
+pub const HYPER_HEADER_LAST_MODIFIED: c_int = 43;
+/// The `link` header.
+pub const HYPER_HEADER_LINK: c_int = 44;
+/// The `location` header.
+pub const HYPER_HEADER_LOCATION: c_int = 45;
+/// The `max-forwards` header.
+pub const HYPER_HEADER_MAX_FORWARDS: c_int = 46;
+/// The `origin` header.
+pub const HYPER_HEADER_ORIGIN: c_int = 47;
+/// The `pragma` header.
+pub const HYPER_HEADER_PRAGMA: c_int = 48;
+/// The `proxy-authenticate` header.
+pub const HYPER_HEADER_PROXY_AUTHENTICATE: c_int = 49;
+/// The `proxy-authorization` header.
+pub const HYPER_HEADER_PROXY_AUTHORIZATION: c_int = 50;
+/// The `public-key-pins` header.
+pub const HYPER_HEADER_PUBLIC_KEY_PINS: c_int = 51;
+/// The `public-key-pins-report-only` header.
+pub const HYPER_HEADER_PUBLIC_KEY_PINS_REPORT_ONLY: c_int = 52;
+/// The `range` header.
+pub const HYPER_HEADER_RANGE: c_int = 53;
+/// The `referer` header.
+pub const HYPER_HEADER_REFERER: c_int = 54;
+/// The `referrer-policy` header.
+pub const HYPER_HEADER_REFERRER_POLICY: c_int = 55;
+/// The `refresh` header.
+pub const HYPER_HEADER_REFRESH: c_int = 56;
+/// The `retry-after` header.
+pub const HYPER_HEADER_RETRY_AFTER: c_int = 57;
+/// The `sec-websocket-accept` header.
+pub const HYPER_HEADER_SEC_WEBSOCKET_ACCEPT: c_int = 58;
+/// The `sec-websocket-extensions` header.
+pub const HYPER_HEADER_SEC_WEBSOCKET_EXTENSIONS: c_int = 59;
+/// The `sec-websocket-key` header.
+pub const HYPER_HEADER_SEC_WEBSOCKET_KEY: c_int = 60;
+/// The `sec-websocket-protocol` header.
+pub const HYPER_HEADER_SEC_WEBSOCKET_PROTOCOL: c_int = 61;
+/// The `sec-websocket-version` header.
+pub const HYPER_HEADER_SEC_WEBSOCKET_VERSION: c_int = 62;
+/// The `server` header.
+pub const HYPER_HEADER_SERVER: c_int = 63;
+/// The `set-cookie` header.
+pub const HYPER_HEADER_SET_COOKIE: c_int = 64;
+/// The `strict-transport-security` header.
+pub const HYPER_HEADER_STRICT_TRANSPORT_SECURITY: c_int = 65;
+/// The `te` header.
+pub const HYPER_HEADER_TE: c_int = 66;
+/// The `trailer` header.
+pub const HYPER_HEADER_TRAILER: c_int = 67;
+/// The `transfer-encoding` header.
+pub const HYPER_HEADER_TRANSFER_ENCODING: c_int = 68;
+/// The `user-agent` header.
+pub const HYPER_HEADER_USER_AGENT: c_int = 69;
+/// The `upgrade` header.
+pub const HYPER_HEADER_UPGRADE: c_int = 70;
+/// The `upgrade-insecure-requests` header.
+pub const HYPER_HEADER_UPGRADE_INSECURE_REQUESTS: c_int = 71;
+/// The `vary` header.
+pub const HYPER_HEADER_VARY: c_int = 72;
+/// The `via` header.
+pub const HYPER_HEADER_VIA: c_int = 73;
+/// The `warning` header.
+pub const HYPER_HEADER_WARNING: c_int = 74;
+/// The `www-authenticate` header.
+pub const HYPER_HEADER_WWW_AUTHENTICATE: c_int = 75;
+/// The `x-content-type-options` header.
+pub const HYPER_HEADER_X_CONTENT_TYPE_OPTIONS: c_int = 76;
+/// The `x-dns-prefetch-control` header.
+pub const HYPER_HEADER_X_DNS_PREFETCH_CONTROL: c_int = 77;
+/// The `x-frame-options` header.
+pub const HYPER_HEADER_X_FRAME_OPTIONS: c_int = 78;
+/// The `x-xss-protection` header.
+pub const HYPER_HEADER_X_XSS_PROTECTION: c_int = 79;
+
+/// Standard header names and their spelling, indexed by their `HYPER_HEADER_*`
+/// constant minus one.
+static STANDARD_HEADERS: [(HeaderName, &[u8]); 79] = [
+    (header::ACCEPT, b"accept"),
+    (header::ACCEPT_CHARSET, b"accept-charset"),
+    (header::ACCEPT_ENCODING, b"accept-encoding"),
+    (header::ACCEPT_LANGUAGE, b"accept-language"),
+    (header::ACCEPT_RANGES, b"accept-ranges"),
+    (
+        header::ACCESS_CONTROL_ALLOW_CREDENTIALS,
+        b"access-control-allow-credentials",
+    ),
+    (
+        header::ACCESS_CONTROL_ALLOW_HEADERS,
+        b"access-control-allow-headers",
+    ),
+    (
+        header::ACCESS_CONTROL_ALLOW_METHODS,
+        b"access-control-allow-methods",
+    ),
+    (
+        header::ACCESS_CONTROL_ALLOW_ORIGIN,
+        b"access-control-allow-origin",
+    ),
+    (
+        header::ACCESS_CONTROL_EXPOSE_HEADERS,
+        b"access-control-expose-headers",
+    ),
+    (header::ACCESS_CONTROL_MAX_AGE, b"access-control-max-age"),
+    (
+        header::ACCESS_CONTROL_REQUEST_HEADERS,
+        b"access-control-request-headers",
+    ),
+    (
+        header::ACCESS_CONTROL_REQUEST_METHOD,
+        b"access-control-request-method",
+    ),
+    (header::AGE, b"age"),
+    (header::ALLOW, b"allow"),
+    (header::ALT_SVC, b"alt-svc"),
+    (header::AUTHORIZATION, b"authorization"),
+    (header::CACHE_CONTROL, b"cache-control"),
+    (header::CONNECTION, b"connection"),
+    (header::CONTENT_DISPOSITION, b"content-disposition"),
+    (header::CONTENT_ENCODING, b"content-encoding"),
+    (header::CONTENT_LANGUAGE, b"content-language"),
+    (header::CONTENT_LENGTH, b"content-length"),
+    (header::CONTENT_LOCATION, b"content-location"),
+    (header::CONTENT_RANGE, b"content-range"),
+    (header::CONTENT_SECURITY_POLICY, b"content-security-policy"),
+    (
+        header::CONTENT_SECURITY_POLICY_REPORT_ONLY,
+        b"content-security-policy-report-only",
+    ),
+    (header::CONTENT_TYPE, b"content-type"),
+    (header::COOKIE, b"cookie"),
+    (header::DNT, b"dnt"),
+    (header::DATE, b"date"),
+    (header::ETAG, b"etag"),
+    (header::EXPECT, b"expect"),
+    (header::EXPIRES, b"expires"),
+    (header::FORWARDED, b"forwarded"),
+    (header::FROM, b"from"),
+    (header::HOST, b"host"),
+    (header::IF_MATCH, b"if-match"),
+    (header::IF_MODIFIED_SINCE, b"if-modified-since"),
+    (header::IF_NONE_MATCH, b"if-none-match"),
+    (header::IF_RANGE, b"if-range"),
+    (header::IF_UNMODIFIED_SINCE, b"if-unmodified-since"),
+    (header::LAST_MODIFIED, b"last-modified"),
+    (header::LINK, b"link"),
+    (header::LOCATION, b"location"),
+    (header::MAX_FORWARDS, b"max-forwards"),
+    (header::ORIGIN, b"origin"),
+    (header::PRAGMA, b"pragma"),
+    (header::PROXY_AUTHENTICATE, b"proxy-authenticate"),
+    (header::PROXY_AUTHORIZATION, b"proxy-authorization"),
+    (header::PUBLIC_KEY_PINS, b"public-key-pins"),
+    (
+        header::PUBLIC_KEY_PINS_REPORT_ONLY,
+        b"public-key-pins-report-only",
+    ),
+    (header::RANGE, b"range"),
+    (header::REFERER, b"referer"),
+    (header::REFERRER_POLICY, b"referrer-policy"),
+    (header::REFRESH, b"refresh"),
+    (header::RETRY_AFTER, b"retry-after"),
+    (header::SEC_WEBSOCKET_ACCEPT, b"sec-websocket-accept"),
+    (
+        header::SEC_WEBSOCKET_EXTENSIONS,
+        b"sec-websocket-extensions",
+    ),
+    (header::SEC_WEBSOCKET_KEY, b"sec-websocket-key"),
+    (header::SEC_WEBSOCKET_PROTOCOL, b"sec-websocket-protocol"),
+    (header::SEC_WEBSOCKET_VERSION, b"sec-websocket-version"),
+    (header::SERVER, b"server"),
+    (header::SET_COOKIE, b"set-cookie"),
+    (
+        header::STRICT_TRANSPORT_SECURITY,
+        b"strict-transport-security",
+    ),
+    (header::TE, b"te"),
+    (header::TRAILER, b"trailer"),
+    (header::TRANSFER_ENCODING, b"transfer-encoding"),
+    (header::USER_AGENT, b"user-agent"),
+    (header::UPGRADE, b"upgrade"),
+    (
+        header::UPGRADE_INSECURE_REQUESTS,
+        b"upgrade-insecure-requests",
+    ),
+    (header::VARY, b"vary"),
+    (header::VIA, b"via"),
+    (header::WARNING, b"warning"),
+    (header::WWW_AUTHENTICATE, b"www-authenticate"),
+    (header::X_CONTENT_TYPE_OPTIONS, b"x-content-type-options"),
+    (header::X_DNS_PREFETCH_CONTROL, b"x-dns-prefetch-control"),
+    (header::X_FRAME_OPTIONS, b"x-frame-options"),
+    (header::X_XSS_PROTECTION, b"x-xss-protection"),
+];
+
 #[derive(Clone)]
 pub(crate) struct OnInformational {
     func: hyper_request_on_informational_callback,
@@ -87,7 +452,7 @@ ffi_fn! {
     /// To avoid a memory leak, the request must eventually be consumed by
     /// `hyper_request_free` or `hyper_clientconn_send`.
     fn hyper_request_new() -> *mut hyper_request {
-        Box::into_raw(Box::new(hyper_request(Request::new(IncomingBody::empty()))))
+        Box::into_raw(hyper_request::recycled(hyper_request(Request::new(IncomingBody::empty()))))
     } ?= std::ptr::null_mut()
 }
 
@@ -97,7 +462,23 @@ ffi_fn! {
     /// This should only be used if the request isn't consumed by
     /// `hyper_clientconn_send`.
     fn hyper_request_free(req: *mut hyper_request) {
-        drop(non_null!(Box::from_raw(req) ?= ()));
+        hyper_request::free(non_null!(Box::from_raw(req) ?= ()));
+    }
+}
+
+ffi_fn! {
+    /// Reset a request to how `hyper_request_new` makes it.
+    ///
+    /// This clears the method, URI, version, headers, body, and any callbacks
+    /// or template set on the request, so it can be built again. The header
+    /// map keeps its capacity, so the same headers can be set again without
+    /// allocating.
+    ///
+    /// Returns `HYPERE_INVALID_ARG` if the request is null.
+    fn hyper_request_reset(req: *mut hyper_request) -> hyper_code {
+        let req = non_null!(&mut *req ?= hyper_code::HYPERE_INVALID_ARG);
+        req.reset();
+        hyper_code::HYPERE_OK
     }
 }
 
@@ -225,6 +606,65 @@ ffi_fn! {
     }
 }
 
+ffi_fn! {
+    /// Get the HTTP Method of this request.
+    ///
+    /// The length of the method is written to `method_len`. The returned
+    /// buffer is not null-terminated, and is owned by the request, so it
+    /// should not be used after the request has been freed.
+    fn hyper_request_method(req: *const hyper_request, method_len: *mut size_t) -> *const u8 {
+        let method = non_null!(&*req ?= std::ptr::null()).0.method().as_str();
+        if !method_len.is_null() {
+            unsafe { *method_len = method.len() };
+        }
+        method.as_ptr()
+    } ?= std::ptr::null()
+}
+
+ffi_fn! {
+    /// Get the scheme, authority, and path/query of this request's URI.
+    ///
+    /// Each pair of `buf` and `len` pointers may be null, to skip that part.
+    /// Otherwise, the pointer to the part, which is not null-terminated, is
+    /// written to `buf`, and its length to `len`. A part the URI doesn't have
+    /// is written as a null pointer and a length of `0`.
+    ///
+    /// Requests received over HTTP/1 usually only have a path and query. The
+    /// buffers are owned by the request, and should not be used after the
+    /// request has been freed.
+    fn hyper_request_uri_parts(
+        req: *const hyper_request,
+        scheme: *mut *const u8,
+        scheme_len: *mut size_t,
+        authority: *mut *const u8,
+        authority_len: *mut size_t,
+        path_and_query: *mut *const u8,
+        path_and_query_len: *mut size_t
+    ) -> hyper_code {
+        let uri = non_null!(&*req ?= hyper_code::HYPERE_INVALID_ARG).0.uri();
+        unsafe {
+            write_part(uri.scheme_str(), scheme, scheme_len);
+            write_part(uri.authority().map(|a| a.as_str()), authority, authority_len);
+            write_part(uri.path_and_query().map(|p| p.as_str()), path_and_query, path_and_query_len);
+        }
+        hyper_code::HYPERE_OK
+    }
+}
+
+ffi_fn! {
+    /// Get the HTTP version of this request.
+    ///
+    /// The returned value could be:
+    ///
+    /// - `HYPER_HTTP_VERSION_1_0`
+    /// - `HYPER_HTTP_VERSION_1_1`
+    /// - `HYPER_HTTP_VERSION_2`
+    /// - `HYPER_HTTP_VERSION_NONE` if newer (or older).
+    fn hyper_request_version(req: *const hyper_request) -> c_int {
+        version_code(non_null!(&*req ?= 0).0.version())
+    }
+}
+
 ffi_fn! {
     /// Gets a mutable reference to the HTTP headers of this request
     ///
@@ -240,16 +680,33 @@ ffi_fn! {
     ///
     /// You can get a `hyper_body` by calling `hyper_body_new`.
     ///
+    /// A received body can be sent on, too. If some of it was already read,
+    /// the rest is sent from where the reading stopped, followed by its
+    /// trailers. A body from `hyper_response_body_decoded` is sent decoded.
+    ///
     /// This takes ownership of the `hyper_body *`, you must not use it or
     /// free it after setting it on the request.
     fn hyper_request_set_body(req: *mut hyper_request, body: *mut hyper_body) -> hyper_code {
         let body = non_null!(Box::from_raw(body) ?= hyper_code::HYPERE_INVALID_ARG);
         let req = non_null!(&mut *req ?= hyper_code::HYPERE_INVALID_ARG);
-        *req.0.body_mut() = body.0;
+        *req.0.body_mut() = body.into_outgoing();
         hyper_code::HYPERE_OK
     }
 }
 
+ffi_fn! {
+    /// Take ownership of the body of this request.
+    ///
+    /// It is safe to free the request even after taking ownership of its body.
+    ///
+    /// To avoid a memory leak, the body must eventually be consumed by
+    /// `hyper_body_free`, `hyper_body_foreach`, or `hyper_response_set_body`.
+    fn hyper_request_body(req: *mut hyper_request) -> *mut hyper_body {
+        let body = std::mem::replace(non_null!(&mut *req ?= std::ptr::null_mut()).0.body_mut(), IncomingBody::empty());
+        Box::into_raw(Box::new(hyper_body::wrap(body)))
+    } ?= std::ptr::null_mut()
+}
+
 ffi_fn! {
     /// Set an informational (1xx) response callback.
     ///
@@ -277,24 +734,152 @@ ffi_fn! {
     }
 }
 
+ffi_fn! {
+    /// Add the headers of a template to the request.
+    ///
+    /// The template's headers are sent after the request's own, which are
+    /// still set with `hyper_request_headers`. They don't show up there, so
+    /// take care not to set the same header in both. Setting a template
+    /// replaces any template set before.
+    ///
+    /// The template isn't consumed, and may be freed while the request is
+    /// still in use.
+    fn hyper_request_set_header_template(req: *mut hyper_request, tmpl: *const hyper_header_template) -> hyper_code {
+        let req = non_null!(&mut *req ?= hyper_code::HYPERE_INVALID_ARG);
+        let tmpl = non_null!(&*tmpl ?= hyper_code::HYPERE_INVALID_ARG);
+        req.0.extensions_mut().insert(tmpl.0.clone());
+        hyper_code::HYPERE_OK
+    }
+}
+
 impl hyper_request {
+    /// Frees the request, keeping its memory and header maps for reuse.
+    fn free(mut this: Box<hyper_request>) {
+        if let Some(headers) = this.0.extensions_mut().remove::<hyper_headers>() {
+            recycle::recycle_header_map(headers.headers);
+        }
+        recycle::recycle_header_map(std::mem::take(this.0.headers_mut()));
+        hyper_request::recycle(this);
+    }
+
+    fn reset(&mut self) {
+        let headers = self.0.extensions_mut().remove::<hyper_headers>();
+        *self.0.method_mut() = Method::default();
+        *self.0.uri_mut() = Uri::default();
+        *self.0.version_mut() = http::Version::default();
+        self.0.headers_mut().clear();
+        self.0.extensions_mut().clear();
+        *self.0.body_mut() = IncomingBody::empty();
+        if let Some(mut headers) = headers {
+            headers.clear();
+            self.0.extensions_mut().insert(headers);
+        }
+    }
+
+    #[cfg(feature = "server")]
+    pub(super) fn wrap(mut req: Request<IncomingBody>) -> hyper_request {
+        let headers = std::mem::take(req.headers_mut());
+        let headers = hyper_headers::from_received(headers, req.extensions_mut());
+        req.extensions_mut().insert(headers);
+        hyper_request(req)
+    }
+
     pub(super) fn finalize_request(&mut self) {
         if let Some(headers) = self.0.extensions_mut().remove::<hyper_headers>() {
             *self.0.headers_mut() = headers.headers;
             self.0.extensions_mut().insert(headers.orig_casing);
             self.0.extensions_mut().insert(headers.orig_order);
         }
+        #[cfg(unix)]
+        if let Some(file) = SendFile::of(self.0.body_mut()) {
+            self.0.extensions_mut().insert(file);
+        }
+    }
+}
+
+/// Writes one part of a URI to the optional out pointers.
+unsafe fn write_part(part: Option<&str>, buf: *mut *const u8, len: *mut size_t) {
+    let part = part.map(str::as_bytes).unwrap_or(&[]);
+    if !buf.is_null() {
+        *buf = if part.is_empty() {
+            std::ptr::null()
+        } else {
+            part.as_ptr()
+        };
+    }
+    if !len.is_null() {
+        *len = part.len();
+    }
+}
+
+fn version_code(version: http::Version) -> c_int {
+    use http::Version;
+
+    match version {
+        Version::HTTP_10 => super::HYPER_HTTP_VERSION_1_0,
+        Version::HTTP_11 => super::HYPER_HTTP_VERSION_1_1,
+        Version::HTTP_2 => super::HYPER_HTTP_VERSION_2,
+        _ => super::HYPER_HTTP_VERSION_NONE,
     }
 }
 
 // ===== impl hyper_response =====
 
+ffi_fn! {
+    /// Construct a new HTTP response.
+    ///
+    /// The default response has a status of `200 OK` and an empty body. To
+    /// send a body, call `hyper_response_set_body`.
+    ///
+    /// To avoid a memory leak, the response must eventually be consumed by
+    /// `hyper_response_free` or `hyper_response_channel_send`.
+    fn hyper_response_new() -> *mut hyper_response {
+        Box::into_raw(hyper_response::recycled(hyper_response(Response::new(IncomingBody::empty()))))
+    } ?= std::ptr::null_mut()
+}
+
+ffi_fn! {
+    /// Set the HTTP-Status code of this response.
+    ///
+    /// Returns `HYPERE_INVALID_ARG` unless the status is within the range of
+    /// 100-999.
+    fn hyper_response_set_status(resp: *mut hyper_response, status: u16) -> hyper_code {
+        let resp = non_null!(&mut *resp ?= hyper_code::HYPERE_INVALID_ARG);
+        match http::StatusCode::from_u16(status) {
+            Ok(status) => {
+                *resp.0.status_mut() = status;
+                hyper_code::HYPERE_OK
+            }
+            Err(_) => hyper_code::HYPERE_INVALID_ARG,
+        }
+    }
+}
+
+ffi_fn! {
+    /// Set the body of this response.
+    ///
+    /// You can get a `hyper_body` by calling `hyper_body_new`, or by taking
+    /// the body of a request with `hyper_request_body`. If some of it was
+    /// already read, the rest is sent from where the reading stopped,
+    /// followed by its trailers. A body from `hyper_response_body_decoded`
+    /// is sent decoded.
+    ///
+    /// This takes ownership of the `hyper_body *`, you must not use it or
+    /// free it after setting it on the response.
+    fn hyper_response_set_body(resp: *mut hyper_response, body: *mut hyper_body) -> hyper_code {
+        let body = non_null!(Box::from_raw(body) ?= hyper_code::HYPERE_INVALID_ARG);
+        let resp = non_null!(&mut *resp ?= hyper_code::HYPERE_INVALID_ARG);
+        *resp.0.body_mut() = body.into_outgoing();
+        hyper_code::HYPERE_OK
+    }
+}
+
 ffi_fn! {
     /// Free an HTTP response.
     ///
     /// This should be used for any response once it is no longer needed.
     fn hyper_response_free(resp: *mut hyper_response) {
-        drop(non_null!(Box::from_raw(resp) ?= ()));
+        hyper_response::free(non_null!(Box::from_raw(resp) ?= ()));
     }
 }
 
@@ -341,14 +926,7 @@ ffi_fn! {
     /// - `HYPER_HTTP_VERSION_2`
     /// - `HYPER_HTTP_VERSION_NONE` if newer (or older).
     fn hyper_response_version(resp: *const hyper_response) -> c_int {
-        use http::Version;
-
-        match non_null!(&*resp ?= 0).0.version() {
-            Version::HTTP_10 => super::HYPER_HTTP_VERSION_1_0,
-            Version::HTTP_11 => super::HYPER_HTTP_VERSION_1_1,
-            Version::HTTP_2 => super::HYPER_HTTP_VERSION_2,
-            _ => super::HYPER_HTTP_VERSION_NONE,
-        }
+        version_code(non_null!(&*resp ?= 0).0.version())
     }
 }
 
@@ -370,31 +948,121 @@ ffi_fn! {
     /// To avoid a memory leak, the body must eventually be consumed by
     /// `hyper_body_free`, `hyper_body_foreach`, or `hyper_request_set_body`.
     fn hyper_response_body(resp: *mut hyper_response) -> *mut hyper_body {
-        let body = std::mem::replace(non_null!(&mut *resp ?= std::ptr::null_mut()).0.body_mut(), IncomingBody::empty());
-        Box::into_raw(Box::new(hyper_body(body)))
+        let resp = non_null!(&mut *resp ?= std::ptr::null_mut());
+        let body = std::mem::replace(resp.0.body_mut(), IncomingBody::empty());
+        Box::into_raw(Box::new(hyper_body::wrap(body).timed(resp.body_stats())))
     } ?= std::ptr::null_mut()
 }
 
+ffi_fn! {
+    /// Take ownership of the body of this response, decoding it.
+    ///
+    /// If the response has a `content-encoding` of `gzip` or `deflate`, the
+    /// data of the returned body is decoded as it is read, and the
+    /// `content-encoding` and `content-length` headers are removed from the
+    /// response. A response without a `content-encoding`, or with `identity`,
+    /// returns the same body as `hyper_response_body`.
+    ///
+    /// Decoding needs hyper to be built with the `ffi-decompression` feature.
+    /// If it isn't, or the encoding isn't supported, this returns NULL and
+    /// leaves the body in the response, so it can still be taken with
+    /// `hyper_response_body`.
+    ///
+    /// A decoded body set on another message with `hyper_request_set_body`
+    /// or `hyper_response_set_body` is sent decoded too, matching the
+    /// headers left in this response.
+    fn hyper_response_body_decoded(resp: *mut hyper_response) -> *mut hyper_body {
+        let resp = non_null!(&mut *resp ?= std::ptr::null_mut());
+        let headers = hyper_headers::get_or_default(resp.0.extensions_mut());
+        let decoder = match headers.headers.get(header::CONTENT_ENCODING) {
+            None => None,
+            Some(encoding) if encoding.as_bytes().eq_ignore_ascii_case(b"identity") => None,
+            Some(encoding) => match Decoder::for_encoding(encoding.as_bytes()) {
+                Some(decoder) => {
+                    headers.remove(&header::CONTENT_ENCODING);
+                    headers.remove(&header::CONTENT_LENGTH);
+                    Some(decoder)
+                }
+                None => return std::ptr::null_mut(),
+            },
+        };
+
+        let body = std::mem::replace(resp.0.body_mut(), IncomingBody::empty());
+        let body = match decoder {
+            Some(decoder) => hyper_body::decoded(body, decoder),
+            None => hyper_body::wrap(body),
+        };
+        Box::into_raw(Box::new(body.timed(resp.body_stats())))
+    } ?= std::ptr::null_mut()
+}
+
+ffi_fn! {
+    /// Copy the timings of this response's request so far into `timings`.
+    ///
+    /// These say when the request head was written, and when the response
+    /// head, the first bytes of its body, and the end of its body were
+    /// received. The body timings keep updating while the body is read, even
+    /// after taking it with `hyper_response_body`, so keep the response
+    /// around until then to see them.
+    ///
+    /// Returns `HYPERE_INVALID_ARG` if either pointer is null, or if the
+    /// response wasn't received with `hyper_clientconn_send` or
+    /// `hyper_client_pool_send`.
+    fn hyper_response_timings(resp: *const hyper_response, timings: *mut hyper_request_timings) -> hyper_code {
+        let resp = non_null!(&*resp ?= hyper_code::HYPERE_INVALID_ARG);
+        let timings = non_null!(&mut *timings ?= hyper_code::HYPERE_INVALID_ARG);
+        match resp.0.extensions().get::<RequestStats>() {
+            Some(stats) => {
+                *timings = stats.snapshot();
+                hyper_code::HYPERE_OK
+            }
+            None => hyper_code::HYPERE_INVALID_ARG,
+        }
+    }
+}
+
 impl hyper_response {
+    /// The timings that reading the body of this response should update.
+    ///
+    /// HTTP/1 connections time the body themselves, as they read it, while
+    /// HTTP/2 ones leave it to the `hyper_body`.
+    fn body_stats(&self) -> Option<RequestStats> {
+        if self.0.version() != http::Version::HTTP_2 {
+            return None;
+        }
+        self.0.extensions().get::<RequestStats>().cloned()
+    }
+
+    /// Frees the response, keeping its memory and header maps for reuse.
+    fn free(mut this: Box<hyper_response>) {
+        if let Some(headers) = this.0.extensions_mut().remove::<hyper_headers>() {
+            recycle::recycle_header_map(headers.headers);
+        }
+        recycle::recycle_header_map(std::mem::take(this.0.headers_mut()));
+        hyper_response::recycle(this);
+    }
+
     pub(super) fn wrap(mut resp: Response<IncomingBody>) -> hyper_response {
         let headers = std::mem::take(resp.headers_mut());
-        let orig_casing = resp
-            .extensions_mut()
-            .remove::<HeaderCaseMap>()
-            .unwrap_or_else(HeaderCaseMap::default);
-        let orig_order = resp
-            .extensions_mut()
-            .remove::<OriginalHeaderOrder>()
-            .unwrap_or_else(OriginalHeaderOrder::default);
-        resp.extensions_mut().insert(hyper_headers {
-            headers,
-            orig_casing,
-            orig_order,
-        });
+        let headers = hyper_headers::from_received(headers, resp.extensions_mut());
+        resp.extensions_mut().insert(headers);
 
         hyper_response(resp)
     }
 
+    #[cfg(feature = "server")]
+    pub(super) fn finalize_response(&mut self) {
+        if let Some(headers) = self.0.extensions_mut().remove::<hyper_headers>() {
+            *self.0.headers_mut() = headers.headers;
+            self.0.extensions_mut().insert(headers.orig_casing);
+            self.0.extensions_mut().insert(headers.orig_order);
+        }
+        #[cfg(unix)]
+        if let Some(file) = SendFile::of(self.0.body_mut()) {
+            self.0.extensions_mut().insert(file);
+        }
+    }
+
     fn reason_phrase(&self) -> &[u8] {
         if let Some(reason) = self.0.extensions().get::<ReasonPhrase>() {
             return reason.as_bytes();
@@ -412,6 +1080,10 @@ unsafe impl AsTaskType for hyper_response {
     fn as_task_type(&self) -> hyper_task_return_type {
         hyper_task_return_type::HYPER_TASK_RESPONSE
     }
+
+    fn boxed(self) -> Box<Self> {
+        hyper_response::recycled(self)
+    }
 }
 
 // ===== impl Headers =====
@@ -419,80 +1091,185 @@ unsafe impl AsTaskType for hyper_response {
 type hyper_headers_foreach_callback =
     extern "C" fn(*mut c_void, *const u8, size_t, *const u8, size_t) -> c_int;
 
+/// The most header names a `HeaderMap` can reserve room for.
+const MAX_HEADERS: usize = (1 << 15) / 4 * 3;
+
 impl hyper_headers {
+    /// Wraps the headers of a received message, along with their original
+    /// casing and order if those were recorded in its extensions.
+    fn from_received(headers: HeaderMap, ext: &mut http::Extensions) -> hyper_headers {
+        hyper_headers {
+            headers,
+            orig_casing: ext
+                .remove::<HeaderCaseMap>()
+                .unwrap_or_else(HeaderCaseMap::default),
+            orig_order: ext
+                .remove::<OriginalHeaderOrder>()
+                .unwrap_or_else(OriginalHeaderOrder::default),
+            snapshot: Snapshot::default(),
+        }
+    }
+
     pub(super) fn get_or_default(ext: &mut http::Extensions) -> &mut hyper_headers {
         if let None = ext.get_mut::<hyper_headers>() {
-            ext.insert(hyper_headers::default());
+            ext.insert(hyper_headers {
+                headers: recycle::header_map(),
+                ..hyper_headers::default()
+            });
         }
 
         ext.get_mut::<hyper_headers>().unwrap()
     }
-}
 
-ffi_fn! {
-    /// Iterates the headers passing each name and value pair to the callback.
-    ///
-    /// The `userdata` pointer is also passed to the callback.
-    ///
-    /// The callback should return `HYPER_ITER_CONTINUE` to keep iterating, or
-    /// `HYPER_ITER_BREAK` to stop.
-    fn hyper_headers_foreach(headers: *const hyper_headers, func: hyper_headers_foreach_callback, userdata: *mut c_void) {
-        let headers = non_null!(&*headers ?= ());
+    /// Removes every header, keeping the capacity of the map.
+    fn clear(&mut self) {
+        self.headers.clear();
+        self.orig_casing = HeaderCaseMap::default();
+        self.orig_order = OriginalHeaderOrder::default();
+        self.snapshot = Snapshot::default();
+    }
+
+    /// Removes every value of a header, and its original casing and order.
+    fn remove(&mut self, name: &HeaderName) {
+        self.headers.remove(name);
+        self.orig_casing.remove(name);
+        self.orig_order.remove(name);
+    }
+
+    fn append(&mut self, name: HeaderName, value: HeaderValue, orig_name: Bytes) {
+        self.headers.append(&name, value);
+        self.orig_casing.append(&name, orig_name);
+        self.orig_order.append(name);
+    }
+
+    /// Calls `f` with each name and value, in their original order and casing
+    /// when those are known, until `f` returns `false`.
+    fn for_each_raw(&self, mut f: impl FnMut(&[u8], &[u8]) -> bool) {
         // For each header name/value pair, there may be a value in the casemap
         // that corresponds to the HeaderValue. So, we iterator all the keys,
         // and for each one, try to pair the originally cased name with the value.
         //
         // TODO: consider adding http::HeaderMap::entries() iterator
-        let mut ordered_iter =  headers.orig_order.get_in_order().peekable();
+        let mut ordered_iter = self.orig_order.get_in_order().peekable();
         if ordered_iter.peek().is_some() {
-            for (name, idx) in ordered_iter {
-                let (name_ptr, name_len) = if let Some(orig_name) = headers.orig_casing.get_all(name).nth(*idx) {
-                    (orig_name.as_ref().as_ptr(), orig_name.as_ref().len())
-                } else {
-                    (
-                    name.as_str().as_bytes().as_ptr(),
-                    name.as_str().as_bytes().len(),
-                    )
+            for (key, idx) in ordered_iter {
+                let orig_name = self.orig_casing.get_all(key).nth(*idx);
+                let name = match orig_name {
+                    Some(ref orig_name) => orig_name.as_ref(),
+                    None => key.as_str().as_bytes(),
                 };
 
-                let val_ptr;
-                let val_len;
-                if let Some(value) = headers.headers.get_all(name).iter().nth(*idx) {
-                    val_ptr = value.as_bytes().as_ptr();
-                    val_len = value.as_bytes().len();
-                } else {
+                let value = match self.headers.get_all(key).iter().nth(*idx) {
+                    Some(value) => value,
                     // Stop iterating, something has gone wrong.
-                    return;
-                }
+                    None => return,
+                };
 
-                if HYPER_ITER_CONTINUE != func(userdata, name_ptr, name_len, val_ptr, val_len) {
+                if !f(name, value.as_bytes()) {
                     return;
                 }
             }
         } else {
-            for name in headers.headers.keys() {
-                let mut names = headers.orig_casing.get_all(name);
-
-                for value in headers.headers.get_all(name) {
-                    let (name_ptr, name_len) = if let Some(orig_name) = names.next() {
-                        (orig_name.as_ref().as_ptr(), orig_name.as_ref().len())
-                    } else {
-                        (
-                            name.as_str().as_bytes().as_ptr(),
-                            name.as_str().as_bytes().len(),
-                        )
+            for key in self.headers.keys() {
+                let mut names = self.orig_casing.get_all(key);
+
+                for value in self.headers.get_all(key) {
+                    let orig_name = names.next();
+                    let name = match orig_name {
+                        Some(ref orig_name) => orig_name.as_ref(),
+                        None => key.as_str().as_bytes(),
                     };
 
-                    let val_ptr = value.as_bytes().as_ptr();
-                    let val_len = value.as_bytes().len();
-
-                    if HYPER_ITER_CONTINUE != func(userdata, name_ptr, name_len, val_ptr, val_len) {
+                    if !f(name, value.as_bytes()) {
                         return;
                     }
                 }
             }
         }
     }
+
+    /// Returns `false` if the map cannot grow by that much.
+    fn reserve(&mut self, additional: usize) -> bool {
+        if MAX_HEADERS.saturating_sub(self.headers.keys_len()) < additional {
+            return false;
+        }
+        self.headers.reserve(additional);
+        self.orig_casing.reserve(additional);
+        self.orig_order.reserve(additional);
+        true
+    }
+}
+
+ffi_fn! {
+    /// Iterates the headers passing each name and value pair to the callback.
+    ///
+    /// The `userdata` pointer is also passed to the callback.
+    ///
+    /// The callback should return `HYPER_ITER_CONTINUE` to keep iterating, or
+    /// `HYPER_ITER_BREAK` to stop.
+    fn hyper_headers_foreach(headers: *const hyper_headers, func: hyper_headers_foreach_callback, userdata: *mut c_void) {
+        let headers = non_null!(&*headers ?= ());
+        headers.for_each_raw(|name, value| {
+            HYPER_ITER_CONTINUE == func(userdata, name.as_ptr(), name.len(), value.as_ptr(), value.len())
+        });
+    }
+}
+
+ffi_fn! {
+    /// Gets a contiguous array of every header name and value pair.
+    ///
+    /// The entries are in the same order, and with the same name casing, as
+    /// `hyper_headers_foreach` would pass them to its callback. The number of
+    /// entries is written to `len`.
+    ///
+    /// The array and the names and values it points to are owned by the
+    /// headers. They should not be used after the headers have been modified
+    /// or freed, or after `hyper_headers_snapshot` is called again. Calling it
+    /// again reuses the same array, so repeated snapshots don't allocate.
+    fn hyper_headers_snapshot(headers: *mut hyper_headers, len: *mut size_t) -> *const hyper_header_entry {
+        let headers = non_null!(&mut *headers ?= std::ptr::null());
+        let mut entries = std::mem::take(&mut headers.snapshot.0);
+        entries.clear();
+        headers.for_each_raw(|name, value| {
+            entries.push(hyper_header_entry {
+                name: name.as_ptr(),
+                name_len: name.len(),
+                value: value.as_ptr(),
+                value_len: value.len(),
+            });
+            true
+        });
+
+        if !len.is_null() {
+            unsafe { *len = entries.len() };
+        }
+        headers.snapshot.0 = entries;
+        headers.snapshot.0.as_ptr()
+    } ?= std::ptr::null()
+}
+
+ffi_fn! {
+    /// Gets the first value of the header with the provided name.
+    ///
+    /// The name is matched case-insensitively, with a single map lookup. The
+    /// length of the value is written to `value_len`.
+    ///
+    /// Returns NULL if there is no header with that name. Otherwise, the
+    /// value is not null-terminated, and is owned by the headers. It should
+    /// not be used after the headers have been modified or freed.
+    fn hyper_headers_get(headers: *const hyper_headers, name: *const u8, name_len: size_t, value_len: *mut size_t) -> *const u8 {
+        let headers = non_null!(&*headers ?= std::ptr::null());
+        let name = non_null!(name, std::slice::from_raw_parts(name, name_len), std::ptr::null());
+        let value = match std::str::from_utf8(name).ok().and_then(|name| headers.headers.get(name)) {
+            Some(value) => value.as_bytes(),
+            None => return std::ptr::null(),
+        };
+
+        if !value_len.is_null() {
+            unsafe { *value_len = value.len() };
+        }
+        value.as_ptr()
+    } ?= std::ptr::null()
 }
 
 ffi_fn! {
@@ -523,9 +1300,7 @@ ffi_fn! {
 
         match unsafe { raw_name_value(name, name_len, value, value_len) } {
             Ok((name, value, orig_name)) => {
-                headers.headers.append(&name, value);
-                headers.orig_casing.append(&name, orig_name.clone());
-                headers.orig_order.append(name);
+                headers.append(name, value, orig_name);
                 hyper_code::HYPERE_OK
             }
             Err(code) => code,
@@ -533,16 +1308,167 @@ ffi_fn! {
     }
 }
 
+ffi_fn! {
+    /// Adds many name and value pairs at once.
+    ///
+    /// Each of the `len` pairs is added as by `hyper_headers_add`. A pair
+    /// whose `name_id` is one of the `HYPER_HEADER_*` constants uses that
+    /// standard header name, and its `name` is not parsed (or read at all).
+    ///
+    /// Returns `HYPERE_INVALID_ARG` at the first pair that isn't valid. The
+    /// pairs before it will already have been added.
+    fn hyper_headers_add_many(headers: *mut hyper_headers, pairs: *const hyper_header_pair, len: size_t) -> hyper_code {
+        let headers = non_null!(&mut *headers ?= hyper_code::HYPERE_INVALID_ARG);
+        if len == 0 {
+            return hyper_code::HYPERE_OK;
+        }
+        if pairs.is_null() || !headers.reserve(len) {
+            return hyper_code::HYPERE_INVALID_ARG;
+        }
+
+        let pairs = unsafe { std::slice::from_raw_parts(pairs, len) };
+        for pair in pairs {
+            match unsafe { pair_name_value(pair) } {
+                Ok((name, value, orig_name)) => headers.append(name, value, orig_name),
+                Err(code) => return code,
+            }
+        }
+        hyper_code::HYPERE_OK
+    }
+}
+
+ffi_fn! {
+    /// Reserves capacity for at least `additional` more headers.
+    ///
+    /// Call this before adding many headers, so the map is allocated once
+    /// instead of growing as they are added.
+    ///
+    /// Returns `HYPERE_INVALID_ARG` if the map would grow beyond the most
+    /// headers it can hold.
+    fn hyper_headers_reserve(headers: *mut hyper_headers, additional: size_t) -> hyper_code {
+        let headers = non_null!(&mut *headers ?= hyper_code::HYPERE_INVALID_ARG);
+        if headers.reserve(additional) {
+            hyper_code::HYPERE_OK
+        } else {
+            hyper_code::HYPERE_INVALID_ARG
+        }
+    }
+}
+
 impl Default for hyper_headers {
     fn default() -> Self {
         Self {
             headers: Default::default(),
             orig_casing: HeaderCaseMap::default(),
             orig_order: OriginalHeaderOrder::default(),
+            snapshot: Snapshot::default(),
+        }
+    }
+}
+
+// ===== impl hyper_header_template =====
+
+ffi_fn! {
+    /// Create a header template from name and value pairs.
+    ///
+    /// Each of the `len` pairs is validated as by `hyper_headers_add_many`,
+    /// and the whole block is encoded once. It can then be added to many
+    /// requests with `hyper_request_set_header_template`, which is much
+    /// cheaper than adding each header to each request.
+    ///
+    /// For HTTP/1, names are written as they are spelled in the pairs, even
+    /// if the connection doesn't preserve header case. Headers that affect
+    /// how a message is framed or how the connection is managed, such as
+    /// `content-length`, `transfer-encoding`, `connection` or `upgrade`,
+    /// can't be part of a template.
+    ///
+    /// Returns NULL if any pair isn't valid.
+    ///
+    /// To avoid a memory leak, the template must eventually be consumed by
+    /// `hyper_header_template_free`.
+    fn hyper_header_template_new(pairs: *const hyper_header_pair, len: size_t) -> *mut hyper_header_template {
+        let pairs = if len == 0 {
+            &[]
+        } else if pairs.is_null() {
+            return std::ptr::null_mut();
+        } else {
+            unsafe { std::slice::from_raw_parts(pairs, len) }
+        };
+        match unsafe { HeaderTemplate::new(pairs) } {
+            Some(template) => Box::into_raw(Box::new(hyper_header_template(template))),
+            None => std::ptr::null_mut(),
+        }
+    } ?= std::ptr::null_mut()
+}
+
+ffi_fn! {
+    /// Free a header template.
+    ///
+    /// Requests the template was added to keep their own reference to it.
+    fn hyper_header_template_free(tmpl: *mut hyper_header_template) {
+        drop(non_null!(Box::from_raw(tmpl) ?= ()));
+    }
+}
+
+impl HeaderTemplate {
+    unsafe fn new(pairs: &[hyper_header_pair]) -> Option<HeaderTemplate> {
+        let mut headers = Vec::with_capacity(pairs.len());
+        let mut encoded = Vec::new();
+        for pair in pairs {
+            let (name, value, orig_name) = pair_name_value(pair).ok()?;
+            if is_connection_header(&name) {
+                return None;
+            }
+            encoded.extend_from_slice(&orig_name);
+            encoded.extend_from_slice(b": ");
+            encoded.extend_from_slice(value.as_bytes());
+            encoded.extend_from_slice(b"\r\n");
+            headers.push((name, value));
+        }
+        Some(HeaderTemplate(Arc::new(TemplateHeaders {
+            headers,
+            encoded,
+        })))
+    }
+
+    /// The header lines, ready to be copied into an HTTP/1 message head.
+    pub(crate) fn encoded(&self) -> &[u8] {
+        &self.0.encoded
+    }
+
+    pub(super) fn append_to(&self, headers: &mut HeaderMap) {
+        headers.reserve(self.0.headers.len());
+        for (name, value) in &self.0.headers {
+            headers.append(name.clone(), value.clone());
         }
     }
 }
 
+/// Whether hyper needs to see a header to frame messages or manage the
+/// connection, which it couldn't in a pre-encoded block.
+fn is_connection_header(name: &HeaderName) -> bool {
+    *name == header::CONTENT_LENGTH
+        || *name == header::TRANSFER_ENCODING
+        || *name == header::CONNECTION
+        || *name == header::TE
+        || *name == header::TRAILER
+        || *name == header::UPGRADE
+        || name.as_str() == "keep-alive"
+        || name.as_str() == "proxy-connection"
+}
+
+// A clone owns different names and values, so it starts without a snapshot.
+impl Clone for Snapshot {
+    fn clone(&self) -> Self {
+        Snapshot::default()
+    }
+}
+
+// The entries only point into the headers that own them, and are only
+// dereferenced by the C side.
+unsafe impl Send for Snapshot {}
+unsafe impl Sync for Snapshot {}
+
 unsafe fn raw_name_value(
     name: *const u8,
     name_len: size_t,
@@ -555,15 +1481,72 @@ unsafe fn raw_name_value(
         Ok(name) => name,
         Err(_) => return Err(hyper_code::HYPERE_INVALID_ARG),
     };
-    let value = std::slice::from_raw_parts(value, value_len);
-    let value = match HeaderValue::from_bytes(value) {
-        Ok(val) => val,
-        Err(_) => return Err(hyper_code::HYPERE_INVALID_ARG),
+    let value = header_value(std::slice::from_raw_parts(value, value_len))?;
+
+    Ok((name, value, orig_name))
+}
+
+unsafe fn pair_name_value(
+    pair: &hyper_header_pair,
+) -> Result<(HeaderName, HeaderValue, Bytes), hyper_code> {
+    if pair.name_id == HYPER_HEADER_CUSTOM {
+        return raw_name_value(pair.name, pair.name_len, pair.value, pair.value_len);
+    }
+
+    let (name, orig_name) = match usize::try_from(pair.name_id)
+        .ok()
+        .and_then(|id| STANDARD_HEADERS.get(id - 1))
+    {
+        Some((name, spelling)) => (name.clone(), Bytes::from_static(spelling)),
+        None => return Err(hyper_code::HYPERE_INVALID_ARG),
     };
+    let value = header_value(std::slice::from_raw_parts(pair.value, pair.value_len))?;
 
     Ok((name, value, orig_name))
 }
 
+/// Copies a header value given from C, checking it a word at a time.
+///
+/// Values such as cookies and tokens can be long, and checking them one
+/// byte at a time, as `HeaderValue::from_bytes` does, shows up when many
+/// headers are set.
+fn header_value(value: &[u8]) -> Result<HeaderValue, hyper_code> {
+    if !is_valid_header_value(value) {
+        return Err(hyper_code::HYPERE_INVALID_ARG);
+    }
+    // Safety: every byte was just checked.
+    Ok(unsafe { HeaderValue::from_maybe_shared_unchecked(Bytes::copy_from_slice(value)) })
+}
+
+fn is_valid_header_value(value: &[u8]) -> bool {
+    const ONES: u64 = u64::from_ne_bytes([0x01; 8]);
+    const HIGHS: u64 = u64::from_ne_bytes([0x80; 8]);
+    const DELS: u64 = u64::from_ne_bytes([0x7f; 8]);
+
+    let mut words = value.chunks_exact(8);
+    for word in &mut words {
+        let x = u64::from_ne_bytes(<[u8; 8]>::try_from(word).unwrap());
+        // Sets a high bit if any byte is below 0x20, or is DEL once XORed
+        // to 0. These can set a bit for a neighbouring byte as well, so a
+        // word that looks bad (such as one with a tab) is checked again
+        // byte by byte.
+        let ctl = x.wrapping_sub(ONES * 0x20) & !x & HIGHS;
+        let del = (x ^ DELS).wrapping_sub(ONES) & !(x ^ DELS) & HIGHS;
+        if ctl | del != 0 && !word.iter().all(|&b| is_valid_header_value_byte(b)) {
+            return false;
+        }
+    }
+    words
+        .remainder()
+        .iter()
+        .all(|&b| is_valid_header_value_byte(b))
+}
+
+#[inline]
+fn is_valid_header_value_byte(b: u8) -> bool {
+    b >= 32 && b != 127 || b == b'\t'
+}
+
 // ===== impl OnInformational =====
 
 impl OnInformational {
@@ -689,4 +1672,146 @@ mod tests {
             HYPER_ITER_CONTINUE
         }
     }
+
+    #[test]
+    fn test_headers_add_many() {
+        let mut headers = hyper_headers::default();
+        assert!(matches!(
+            hyper_headers_reserve(&mut headers, 3),
+            hyper_code::HYPERE_OK
+        ));
+
+        let pair = |name_id, name: &'static [u8], value: &'static [u8]| hyper_header_pair {
+            name_id,
+            name: name.as_ptr(),
+            name_len: name.len(),
+            value: value.as_ptr(),
+            value_len: value.len(),
+        };
+        let pairs = [
+            pair(HYPER_HEADER_HOST, b"", b"example.com"),
+            pair(HYPER_HEADER_CUSTOM, b"X-Request-Id", b"42"),
+            pair(HYPER_HEADER_ACCEPT, b"", b"*/*"),
+        ];
+        assert!(matches!(
+            hyper_headers_add_many(&mut headers, pairs.as_ptr(), pairs.len()),
+            hyper_code::HYPERE_OK
+        ));
+        assert_eq!(headers.headers["host"], "example.com");
+        assert_eq!(headers.headers["x-request-id"], "42");
+        assert_eq!(headers.headers["accept"], "*/*");
+        assert_eq!(
+            headers
+                .orig_casing
+                .get_all(&header::HOST)
+                .next()
+                .unwrap()
+                .as_ref(),
+            b"host"
+        );
+
+        let bad = [pair(HYPER_HEADER_X_XSS_PROTECTION + 1, b"", b"nope")];
+        assert!(matches!(
+            hyper_headers_add_many(&mut headers, bad.as_ptr(), bad.len()),
+            hyper_code::HYPERE_INVALID_ARG
+        ));
+        assert!(matches!(
+            hyper_headers_reserve(&mut headers, usize::MAX),
+            hyper_code::HYPERE_INVALID_ARG
+        ));
+    }
+
+    #[test]
+    fn test_headers_snapshot_and_get() {
+        let mut headers = hyper_headers::default();
+        for (name, value) in [
+            (&b"Set-CookiE"[..], &b"a=b"[..]),
+            (b"X-Id", b"7"),
+            (b"SET-COOKIE", b"c=d"),
+        ] {
+            hyper_headers_add(
+                &mut headers,
+                name.as_ptr(),
+                name.len(),
+                value.as_ptr(),
+                value.len(),
+            );
+        }
+
+        let mut len = 0;
+        let entries = hyper_headers_snapshot(&mut headers, &mut len);
+        let entries = unsafe { std::slice::from_raw_parts(entries, len) };
+        let entries = entries
+            .iter()
+            .map(|entry| unsafe {
+                (
+                    std::slice::from_raw_parts(entry.name, entry.name_len),
+                    std::slice::from_raw_parts(entry.value, entry.value_len),
+                )
+            })
+            .collect::<Vec<_>>();
+        assert_eq!(
+            entries,
+            [
+                (&b"Set-CookiE"[..], &b"a=b"[..]),
+                (b"X-Id", b"7"),
+                (b"SET-COOKIE", b"c=d"),
+            ]
+        );
+
+        let name = b"SET-cookie";
+        let mut value_len = 0;
+        let value = hyper_headers_get(&headers, name.as_ptr(), name.len(), &mut value_len);
+        assert_eq!(
+            unsafe { std::slice::from_raw_parts(value, value_len) },
+            b"a=b"
+        );
+
+        let name = b"x-missing";
+        let value = hyper_headers_get(&headers, name.as_ptr(), name.len(), &mut value_len);
+        assert!(value.is_null());
+    }
+
+    #[test]
+    fn test_header_value_matches_http() {
+        let mut value = *b"token 0123456789abcdef\tZ";
+        for pos in 0..value.len() {
+            let orig = value[pos];
+            for b in 0..=255u8 {
+                value[pos] = b;
+                assert_eq!(
+                    is_valid_header_value(&value),
+                    HeaderValue::from_bytes(&value).is_ok(),
+                    "byte {:#04x} at {}",
+                    b,
+                    pos,
+                );
+            }
+            value[pos] = orig;
+        }
+    }
+
+    #[test]
+    fn test_request_reset_keeps_header_capacity() {
+        let req = hyper_request_new();
+        hyper_request_set_method(req, b"POST".as_ptr(), 4);
+        hyper_request_set_uri(req, b"/upload".as_ptr(), 7);
+        let headers = hyper_request_headers(req);
+        for name in [&b"x-a"[..], b"x-b", b"x-c"] {
+            hyper_headers_add(headers, name.as_ptr(), name.len(), b"1".as_ptr(), 1);
+        }
+        let cap = unsafe { &*headers }.headers.capacity();
+
+        assert!(matches!(hyper_request_reset(req), hyper_code::HYPERE_OK));
+        {
+            let req = unsafe { &*req };
+            assert_eq!(req.0.method(), Method::GET);
+            assert_eq!(req.0.uri(), "/");
+        }
+        let headers = hyper_request_headers(req);
+        assert!(unsafe { &*headers }.headers.is_empty());
+        assert_eq!(unsafe { &*headers }.headers.capacity(), cap);
+
+        hyper_request_free(req);
+    }
 }
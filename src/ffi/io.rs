@@ -1,11 +1,22 @@
 use std::ffi::c_void;
 use std::pin::Pin;
+use std::sync::Arc;
 use std::task::{Context, Poll};
 
+use crate::proto::h1::FfiTransport;
 use crate::rt::{Read, Write};
-use libc::size_t;
+use bytes::{Buf, Bytes};
+use libc::{c_int, size_t};
 
-use super::task::hyper_context;
+use super::body::hyper_buf;
+use super::recycle::Recycle;
+use super::stats::ConnStats;
+use super::task::{
+    hyper_context, hyper_task_return_type, hyper_waker, AsTaskType, HYPER_POLL_ERROR,
+    HYPER_POLL_PENDING, HYPER_POLL_READY,
+};
+#[cfg(unix)]
+use super::task::{hyper_context_waker, hyper_waker_free, hyper_waker_update};
 
 /// Sentinel value to return from a read or write callback that the operation
 /// is pending.
@@ -13,11 +24,74 @@ pub const HYPER_IO_PENDING: size_t = 0xFFFFFFFF;
 /// Sentinel value to return from a read or write callback that the operation
 /// has errored.
 pub const HYPER_IO_ERROR: size_t = 0xFFFFFFFE;
+/// Passed to a `hyper_io_fd_wait_callback` when hyper is waiting for the file
+/// descriptor to become readable.
+pub const HYPER_IO_READABLE: c_int = 1;
+/// Passed to a `hyper_io_fd_wait_callback` when hyper is waiting for the file
+/// descriptor to become writable.
+pub const HYPER_IO_WRITABLE: c_int = 2;
 
 type hyper_io_read_callback =
     extern "C" fn(*mut c_void, *mut hyper_context<'_>, *mut u8, size_t) -> size_t;
+type hyper_io_read_buf_callback =
+    extern "C" fn(*mut c_void, *mut hyper_context<'_>, *mut *mut hyper_buf) -> c_int;
 type hyper_io_write_callback =
     extern "C" fn(*mut c_void, *mut hyper_context<'_>, *const u8, size_t) -> size_t;
+type hyper_io_write_vectored_callback =
+    extern "C" fn(*mut c_void, *mut hyper_context<'_>, *const hyper_iovec, size_t) -> size_t;
+#[cfg(unix)]
+type hyper_io_sendfile_callback =
+    extern "C" fn(*mut c_void, *mut hyper_context<'_>, c_int, u64, size_t) -> size_t;
+pub(super) type hyper_io_fd_wait_callback =
+    extern "C" fn(*mut c_void, c_int, c_int, *mut hyper_waker);
+
+/// The most buffers passed to a vectored write callback at once.
+///
+/// This matches the limit the HTTP/1 connection uses when flushing.
+const MAX_WRITEV_BUFS: usize = 64;
+
+/// Passed to `send(2)` and `sendmsg(2)`, so that writing to a socket the
+/// peer has closed fails with `EPIPE` instead of raising `SIGPIPE`.
+#[cfg(any(
+    target_os = "linux",
+    target_os = "android",
+    target_os = "freebsd",
+    target_os = "dragonfly",
+    target_os = "netbsd",
+    target_os = "openbsd",
+    target_os = "illumos",
+    target_os = "solaris",
+))]
+const SEND_FLAGS: c_int = libc::MSG_NOSIGNAL;
+/// Apple platforms don't have `MSG_NOSIGNAL`; `SO_NOSIGPIPE` is set on the
+/// socket instead.
+#[cfg(all(
+    unix,
+    not(any(
+        target_os = "linux",
+        target_os = "android",
+        target_os = "freebsd",
+        target_os = "dragonfly",
+        target_os = "netbsd",
+        target_os = "openbsd",
+        target_os = "illumos",
+        target_os = "solaris",
+    ))
+))]
+const SEND_FLAGS: c_int = 0;
+
+/// A buffer of bytes passed to a vectored write callback.
+///
+/// On POSIX systems this has the same layout as `struct iovec`, so an array
+/// of them can be passed straight to `writev(2)` or `sendmsg(2)`.
+#[repr(C)]
+#[derive(Clone, Copy)]
+pub struct hyper_iovec {
+    /// Pointer to the start of the bytes.
+    pub iov_base: *const c_void,
+    /// The number of bytes at `iov_base`.
+    pub iov_len: size_t,
+}
 
 /// A read/write handle for a specific connection.
 ///
@@ -29,14 +103,55 @@ type hyper_io_write_callback =
 /// Methods:
 ///
 /// - hyper_io_new:          Create a new IO type used to represent a transport.
+/// - hyper_io_new_fd:       Create a new IO type that reads and writes a non-blocking file descriptor.
 /// - hyper_io_set_read:     Set the read function for this IO transport.
+/// - hyper_io_set_read_buf: Set a read function that hands owned buffers to this IO transport.
 /// - hyper_io_set_write:    Set the write function for this IO transport.
+/// - hyper_io_set_write_vectored: Set the vectored write function for this IO transport.
+/// - hyper_io_set_sendfile: Set a function that sends part of a file straight to this IO transport.
 /// - hyper_io_set_userdata: Set the user data pointer for this IO to some value.
 /// - hyper_io_free:         Free an IO handle.
 pub struct hyper_io {
     read: hyper_io_read_callback,
+    read_buf: Option<hyper_io_read_buf_callback>,
+    /// Bytes from a `read_buf` callback that didn't fit in the last read.
+    read_leftover: Bytes,
     write: hyper_io_write_callback,
+    write_vectored: Option<hyper_io_write_vectored_callback>,
+    #[cfg(unix)]
+    sendfile: Option<hyper_io_sendfile_callback>,
     userdata: *mut c_void,
+    /// Set by `hyper_io_new_fd`, replacing all of the callbacks above.
+    #[cfg(unix)]
+    fd: Option<FdIo>,
+    /// The counters of the connection using this transport.
+    stats: Option<Arc<ConnStats>>,
+}
+
+/// A non-blocking file descriptor that hyper reads and writes itself.
+#[cfg(unix)]
+struct FdIo {
+    fd: c_int,
+    waits: FdWait,
+    /// Whether hyper opened the fd, and so closes it when done.
+    owned: bool,
+    /// Cleared once `send` fails with `ENOTSOCK`, to use `write` instead.
+    socket: bool,
+}
+
+/// The wakers a `hyper_io_fd_wait_callback` is given for one fd.
+///
+/// Each interest keeps a single waker for as long as hyper uses the fd. It
+/// is refreshed with `hyper_waker_update` each time the fd would block,
+/// rather than a new one being boxed. Once hyper is done with the fd, the
+/// callback is passed a `NULL` waker for each interest, and they're freed.
+#[cfg(unix)]
+pub(super) struct FdWait {
+    fd: c_int,
+    wait: hyper_io_fd_wait_callback,
+    userdata: *mut c_void,
+    readable: *mut hyper_waker,
+    writable: *mut hyper_waker,
 }
 
 ffi_fn! {
@@ -51,13 +166,57 @@ ffi_fn! {
     /// arrange to be called again when data is available.
     ///
     /// To avoid a memory leak, the IO handle must eventually be consumed by
-    /// `hyper_io_free` or `hyper_clientconn_handshake`.
+    /// `hyper_io_free`, `hyper_clientconn_handshake`, or `hyper_serve_connection`.
     fn hyper_io_new() -> *mut hyper_io {
-        Box::into_raw(Box::new(hyper_io {
-            read: read_noop,
-            write: write_noop,
-            userdata: std::ptr::null_mut(),
-        }))
+        Box::into_raw(Box::new(hyper_io::new()))
+    } ?= std::ptr::null_mut()
+}
+
+ffi_fn! {
+    /// Create a new IO type that reads and writes a non-blocking file descriptor.
+    ///
+    /// This is a built-in transport for a plain (non-TLS) socket, so the read
+    /// and write callbacks don't have to be written by hand. hyper calls
+    /// `read(2)` and `send(2)` or `sendmsg(2)` on `fd` itself (`write(2)` and
+    /// `writev(2)` if it isn't a socket), and the other `hyper_io_set_*`
+    /// functions should not be used with it.
+    ///
+    /// Writes to a socket whose peer has gone away fail with an error rather
+    /// than raising `SIGPIPE`, using `MSG_NOSIGNAL`, or `SO_NOSIGPIPE` on
+    /// Apple platforms. A `hyper_body_new_from_fd` body is sent with
+    /// `sendfile(2)` on Linux, with `SIGPIPE` blocked while it runs. On other
+    /// platforms, and for an fd that isn't a socket, `SIGPIPE` is not
+    /// suppressed, and should be ignored by the application.
+    ///
+    /// The file descriptor must already be in non-blocking mode. Whenever an
+    /// operation would block, the `wait` callback is called with `userdata`,
+    /// `fd`, either `HYPER_IO_READABLE` or `HYPER_IO_WRITABLE`, and a
+    /// `hyper_waker *`. The application should register interest in that
+    /// event with its polling mechanism (`select`, `epoll`, a poll request
+    /// on an `io_uring`, ...), and wake the waker with
+    /// `hyper_waker_wake_by_ref` once it happens, replacing any waker it was
+    /// given before for the same `fd` and interest. The callback must not
+    /// call back into hyper.
+    ///
+    /// The waker is still owned by hyper, which passes the same one each
+    /// time for an `fd` and interest, so it must not be freed or consumed by
+    /// `hyper_waker_wake`. When hyper is done with `fd`, the `wait` callback
+    /// is called one last time for each interest it waited for, with a
+    /// `NULL` waker, after which the waker must not be used. `userdata` must
+    /// stay valid until then.
+    ///
+    /// The `fd` is not closed by hyper, and must stay open until the IO handle
+    /// has been freed, along with the connection using it.
+    ///
+    /// This is only available on Unix platforms.
+    ///
+    /// To avoid a memory leak, the IO handle must eventually be consumed by
+    /// `hyper_io_free`, `hyper_clientconn_handshake`, or `hyper_serve_connection`.
+    #[cfg(unix)]
+    fn hyper_io_new_fd(fd: c_int, wait: hyper_io_fd_wait_callback, userdata: *mut c_void) -> *mut hyper_io {
+        let mut io = hyper_io::new();
+        io.fd = Some(FdIo::new(FdWait::new(fd, wait, userdata), false));
+        Box::into_raw(Box::new(io))
     } ?= std::ptr::null_mut()
 }
 
@@ -65,7 +224,7 @@ ffi_fn! {
     /// Free an IO handle.
     ///
     /// This should only be used if the request isn't consumed by
-    /// `hyper_clientconn_handshake`.
+    /// `hyper_clientconn_handshake` or `hyper_serve_connection`.
     fn hyper_io_free(io: *mut hyper_io) {
         drop(non_null!(Box::from_raw(io) ?= ()));
     }
@@ -103,6 +262,42 @@ ffi_fn! {
     }
 }
 
+ffi_fn! {
+    /// Set a read function that hands owned buffers to this IO transport.
+    ///
+    /// This is an alternative to `hyper_io_set_read`, for transports that
+    /// already hold the received data in buffers of their own, such as a TLS
+    /// layer that decrypts into its own memory. Once set, the callback from
+    /// `hyper_io_set_read` is no longer used.
+    ///
+    /// If there is data available, the `hyper_buf **` argument should be set
+    /// to a `hyper_buf *` containing the data, and `HYPER_POLL_READY` should
+    /// be returned. hyper takes ownership of the buffer and keeps any bytes it
+    /// can't use right away for the next read, so buffers of any size may be
+    /// returned.
+    ///
+    /// With a buffer made by `hyper_buf_from_owned`, the body data of an
+    /// HTTP/1 message is handed to the application as slices of the
+    /// transport's own memory, without being copied. Message heads, and the
+    /// body bytes read in along with a head, are still copied into hyper's
+    /// read buffer to be parsed. HTTP/2 connections copy all of
+    /// the data.
+    ///
+    /// Returning `HYPER_POLL_READY` while the `hyper_buf **` argument points
+    /// to `NULL` signals the end of the stream. Returning an empty buffer is
+    /// an error.
+    ///
+    /// If there is no data currently available, the callback should save a
+    /// `hyper_waker` from the `hyper_context *` argument, and return
+    /// `HYPER_POLL_PENDING`. See the documentation for `hyper_waker`.
+    ///
+    /// If there is an irrecoverable error reading data, then
+    /// `HYPER_POLL_ERROR` should be the return value.
+    fn hyper_io_set_read_buf(io: *mut hyper_io, func: hyper_io_read_buf_callback) {
+        non_null!(&mut *io ?= ()).read_buf = Some(func);
+    }
+}
+
 ffi_fn! {
     /// Set the write function for this IO transport.
     ///
@@ -122,6 +317,52 @@ ffi_fn! {
     }
 }
 
+ffi_fn! {
+    /// Set the vectored write function for this IO transport.
+    ///
+    /// This is optional. When set, hyper will hand several buffers at once
+    /// (such as the message head and a body chunk) to this callback, instead
+    /// of first copying them into a single buffer for the write callback.
+    ///
+    /// The callback is passed an array of `iovs_len` `hyper_iovec`s. Data from
+    /// them should be written to the transport in order, and the total number
+    /// of bytes written should be the return value. It is fine to write only
+    /// some of the bytes, stopping at any point.
+    ///
+    /// The `HYPER_IO_PENDING` and `HYPER_IO_ERROR` return values behave the
+    /// same as for the callback set with `hyper_io_set_write`, which must
+    /// still be set; it is used for writes of a single buffer.
+    fn hyper_io_set_write_vectored(io: *mut hyper_io, func: hyper_io_write_vectored_callback) {
+        non_null!(&mut *io ?= ()).write_vectored = Some(func);
+    }
+}
+
+ffi_fn! {
+    /// Set a function that sends part of a file straight to this IO transport.
+    ///
+    /// This is optional. When set, a body from `hyper_body_new_from_fd` that
+    /// is sent with a `content-length` is handed to this callback once the
+    /// message head has been written, instead of hyper reading the file into
+    /// a buffer and writing that out. The callback would typically call
+    /// `sendfile(2)` or `splice(2)`, so it should only be set on transports
+    /// that write to the socket as is, not through TLS.
+    ///
+    /// The callback is passed the file descriptor, the offset to send from,
+    /// and the most bytes to send. The number of bytes sent should be the
+    /// return value. Returning 0 means the file ended early, which fails the
+    /// body. The `HYPER_IO_PENDING` and `HYPER_IO_ERROR` return values behave
+    /// the same as for the callback set with `hyper_io_set_write`.
+    ///
+    /// A transport from `hyper_io_new_fd` calls `sendfile(2)` itself on
+    /// Linux, so this has no effect on it.
+    ///
+    /// This is only available on Unix platforms.
+    #[cfg(unix)]
+    fn hyper_io_set_sendfile(io: *mut hyper_io, func: hyper_io_sendfile_callback) {
+        non_null!(&mut *io ?= ()).sendfile = Some(func);
+    }
+}
+
 /// cbindgen:ignore
 extern "C" fn read_noop(
     _userdata: *mut c_void,
@@ -142,12 +383,334 @@ extern "C" fn write_noop(
     0
 }
 
-impl Read for hyper_io {
+#[cfg(unix)]
+impl FdIo {
+    fn new(waits: FdWait, owned: bool) -> FdIo {
+        let fd = waits.fd;
+        #[cfg(target_vendor = "apple")]
+        unsafe {
+            // Fails for an fd that isn't a socket, which is fine.
+            let on: c_int = 1;
+            libc::setsockopt(
+                fd,
+                libc::SOL_SOCKET,
+                libc::SO_NOSIGPIPE,
+                &on as *const c_int as *const c_void,
+                std::mem::size_of::<c_int>() as libc::socklen_t,
+            );
+        }
+        FdIo {
+            fd,
+            waits,
+            owned,
+            socket: true,
+        }
+    }
+
     fn poll_read(
-        self: Pin<&mut Self>,
+        &mut self,
         cx: &mut Context<'_>,
         mut buf: crate::rt::ReadBufCursor<'_>,
+    ) -> Poll<std::io::Result<usize>> {
+        let fd = self.fd;
+        let dst = unsafe { buf.as_mut() };
+        let polled = self.waits.poll_syscall(cx, HYPER_IO_READABLE, || unsafe {
+            libc::read(fd, dst.as_mut_ptr() as *mut c_void, dst.len())
+        });
+        polled.map_ok(|n| {
+            // Safety: read(2) initialized the first `n` bytes.
+            unsafe { buf.advance(n) };
+            n
+        })
+    }
+
+    fn poll_write(&mut self, cx: &mut Context<'_>, buf: &[u8]) -> Poll<std::io::Result<usize>> {
+        let fd = self.fd;
+        if self.socket {
+            let polled = self.waits.poll_syscall(cx, HYPER_IO_WRITABLE, || unsafe {
+                libc::send(fd, buf.as_ptr() as *const c_void, buf.len(), SEND_FLAGS)
+            });
+            if !is_not_socket(&polled) {
+                return polled;
+            }
+            self.socket = false;
+        }
+        self.waits.poll_syscall(cx, HYPER_IO_WRITABLE, || unsafe {
+            libc::write(fd, buf.as_ptr() as *const c_void, buf.len())
+        })
+    }
+
+    fn poll_write_vectored(
+        &mut self,
+        cx: &mut Context<'_>,
+        bufs: &[std::io::IoSlice<'_>],
+    ) -> Poll<std::io::Result<usize>> {
+        let fd = self.fd;
+        // IoSlice is guaranteed to be ABI compatible with `struct iovec`.
+        let iov = bufs.as_ptr() as *mut libc::iovec;
+        let iovcnt = bufs.len().min(MAX_WRITEV_BUFS);
+        if self.socket {
+            let polled = self.waits.poll_syscall(cx, HYPER_IO_WRITABLE, || unsafe {
+                let mut msg: libc::msghdr = std::mem::zeroed();
+                msg.msg_iov = iov;
+                msg.msg_iovlen = iovcnt as _;
+                libc::sendmsg(fd, &msg, SEND_FLAGS)
+            });
+            if !is_not_socket(&polled) {
+                return polled;
+            }
+            self.socket = false;
+        }
+        self.waits.poll_syscall(cx, HYPER_IO_WRITABLE, || unsafe {
+            libc::writev(fd, iov, iovcnt as c_int)
+        })
+    }
+
+    #[cfg(target_os = "linux")]
+    fn poll_sendfile(
+        &mut self,
+        cx: &mut Context<'_>,
+        in_fd: c_int,
+        offset: u64,
+        len: usize,
+    ) -> Poll<std::io::Result<usize>> {
+        let fd = self.fd;
+        let mut offset = offset as libc::off_t;
+        self.waits.poll_syscall(cx, HYPER_IO_WRITABLE, || {
+            without_sigpipe(|| unsafe { libc::sendfile(fd, in_fd, &mut offset, len) })
+        })
+    }
+}
+
+#[cfg(unix)]
+fn is_not_socket(polled: &Poll<std::io::Result<usize>>) -> bool {
+    matches!(polled, Poll::Ready(Err(ref err)) if err.raw_os_error() == Some(libc::ENOTSOCK))
+}
+
+/// Runs a syscall with `SIGPIPE` blocked on this thread, discarding one it
+/// raised, for writes to a socket that can't be passed `MSG_NOSIGNAL`.
+#[cfg(target_os = "linux")]
+fn without_sigpipe(syscall: impl FnOnce() -> libc::ssize_t) -> libc::ssize_t {
+    unsafe {
+        let mut sigpipe: libc::sigset_t = std::mem::zeroed();
+        libc::sigemptyset(&mut sigpipe);
+        libc::sigaddset(&mut sigpipe, libc::SIGPIPE);
+        let mut old: libc::sigset_t = std::mem::zeroed();
+        libc::pthread_sigmask(libc::SIG_BLOCK, &sigpipe, &mut old);
+
+        let ret = syscall();
+        if ret < 0 && *libc::__errno_location() == libc::EPIPE {
+            let poll = libc::timespec {
+                tv_sec: 0,
+                tv_nsec: 0,
+            };
+            libc::sigtimedwait(&sigpipe, std::ptr::null_mut(), &poll);
+            // Put back the errno sigtimedwait overwrote.
+            *libc::__errno_location() = libc::EPIPE;
+        }
+
+        libc::pthread_sigmask(libc::SIG_SETMASK, &old, std::ptr::null_mut());
+        ret
+    }
+}
+
+#[cfg(unix)]
+impl Drop for FdIo {
+    fn drop(&mut self) {
+        if self.owned {
+            // The callback must forget the fd before its number is reused.
+            self.waits.release();
+            unsafe { libc::close(self.fd) };
+        }
+    }
+}
+
+#[cfg(unix)]
+impl FdWait {
+    pub(super) fn new(fd: c_int, wait: hyper_io_fd_wait_callback, userdata: *mut c_void) -> FdWait {
+        FdWait {
+            fd,
+            wait,
+            userdata,
+            readable: std::ptr::null_mut(),
+            writable: std::ptr::null_mut(),
+        }
+    }
+
+    /// Has the `wait` callback wake the task of `cx` once the fd has
+    /// `interest`.
+    pub(super) fn register(&mut self, cx: &mut Context<'_>, interest: c_int) {
+        let slot = if interest == HYPER_IO_READABLE {
+            &mut self.readable
+        } else {
+            &mut self.writable
+        };
+        if slot.is_null() {
+            *slot = hyper_context_waker(hyper_context::wrap(cx));
+        } else {
+            hyper_waker_update(*slot, hyper_context::wrap(cx));
+        }
+        (self.wait)(self.userdata, self.fd, interest, *slot);
+    }
+
+    /// Runs a syscall until it isn't interrupted. If it would block, registers
+    /// `interest` with the `wait` callback.
+    fn poll_syscall(
+        &mut self,
+        cx: &mut Context<'_>,
+        interest: c_int,
+        mut syscall: impl FnMut() -> libc::ssize_t,
+    ) -> Poll<std::io::Result<usize>> {
+        loop {
+            let ret = syscall();
+            if ret >= 0 {
+                return Poll::Ready(Ok(ret as usize));
+            }
+
+            let err = std::io::Error::last_os_error();
+            match err.kind() {
+                std::io::ErrorKind::Interrupted => continue,
+                std::io::ErrorKind::WouldBlock => {
+                    self.register(cx, interest);
+                    return Poll::Pending;
+                }
+                _ => return Poll::Ready(Err(err)),
+            }
+        }
+    }
+
+    /// Tells the `wait` callback to forget the wakers it was given, and
+    /// frees them.
+    pub(super) fn release(&mut self) {
+        let slots = [
+            (HYPER_IO_READABLE, &mut self.readable),
+            (HYPER_IO_WRITABLE, &mut self.writable),
+        ];
+        for (interest, slot) in slots {
+            if !slot.is_null() {
+                (self.wait)(self.userdata, self.fd, interest, std::ptr::null_mut());
+                hyper_waker_free(std::mem::replace(slot, std::ptr::null_mut()));
+            }
+        }
+    }
+}
+
+#[cfg(unix)]
+impl Drop for FdWait {
+    fn drop(&mut self) {
+        self.release();
+    }
+}
+
+#[cfg(unix)]
+unsafe impl Send for FdWait {}
+
+impl hyper_io {
+    fn new() -> hyper_io {
+        hyper_io {
+            read: read_noop,
+            read_buf: None,
+            read_leftover: Bytes::new(),
+            write: write_noop,
+            write_vectored: None,
+            #[cfg(unix)]
+            sendfile: None,
+            userdata: std::ptr::null_mut(),
+            #[cfg(unix)]
+            fd: None,
+            stats: None,
+        }
+    }
+
+    pub(super) fn set_stats(&mut self, stats: Arc<ConnStats>) {
+        self.stats = Some(stats);
+    }
+
+    /// Given to an HTTP/1 connection over a `hyper_io`, so it can use what
+    /// the transport does besides reading and writing.
+    pub(super) fn ffi_transport(io: &mut Box<hyper_io>) -> &mut dyn FfiTransport {
+        &mut **io
+    }
+
+    /// Wraps a connected socket that hyper opened, closing it when dropped.
+    #[cfg(unix)]
+    pub(super) fn owned_fd(waits: FdWait) -> hyper_io {
+        let mut io = hyper_io::new();
+        io.fd = Some(FdIo::new(waits, true));
+        io
+    }
+
+    /// Makes sure `read_leftover` holds bytes from the `read_buf` callback,
+    /// unless the stream has ended.
+    fn poll_read_leftover(
+        &mut self,
+        read_buf: hyper_io_read_buf_callback,
+        cx: &mut Context<'_>,
     ) -> Poll<std::io::Result<()>> {
+        if !self.read_leftover.is_empty() {
+            return Poll::Ready(Ok(()));
+        }
+
+        let mut out = std::ptr::null_mut();
+        match read_buf(self.userdata, hyper_context::wrap(cx), &mut out) {
+            HYPER_POLL_READY => {
+                if out.is_null() {
+                    return Poll::Ready(Ok(()));
+                }
+                self.read_leftover = hyper_buf::unbox(unsafe { Box::from_raw(out) }).0;
+                if self.read_leftover.is_empty() {
+                    return Poll::Ready(Err(std::io::Error::new(
+                        std::io::ErrorKind::Other,
+                        "hyper_io_read_buf_callback returned an empty buffer",
+                    )));
+                }
+                Poll::Ready(Ok(()))
+            }
+            HYPER_POLL_PENDING => Poll::Pending,
+            HYPER_POLL_ERROR => Poll::Ready(Err(std::io::Error::new(
+                std::io::ErrorKind::Other,
+                "io error",
+            ))),
+            unexpected => Poll::Ready(Err(std::io::Error::new(
+                std::io::ErrorKind::Other,
+                format!(
+                    "unexpected hyper_io_read_buf_callback return code {}",
+                    unexpected
+                ),
+            ))),
+        }
+    }
+
+    /// Copies bytes from the `read_buf` callback into `buf`, for reads that
+    /// need them contiguous, such as of a message head.
+    fn poll_read_copied(
+        &mut self,
+        read_buf: hyper_io_read_buf_callback,
+        cx: &mut Context<'_>,
+        mut buf: crate::rt::ReadBufCursor<'_>,
+    ) -> Poll<std::io::Result<usize>> {
+        futures_util::ready!(self.poll_read_leftover(read_buf, cx))?;
+        let n = std::cmp::min(buf.remaining(), self.read_leftover.len());
+        buf.put_slice(&self.read_leftover[..n]);
+        self.read_leftover.advance(n);
+        Poll::Ready(Ok(n))
+    }
+
+    /// Reads from whichever transport is set, returning the bytes read.
+    fn poll_read_transport(
+        &mut self,
+        cx: &mut Context<'_>,
+        mut buf: crate::rt::ReadBufCursor<'_>,
+    ) -> Poll<std::io::Result<usize>> {
+        #[cfg(unix)]
+        if let Some(ref mut fd) = self.fd {
+            return fd.poll_read(cx, buf);
+        }
+
+        if let Some(read_buf) = self.read_buf {
+            return self.poll_read_copied(read_buf, cx, buf);
+        }
+
         let buf_ptr = unsafe { buf.as_mut() }.as_mut_ptr() as *mut u8;
         let buf_len = buf.remaining();
 
@@ -161,29 +724,179 @@ impl Read for hyper_io {
                 // We have to trust that the user's read callback actually
                 // filled in that many bytes... :(
                 unsafe { buf.advance(ok) };
-                Poll::Ready(Ok(()))
+                Poll::Ready(Ok(ok))
             }
         }
     }
+
+    fn record_write(&self, polled: Poll<std::io::Result<usize>>) -> Poll<std::io::Result<usize>> {
+        if let Some(ref stats) = self.stats {
+            stats.record_write(&polled);
+        }
+        polled
+    }
+}
+
+impl Read for hyper_io {
+    fn poll_read(
+        self: Pin<&mut Self>,
+        cx: &mut Context<'_>,
+        buf: crate::rt::ReadBufCursor<'_>,
+    ) -> Poll<std::io::Result<()>> {
+        let this = self.get_mut();
+        let polled = this.poll_read_transport(cx, buf);
+        if let Some(ref stats) = this.stats {
+            stats.record_read(&polled);
+        }
+        polled.map_ok(|_| ())
+    }
+}
+
+impl FfiTransport for hyper_io {
+    fn poll_read_owned(
+        &mut self,
+        cx: &mut Context<'_>,
+        max: usize,
+    ) -> Poll<std::io::Result<Option<Bytes>>> {
+        #[cfg(unix)]
+        if self.fd.is_some() {
+            return Poll::Ready(Ok(None));
+        }
+        let read_buf = match self.read_buf {
+            Some(read_buf) => read_buf,
+            None => return Poll::Ready(Ok(None)),
+        };
+
+        let polled = self
+            .poll_read_leftover(read_buf, cx)
+            .map_ok(|()| std::cmp::min(max, self.read_leftover.len()));
+        if let Some(ref stats) = self.stats {
+            stats.record_read(&polled);
+        }
+        polled.map_ok(|n| Some(self.read_leftover.split_to(n)))
+    }
+
+    #[cfg(unix)]
+    fn is_sendfile(&self) -> bool {
+        if self.fd.is_some() {
+            return cfg!(target_os = "linux");
+        }
+
+        self.sendfile.is_some()
+    }
+
+    #[cfg(unix)]
+    fn poll_sendfile(
+        &mut self,
+        cx: &mut Context<'_>,
+        fd: c_int,
+        offset: u64,
+        len: usize,
+    ) -> Poll<std::io::Result<usize>> {
+        #[cfg(target_os = "linux")]
+        if let Some(ref mut io) = self.fd {
+            let polled = io.poll_sendfile(cx, fd, offset, len);
+            return self.record_write(polled);
+        }
+
+        let sendfile = match self.sendfile {
+            Some(func) if self.fd.is_none() => func,
+            _ => return Poll::Ready(Err(std::io::ErrorKind::Unsupported.into())),
+        };
+        let polled = match sendfile(self.userdata, hyper_context::wrap(cx), fd, offset, len) {
+            HYPER_IO_PENDING => Poll::Pending,
+            HYPER_IO_ERROR => Poll::Ready(Err(std::io::Error::new(
+                std::io::ErrorKind::Other,
+                "io error",
+            ))),
+            ok => Poll::Ready(Ok(ok)),
+        };
+        self.record_write(polled)
+    }
 }
 
 impl Write for hyper_io {
     fn poll_write(
-        self: Pin<&mut Self>,
+        mut self: Pin<&mut Self>,
         cx: &mut Context<'_>,
         buf: &[u8],
     ) -> Poll<std::io::Result<usize>> {
+        #[cfg(unix)]
+        if let Some(ref mut fd) = self.fd {
+            let polled = fd.poll_write(cx, buf);
+            return self.record_write(polled);
+        }
+
         let buf_ptr = buf.as_ptr();
         let buf_len = buf.len();
 
-        match (self.write)(self.userdata, hyper_context::wrap(cx), buf_ptr, buf_len) {
+        let polled = match (self.write)(self.userdata, hyper_context::wrap(cx), buf_ptr, buf_len) {
             HYPER_IO_PENDING => Poll::Pending,
             HYPER_IO_ERROR => Poll::Ready(Err(std::io::Error::new(
                 std::io::ErrorKind::Other,
                 "io error",
             ))),
             ok => Poll::Ready(Ok(ok)),
+        };
+        self.record_write(polled)
+    }
+
+    fn is_write_vectored(&self) -> bool {
+        #[cfg(unix)]
+        if self.fd.is_some() {
+            return true;
         }
+
+        self.write_vectored.is_some()
+    }
+
+    fn poll_write_vectored(
+        mut self: Pin<&mut Self>,
+        cx: &mut Context<'_>,
+        bufs: &[std::io::IoSlice<'_>],
+    ) -> Poll<std::io::Result<usize>> {
+        #[cfg(unix)]
+        if let Some(ref mut fd) = self.fd {
+            let polled = fd.poll_write_vectored(cx, bufs);
+            return self.record_write(polled);
+        }
+
+        let write_vectored = match self.write_vectored {
+            Some(func) => func,
+            None => {
+                let buf = bufs
+                    .iter()
+                    .find(|b| !b.is_empty())
+                    .map_or(&[][..], |b| &**b);
+                return self.poll_write(cx, buf);
+            }
+        };
+
+        let mut iovs = [hyper_iovec {
+            iov_base: std::ptr::null(),
+            iov_len: 0,
+        }; MAX_WRITEV_BUFS];
+        let mut iovs_len = 0;
+        for (iov, buf) in iovs.iter_mut().zip(bufs) {
+            iov.iov_base = buf.as_ptr() as *const c_void;
+            iov.iov_len = buf.len();
+            iovs_len += 1;
+        }
+
+        let polled = match write_vectored(
+            self.userdata,
+            hyper_context::wrap(cx),
+            iovs.as_ptr(),
+            iovs_len,
+        ) {
+            HYPER_IO_PENDING => Poll::Pending,
+            HYPER_IO_ERROR => Poll::Ready(Err(std::io::Error::new(
+                std::io::ErrorKind::Other,
+                "io error",
+            ))),
+            ok => Poll::Ready(Ok(ok)),
+        };
+        self.record_write(polled)
     }
 
     fn poll_flush(self: Pin<&mut Self>, _: &mut Context<'_>) -> Poll<std::io::Result<()>> {
@@ -197,3 +910,239 @@ impl Write for hyper_io {
 
 unsafe impl Send for hyper_io {}
 unsafe impl Sync for hyper_io {}
+
+unsafe impl AsTaskType for hyper_io {
+    fn as_task_type(&self) -> hyper_task_return_type {
+        hyper_task_return_type::HYPER_TASK_IO
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    #[cfg(unix)]
+    use crate::ffi::client::tests::socketpair;
+    use crate::ffi::hyper_buf_copy;
+    use crate::rt::ReadBuf;
+
+    #[test]
+    fn test_read_buf_keeps_leftover() {
+        extern "C" fn read_buf(
+            userdata: *mut c_void,
+            _: *mut hyper_context<'_>,
+            out: *mut *mut hyper_buf,
+        ) -> c_int {
+            let calls = unsafe { &mut *(userdata as *mut usize) };
+            *calls += 1;
+            if *calls == 1 {
+                let data = b"hello world";
+                unsafe { *out = hyper_buf_copy(data.as_ptr(), data.len()) };
+            }
+            HYPER_POLL_READY
+        }
+
+        let mut calls = 0usize;
+        let mut io = unsafe { *Box::from_raw(hyper_io_new()) };
+        io.userdata = &mut calls as *mut usize as *mut c_void;
+        hyper_io_set_read_buf(&mut io, read_buf);
+
+        let mut cx = Context::from_waker(futures_util::task::noop_waker_ref());
+        let mut read = |io: &mut hyper_io| {
+            let mut dst = [0u8; 8];
+            let mut buf = ReadBuf::new(&mut dst);
+            match Pin::new(io).poll_read(&mut cx, buf.unfilled()) {
+                Poll::Ready(Ok(())) => buf.filled().to_vec(),
+                other => panic!("unexpected poll_read result: {:?}", other),
+            }
+        };
+
+        assert_eq!(read(&mut io), b"hello wo");
+        assert_eq!(read(&mut io), b"rld");
+        assert_eq!(read(&mut io), b"");
+        assert_eq!(calls, 2);
+    }
+
+    #[test]
+    fn test_read_buf_owned_without_copying() {
+        static DATA: [u8; 11] = *b"hello world";
+
+        extern "C" fn release(_: *mut c_void, _: *const u8, _: size_t) {}
+
+        extern "C" fn read_buf(
+            userdata: *mut c_void,
+            _: *mut hyper_context<'_>,
+            out: *mut *mut hyper_buf,
+        ) -> c_int {
+            let calls = unsafe { &mut *(userdata as *mut usize) };
+            *calls += 1;
+            match *calls {
+                1 => unsafe {
+                    *out = crate::ffi::hyper_buf_from_owned(
+                        DATA.as_ptr(),
+                        DATA.len(),
+                        std::ptr::null_mut(),
+                        release,
+                    )
+                },
+                2 => unsafe { *out = hyper_buf_copy(DATA.as_ptr(), 0) },
+                _ => (),
+            }
+            HYPER_POLL_READY
+        }
+
+        let mut calls = 0usize;
+        let mut io = unsafe { *Box::from_raw(hyper_io_new()) };
+        io.userdata = &mut calls as *mut usize as *mut c_void;
+        hyper_io_set_read_buf(&mut io, read_buf);
+
+        let mut cx = Context::from_waker(futures_util::task::noop_waker_ref());
+        let mut read = |io: &mut hyper_io| io.poll_read_owned(&mut cx, 8);
+
+        // The bytes are slices of the transport's memory.
+        match read(&mut io) {
+            Poll::Ready(Ok(Some(bytes))) => {
+                assert_eq!(bytes, &b"hello wo"[..]);
+                assert_eq!(bytes.as_ptr(), DATA.as_ptr());
+            }
+            other => panic!("unexpected poll_read_owned result: {:?}", other),
+        }
+        match read(&mut io) {
+            Poll::Ready(Ok(Some(bytes))) => {
+                assert_eq!(bytes, &b"rld"[..]);
+                assert_eq!(bytes.as_ptr(), DATA[8..].as_ptr());
+            }
+            other => panic!("unexpected poll_read_owned result: {:?}", other),
+        }
+
+        // An empty buffer isn't mistaken for the end of the stream.
+        assert!(matches!(read(&mut io), Poll::Ready(Err(_))));
+        match read(&mut io) {
+            Poll::Ready(Ok(Some(bytes))) => assert!(bytes.is_empty()),
+            other => panic!("unexpected poll_read_owned result: {:?}", other),
+        }
+        assert_eq!(calls, 3);
+    }
+
+    #[cfg(unix)]
+    #[test]
+    fn test_fd_io_reads_writes_and_waits() {
+        #[derive(Default)]
+        struct Waited {
+            interest: c_int,
+            wakers: Vec<*mut hyper_waker>,
+            released: usize,
+        }
+
+        extern "C" fn wait(
+            userdata: *mut c_void,
+            _fd: c_int,
+            interest: c_int,
+            waker: *mut hyper_waker,
+        ) {
+            // The waker is hyper's; a NULL one means it is done with the fd.
+            let waited = unsafe { &mut *(userdata as *mut Waited) };
+            if waker.is_null() {
+                waited.released += 1;
+            } else {
+                waited.interest = interest;
+                waited.wakers.push(waker);
+            }
+        }
+
+        let fds = socketpair();
+
+        let mut waited = Waited::default();
+        let mut io = unsafe {
+            *Box::from_raw(hyper_io_new_fd(
+                fds[0],
+                wait,
+                &mut waited as *mut Waited as *mut c_void,
+            ))
+        };
+        let mut cx = Context::from_waker(futures_util::task::noop_waker_ref());
+
+        let mut dst = [0u8; 8];
+        let mut buf = ReadBuf::new(&mut dst);
+        for _ in 0..2 {
+            assert!(Pin::new(&mut io)
+                .poll_read(&mut cx, buf.unfilled())
+                .is_pending());
+        }
+        assert_eq!(waited.interest, HYPER_IO_READABLE);
+        // Waiting again passes the same waker.
+        assert_eq!(waited.wakers.len(), 2);
+        assert_eq!(waited.wakers[0], waited.wakers[1]);
+
+        let bufs = [
+            std::io::IoSlice::new(b"hello "),
+            std::io::IoSlice::new(b"world"),
+        ];
+        match Pin::new(&mut io).poll_write_vectored(&mut cx, &bufs) {
+            Poll::Ready(Ok(n)) => assert_eq!(n, 11),
+            other => panic!("unexpected poll_write_vectored result: {:?}", other),
+        }
+        let mut out = [0u8; 16];
+        let n = unsafe { libc::read(fds[1], out.as_mut_ptr() as *mut c_void, out.len()) };
+        assert_eq!(&out[..n as usize], b"hello world");
+
+        let n = unsafe { libc::write(fds[1], b"hi".as_ptr() as *const c_void, 2) };
+        assert_eq!(n, 2);
+        match Pin::new(&mut io).poll_read(&mut cx, buf.unfilled()) {
+            Poll::Ready(Ok(())) => assert_eq!(buf.filled(), b"hi"),
+            other => panic!("unexpected poll_read result: {:?}", other),
+        }
+
+        // Dropping the IO tells the callback to forget the waker.
+        drop(io);
+        assert_eq!(waited.released, 1);
+
+        unsafe {
+            libc::close(fds[0]);
+            libc::close(fds[1]);
+        }
+    }
+
+    #[cfg(any(target_os = "linux", target_vendor = "apple"))]
+    #[test]
+    fn test_fd_io_write_to_closed_peer_fails_without_sigpipe() {
+        use std::sync::atomic::{AtomicUsize, Ordering};
+
+        static SIGPIPES: AtomicUsize = AtomicUsize::new(0);
+
+        extern "C" fn count_sigpipe(_: c_int) {
+            SIGPIPES.fetch_add(1, Ordering::SeqCst);
+        }
+
+        extern "C" fn wait(_: *mut c_void, _: c_int, _: c_int, _: *mut hyper_waker) {}
+
+        let fds = socketpair();
+        unsafe { libc::close(fds[1]) };
+
+        // Rust ignores SIGPIPE by default, which would hide one being raised.
+        let old = unsafe { libc::signal(libc::SIGPIPE, count_sigpipe as libc::sighandler_t) };
+        let mut io = unsafe { *Box::from_raw(hyper_io_new_fd(fds[0], wait, std::ptr::null_mut())) };
+        let mut cx = Context::from_waker(futures_util::task::noop_waker_ref());
+
+        let is_epipe = |polled: Poll<std::io::Result<usize>>| match polled {
+            Poll::Ready(Err(err)) => err.raw_os_error() == Some(libc::EPIPE),
+            _ => false,
+        };
+        assert!(is_epipe(Pin::new(&mut io).poll_write(&mut cx, b"hello")));
+        let bufs = [std::io::IoSlice::new(b"hello")];
+        assert!(is_epipe(
+            Pin::new(&mut io).poll_write_vectored(&mut cx, &bufs)
+        ));
+        #[cfg(target_os = "linux")]
+        {
+            let file = std::fs::File::open("/proc/self/exe").expect("open");
+            let in_fd = std::os::unix::io::AsRawFd::as_raw_fd(&file);
+            assert!(is_epipe(io.poll_sendfile(&mut cx, in_fd, 0, 16)));
+        }
+
+        unsafe { libc::signal(libc::SIGPIPE, old) };
+        assert_eq!(SIGPIPES.load(Ordering::SeqCst), 0);
+
+        drop(io);
+        unsafe { libc::close(fds[0]) };
+    }
+}
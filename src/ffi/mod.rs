@@ -25,8 +25,14 @@
 //! `cargo`, staring with `1.64.0`, it can be compiled with the following command:
 //!
 //! ```notrust
-//! RUSTFLAGS="--cfg hyper_unstable_ffi" cargo rustc --crate-type cdylib --features client,http1,http2,ffi
+//! RUSTFLAGS="--cfg hyper_unstable_ffi" cargo rustc --crate-type cdylib --features client,http1,http2,server,ffi
 //! ```
+//!
+//! Adding the `ffi-decompression` feature lets `hyper_response_body_decoded`
+//! decode gzip and deflate response bodies.
+//!
+//! Adding the `ffi-stats` feature makes `hyper_stats_snapshot` count the
+//! allocations, copies and executor work of the C API.
 
 // We may eventually allow the FFI to be enabled without `client` or `http1`,
 // that is why we don't auto enable them as `ffi = ["client", "http1"]` in
@@ -49,16 +55,30 @@ mod macros;
 
 mod body;
 mod client;
+#[cfg(unix)]
+mod connector;
+mod decompress;
 mod error;
 mod http_types;
 mod io;
+mod pool;
+mod recycle;
+#[cfg(feature = "server")]
+mod server;
+mod stats;
 mod task;
 
 pub use self::body::*;
 pub use self::client::*;
+#[cfg(unix)]
+pub use self::connector::*;
 pub use self::error::*;
 pub use self::http_types::*;
 pub use self::io::*;
+pub use self::pool::*;
+#[cfg(feature = "server")]
+pub use self::server::*;
+pub use self::stats::*;
 pub use self::task::*;
 
 /// Return in iter functions to continue iterating.
@@ -0,0 +1,667 @@
+use std::collections::HashMap;
+use std::ffi::c_void;
+use std::ptr;
+use std::sync::{Arc, Mutex};
+use std::time::{Duration, Instant};
+
+use futures_channel::oneshot;
+use libc::size_t;
+
+use super::client::{hyper_clientconn, Tx};
+use super::http_types::hyper_request;
+use super::recycle::Recycle;
+use super::task::{hyper_task, hyper_task_return_type, BoxAny};
+use super::UserDataPointer;
+
+/// A pool of HTTP client connections, reused across requests.
+///
+/// Requests are sent with `hyper_client_pool_send`, along with a key that
+/// identifies which connections they can be sent on. Typically the key is
+/// the scheme and authority of the request, such as `https://example.com:443`.
+///
+/// If the pool has a connection for that key which is ready for another
+/// request, it is used. HTTP/2 connections are shared by all the requests
+/// for their key. Otherwise, the pool calls the connect callback to create a
+/// new connection, and keeps it for later requests. Requests made while that
+/// connection is still being created wait for it, and share it if it turns
+/// out to be HTTP/2.
+///
+/// Methods:
+///
+/// - hyper_client_pool_new:                   Creates a new, empty connection pool.
+/// - hyper_client_pool_set_connect:           Set the callback used to create new connections.
+/// - hyper_client_pool_set_max_idle_per_host: Set the most connections kept per key.
+/// - hyper_client_pool_set_idle_timeout:      Set how long an unused connection is kept.
+/// - hyper_client_pool_send:                  Creates a task to send a request on a pooled connection.
+/// - hyper_client_pool_free:                  Free a connection pool.
+pub struct hyper_client_pool(Arc<Mutex<Pool>>);
+
+struct Pool {
+    connect: Option<(hyper_client_pool_connect_callback, UserDataPointer)>,
+    max_idle_per_host: usize,
+    idle_timeout: Option<Duration>,
+    hosts: HashMap<Vec<u8>, Host>,
+    /// When the next sweep over every key is due.
+    next_reap: Instant,
+}
+
+/// How often closed and expired connections are dropped for every key, not
+/// just the one a request is being sent for.
+const REAP_INTERVAL: Duration = Duration::from_secs(1);
+
+/// The connections for one key.
+#[derive(Default)]
+struct Host {
+    conns: Vec<Pooled>,
+    /// Requests waiting on the connection being created for this key.
+    connecting: Option<Vec<oneshot::Sender<Tx>>>,
+    /// Whether the last connection created for this key was HTTP/1, so the
+    /// next requests shouldn't wait to share one.
+    http1: bool,
+}
+
+/// What a request should do to get a connection.
+enum Checkout {
+    Ready(Tx),
+    Wait(oneshot::Receiver<Tx>),
+    Connect { shared: bool },
+}
+
+/// Clears a key's in-progress connection if it is dropped before finishing,
+/// so the requests waiting on it make their own.
+struct Connecting<'a> {
+    pool: &'a Mutex<Pool>,
+    key: &'a [u8],
+    done: bool,
+}
+
+struct Pooled {
+    tx: Tx,
+    last_used: Instant,
+}
+
+type hyper_client_pool_connect_callback =
+    extern "C" fn(*mut c_void, *const u8, size_t) -> *mut hyper_task;
+
+ffi_fn! {
+    /// Creates a new, empty connection pool.
+    ///
+    /// By default, any number of connections are kept per key, and unused
+    /// connections are dropped after 90 seconds.
+    ///
+    /// To avoid a memory leak, the pool must eventually be consumed by
+    /// `hyper_client_pool_free`.
+    fn hyper_client_pool_new() -> *mut hyper_client_pool {
+        Box::into_raw(Box::new(hyper_client_pool(Arc::new(Mutex::new(Pool {
+            connect: None,
+            max_idle_per_host: usize::MAX,
+            idle_timeout: Some(Duration::from_secs(90)),
+            hosts: HashMap::new(),
+            next_reap: Instant::now() + REAP_INTERVAL,
+        })))))
+    } ?= ptr::null_mut()
+}
+
+ffi_fn! {
+    /// Free a connection pool.
+    ///
+    /// Requests already sent through the pool are not affected. Their
+    /// connections are closed once they are done.
+    fn hyper_client_pool_free(pool: *mut hyper_client_pool) {
+        drop(non_null!(Box::from_raw(pool) ?= ()));
+    }
+}
+
+ffi_fn! {
+    /// Set the callback used to create new connections.
+    ///
+    /// The callback is passed the `userdata` pointer and the key of the
+    /// request that needs a connection. It should start connecting a
+    /// transport, and return the task from `hyper_clientconn_handshake` for
+    /// it, without pushing that task onto an executor. The pool drives it as
+    /// part of the send task. Returning `NULL` fails the request.
+    ///
+    /// The `userdata` must stay valid as long as any task from
+    /// `hyper_client_pool_send` is still running.
+    fn hyper_client_pool_set_connect(pool: *mut hyper_client_pool, func: hyper_client_pool_connect_callback, userdata: *mut c_void) {
+        let pool = non_null!(&*pool ?= ());
+        pool.0.lock().unwrap().connect = Some((func, UserDataPointer(userdata)));
+    }
+}
+
+ffi_fn! {
+    /// Set the most connections kept per key.
+    ///
+    /// Connections beyond this limit are closed once their request is done,
+    /// instead of being kept for reuse. Pass `0` to disable reuse.
+    fn hyper_client_pool_set_max_idle_per_host(pool: *mut hyper_client_pool, max: size_t) {
+        let pool = non_null!(&*pool ?= ());
+        pool.0.lock().unwrap().max_idle_per_host = max;
+    }
+}
+
+ffi_fn! {
+    /// Set how long an unused connection is kept.
+    ///
+    /// A connection that hasn't been used for longer than `timeout_ms`
+    /// milliseconds since its last response is closed instead of being
+    /// reused. Pass `0` to keep unused connections until the peer closes
+    /// them.
+    ///
+    /// Expired connections are closed as requests are sent through the pool,
+    /// including those of keys that no longer get any requests.
+    fn hyper_client_pool_set_idle_timeout(pool: *mut hyper_client_pool, timeout_ms: u64) {
+        let pool = non_null!(&*pool ?= ());
+        pool.0.lock().unwrap().idle_timeout = if timeout_ms == 0 {
+            None
+        } else {
+            Some(Duration::from_millis(timeout_ms))
+        };
+    }
+}
+
+ffi_fn! {
+    /// Creates a task to send a request on a pooled connection.
+    ///
+    /// The `key` selects which connections the request may be sent on, and
+    /// is passed to the connect callback if a new connection is needed.
+    ///
+    /// This consumes the request. You should not use or free the request
+    /// afterwards.
+    ///
+    /// Returns a task that needs to be polled until it is ready. When ready, the
+    /// task yields a `hyper_response *`.
+    ///
+    /// To avoid a memory leak, the task must eventually be consumed by
+    /// `hyper_task_free`, or taken ownership of by `hyper_executor_push`
+    /// without subsequently being given back by `hyper_executor_poll`.
+    fn hyper_client_pool_send(pool: *mut hyper_client_pool, key: *const u8, key_len: size_t, req: *mut hyper_request) -> *mut hyper_task {
+        let pool = non_null!(&*pool ?= ptr::null_mut()).0.clone();
+        let req = hyper_request::unbox(non_null!(Box::from_raw(req) ?= ptr::null_mut()));
+        let key = if key_len == 0 {
+            Vec::new()
+        } else {
+            unsafe { std::slice::from_raw_parts(key, key_len) }.to_vec()
+        };
+
+        Box::into_raw(hyper_task::boxed(async move {
+            let mut tx = Pool::get(&pool, &key).await?;
+            let res = tx.send_request(req).await;
+            Pool::checkin(&pool, key, tx);
+            res
+        }))
+    } ?= ptr::null_mut()
+}
+
+// ===== impl Pool =====
+
+impl Pool {
+    /// Gets a connection for `key`, from the pool or by creating one.
+    async fn get(pool: &Mutex<Pool>, key: &[u8]) -> crate::Result<Tx> {
+        loop {
+            let shared = match Pool::checkout(pool, key) {
+                Checkout::Ready(tx) => return Ok(tx),
+                Checkout::Wait(rx) => match rx.await {
+                    Ok(tx) => return Ok(tx),
+                    // It failed or was HTTP/1, so look again.
+                    Err(_canceled) => continue,
+                },
+                Checkout::Connect { shared } => shared,
+            };
+
+            if !shared {
+                return Pool::connect(pool, key).await;
+            }
+            let connecting = Connecting {
+                pool,
+                key,
+                done: false,
+            };
+            let tx = Pool::connect(pool, key).await?;
+            connecting.finish(&tx);
+            return Ok(tx);
+        }
+    }
+
+    /// Finds a connection for `key` that is ready for another request,
+    /// dropping any closed or expired ones along the way.
+    ///
+    /// If there isn't one, the request either waits on the connection
+    /// already being created for `key`, or creates one itself.
+    fn checkout(pool: &Mutex<Pool>, key: &[u8]) -> Checkout {
+        let mut pool = pool.lock().unwrap();
+        let now = Instant::now();
+        pool.reap(now);
+        let idle_timeout = pool.idle_timeout;
+        let reuse = pool.max_idle_per_host > 0;
+        let host = pool.hosts.entry(key.to_vec()).or_default();
+        host.retain_usable(idle_timeout, now);
+
+        if let Some(idx) = host.conns.iter().position(|pooled| pooled.tx.is_ready()) {
+            // HTTP/2 connections stay in the pool while in use.
+            if let Some(tx) = host.conns[idx].tx.try_clone() {
+                host.conns[idx].last_used = now;
+                return Checkout::Ready(tx);
+            }
+            return Checkout::Ready(host.conns.swap_remove(idx).tx);
+        }
+
+        if !reuse || host.http1 {
+            return Checkout::Connect { shared: false };
+        }
+        match host.connecting {
+            Some(ref mut waiters) => {
+                let (tx, rx) = oneshot::channel();
+                waiters.push(tx);
+                Checkout::Wait(rx)
+            }
+            None => {
+                host.connecting = Some(Vec::new());
+                Checkout::Connect { shared: true }
+            }
+        }
+    }
+
+    /// Puts a connection back in the pool, once the response to a request
+    /// sent on it has been received.
+    ///
+    /// An HTTP/1 connection won't be ready for another request until the
+    /// response body has been read, so it is only checked out again once
+    /// `is_ready` says so.
+    fn checkin(pool: &Mutex<Pool>, key: Vec<u8>, tx: Tx) {
+        if tx.is_closed() {
+            return;
+        }
+
+        let mut pool = pool.lock().unwrap();
+        let now = Instant::now();
+        pool.reap(now);
+        let max = pool.max_idle_per_host;
+        if max == 0 {
+            return;
+        }
+        let conns = &mut pool.hosts.entry(key).or_default().conns;
+
+        if let Tx::Http2(_) = tx {
+            // A shared connection that is already pooled doesn't need to be
+            // added twice.
+            if let Some(pooled) = conns
+                .iter_mut()
+                .find(|pooled| matches!(pooled.tx, Tx::Http2(_)) && pooled.tx.is_ready())
+            {
+                pooled.last_used = now;
+                return;
+            }
+        }
+
+        if conns.len() < max {
+            conns.push(Pooled { tx, last_used: now });
+        }
+    }
+
+    /// Drops closed and expired connections for every key, and the keys left
+    /// with none, at most once per `REAP_INTERVAL`.
+    ///
+    /// Otherwise a key that is no longer used would keep its connections
+    /// open, and its entry, until a request is sent for it again.
+    fn reap(&mut self, now: Instant) {
+        if now < self.next_reap {
+            return;
+        }
+        self.next_reap = now + REAP_INTERVAL;
+
+        let idle_timeout = self.idle_timeout;
+        self.hosts.retain(|_, host| {
+            host.retain_usable(idle_timeout, now);
+            !host.conns.is_empty() || host.connecting.is_some()
+        });
+    }
+
+    async fn connect(pool: &Mutex<Pool>, key: &[u8]) -> crate::Result<Tx> {
+        let connect = pool.lock().unwrap().connect.clone();
+        let handshake = match connect {
+            Some((func, userdata)) => func(userdata.0, key.as_ptr(), key.len()),
+            None => ptr::null_mut(),
+        };
+        if handshake.is_null() {
+            return Err(crate::Error::new_user_aborted_by_callback());
+        }
+
+        let handshake = unsafe { Box::from_raw(handshake) };
+        let out: BoxAny = handshake.run().await;
+        match out.as_task_type() {
+            hyper_task_return_type::HYPER_TASK_CLIENTCONN => {
+                let conn = unsafe { Box::from_raw(Box::into_raw(out) as *mut hyper_clientconn) };
+                Ok(conn.tx)
+            }
+            hyper_task_return_type::HYPER_TASK_ERROR => {
+                let err = unsafe { Box::from_raw(Box::into_raw(out) as *mut crate::Error) };
+                Err(*err)
+            }
+            _ => Err(crate::Error::new_user_aborted_by_callback()),
+        }
+    }
+}
+
+// ===== impl Host =====
+
+impl Host {
+    /// Drops the connections that are closed, or unused for longer than
+    /// `idle_timeout`.
+    fn retain_usable(&mut self, idle_timeout: Option<Duration>, now: Instant) {
+        self.conns.retain(|pooled| {
+            let expired = idle_timeout.map_or(false, |timeout| now - pooled.last_used > timeout);
+            !expired && !pooled.tx.is_closed()
+        });
+    }
+}
+
+// ===== impl Connecting =====
+
+impl Connecting<'_> {
+    /// Hands a new connection to the requests waiting on it, if it can be
+    /// shared, and pools it right away so later requests find it too.
+    ///
+    /// Otherwise the waiting requests go on to create their own.
+    fn finish(mut self, tx: &Tx) {
+        let mut pool = self.pool.lock().unwrap();
+        let max = pool.max_idle_per_host;
+        let host = pool.hosts.entry(self.key.to_vec()).or_default();
+        let waiters = host.connecting.take().unwrap_or_default();
+        self.done = true;
+
+        host.http1 = tx.try_clone().is_none();
+        if host.http1 {
+            return;
+        }
+        for waiter in waiters {
+            if let Some(shared) = tx.try_clone() {
+                let _ = waiter.send(shared);
+            }
+        }
+        if let Some(shared) = tx.try_clone() {
+            if host.conns.len() < max {
+                host.conns.push(Pooled {
+                    tx: shared,
+                    last_used: Instant::now(),
+                });
+            }
+        }
+    }
+}
+
+impl Drop for Connecting<'_> {
+    fn drop(&mut self) {
+        if self.done {
+            return;
+        }
+        if let Ok(mut pool) = self.pool.lock() {
+            if let Some(host) = pool.hosts.get_mut(self.key) {
+                host.connecting = None;
+            }
+        }
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use crate::ffi::{
+        hyper_executor_free, hyper_executor_new, hyper_executor_poll, hyper_executor_push,
+        hyper_request_new, hyper_task_free, hyper_task_type,
+    };
+
+    #[test]
+    fn test_pool_connect_failure() {
+        extern "C" fn connect(
+            userdata: *mut c_void,
+            key: *const u8,
+            key_len: size_t,
+        ) -> *mut hyper_task {
+            let seen = unsafe { &mut *(userdata as *mut Vec<u8>) };
+            seen.extend_from_slice(unsafe { std::slice::from_raw_parts(key, key_len) });
+            ptr::null_mut()
+        }
+
+        let mut seen = Vec::<u8>::new();
+        let pool = hyper_client_pool_new();
+        hyper_client_pool_set_connect(pool, connect, &mut seen as *mut _ as *mut c_void);
+
+        let key = b"http://example.com:80";
+        let task = hyper_client_pool_send(pool, key.as_ptr(), key.len(), hyper_request_new());
+        assert!(!task.is_null());
+
+        let exec = hyper_executor_new();
+        hyper_executor_push(exec, task);
+        let task = hyper_executor_poll(exec);
+        assert!(matches!(
+            hyper_task_type(task),
+            hyper_task_return_type::HYPER_TASK_ERROR
+        ));
+        assert_eq!(seen, &key[..]);
+
+        hyper_task_free(task);
+        hyper_executor_free(exec);
+        hyper_client_pool_free(pool);
+    }
+
+    #[cfg(feature = "server")]
+    #[test]
+    fn test_pool_reuses_http1_connection() {
+        let mut server = Server::new(false);
+        let pool = server.pool();
+
+        for _ in 0..3 {
+            let mut statuses = [0u16; 1];
+            server.send(pool, 0);
+            server.run(&mut statuses);
+            assert_eq!(statuses, [200]);
+        }
+        assert_eq!(server.connects, 1);
+
+        server.free(pool);
+    }
+
+    #[cfg(all(feature = "http2", feature = "server"))]
+    #[test]
+    fn test_pool_shares_http2_connection_while_connecting() {
+        let mut server = Server::new(true);
+        let pool = server.pool();
+
+        // None of these find a connection, but they all share the first.
+        let mut statuses = [0u16; 5];
+        for i in 0..statuses.len() {
+            server.send(pool, i);
+        }
+        server.run(&mut statuses);
+        assert_eq!(statuses, [200; 5]);
+        assert_eq!(server.connects, 1);
+
+        let mut statuses = [0u16; 1];
+        server.send(pool, 0);
+        server.run(&mut statuses);
+        assert_eq!(statuses, [200]);
+        assert_eq!(server.connects, 1);
+
+        server.free(pool);
+    }
+
+    #[cfg(feature = "server")]
+    #[test]
+    fn test_pool_reaps_expired_connections_of_other_keys() {
+        let mut server = Server::new(false);
+        let pool = server.pool();
+        hyper_client_pool_set_idle_timeout(pool, 1);
+        let hosts = |pool: *mut hyper_client_pool| {
+            let pool = unsafe { &*pool }.0.lock().unwrap();
+            let mut keys = pool.hosts.keys().cloned().collect::<Vec<_>>();
+            keys.sort();
+            keys
+        };
+
+        let mut statuses = [0u16; 1];
+        server.send_to(pool, b"http://a", 0);
+        server.run(&mut statuses);
+        assert_eq!(hosts(pool), [b"http://a".to_vec()]);
+
+        // Once the first key's connection has expired, the next sweep drops
+        // it, even though nothing is sent for that key again.
+        std::thread::sleep(Duration::from_millis(5));
+        unsafe { &*pool }.0.lock().unwrap().next_reap = Instant::now();
+        let mut statuses = [0u16; 1];
+        server.send_to(pool, b"http://b", 0);
+        server.run(&mut statuses);
+        assert_eq!(hosts(pool), [b"http://b".to_vec()]);
+
+        server.free(pool);
+    }
+
+    /// Connects the pool to hyper servers on the same executor.
+    #[cfg(feature = "server")]
+    struct Server {
+        exec: *const crate::ffi::hyper_executor,
+        http2: bool,
+        connects: usize,
+        fds: Vec<libc::c_int>,
+        // A waker per interest for each end of each connection.
+        wakers: Vec<Box<[*mut crate::ffi::hyper_waker; 2]>>,
+    }
+
+    #[cfg(feature = "server")]
+    impl Server {
+        const KEY: &'static [u8] = b"http://example.com:80";
+
+        fn new(http2: bool) -> Box<Server> {
+            Box::new(Server {
+                exec: hyper_executor_new(),
+                http2,
+                connects: 0,
+                fds: Vec::new(),
+                wakers: Vec::new(),
+            })
+        }
+
+        fn pool(&mut self) -> *mut hyper_client_pool {
+            let pool = hyper_client_pool_new();
+            hyper_client_pool_set_connect(pool, Server::connect, self as *mut _ as *mut c_void);
+            pool
+        }
+
+        fn send(&mut self, pool: *mut hyper_client_pool, i: usize) {
+            self.send_to(pool, Server::KEY, i);
+        }
+
+        fn send_to(&mut self, pool: *mut hyper_client_pool, key: &[u8], i: usize) {
+            use crate::ffi::{hyper_request_set_uri, hyper_task_set_userdata};
+
+            let req = hyper_request_new();
+            hyper_request_set_uri(req, b"http://example.com/".as_ptr(), 19);
+            let task = hyper_client_pool_send(pool, key.as_ptr(), key.len(), req);
+            hyper_task_set_userdata(task, (i + 1) as *mut c_void);
+            hyper_executor_push(self.exec, task);
+        }
+
+        /// Runs the executor until every request has a response.
+        fn run(&mut self, statuses: &mut [u16]) {
+            use crate::ffi::{
+                hyper_response, hyper_response_free, hyper_response_status, hyper_task_userdata,
+                hyper_task_value, hyper_waker_wake_by_ref,
+            };
+
+            for _ in 0..1000 {
+                loop {
+                    let task = hyper_executor_poll(self.exec);
+                    if task.is_null() {
+                        break;
+                    }
+                    let i = hyper_task_userdata(task) as usize;
+                    if i != 0 {
+                        assert!(matches!(
+                            hyper_task_type(task),
+                            hyper_task_return_type::HYPER_TASK_RESPONSE
+                        ));
+                        let resp = hyper_task_value(task) as *mut hyper_response;
+                        statuses[i - 1] = hyper_response_status(resp);
+                        hyper_response_free(resp);
+                    }
+                    hyper_task_free(task);
+                }
+                if statuses.iter().all(|&status| status != 0) {
+                    return;
+                }
+                for slot in self.wakers.iter_mut().flat_map(|wakers| wakers.iter_mut()) {
+                    if !slot.is_null() {
+                        hyper_waker_wake_by_ref(*slot);
+                        *slot = ptr::null_mut();
+                    }
+                }
+            }
+        }
+
+        fn free(self: Box<Server>, pool: *mut hyper_client_pool) {
+            hyper_client_pool_free(pool);
+            hyper_executor_free(self.exec);
+            for &fd in &self.fds {
+                unsafe { libc::close(fd) };
+            }
+        }
+
+        extern "C" fn connect(
+            userdata: *mut c_void,
+            _key: *const u8,
+            _key_len: size_t,
+        ) -> *mut hyper_task {
+            use crate::ffi::{
+                hyper_clientconn_handshake, hyper_clientconn_options_exec,
+                hyper_clientconn_options_http2, hyper_clientconn_options_new, hyper_io_new_fd,
+                hyper_response_channel, hyper_response_channel_send, hyper_response_new,
+                hyper_serve_connection, hyper_serverconn_options_exec,
+                hyper_serverconn_options_http2, hyper_serverconn_options_new, hyper_service_new,
+                hyper_waker, HYPER_IO_READABLE,
+            };
+
+            extern "C" fn wait(
+                userdata: *mut c_void,
+                _fd: libc::c_int,
+                interest: libc::c_int,
+                waker: *mut hyper_waker,
+            ) {
+                let slots = unsafe { &mut *(userdata as *mut [*mut hyper_waker; 2]) };
+                slots[(interest == HYPER_IO_READABLE) as usize] = waker;
+            }
+
+            extern "C" fn no_content(
+                _userdata: *mut c_void,
+                req: *mut hyper_request,
+                channel: *mut hyper_response_channel,
+            ) {
+                crate::ffi::hyper_request_free(req);
+                hyper_response_channel_send(channel, hyper_response_new());
+            }
+
+            let server = unsafe { &mut *(userdata as *mut Server) };
+            server.connects += 1;
+
+            let fds = crate::ffi::client::tests::socketpair();
+            server.fds.extend_from_slice(&fds);
+            let mut wakers = || {
+                server.wakers.push(Box::new([ptr::null_mut(); 2]));
+                &mut **server.wakers.last_mut().unwrap() as *mut _ as *mut c_void
+            };
+
+            let opts = hyper_serverconn_options_new();
+            hyper_serverconn_options_exec(opts, server.exec);
+            hyper_serverconn_options_http2(opts, server.http2 as libc::c_int);
+            let io = hyper_io_new_fd(fds[1], wait, wakers());
+            hyper_executor_push(
+                server.exec,
+                hyper_serve_connection(io, opts, hyper_service_new(no_content)),
+            );
+
+            let opts = hyper_clientconn_options_new();
+            hyper_clientconn_options_exec(opts, server.exec);
+            hyper_clientconn_options_http2(opts, server.http2 as libc::c_int);
+            hyper_clientconn_handshake(hyper_io_new_fd(fds[0], wait, wakers()), opts)
+        }
+    }
+}
@@ -0,0 +1,181 @@
+//! Per-thread caches of freed FFI wrapper boxes.
+//!
+//! Every request and every chunk of a body creates a few small boxes that
+//! only wrap a value for the C side, such as a `hyper_task`, a `hyper_buf`,
+//! or a `hyper_waker`, and frees them again soon after. Instead of going back
+//! to the allocator each time, the memory of freed ones is kept here, up to
+//! `MAX_CACHED` per type, and reused for the next one made on the same
+//! thread.
+//!
+//! The header maps of freed requests and responses are kept the same way,
+//! cleared but with their capacity, for the headers of the next request.
+
+use std::cell::RefCell;
+use std::mem::MaybeUninit;
+use std::ptr;
+
+use http::HeaderMap;
+
+use super::body::hyper_buf;
+use super::http_types::{hyper_request, hyper_response};
+use super::stats::{self, Counter};
+use super::task::{hyper_task, hyper_waker};
+
+/// The most freed boxes of one type kept for reuse, per thread.
+const MAX_CACHED: usize = 64;
+
+/// Header maps that grew to hold more headers than this aren't kept, so an
+/// unusual message doesn't pin a large map.
+const MAX_CACHED_HEADERS_CAPACITY: usize = 128;
+
+thread_local! {
+    static HEADER_MAPS: RefCell<Vec<HeaderMap>> = RefCell::new(Vec::new());
+}
+
+pub(super) trait Recycle: Sized + 'static {
+    /// Runs `f` with this thread's cache of freed boxes of `Self`.
+    ///
+    /// Returns `None` without running `f`, if the cache is in use or the
+    /// thread is exiting.
+    fn with_cache<R>(f: impl FnOnce(&mut Vec<Box<MaybeUninit<Self>>>) -> R) -> Option<R>;
+
+    /// Boxes `value`, reusing the memory of a freed box if there is one.
+    fn recycled(value: Self) -> Box<Self> {
+        let mem = match Self::with_cache(|cache| cache.pop()).flatten() {
+            Some(mem) => {
+                stats::count(Counter::BoxesReused, 1);
+                mem
+            }
+            None => {
+                stats::count(Counter::BoxesAllocated, 1);
+                Box::new(MaybeUninit::uninit())
+            }
+        };
+        let raw = Box::into_raw(mem) as *mut Self;
+        // Safety: a `MaybeUninit<Self>` has the same layout as `Self`.
+        unsafe {
+            raw.write(value);
+            Box::from_raw(raw)
+        }
+    }
+
+    /// Drops the boxed value, and keeps the memory for reuse.
+    fn recycle(this: Box<Self>) {
+        let raw = Box::into_raw(this);
+        // Safety: the value is dropped once, and its memory is then only
+        // used as uninitialized.
+        let mem = unsafe {
+            ptr::drop_in_place(raw);
+            Box::from_raw(raw as *mut MaybeUninit<Self>)
+        };
+        cache_mem(mem);
+    }
+
+    /// Moves the value out of the box, and keeps the memory for reuse.
+    fn unbox(this: Box<Self>) -> Self {
+        let raw = Box::into_raw(this);
+        // Safety: the value is moved out once, and its memory is then only
+        // used as uninitialized.
+        let (value, mem) = unsafe { (raw.read(), Box::from_raw(raw as *mut MaybeUninit<Self>)) };
+        cache_mem(mem);
+        value
+    }
+}
+
+fn cache_mem<T: Recycle>(mem: Box<MaybeUninit<T>>) {
+    let mut mem = Some(mem);
+    T::with_cache(|cache| {
+        if cache.len() < MAX_CACHED {
+            cache.extend(mem.take());
+        }
+    });
+    // Otherwise, `mem` is deallocated here.
+}
+
+macro_rules! recycle {
+    ($($ty:ty),*) => {
+        $(
+            impl Recycle for $ty {
+                fn with_cache<R>(
+                    f: impl FnOnce(&mut Vec<Box<MaybeUninit<Self>>>) -> R,
+                ) -> Option<R> {
+                    thread_local! {
+                        static CACHE: RefCell<Vec<Box<MaybeUninit<$ty>>>> = RefCell::new(Vec::new());
+                    }
+                    CACHE
+                        .try_with(|cache| cache.try_borrow_mut().ok().map(|mut cache| f(&mut cache)))
+                        .ok()
+                        .flatten()
+                }
+            }
+        )*
+    };
+}
+
+recycle!(
+    hyper_buf,
+    hyper_request,
+    hyper_response,
+    hyper_task,
+    hyper_waker
+);
+
+/// Returns an empty header map, reusing one freed on this thread if there
+/// is one.
+pub(super) fn header_map() -> HeaderMap {
+    HEADER_MAPS
+        .try_with(|maps| maps.try_borrow_mut().ok().and_then(|mut maps| maps.pop()))
+        .ok()
+        .flatten()
+        .unwrap_or_default()
+}
+
+/// Clears the header map, and keeps it for reuse.
+pub(super) fn recycle_header_map(mut map: HeaderMap) {
+    if map.capacity() == 0 || map.capacity() > MAX_CACHED_HEADERS_CAPACITY {
+        return;
+    }
+    map.clear();
+    let mut map = Some(map);
+    let _ = HEADER_MAPS.try_with(|maps| {
+        if let Ok(mut maps) = maps.try_borrow_mut() {
+            if maps.len() < MAX_CACHED {
+                maps.extend(map.take());
+            }
+        }
+    });
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use crate::body::Bytes;
+
+    #[test]
+    fn test_recycle_reuses_memory() {
+        let first = hyper_buf::recycled(hyper_buf(Bytes::from_static(b"a")));
+        let addr = &*first as *const hyper_buf;
+        hyper_buf::recycle(first);
+
+        let second = hyper_buf::recycled(hyper_buf(Bytes::from_static(b"b")));
+        assert_eq!(&*second as *const hyper_buf, addr);
+        assert_eq!(hyper_buf::unbox(second).0, "b");
+
+        let third = hyper_buf::recycled(hyper_buf(Bytes::from_static(b"c")));
+        assert_eq!(&*third as *const hyper_buf, addr);
+        hyper_buf::recycle(third);
+    }
+
+    #[test]
+    fn test_recycle_header_map_keeps_capacity() {
+        let mut map = HeaderMap::with_capacity(16);
+        map.insert("x-a", "1".parse().unwrap());
+        let cap = map.capacity();
+        recycle_header_map(map);
+
+        let map = header_map();
+        assert!(map.is_empty());
+        assert_eq!(map.capacity(), cap);
+        assert_eq!(header_map().capacity(), 0);
+    }
+}
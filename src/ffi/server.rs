@@ -0,0 +1,591 @@
+use std::ffi::c_void;
+use std::future::Future;
+use std::pin::Pin;
+use std::ptr;
+use std::sync::Arc;
+use std::task::{Context, Poll};
+
+use libc::c_int;
+use tokio::sync::oneshot;
+
+use crate::body::Incoming as IncomingBody;
+use crate::server::conn;
+use crate::{Request, Response};
+
+use super::error::hyper_code;
+use super::http_types::{hyper_request, hyper_response};
+use super::io::hyper_io;
+use super::recycle::Recycle;
+use super::task::{hyper_executor, hyper_task, WeakExec};
+use super::UserDataPointer;
+
+/// An options builder to configure an HTTP server connection.
+///
+/// Methods:
+///
+/// - hyper_serverconn_options_new:     Creates a new set of HTTP serverconn options to be used with `hyper_serve_connection`.
+/// - hyper_serverconn_options_exec:    Set the executor for background tasks of the connection.
+/// - hyper_serverconn_options_http1_keep_alive:           Set whether HTTP/1 connections are kept alive between requests.
+/// - hyper_serverconn_options_http1_half_close:           Set whether HTTP/1 connections answer requests after the client stopped sending.
+/// - hyper_serverconn_options_http1_pipeline_flush:       Set whether responses to pipelined HTTP/1 requests are written together.
+/// - hyper_serverconn_options_http1_preserve_header_case: Set whether HTTP/1 header case is preserved.
+/// - hyper_serverconn_options_http2:   Set whether to serve HTTP/2.
+/// - hyper_serverconn_options_http2_max_concurrent_streams: Set the most concurrent HTTP/2 streams the client may open.
+/// - hyper_serverconn_options_free:    Free a set of HTTP serverconn options.
+pub struct hyper_serverconn_options {
+    http1_keep_alive: bool,
+    http1_half_close: bool,
+    http1_pipeline_flush: bool,
+    http1_preserve_header_case: bool,
+    http2: bool,
+    http2_max_concurrent_streams: Option<u32>,
+    /// Use a `Weak` to prevent cycles.
+    exec: WeakExec,
+}
+
+/// A service that answers the requests of a server connection.
+///
+/// The service's callback is called with each request the connection
+/// receives, and a `hyper_response_channel` to send its response with.
+///
+/// Methods:
+///
+/// - hyper_service_new:           Create a service from a callback.
+/// - hyper_service_set_userdata:  Set the userdata passed to the service callback.
+/// - hyper_service_free:          Free a service.
+pub struct hyper_service {
+    func: hyper_service_callback,
+    userdata: UserDataPointer,
+}
+
+/// The channel to send the response to one request with.
+///
+/// A channel is passed to the `hyper_service` callback with each request.
+/// HTTP/1 connections answer requests in the order they were received, so
+/// the next request on the connection is only read once this one has been
+/// answered.
+///
+/// Methods:
+///
+/// - hyper_response_channel_send: Send the response to the request.
+/// - hyper_response_channel_free: Free a channel without responding.
+pub struct hyper_response_channel(oneshot::Sender<hyper_response>);
+
+type hyper_service_callback =
+    extern "C" fn(*mut c_void, *mut hyper_request, *mut hyper_response_channel);
+
+/// Resolves to the response sent on a request's `hyper_response_channel`.
+///
+/// cbindgen:ignore
+pub struct ResponseFuture(oneshot::Receiver<hyper_response>);
+
+// ===== impl hyper_serverconn_options =====
+
+ffi_fn! {
+    /// Creates a new set of HTTP serverconn options to be used with
+    /// `hyper_serve_connection`.
+    ///
+    /// To avoid a memory leak, the options must eventually be consumed by
+    /// `hyper_serverconn_options_free` or `hyper_serve_connection`.
+    fn hyper_serverconn_options_new() -> *mut hyper_serverconn_options {
+        Box::into_raw(Box::new(hyper_serverconn_options {
+            http1_keep_alive: true,
+            http1_half_close: false,
+            http1_pipeline_flush: false,
+            http1_preserve_header_case: false,
+            http2: false,
+            http2_max_concurrent_streams: None,
+            exec: WeakExec::new(),
+        }))
+    } ?= std::ptr::null_mut()
+}
+
+ffi_fn! {
+    /// Free a set of HTTP serverconn options.
+    ///
+    /// This should only be used if the options aren't consumed by
+    /// `hyper_serve_connection`.
+    fn hyper_serverconn_options_free(opts: *mut hyper_serverconn_options) {
+        drop(non_null! { Box::from_raw(opts) ?= () });
+    }
+}
+
+ffi_fn! {
+    /// Set the executor for background tasks of the connection.
+    ///
+    /// HTTP/2 connections need one, to run the tasks answering each stream.
+    ///
+    /// This does not consume the `options` or the `exec`.
+    fn hyper_serverconn_options_exec(opts: *mut hyper_serverconn_options, exec: *const hyper_executor) {
+        let opts = non_null! { &mut *opts ?= () };
+
+        let exec = non_null! { Arc::from_raw(exec) ?= () };
+        let weak_exec = hyper_executor::downgrade(&exec);
+        std::mem::forget(exec);
+
+        opts.exec = weak_exec;
+    }
+}
+
+ffi_fn! {
+    /// Set whether HTTP/1 connections are kept alive between requests.
+    ///
+    /// When enabled, the connection keeps reading requests after answering
+    /// one, including requests the client pipelined without waiting for the
+    /// previous response. When disabled, the connection is closed after the
+    /// first response.
+    ///
+    /// Pass `0` to disable, `1` to enable (default).
+    fn hyper_serverconn_options_http1_keep_alive(opts: *mut hyper_serverconn_options, enabled: c_int) -> hyper_code {
+        let opts = non_null! { &mut *opts ?= hyper_code::HYPERE_INVALID_ARG };
+        opts.http1_keep_alive = enabled != 0;
+        hyper_code::HYPERE_OK
+    }
+}
+
+ffi_fn! {
+    /// Set whether HTTP/1 connections answer requests after the client stopped sending.
+    ///
+    /// When a client shuts down its writing side, such as after sending all
+    /// of its pipelined requests, the connection normally treats the requests
+    /// it hasn't answered yet as aborted, and closes. When enabled, it answers
+    /// them first.
+    ///
+    /// Pass `0` to disable (default), `1` to enable.
+    fn hyper_serverconn_options_http1_half_close(opts: *mut hyper_serverconn_options, enabled: c_int) -> hyper_code {
+        let opts = non_null! { &mut *opts ?= hyper_code::HYPERE_INVALID_ARG };
+        opts.http1_half_close = enabled != 0;
+        hyper_code::HYPERE_OK
+    }
+}
+
+ffi_fn! {
+    /// Set whether responses to pipelined HTTP/1 requests are written together.
+    ///
+    /// When enabled, a response isn't flushed to the transport while more
+    /// pipelined requests are already buffered, so their responses can go out
+    /// in a single write. This is an experimental option.
+    ///
+    /// Pass `0` to disable (default), `1` to enable.
+    fn hyper_serverconn_options_http1_pipeline_flush(opts: *mut hyper_serverconn_options, enabled: c_int) -> hyper_code {
+        let opts = non_null! { &mut *opts ?= hyper_code::HYPERE_INVALID_ARG };
+        opts.http1_pipeline_flush = enabled != 0;
+        hyper_code::HYPERE_OK
+    }
+}
+
+ffi_fn! {
+    /// Set whether HTTP/1 header case is preserved.
+    ///
+    /// When enabled, the headers of each request keep the casing they were
+    /// received with, and the headers of responses are written with the
+    /// casing they were added with.
+    ///
+    /// Pass `0` to allow lowercase normalization (default), `1` to retain original case.
+    fn hyper_serverconn_options_http1_preserve_header_case(opts: *mut hyper_serverconn_options, enabled: c_int) -> hyper_code {
+        let opts = non_null! { &mut *opts ?= hyper_code::HYPERE_INVALID_ARG };
+        opts.http1_preserve_header_case = enabled != 0;
+        hyper_code::HYPERE_OK
+    }
+}
+
+ffi_fn! {
+    /// Set whether to serve HTTP/2.
+    ///
+    /// When enabled, the connection expects the client to start with the
+    /// HTTP/2 connection preface, such as after negotiating `h2` with ALPN.
+    /// It doesn't fall back to HTTP/1.
+    ///
+    /// Pass `0` to disable, `1` to enable.
+    fn hyper_serverconn_options_http2(opts: *mut hyper_serverconn_options, enabled: c_int) -> hyper_code {
+        #[cfg(feature = "http2")]
+        {
+            let opts = non_null! { &mut *opts ?= hyper_code::HYPERE_INVALID_ARG };
+            opts.http2 = enabled != 0;
+            hyper_code::HYPERE_OK
+        }
+
+        #[cfg(not(feature = "http2"))]
+        {
+            drop(opts);
+            drop(enabled);
+            hyper_code::HYPERE_FEATURE_NOT_ENABLED
+        }
+    }
+}
+
+ffi_fn! {
+    /// Set the most concurrent HTTP/2 streams the client may open.
+    ///
+    /// This is the `SETTINGS_MAX_CONCURRENT_STREAMS` sent to the client. The
+    /// default is `200`.
+    fn hyper_serverconn_options_http2_max_concurrent_streams(opts: *mut hyper_serverconn_options, max: u32) -> hyper_code {
+        #[cfg(feature = "http2")]
+        {
+            let opts = non_null! { &mut *opts ?= hyper_code::HYPERE_INVALID_ARG };
+            opts.http2_max_concurrent_streams = Some(max);
+            hyper_code::HYPERE_OK
+        }
+
+        #[cfg(not(feature = "http2"))]
+        {
+            drop(opts);
+            drop(max);
+            hyper_code::HYPERE_FEATURE_NOT_ENABLED
+        }
+    }
+}
+
+// ===== impl hyper_service =====
+
+ffi_fn! {
+    /// Create a service from a callback.
+    ///
+    /// The callback is called with the service's userdata, each request the
+    /// connection receives, and a `hyper_response_channel` to answer it with.
+    /// It is called from within `hyper_executor_poll`, so it must not poll
+    /// the executor itself, but it may push tasks to it, such as to read the
+    /// request body.
+    ///
+    /// The callback takes ownership of both the request and the channel. The
+    /// request must eventually be freed with `hyper_request_free`, and the
+    /// channel consumed by `hyper_response_channel_send` or
+    /// `hyper_response_channel_free`. Until then, the connection waits for
+    /// the response, so it can be sent after the callback has returned.
+    ///
+    /// To avoid a memory leak, the service must eventually be consumed by
+    /// `hyper_service_free` or `hyper_serve_connection`.
+    fn hyper_service_new(func: hyper_service_callback) -> *mut hyper_service {
+        Box::into_raw(Box::new(hyper_service {
+            func,
+            userdata: UserDataPointer(ptr::null_mut()),
+        }))
+    } ?= ptr::null_mut()
+}
+
+ffi_fn! {
+    /// Set the userdata passed to the service callback.
+    fn hyper_service_set_userdata(service: *mut hyper_service, userdata: *mut c_void) {
+        let service = non_null! { &mut *service ?= () };
+        service.userdata = UserDataPointer(userdata);
+    }
+}
+
+ffi_fn! {
+    /// Free a service.
+    ///
+    /// This should only be used if the service isn't consumed by
+    /// `hyper_serve_connection`.
+    fn hyper_service_free(service: *mut hyper_service) {
+        drop(non_null! { Box::from_raw(service) ?= () });
+    }
+}
+
+impl crate::service::Service<Request<IncomingBody>> for hyper_service {
+    type Response = Response<IncomingBody>;
+    type Error = oneshot::error::RecvError;
+    type Future = ResponseFuture;
+
+    fn call(&self, req: Request<IncomingBody>) -> Self::Future {
+        let (tx, rx) = oneshot::channel();
+        let req = Box::into_raw(hyper_request::recycled(hyper_request::wrap(req)));
+        let channel = Box::into_raw(Box::new(hyper_response_channel(tx)));
+        (self.func)(self.userdata.0, req, channel);
+        ResponseFuture(rx)
+    }
+}
+
+impl Future for ResponseFuture {
+    type Output = Result<Response<IncomingBody>, oneshot::error::RecvError>;
+
+    fn poll(mut self: Pin<&mut Self>, cx: &mut Context<'_>) -> Poll<Self::Output> {
+        Pin::new(&mut self.0)
+            .poll(cx)
+            .map(|res| res.map(|resp| resp.0))
+    }
+}
+
+// ===== impl hyper_response_channel =====
+
+ffi_fn! {
+    /// Send the response to the request.
+    ///
+    /// This consumes both the channel and the response, even if an error is
+    /// returned. You should not use or free them afterwards.
+    ///
+    /// Returns `HYPERE_ERROR` if the connection closed before the response
+    /// could be sent, and `HYPERE_INVALID_ARG` if either pointer is null.
+    fn hyper_response_channel_send(channel: *mut hyper_response_channel, resp: *mut hyper_response) -> hyper_code {
+        // Take both before checking either, so neither is leaked.
+        let channel = (!channel.is_null()).then(|| unsafe { Box::from_raw(channel) });
+        let resp = (!resp.is_null()).then(|| unsafe { Box::from_raw(resp) });
+        let (channel, resp) = match (channel, resp) {
+            (Some(channel), Some(resp)) => (channel, resp),
+            _ => return hyper_code::HYPERE_INVALID_ARG,
+        };
+        let mut resp = hyper_response::unbox(resp);
+        // Move the headers back out of the extensions
+        resp.finalize_response();
+        match channel.0.send(resp) {
+            Ok(()) => hyper_code::HYPERE_OK,
+            Err(_) => hyper_code::HYPERE_ERROR,
+        }
+    }
+}
+
+ffi_fn! {
+    /// Free a channel without responding.
+    ///
+    /// This fails the request. An HTTP/1 connection is closed, since it can't
+    /// answer the requests after this one, and an HTTP/2 stream is reset.
+    fn hyper_response_channel_free(channel: *mut hyper_response_channel) {
+        drop(non_null! { Box::from_raw(channel) ?= () });
+    }
+}
+
+// ===== impl hyper_serve_connection =====
+
+ffi_fn! {
+    /// Creates a task to serve HTTP on a connection.
+    ///
+    /// The `io`, the `options`, and the `service` are consumed in this function
+    /// call. They should not be used or freed afterwards.
+    ///
+    /// The service callback is called with each request received on the
+    /// connection. The task completes once the connection is closed, with a
+    /// value of type `HYPER_TASK_EMPTY` if it closed cleanly, such as when the
+    /// client closed an HTTP/1 connection between requests, or
+    /// `HYPER_TASK_ERROR` otherwise.
+    ///
+    /// To avoid a memory leak, the task must eventually be consumed by
+    /// `hyper_task_free`, or taken ownership of by `hyper_executor_push`
+    /// without subsequently being given back by `hyper_executor_poll`.
+    fn hyper_serve_connection(io: *mut hyper_io, options: *mut hyper_serverconn_options, service: *mut hyper_service) -> *mut hyper_task {
+        let service = non_null! { Box::from_raw(service) ?= ptr::null_mut() };
+        let options = non_null! { Box::from_raw(options) ?= ptr::null_mut() };
+        let io = non_null! { Box::from_raw(io) ?= ptr::null_mut() };
+
+        Box::into_raw(hyper_task::boxed(async move {
+            #[cfg(feature = "http2")]
+            {
+                if options.http2 {
+                    let mut builder = conn::http2::Builder::new(options.exec.clone());
+                    if let Some(max) = options.http2_max_concurrent_streams {
+                        builder.max_concurrent_streams(max);
+                    }
+                    return builder.serve_connection(io, *service).await;
+                }
+            }
+
+            let mut builder = conn::http1::Builder::new();
+            builder
+                .keep_alive(options.http1_keep_alive)
+                .half_close(options.http1_half_close)
+                .pipeline_flush(options.http1_pipeline_flush)
+                .preserve_header_case(options.http1_preserve_header_case)
+                // There is no timer to enforce it with.
+                .header_read_timeout(None);
+            let mut conn = builder.serve_connection(io, *service);
+            conn.set_ffi_transport(hyper_io::ffi_transport);
+            conn.await
+        }))
+    } ?= ptr::null_mut()
+}
+
+#[cfg(all(test, unix))]
+mod tests {
+    use super::*;
+    use crate::ffi::client::tests::socketpair;
+    use crate::ffi::{
+        hyper_body_new_from_fd, hyper_executor_free, hyper_executor_new, hyper_executor_poll,
+        hyper_executor_push, hyper_headers_set, hyper_io_new_fd, hyper_request_free,
+        hyper_request_method, hyper_request_uri_parts, hyper_response_headers, hyper_response_new,
+        hyper_response_set_body, hyper_response_set_status, hyper_task_free,
+        hyper_task_return_type, hyper_task_type, hyper_waker,
+    };
+
+    extern "C" fn wait(
+        userdata: *mut c_void,
+        _fd: c_int,
+        _interest: c_int,
+        waker: *mut hyper_waker,
+    ) {
+        // The waker is hyper's. It is NULL once hyper is done with the fd.
+        let slot = unsafe { &mut *(userdata as *mut *mut hyper_waker) };
+        *slot = waker;
+    }
+
+    extern "C" fn echo_path(
+        userdata: *mut c_void,
+        req: *mut hyper_request,
+        channel: *mut hyper_response_channel,
+    ) {
+        let seen = unsafe { &mut *(userdata as *mut Vec<String>) };
+        let mut method_len = 0;
+        let method = hyper_request_method(req, &mut method_len);
+        let mut path = ptr::null();
+        let mut path_len = 0;
+        assert!(matches!(
+            hyper_request_uri_parts(
+                req,
+                ptr::null_mut(),
+                ptr::null_mut(),
+                ptr::null_mut(),
+                ptr::null_mut(),
+                &mut path,
+                &mut path_len
+            ),
+            hyper_code::HYPERE_OK
+        ));
+        let (method, path) = unsafe {
+            (
+                std::slice::from_raw_parts(method, method_len),
+                std::slice::from_raw_parts(path, path_len),
+            )
+        };
+        seen.push(format!(
+            "{} {}",
+            String::from_utf8_lossy(method),
+            String::from_utf8_lossy(path)
+        ));
+
+        let resp = hyper_response_new();
+        assert!(matches!(
+            hyper_response_set_status(resp, 204),
+            hyper_code::HYPERE_OK
+        ));
+        assert!(matches!(
+            hyper_headers_set(
+                hyper_response_headers(resp),
+                b"x-path".as_ptr(),
+                6,
+                path.as_ptr(),
+                path.len()
+            ),
+            hyper_code::HYPERE_OK
+        ));
+        hyper_request_free(req);
+        assert!(matches!(
+            hyper_response_channel_send(channel, resp),
+            hyper_code::HYPERE_OK
+        ));
+    }
+
+    #[test]
+    fn test_serve_pipelined_requests() {
+        let fds = socketpair();
+
+        // Both requests are sent at once, before the first is answered.
+        let reqs = b"GET /a HTTP/1.1\r\nhost: x\r\n\r\nPOST /b HTTP/1.1\r\nhost: x\r\ncontent-length: 0\r\n\r\n";
+        let ret = unsafe { libc::write(fds[1], reqs.as_ptr() as *const c_void, reqs.len()) };
+        assert_eq!(ret, reqs.len() as isize);
+        unsafe { libc::shutdown(fds[1], libc::SHUT_WR) };
+
+        let mut waker: *mut hyper_waker = ptr::null_mut();
+        let io = hyper_io_new_fd(fds[0], wait, &mut waker as *mut _ as *mut c_void);
+        let mut seen = Vec::<String>::new();
+        let service = hyper_service_new(echo_path);
+        hyper_service_set_userdata(service, &mut seen as *mut _ as *mut c_void);
+
+        let exec = hyper_executor_new();
+        let opts = hyper_serverconn_options_new();
+        hyper_serverconn_options_exec(opts, exec);
+        hyper_serverconn_options_http1_half_close(opts, 1);
+        hyper_executor_push(exec, hyper_serve_connection(io, opts, service));
+
+        // The client stopped sending after the requests, so the connection
+        // finishes cleanly once both have been answered.
+        let task = hyper_executor_poll(exec);
+        assert!(!task.is_null());
+        assert!(matches!(
+            hyper_task_type(task),
+            hyper_task_return_type::HYPER_TASK_EMPTY
+        ));
+        hyper_task_free(task);
+        assert_eq!(seen, ["GET /a", "POST /b"]);
+
+        let mut written = [0u8; 512];
+        let n = unsafe { libc::read(fds[1], written.as_mut_ptr() as *mut c_void, written.len()) };
+        let written = String::from_utf8_lossy(&written[..n as usize]).into_owned();
+        let a = written.find("x-path: /a").expect("first response");
+        let b = written.find("x-path: /b").expect("second response");
+        assert!(written.starts_with("HTTP/1.1 204 No Content\r\n"));
+        assert!(a < b);
+
+        hyper_executor_free(exec);
+        unsafe {
+            libc::close(fds[0]);
+            libc::close(fds[1]);
+        }
+    }
+
+    extern "C" fn send_file(
+        userdata: *mut c_void,
+        req: *mut hyper_request,
+        channel: *mut hyper_response_channel,
+    ) {
+        let fd = userdata as usize as c_int;
+        let resp = hyper_response_new();
+        assert!(matches!(
+            hyper_response_set_body(resp, hyper_body_new_from_fd(fd, 6, 5)),
+            hyper_code::HYPERE_OK
+        ));
+        hyper_request_free(req);
+        assert!(matches!(
+            hyper_response_channel_send(channel, resp),
+            hyper_code::HYPERE_OK
+        ));
+    }
+
+    #[test]
+    fn test_serve_fd_body_response() {
+        use std::io::Write as _;
+        use std::os::unix::io::AsRawFd;
+
+        let path = std::env::temp_dir().join(format!("hyper-ffi-serve-fd-{}", std::process::id()));
+        let mut file = std::fs::File::create(&path).expect("create");
+        file.write_all(b"hello world").expect("write");
+        let file = std::fs::File::open(&path).expect("open");
+        std::fs::remove_file(&path).expect("remove");
+
+        let fds = socketpair();
+        let req = b"GET / HTTP/1.1\r\nhost: x\r\n\r\n";
+        let ret = unsafe { libc::write(fds[1], req.as_ptr() as *const c_void, req.len()) };
+        assert_eq!(ret, req.len() as isize);
+        unsafe { libc::shutdown(fds[1], libc::SHUT_WR) };
+
+        // On Linux, the file goes out with sendfile(2), and the response
+        // must come out the same as when it's read.
+        let mut waker: *mut hyper_waker = ptr::null_mut();
+        let io = hyper_io_new_fd(fds[0], wait, &mut waker as *mut _ as *mut c_void);
+        let service = hyper_service_new(send_file);
+        hyper_service_set_userdata(service, file.as_raw_fd() as usize as *mut c_void);
+
+        let exec = hyper_executor_new();
+        let opts = hyper_serverconn_options_new();
+        hyper_serverconn_options_exec(opts, exec);
+        hyper_serverconn_options_http1_half_close(opts, 1);
+        hyper_executor_push(exec, hyper_serve_connection(io, opts, service));
+
+        let task = hyper_executor_poll(exec);
+        assert!(!task.is_null());
+        assert!(matches!(
+            hyper_task_type(task),
+            hyper_task_return_type::HYPER_TASK_EMPTY
+        ));
+        hyper_task_free(task);
+
+        let mut written = [0u8; 512];
+        let n = unsafe { libc::read(fds[1], written.as_mut_ptr() as *mut c_void, written.len()) };
+        let written = String::from_utf8_lossy(&written[..n as usize]).into_owned();
+        assert!(written.starts_with("HTTP/1.1 200 OK\r\n"), "{:?}", written);
+        assert!(written.contains("content-length: 5\r\n"), "{:?}", written);
+        assert!(written.ends_with("\r\n\r\nworld"), "{:?}", written);
+
+        hyper_executor_free(exec);
+        unsafe {
+            libc::close(fds[0]);
+            libc::close(fds[1]);
+        }
+    }
+}
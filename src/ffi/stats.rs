@@ -0,0 +1,367 @@
+use std::sync::atomic::{AtomicBool, AtomicU64, Ordering};
+use std::sync::Arc;
+use std::task::Poll;
+use std::time::Instant;
+
+use super::error::hyper_code;
+
+/// Counters of a client connection's activity.
+///
+/// Filled in by `hyper_clientconn_stats`. The counters only ever increase, so
+/// two snapshots can be subtracted to see what happened in between.
+#[repr(C)]
+#[derive(Clone, Copy, Default)]
+pub struct hyper_conn_stats {
+    /// Nanoseconds from `hyper_clientconn_handshake` until the connection was ready.
+    pub handshake_ns: u64,
+    /// Requests sent with `hyper_clientconn_send`.
+    pub requests: u64,
+    /// Reads hyper asked of the transport, including those that were pending.
+    pub read_calls: u64,
+    /// Writes hyper asked of the transport, including those that were pending.
+    pub write_calls: u64,
+    /// Bytes read from the transport.
+    pub bytes_read: u64,
+    /// Bytes written to the transport.
+    pub bytes_written: u64,
+    /// Times the HTTP/1 read buffer had to grow to fit more data.
+    pub read_buf_grows: u64,
+    /// Times the HTTP/1 buffer for message heads had to grow.
+    pub write_buf_grows: u64,
+}
+
+/// Timings of a single request and its response.
+///
+/// Filled in by `hyper_response_timings`. Each is the number of nanoseconds
+/// since the request was given to `hyper_clientconn_send`, or `0` if that
+/// point hasn't been reached yet.
+#[repr(C)]
+#[derive(Clone, Copy, Default)]
+pub struct hyper_request_timings {
+    /// The request head was written to the transport.
+    ///
+    /// For HTTP/2, this is when the request was handed to the connection's
+    /// send buffer.
+    pub head_written_ns: u64,
+    /// The response head was received.
+    pub headers_received_ns: u64,
+    /// The first bytes of the response body were received.
+    pub first_body_ns: u64,
+    /// The whole response body was received.
+    pub body_complete_ns: u64,
+}
+
+/// Counts of the work done by the C API itself, across the whole process.
+///
+/// Filled in by `hyper_stats_snapshot`, when hyper is built with the
+/// `ffi-stats` feature. Like `hyper_conn_stats`, the counters only ever
+/// increase, so dividing the difference of two snapshots by the requests
+/// sent in between gives the cost per request.
+#[repr(C)]
+#[derive(Clone, Copy, Default)]
+pub struct hyper_ffi_stats {
+    /// Boxes for a `hyper_task`, `hyper_buf`, `hyper_waker`, `hyper_request`
+    /// or `hyper_response` that were taken from the allocator.
+    pub boxes_allocated: u64,
+    /// Boxes for those that reused the memory of a freed one instead.
+    pub boxes_reused: u64,
+    /// Calls to `hyper_buf_copy`.
+    pub buf_copies: u64,
+    /// Bytes copied by `hyper_buf_copy`.
+    pub buf_copy_bytes: u64,
+    /// Wakers cloned by `hyper_context_waker` and `hyper_waker_update`.
+    pub waker_clones: u64,
+    /// Tasks pushed onto an executor's spawn queue.
+    pub tasks_spawned: u64,
+    /// Times an executor's driver was locked to poll its tasks.
+    pub driver_locks: u64,
+    /// Times `hyper_executor_poll` skipped a shard of a pool executor, since
+    /// another thread was already polling it.
+    pub driver_lock_contended: u64,
+}
+
+/// The connection-wide counters, shared by the `hyper_clientconn` and the
+/// connection's IO and protocol state.
+#[derive(Debug, Default)]
+pub(crate) struct ConnStats {
+    handshake_ns: AtomicU64,
+    requests: AtomicU64,
+    read_calls: AtomicU64,
+    write_calls: AtomicU64,
+    bytes_read: AtomicU64,
+    bytes_written: AtomicU64,
+    read_buf_grows: AtomicU64,
+    write_buf_grows: AtomicU64,
+    /// The connection won't be kept alive after its current message.
+    closing: AtomicBool,
+}
+
+/// The timings of one request, carried from `hyper_clientconn_send` to the
+/// protocol state in the request's extensions, and kept in the response's.
+#[derive(Clone)]
+pub(crate) struct RequestStats(Arc<RequestTimings>);
+
+struct RequestTimings {
+    sent: Instant,
+    head_written: AtomicU64,
+    headers_received: AtomicU64,
+    first_body: AtomicU64,
+    body_complete: AtomicU64,
+}
+
+// ===== impl ConnStats =====
+
+impl ConnStats {
+    pub(super) fn record_handshake(&self, started: Instant) {
+        self.handshake_ns
+            .store(elapsed_ns(started), Ordering::Relaxed);
+    }
+
+    pub(super) fn record_request(&self) {
+        self.requests.fetch_add(1, Ordering::Relaxed);
+    }
+
+    pub(super) fn record_read(&self, polled: &Poll<std::io::Result<usize>>) {
+        self.read_calls.fetch_add(1, Ordering::Relaxed);
+        if let Poll::Ready(Ok(n)) = *polled {
+            self.bytes_read.fetch_add(n as u64, Ordering::Relaxed);
+        }
+    }
+
+    pub(super) fn record_write(&self, polled: &Poll<std::io::Result<usize>>) {
+        self.write_calls.fetch_add(1, Ordering::Relaxed);
+        if let Poll::Ready(Ok(n)) = *polled {
+            self.bytes_written.fetch_add(n as u64, Ordering::Relaxed);
+        }
+    }
+
+    pub(crate) fn record_read_buf_grow(&self) {
+        self.read_buf_grows.fetch_add(1, Ordering::Relaxed);
+    }
+
+    pub(crate) fn record_write_buf_grow(&self) {
+        self.write_buf_grows.fetch_add(1, Ordering::Relaxed);
+    }
+
+    pub(crate) fn record_closing(&self) {
+        self.closing.store(true, Ordering::Relaxed);
+    }
+
+    pub(super) fn is_closing(&self) -> bool {
+        self.closing.load(Ordering::Relaxed)
+    }
+
+    pub(super) fn snapshot(&self) -> hyper_conn_stats {
+        hyper_conn_stats {
+            handshake_ns: self.handshake_ns.load(Ordering::Relaxed),
+            requests: self.requests.load(Ordering::Relaxed),
+            read_calls: self.read_calls.load(Ordering::Relaxed),
+            write_calls: self.write_calls.load(Ordering::Relaxed),
+            bytes_read: self.bytes_read.load(Ordering::Relaxed),
+            bytes_written: self.bytes_written.load(Ordering::Relaxed),
+            read_buf_grows: self.read_buf_grows.load(Ordering::Relaxed),
+            write_buf_grows: self.write_buf_grows.load(Ordering::Relaxed),
+        }
+    }
+}
+
+// ===== impl RequestStats =====
+
+impl RequestStats {
+    pub(super) fn new() -> RequestStats {
+        RequestStats(Arc::new(RequestTimings {
+            sent: Instant::now(),
+            head_written: AtomicU64::new(0),
+            headers_received: AtomicU64::new(0),
+            first_body: AtomicU64::new(0),
+            body_complete: AtomicU64::new(0),
+        }))
+    }
+
+    /// Records that the request head was written, returning `false` if that
+    /// had already been recorded.
+    pub(crate) fn record_head_written(&self) -> bool {
+        self.record(&self.0.head_written)
+    }
+
+    pub(crate) fn record_headers_received(&self) {
+        self.record(&self.0.headers_received);
+    }
+
+    pub(crate) fn record_body_data(&self) {
+        self.record(&self.0.first_body);
+    }
+
+    pub(crate) fn record_body_complete(&self) {
+        self.record(&self.0.body_complete);
+    }
+
+    fn record(&self, event: &AtomicU64) -> bool {
+        if event.load(Ordering::Relaxed) != 0 {
+            return false;
+        }
+        // 0 means "not yet", so an event is never recorded as exactly 0ns.
+        let ns = elapsed_ns(self.0.sent).max(1);
+        event
+            .compare_exchange(0, ns, Ordering::Relaxed, Ordering::Relaxed)
+            .is_ok()
+    }
+
+    pub(super) fn snapshot(&self) -> hyper_request_timings {
+        hyper_request_timings {
+            head_written_ns: self.0.head_written.load(Ordering::Relaxed),
+            headers_received_ns: self.0.headers_received.load(Ordering::Relaxed),
+            first_body_ns: self.0.first_body.load(Ordering::Relaxed),
+            body_complete_ns: self.0.body_complete.load(Ordering::Relaxed),
+        }
+    }
+}
+
+fn elapsed_ns(since: Instant) -> u64 {
+    since.elapsed().as_nanos() as u64
+}
+
+// ===== FFI counters =====
+
+/// A counter of `hyper_ffi_stats`.
+#[derive(Clone, Copy)]
+pub(super) enum Counter {
+    BoxesAllocated,
+    BoxesReused,
+    BufCopies,
+    BufCopyBytes,
+    WakerClones,
+    TasksSpawned,
+    DriverLocks,
+    DriverLockContended,
+}
+
+#[cfg(feature = "ffi-stats")]
+struct FfiCounters {
+    boxes_allocated: AtomicU64,
+    boxes_reused: AtomicU64,
+    buf_copies: AtomicU64,
+    buf_copy_bytes: AtomicU64,
+    waker_clones: AtomicU64,
+    tasks_spawned: AtomicU64,
+    driver_locks: AtomicU64,
+    driver_lock_contended: AtomicU64,
+}
+
+#[cfg(feature = "ffi-stats")]
+static FFI_COUNTERS: FfiCounters = FfiCounters {
+    boxes_allocated: AtomicU64::new(0),
+    boxes_reused: AtomicU64::new(0),
+    buf_copies: AtomicU64::new(0),
+    buf_copy_bytes: AtomicU64::new(0),
+    waker_clones: AtomicU64::new(0),
+    tasks_spawned: AtomicU64::new(0),
+    driver_locks: AtomicU64::new(0),
+    driver_lock_contended: AtomicU64::new(0),
+};
+
+/// Adds `n` to a counter, if the `ffi-stats` feature is enabled.
+#[inline]
+pub(super) fn count(counter: Counter, n: u64) {
+    #[cfg(feature = "ffi-stats")]
+    {
+        let c = &FFI_COUNTERS;
+        let atomic = match counter {
+            Counter::BoxesAllocated => &c.boxes_allocated,
+            Counter::BoxesReused => &c.boxes_reused,
+            Counter::BufCopies => &c.buf_copies,
+            Counter::BufCopyBytes => &c.buf_copy_bytes,
+            Counter::WakerClones => &c.waker_clones,
+            Counter::TasksSpawned => &c.tasks_spawned,
+            Counter::DriverLocks => &c.driver_locks,
+            Counter::DriverLockContended => &c.driver_lock_contended,
+        };
+        atomic.fetch_add(n, Ordering::Relaxed);
+    }
+
+    #[cfg(not(feature = "ffi-stats"))]
+    {
+        let _ = (counter, n);
+    }
+}
+
+ffi_fn! {
+    /// Copy the counters of the C API's own work so far into `stats`.
+    ///
+    /// These count the allocations of the boxes handed to C, the copies made
+    /// by `hyper_buf_copy`, the wakers cloned for C, and the work of the
+    /// executors, for every connection and executor in the process. Each
+    /// counter is a relaxed atomic, so they are cheap to keep enabled, but a
+    /// snapshot taken while other threads are busy may not be consistent
+    /// between counters.
+    ///
+    /// Returns `HYPERE_FEATURE_NOT_ENABLED` if hyper was built without the
+    /// `ffi-stats` feature, and `HYPERE_INVALID_ARG` if `stats` is null.
+    fn hyper_stats_snapshot(stats: *mut hyper_ffi_stats) -> hyper_code {
+        #[cfg(feature = "ffi-stats")]
+        {
+            let stats = non_null!(&mut *stats ?= hyper_code::HYPERE_INVALID_ARG);
+            let c = &FFI_COUNTERS;
+            *stats = hyper_ffi_stats {
+                boxes_allocated: c.boxes_allocated.load(Ordering::Relaxed),
+                boxes_reused: c.boxes_reused.load(Ordering::Relaxed),
+                buf_copies: c.buf_copies.load(Ordering::Relaxed),
+                buf_copy_bytes: c.buf_copy_bytes.load(Ordering::Relaxed),
+                waker_clones: c.waker_clones.load(Ordering::Relaxed),
+                tasks_spawned: c.tasks_spawned.load(Ordering::Relaxed),
+                driver_locks: c.driver_locks.load(Ordering::Relaxed),
+                driver_lock_contended: c.driver_lock_contended.load(Ordering::Relaxed),
+            };
+            hyper_code::HYPERE_OK
+        }
+
+        #[cfg(not(feature = "ffi-stats"))]
+        {
+            let _ = stats;
+            hyper_code::HYPERE_FEATURE_NOT_ENABLED
+        }
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use crate::ffi::{hyper_buf_copy, hyper_buf_free};
+
+    #[cfg(feature = "ffi-stats")]
+    #[test]
+    fn test_stats_snapshot_counts_buf_copies() {
+        let mut before = hyper_ffi_stats::default();
+        assert!(matches!(
+            hyper_stats_snapshot(&mut before),
+            hyper_code::HYPERE_OK
+        ));
+
+        let data = b"hello";
+        let buf = hyper_buf_copy(data.as_ptr(), data.len());
+        hyper_buf_free(buf);
+
+        // Other tests may be counting at the same time.
+        let mut after = hyper_ffi_stats::default();
+        assert!(matches!(
+            hyper_stats_snapshot(&mut after),
+            hyper_code::HYPERE_OK
+        ));
+        assert!(after.buf_copies >= before.buf_copies + 1);
+        assert!(after.buf_copy_bytes >= before.buf_copy_bytes + 5);
+        assert!(
+            after.boxes_allocated + after.boxes_reused
+                > before.boxes_allocated + before.boxes_reused
+        );
+    }
+
+    #[cfg(not(feature = "ffi-stats"))]
+    #[test]
+    fn test_stats_snapshot_without_feature() {
+        let mut stats = hyper_ffi_stats::default();
+        assert!(matches!(
+            hyper_stats_snapshot(&mut stats),
+            hyper_code::HYPERE_FEATURE_NOT_ENABLED
+        ));
+    }
+}
@@ -3,19 +3,22 @@ use std::future::Future;
 use std::pin::Pin;
 use std::ptr;
 use std::sync::{
-    atomic::{AtomicBool, Ordering},
+    atomic::{AtomicBool, AtomicUsize, Ordering},
     Arc, Mutex, Weak,
 };
 use std::task::{Context, Poll};
 
+use futures_channel::mpsc;
 use futures_util::stream::{FuturesUnordered, Stream};
-use libc::c_int;
+use libc::{c_int, size_t};
 
 use super::error::hyper_code;
+use super::recycle::Recycle;
+use super::stats::{self, Counter};
 use super::UserDataPointer;
 
 type BoxFuture<T> = Pin<Box<dyn Future<Output = T> + Send>>;
-type BoxAny = Box<dyn AsTaskType + Send + Sync>;
+pub(crate) type BoxAny = Box<dyn AsTaskType + Send + Sync>;
 
 /// Return in a poll function to indicate it was ready.
 pub const HYPER_POLL_READY: c_int = 0;
@@ -36,6 +39,10 @@ pub const HYPER_POLL_ERROR: c_int = 3;
 /// An executor is single threaded. Typically you might have one executor per
 /// thread. Or, for simplicity, you may choose one executor per connection.
 ///
+/// To spread tasks over several threads instead, create the executor with
+/// `hyper_executor_new_pool`, and call `hyper_executor_poll` on it from each
+/// of those threads.
+///
 /// Progress on tasks happens only when `hyper_executor_poll` is called, and only
 /// on tasks whose corresponding `hyper_waker` has been called to indicate they
 /// are ready to make progress (for instance, because the OS has indicated there
@@ -47,34 +54,73 @@ pub const HYPER_POLL_ERROR: c_int = 3;
 /// Methods:
 ///
 /// - hyper_executor_new:  Creates a new task executor.
+/// - hyper_executor_new_pool: Creates a new task executor that can be polled from several threads at once.
 /// - hyper_executor_push: Push a task onto the executor.
 /// - hyper_executor_poll: Polls the executor, trying to make progress on any tasks that have notified that they are ready again.
+/// - hyper_executor_poll_batch: Polls the executor, returning as many ready tasks as fit in the provided array.
+/// - hyper_executor_set_wake_callback: Set a callback to be notified when the executor has work to do.
 /// - hyper_executor_free: Frees an executor and any incomplete tasks still part of it.
 pub struct hyper_executor {
-    /// The executor of all task futures.
+    /// The sets of tasks driven by this executor.
     ///
-    /// There should never be contention on the mutex, as it is only locked
-    /// to drive the futures. However, we cannot guarantee proper usage from
-    /// `hyper_executor_poll()`, which in C could potentially be called inside
-    /// one of the stored futures. The mutex isn't re-entrant, so doing so
-    /// would result in a deadlock, but that's better than data corruption.
-    driver: Mutex<FuturesUnordered<TaskFuture>>,
+    /// There is exactly one, unless the executor was created with
+    /// `hyper_executor_new_pool`. New tasks are spread over the shards
+    /// round-robin, and any thread polling the executor drives whichever
+    /// shards no other thread is currently driving.
+    shards: Box<[Shard]>,
+
+    /// The shard the next spawned task is pushed to.
+    next_spawn: AtomicUsize,
+
+    /// The shard the next poll starts with, so pollers don't all contend
+    /// on the first one.
+    next_poll: AtomicUsize,
+
+    /// Called when the executor goes from idle to having work to do.
+    on_wake: Arc<WakeCallback>,
+}
 
-    /// The queue of futures that need to be pushed into the `driver`.
+struct Shard {
+    /// The executor of this shard's task futures.
+    ///
+    /// There should never be contention on the mutex of a single-shard
+    /// executor, as it is only locked to drive the futures. However, we
+    /// cannot guarantee proper usage from `hyper_executor_poll()`, which in
+    /// C could potentially be called inside one of the stored futures. The
+    /// mutex isn't re-entrant, so doing so would result in a deadlock, but
+    /// that's better than data corruption.
+    driver: Mutex<Driver>,
+
+    /// The sending half of the queue of futures that need to be pushed into
+    /// the `driver`.
     ///
-    /// This is has a separate mutex since `spawn` could be called from inside
+    /// This is a lock-free queue, since `spawn` could be called from inside
     /// a future, which would mean the driver's mutex is already locked.
-    spawn_queue: Mutex<Vec<TaskFuture>>,
+    spawn_tx: mpsc::UnboundedSender<TaskFuture>,
 
     /// This is used to track when a future calls `wake` while we are within
-    /// `hyper_executor::poll_next`.
+    /// `Shard::poll_locked`.
     is_woken: Arc<ExecWaker>,
 }
 
+struct Driver {
+    tasks: FuturesUnordered<TaskFuture>,
+    /// The receiving half of the spawn queue, only drained with the driver
+    /// locked.
+    spawn_rx: mpsc::UnboundedReceiver<TaskFuture>,
+}
+
 #[derive(Clone)]
 pub(crate) struct WeakExec(Weak<hyper_executor>);
 
-struct ExecWaker(AtomicBool);
+struct ExecWaker {
+    is_woken: AtomicBool,
+    on_wake: Arc<WakeCallback>,
+}
+
+struct WakeCallback(Mutex<Option<(hyper_executor_wake_callback, UserDataPointer)>>);
+
+type hyper_executor_wake_callback = extern "C" fn(*mut c_void);
 
 /// An async task.
 ///
@@ -88,6 +134,7 @@ struct ExecWaker(AtomicBool);
 ///
 /// - hyper_clientconn_handshake: Creates an HTTP client handshake task.
 /// - hyper_clientconn_send:      Creates a task to send a request on the client connection.
+/// - hyper_serve_connection:     Creates a task to serve HTTP on a connection.
 /// - hyper_body_data:            Creates a task that will poll a response body for the next buffer of data.
 /// - hyper_body_foreach:         Creates a task to execute the callback with each body chunk received.
 ///
@@ -142,7 +189,10 @@ pub struct hyper_context<'a>(Context<'a>);
 ///
 /// The read or write callback, upon finding it can't make progress, must get a
 /// waker from the context (`hyper_context_waker`), arrange for that waker to be
-/// called in the future, and then return `HYPER_POLL_PENDING`.
+/// called in the future, and then return `HYPER_POLL_PENDING`. A waker saved
+/// from an earlier call can instead be refreshed with `hyper_waker_update`,
+/// and woken with `hyper_waker_wake_by_ref`, so it is kept for the whole
+/// connection.
 ///
 /// The arrangements for the waker to be called in the future are up to the
 /// application, but usually it will involve one big `select(2)` loop that checks which
@@ -153,7 +203,7 @@ pub struct hyper_context<'a>(Context<'a>);
 ///
 /// Corresponding Rust type: <https://doc.rust-lang.org/std/task/struct.Waker.html>
 pub struct hyper_waker {
-    waker: std::task::Waker,
+    pub(super) waker: std::task::Waker,
 }
 
 /// A descriptor for what type a `hyper_task` value is.
@@ -169,10 +219,20 @@ pub enum hyper_task_return_type {
     HYPER_TASK_RESPONSE,
     /// The value of this task is `hyper_buf *`.
     HYPER_TASK_BUF,
+    /// The value of this task is `hyper_io *`.
+    HYPER_TASK_IO,
 }
 
 pub(crate) unsafe trait AsTaskType {
     fn as_task_type(&self) -> hyper_task_return_type;
+
+    /// Boxes the value, to be the output of a task.
+    fn boxed(self) -> Box<Self>
+    where
+        Self: Sized,
+    {
+        Box::new(self)
+    }
 }
 
 pub(crate) trait IntoDynTaskType {
@@ -182,11 +242,30 @@ pub(crate) trait IntoDynTaskType {
 // ===== impl hyper_executor =====
 
 impl hyper_executor {
-    fn new() -> Arc<hyper_executor> {
+    fn new(shards: usize) -> Arc<hyper_executor> {
+        let on_wake = Arc::new(WakeCallback(Mutex::new(None)));
+        let shards = (0..shards)
+            .map(|_| {
+                let (spawn_tx, spawn_rx) = mpsc::unbounded();
+                Shard {
+                    driver: Mutex::new(Driver {
+                        tasks: FuturesUnordered::new(),
+                        spawn_rx,
+                    }),
+                    spawn_tx,
+                    is_woken: Arc::new(ExecWaker {
+                        is_woken: AtomicBool::new(false),
+                        on_wake: on_wake.clone(),
+                    }),
+                }
+            })
+            .collect();
+
         Arc::new(hyper_executor {
-            driver: Mutex::new(FuturesUnordered::new()),
-            spawn_queue: Mutex::new(Vec::new()),
-            is_woken: Arc::new(ExecWaker(AtomicBool::new(false))),
+            shards,
+            next_spawn: AtomicUsize::new(0),
+            next_poll: AtomicUsize::new(0),
+            on_wake,
         })
     }
 
@@ -195,68 +274,144 @@ impl hyper_executor {
     }
 
     fn spawn(&self, task: Box<hyper_task>) {
-        self.spawn_queue
-            .lock()
-            .unwrap()
-            .push(TaskFuture { task: Some(task) });
+        let shard = if self.shards.len() == 1 {
+            &self.shards[0]
+        } else {
+            let idx = self.next_spawn.fetch_add(1, Ordering::Relaxed);
+            &self.shards[idx % self.shards.len()]
+        };
+        stats::count(Counter::TasksSpawned, 1);
+        // The receiver lives as long as the executor, so this can't fail.
+        let _ = shard
+            .spawn_tx
+            .unbounded_send(TaskFuture { task: Some(task) });
+        futures_util::task::ArcWake::wake_by_ref(&shard.is_woken);
     }
 
     fn poll_next(&self) -> Option<Box<hyper_task>> {
-        // Drain the queue first.
-        self.drain_queue();
+        let mut ready = None;
+        self.poll_batch(1, |task| ready = Some(task));
+        ready
+    }
+
+    /// Polls the tasks until `max` of them have completed, or none of them
+    /// can make progress, passing each completed task to `on_ready`.
+    ///
+    /// Each shard's driver is only locked once for the whole batch.
+    fn poll_batch(&self, max: usize, mut on_ready: impl FnMut(Box<hyper_task>)) -> usize {
+        if let [ref shard] = *self.shards {
+            let mut driver = shard.driver.lock().unwrap();
+            stats::count(Counter::DriverLocks, 1);
+            return shard.poll_locked(&mut driver, max, &mut on_ready);
+        }
 
+        // Start at a different shard each time, and skip any that another
+        // thread is already driving.
+        let start = self.next_poll.fetch_add(1, Ordering::Relaxed);
+        let mut completed = 0;
+        for i in 0..self.shards.len() {
+            if completed == max {
+                break;
+            }
+            let shard = &self.shards[(start + i) % self.shards.len()];
+            completed += shard.try_poll(max - completed, &mut on_ready);
+        }
+        completed
+    }
+}
+
+impl Shard {
+    /// Polls this shard, unless another thread is already doing so.
+    fn try_poll(&self, max: usize, on_ready: &mut dyn FnMut(Box<hyper_task>)) -> usize {
+        let mut completed = 0;
+        loop {
+            let mut driver = match self.driver.try_lock() {
+                Ok(driver) => driver,
+                Err(std::sync::TryLockError::WouldBlock) => {
+                    stats::count(Counter::DriverLockContended, 1);
+                    return completed;
+                }
+                Err(std::sync::TryLockError::Poisoned(err)) => panic!("{}", err),
+            };
+            stats::count(Counter::DriverLocks, 1);
+            completed += self.poll_locked(&mut driver, max - completed, on_ready);
+            drop(driver);
+
+            // A task may have been woken after we last checked, while another
+            // thread gave up on this shard because we still held the lock.
+            // In that case, it's up to us to poll again.
+            if completed == max || !self.is_woken.is_woken.load(Ordering::SeqCst) {
+                return completed;
+            }
+        }
+    }
+
+    fn poll_locked(
+        &self,
+        driver: &mut Driver,
+        max: usize,
+        on_ready: &mut dyn FnMut(Box<hyper_task>),
+    ) -> usize {
         let waker = futures_util::task::waker_ref(&self.is_woken);
         let mut cx = Context::from_waker(&waker);
 
-        loop {
-            {
-                // Scope the lock on the driver to ensure it is dropped before
-                // calling drain_queue below.
-                let mut driver = self.driver.lock().unwrap();
-                match Pin::new(&mut *driver).poll_next(&mut cx) {
-                    Poll::Ready(val) => return val,
-                    Poll::Pending => {}
-                };
+        let mut completed = 0;
+
+        while completed < max {
+            // Drain the queue first.
+            driver.drain_queue();
+
+            match Pin::new(&mut driver.tasks).poll_next(&mut cx) {
+                Poll::Ready(Some(task)) => {
+                    on_ready(task);
+                    completed += 1;
+                    continue;
+                }
+                // No tasks left, but still clear the wake flag below so
+                // that the next push notifies again.
+                Poll::Ready(None) | Poll::Pending => {}
             }
 
-            // poll_next returned Pending.
             // Check if any of the pending tasks tried to spawn
             // some new tasks. If so, drain into the driver and loop.
-            if self.drain_queue() {
+            if driver.drain_queue() {
                 continue;
             }
 
             // If the driver called `wake` while we were polling,
             // we should poll again immediately!
-            if self.is_woken.0.swap(false, Ordering::SeqCst) {
+            if self.is_woken.is_woken.swap(false, Ordering::SeqCst) {
                 continue;
             }
 
-            return None;
-        }
-    }
-
-    /// drain_queue locks both self.spawn_queue and self.driver, so it requires
-    /// that neither of them be locked already.
-    fn drain_queue(&self) -> bool {
-        let mut queue = self.spawn_queue.lock().unwrap();
-        if queue.is_empty() {
-            return false;
+            break;
         }
 
-        let driver = self.driver.lock().unwrap();
+        completed
+    }
+}
 
-        for task in queue.drain(..) {
-            driver.push(task);
+impl Driver {
+    /// Moves any newly spawned tasks into the set being driven.
+    fn drain_queue(&mut self) -> bool {
+        let mut drained = false;
+        while let Ok(Some(task)) = self.spawn_rx.try_next() {
+            self.tasks.push(task);
+            drained = true;
         }
-
-        true
+        drained
     }
 }
 
 impl futures_util::task::ArcWake for ExecWaker {
     fn wake_by_ref(me: &Arc<ExecWaker>) {
-        me.0.store(true, Ordering::SeqCst);
+        // Only notify on the transition from idle, the flag is cleared
+        // again once polling finds nothing else to do.
+        if !me.is_woken.swap(true, Ordering::SeqCst) {
+            if let Some((func, ref userdata)) = *me.on_wake.0.lock().unwrap() {
+                func(userdata.0);
+            }
+        }
     }
 }
 
@@ -286,7 +441,35 @@ ffi_fn! {
     /// To avoid a memory leak, the executor must eventually be consumed by
     /// `hyper_executor_free`.
     fn hyper_executor_new() -> *const hyper_executor {
-        Arc::into_raw(hyper_executor::new())
+        Arc::into_raw(hyper_executor::new(1))
+    } ?= ptr::null()
+}
+
+ffi_fn! {
+    /// Creates a new task executor that can be polled from several threads at once.
+    ///
+    /// The executor keeps `threads` separate sets of tasks, and spreads the
+    /// tasks pushed onto it over them. Each thread that calls
+    /// `hyper_executor_poll` drives whichever sets no other thread is driving
+    /// at that moment, so a task pushed from any thread can end up running
+    /// on any of them, and a thread with nothing to do picks up work that
+    /// would otherwise wait on a busy one. Typically `threads` is the number
+    /// of threads that will be polling the executor.
+    ///
+    /// Since tasks can run on any polling thread, all callbacks of the
+    /// `hyper_io`s and `hyper_body`s used with this executor must be safe to
+    /// call from any of those threads (though never from two at once for the
+    /// same task).
+    ///
+    /// Returns `NULL` if `threads` is `0`.
+    ///
+    /// To avoid a memory leak, the executor must eventually be consumed by
+    /// `hyper_executor_free`.
+    fn hyper_executor_new_pool(threads: size_t) -> *const hyper_executor {
+        if threads == 0 {
+            return ptr::null();
+        }
+        Arc::into_raw(hyper_executor::new(threads))
     } ?= ptr::null()
 }
 
@@ -338,6 +521,61 @@ ffi_fn! {
     } ?= ptr::null_mut()
 }
 
+ffi_fn! {
+    /// Polls the executor, returning as many ready tasks as fit in the provided array.
+    ///
+    /// This behaves like calling `hyper_executor_poll` until it returns `NULL`
+    /// or `tasks_len` tasks have been returned, but only does the work of
+    /// entering the executor once.
+    ///
+    /// Up to `tasks_len` ready tasks are written to the start of the `tasks`
+    /// array, and the number written is returned. If this is less than
+    /// `tasks_len`, there are no more ready tasks for now.
+    ///
+    /// To avoid a memory leak, each returned task must eventually be consumed
+    /// by `hyper_task_free`.
+    fn hyper_executor_poll_batch(exec: *const hyper_executor, tasks: *mut *mut hyper_task, tasks_len: size_t) -> size_t {
+        let exec = non_null!(&*exec ?= 0);
+        if tasks.is_null() || tasks_len == 0 {
+            return 0;
+        }
+        let tasks = unsafe { std::slice::from_raw_parts_mut(tasks, tasks_len) };
+        let mut slots = tasks.iter_mut();
+        exec.poll_batch(tasks_len, |task| {
+            if let Some(slot) = slots.next() {
+                *slot = Box::into_raw(task);
+            }
+        })
+    } ?= 0
+}
+
+ffi_fn! {
+    /// Set a callback to be notified when the executor has work to do.
+    ///
+    /// The callback is passed the `userdata` pointer. It is called when a
+    /// task is pushed, or when a `hyper_waker` for one of the executor's
+    /// tasks is woken, while the executor is idle. This allows an event loop
+    /// to sleep (for instance in `epoll_wait(2)`) until `hyper_executor_poll`
+    /// actually needs to be called, such as by writing to an `eventfd` or a
+    /// pipe in the callback.
+    ///
+    /// The executor only counts as idle again once `hyper_executor_poll` has
+    /// returned `NULL` (or `hyper_executor_poll_batch` has returned fewer
+    /// tasks than requested). Until then, further wakeups do not call the
+    /// callback again.
+    ///
+    /// The callback may be called from any thread that wakes a `hyper_waker`,
+    /// and from within `hyper_executor_push`. It must not call back into the
+    /// executor.
+    ///
+    /// Pass `NULL` as the callback to remove a previously set one.
+    fn hyper_executor_set_wake_callback(exec: *const hyper_executor, func: Option<hyper_executor_wake_callback>, userdata: *mut c_void) -> hyper_code {
+        let exec = non_null!(&*exec ?= hyper_code::HYPERE_INVALID_ARG);
+        *exec.on_wake.0.lock().unwrap() = func.map(|func| (func, UserDataPointer(userdata)));
+        hyper_code::HYPERE_OK
+    }
+}
+
 // ===== impl hyper_task =====
 
 impl hyper_task {
@@ -346,13 +584,20 @@ impl hyper_task {
         F: Future + Send + 'static,
         F::Output: IntoDynTaskType + Send + Sync + 'static,
     {
-        Box::new(hyper_task {
+        hyper_task::recycled(hyper_task {
             future: Box::pin(async move { fut.await.into_dyn_task_type() }),
             output: None,
             userdata: UserDataPointer(ptr::null_mut()),
         })
     }
 
+    /// Runs a task that was never pushed onto an executor as part of
+    /// another task, yielding its output.
+    pub(crate) async fn run(self: Box<Self>) -> BoxAny {
+        let task = hyper_task::unbox(self);
+        task.future.await
+    }
+
     fn output_type(&self) -> hyper_task_return_type {
         match self.output {
             None => hyper_task_return_type::HYPER_TASK_EMPTY,
@@ -383,7 +628,7 @@ ffi_fn! {
     /// `hyper_clientconn_handshake` or taken ownership of by
     /// `hyper_executor_push`.
     fn hyper_task_free(task: *mut hyper_task) {
-        drop(non_null!(Box::from_raw(task) ?= ()));
+        hyper_task::recycle(non_null!(Box::from_raw(task) ?= ()));
     }
 }
 
@@ -468,7 +713,7 @@ where
     T: AsTaskType + Send + Sync + 'static,
 {
     fn into_dyn_task_type(self) -> BoxAny {
-        Box::new(self)
+        self.boxed()
     }
 }
 
@@ -518,7 +763,8 @@ ffi_fn! {
     /// `hyper_waker_free` or `hyper_waker_wake`.
     fn hyper_context_waker(cx: *mut hyper_context<'_>) -> *mut hyper_waker {
         let waker = non_null!(&mut *cx ?= ptr::null_mut()).0.waker().clone();
-        Box::into_raw(Box::new(hyper_waker { waker }))
+        stats::count(Counter::WakerClones, 1);
+        Box::into_raw(hyper_waker::recycled(hyper_waker { waker }))
     } ?= ptr::null_mut()
 }
 
@@ -530,7 +776,7 @@ ffi_fn! {
     /// This should only be used if the request isn't consumed by
     /// `hyper_waker_wake`.
     fn hyper_waker_free(waker: *mut hyper_waker) {
-        drop(non_null!(Box::from_raw(waker) ?= ()));
+        hyper_waker::recycle(non_null!(Box::from_raw(waker) ?= ()));
     }
 }
 
@@ -544,7 +790,163 @@ ffi_fn! {
     ///
     /// NOTE: This consumes the waker. You should not use or free the waker afterwards.
     fn hyper_waker_wake(waker: *mut hyper_waker) {
-        let waker = non_null!(Box::from_raw(waker) ?= ());
+        let waker = hyper_waker::unbox(non_null!(Box::from_raw(waker) ?= ()));
         waker.waker.wake();
     }
 }
+
+ffi_fn! {
+    /// Wake up the task associated with a waker, without consuming the waker.
+    ///
+    /// This behaves like `hyper_waker_wake`, except that the waker can be
+    /// used again afterwards, and must still eventually be consumed by
+    /// `hyper_waker_free` or `hyper_waker_wake`.
+    fn hyper_waker_wake_by_ref(waker: *const hyper_waker) {
+        non_null!(&*waker ?= ()).waker.wake_by_ref();
+    }
+}
+
+ffi_fn! {
+    /// Update a waker to wake up the task associated with a context.
+    ///
+    /// This lets a read or write callback keep a single waker for the whole
+    /// connection, instead of freeing the saved one and getting a new one with
+    /// `hyper_context_waker` each time it can't make progress. If the waker
+    /// would already wake the same task, it is left as it is, without
+    /// allocating or cloning anything.
+    fn hyper_waker_update(waker: *mut hyper_waker, cx: *mut hyper_context<'_>) {
+        let waker = non_null!(&mut *waker ?= ());
+        let cx_waker = non_null!(&mut *cx ?= ()).0.waker();
+        if !waker.waker.will_wake(cx_waker) {
+            waker.waker = cx_waker.clone();
+            stats::count(Counter::WakerClones, 1);
+        }
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn test_executor_poll_batch() {
+        let exec = hyper_executor_new();
+        for _ in 0..3 {
+            let task = hyper_task::boxed(async { Ok::<_, crate::Error>(()) });
+            hyper_executor_push(exec, Box::into_raw(task));
+        }
+
+        let mut tasks = [ptr::null_mut(); 2];
+        assert_eq!(hyper_executor_poll_batch(exec, tasks.as_mut_ptr(), 2), 2);
+        for task in tasks {
+            assert!(matches!(
+                hyper_task_type(task),
+                hyper_task_return_type::HYPER_TASK_EMPTY
+            ));
+            hyper_task_free(task);
+        }
+
+        assert_eq!(hyper_executor_poll_batch(exec, tasks.as_mut_ptr(), 2), 1);
+        hyper_task_free(tasks[0]);
+
+        assert_eq!(hyper_executor_poll_batch(exec, tasks.as_mut_ptr(), 2), 0);
+        hyper_executor_free(exec);
+    }
+
+    #[test]
+    fn test_executor_wake_callback() {
+        extern "C" fn on_wake(userdata: *mut c_void) {
+            let count = unsafe { &*(userdata as *const AtomicUsize) };
+            count.fetch_add(1, Ordering::SeqCst);
+        }
+
+        let count = AtomicUsize::new(0);
+        let exec = hyper_executor_new();
+        hyper_executor_set_wake_callback(exec, Some(on_wake), &count as *const _ as *mut c_void);
+
+        let ready = || Box::into_raw(hyper_task::boxed(async { Ok::<_, crate::Error>(()) }));
+        hyper_executor_push(exec, ready());
+        hyper_executor_push(exec, ready());
+        assert_eq!(count.load(Ordering::SeqCst), 1);
+
+        loop {
+            let task = hyper_executor_poll(exec);
+            if task.is_null() {
+                break;
+            }
+            hyper_task_free(task);
+        }
+
+        hyper_executor_push(exec, ready());
+        assert_eq!(count.load(Ordering::SeqCst), 2);
+        hyper_executor_free(exec);
+    }
+
+    #[test]
+    fn test_executor_pool_polled_from_threads() {
+        let exec = hyper_executor_new_pool(4);
+        assert!(hyper_executor_new_pool(0).is_null());
+
+        let completed = AtomicUsize::new(0);
+        let exec_addr = exec as usize;
+        std::thread::scope(|s| {
+            for _ in 0..4 {
+                s.spawn(|| {
+                    let exec = exec_addr as *const hyper_executor;
+                    for _ in 0..4 {
+                        let task = hyper_task::boxed(async { Ok::<_, crate::Error>(()) });
+                        hyper_executor_push(exec, Box::into_raw(task));
+                    }
+                    while completed.load(Ordering::SeqCst) < 16 {
+                        let task = hyper_executor_poll(exec);
+                        if !task.is_null() {
+                            completed.fetch_add(1, Ordering::SeqCst);
+                            hyper_task_free(task);
+                        }
+                    }
+                });
+            }
+        });
+
+        assert_eq!(completed.load(Ordering::SeqCst), 16);
+        assert!(hyper_executor_poll(exec).is_null());
+        hyper_executor_free(exec);
+    }
+
+    #[test]
+    fn test_waker_update_and_wake_by_ref() {
+        let slot = Arc::new(AtomicUsize::new(0));
+        let polls = Arc::new(AtomicUsize::new(0));
+
+        let (task_slot, task_polls) = (slot.clone(), polls.clone());
+        let task = hyper_task::boxed(futures_util::future::poll_fn(move |cx| {
+            if task_polls.fetch_add(1, Ordering::SeqCst) == 2 {
+                return Poll::Ready(Ok::<_, crate::Error>(()));
+            }
+            let cx = hyper_context::wrap(cx);
+            match task_slot.load(Ordering::SeqCst) {
+                0 => task_slot.store(hyper_context_waker(cx) as usize, Ordering::SeqCst),
+                waker => hyper_waker_update(waker as *mut hyper_waker, cx),
+            }
+            Poll::Pending
+        }));
+
+        let exec = hyper_executor_new();
+        hyper_executor_push(exec, Box::into_raw(task));
+        assert!(hyper_executor_poll(exec).is_null());
+        let waker = slot.load(Ordering::SeqCst) as *mut hyper_waker;
+
+        // The same waker is woken, and refreshed, each time.
+        hyper_waker_wake_by_ref(waker);
+        assert!(hyper_executor_poll(exec).is_null());
+        assert_eq!(slot.load(Ordering::SeqCst), waker as usize);
+        hyper_waker_wake_by_ref(waker);
+        let task = hyper_executor_poll(exec);
+        assert!(!task.is_null());
+        assert_eq!(polls.load(Ordering::SeqCst), 3);
+
+        hyper_task_free(task);
+        hyper_waker_free(waker);
+        hyper_executor_free(exec);
+    }
+}
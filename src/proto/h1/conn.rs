@@ -1,6 +1,9 @@
+#[cfg(feature = "ffi")]
+use std::collections::VecDeque;
 use std::fmt;
 use std::io;
 use std::marker::{PhantomData, Unpin};
+use std::mem::MaybeUninit;
 use std::pin::Pin;
 use std::task::{Context, Poll};
 #[cfg(feature = "server")]
@@ -15,6 +18,7 @@ use http_body::Frame;
 use httparse::ParserConfig;
 
 use super::io::Buffered;
+use super::role::HeaderIndices;
 use super::{Decoder, Encode, EncodedBuf, Encoder, Http1Transaction, ParseContext, Wants};
 use crate::body::DecodedLength;
 #[cfg(feature = "server")]
@@ -51,6 +55,7 @@ where
             state: State {
                 allow_half_close: false,
                 cached_headers: None,
+                header_indices: Vec::new(),
                 error: None,
                 keep_alive: KA::Busy,
                 method: None,
@@ -73,6 +78,20 @@ where
                 h09_responses: false,
                 #[cfg(feature = "ffi")]
                 on_informational: None,
+                #[cfg(feature = "ffi")]
+                pipeline_depth: 1,
+                #[cfg(feature = "ffi")]
+                in_flight: 0,
+                #[cfg(feature = "ffi")]
+                pipelined_methods: VecDeque::new(),
+                #[cfg(feature = "ffi")]
+                pipelined_on_informational: VecDeque::new(),
+                #[cfg(feature = "ffi")]
+                request_stats: VecDeque::new(),
+                #[cfg(all(feature = "ffi", unix))]
+                sendfile: None,
+                #[cfg(feature = "ffi")]
+                release_idle_buffers: false,
                 notify_read: false,
                 reading: Reading::Init,
                 writing: Writing::Init,
@@ -131,6 +150,27 @@ where
         self.state.preserve_header_order = true;
     }
 
+    #[cfg(feature = "ffi")]
+    pub(crate) fn set_pipeline_depth(&mut self, depth: usize) {
+        debug_assert!(depth > 0);
+        self.state.pipeline_depth = depth;
+    }
+
+    #[cfg(feature = "ffi")]
+    pub(crate) fn set_stats(&mut self, stats: std::sync::Arc<crate::ffi::ConnStats>) {
+        self.io.set_stats(stats);
+    }
+
+    #[cfg(feature = "ffi")]
+    pub(crate) fn set_ffi_transport(&mut self, get: super::GetFfiTransport<I>) {
+        self.io.set_ffi_transport(get);
+    }
+
+    #[cfg(feature = "ffi")]
+    pub(crate) fn set_release_idle_buffers(&mut self) {
+        self.state.release_idle_buffers = true;
+    }
+
     #[cfg(feature = "client")]
     pub(crate) fn set_h09_responses(&mut self) {
         self.state.h09_responses = true;
@@ -175,6 +215,13 @@ where
             return true;
         }
 
+        // With pipelining, writing goes back to `Init` while responses are
+        // still outstanding.
+        #[cfg(feature = "ffi")]
+        if self.state.is_pipelining::<T>() && self.state.in_flight > 0 {
+            return true;
+        }
+
         !matches!(self.state.writing, Writing::Init)
     }
 
@@ -213,6 +260,7 @@ where
             cx,
             ParseContext {
                 cached_headers: &mut self.state.cached_headers,
+                header_indices: &mut self.state.header_indices,
                 req_method: &mut self.state.method,
                 h1_parser_config: self.state.h1_parser_config.clone(),
                 h1_max_headers: self.state.h1_max_headers,
@@ -248,10 +296,17 @@ where
         #[cfg(feature = "ffi")]
         {
             self.state.on_informational = None;
+            if let Some(Some(stats)) = self.state.request_stats.front() {
+                stats.record_headers_received();
+            }
         }
 
         self.state.busy();
         self.state.keep_alive &= msg.keep_alive;
+        #[cfg(feature = "ffi")]
+        if !self.state.wants_keep_alive() {
+            self.io.record_closing();
+        }
         self.state.version = msg.head.version;
 
         let mut wants = if msg.wants_upgrade {
@@ -264,6 +319,8 @@ where
             if msg.expect_continue {
                 debug!("ignoring expect-continue since body is empty");
             }
+            #[cfg(feature = "ffi")]
+            self.state.finish_request_stats(true);
             self.state.reading = Reading::KeepAlive;
             if !T::should_read_first() {
                 self.try_keep_alive(cx);
@@ -332,6 +389,12 @@ where
                     Ok(frame) => {
                         if frame.is_data() {
                             let slice = frame.data_ref().unwrap_or_else(|| unreachable!());
+                            #[cfg(feature = "ffi")]
+                            if !slice.is_empty() {
+                                if let Some(Some(stats)) = self.state.request_stats.front() {
+                                    stats.record_body_data();
+                                }
+                            }
                             let (reading, maybe_frame) = if decoder.is_eof() {
                                 debug!("incoming body completed");
                                 (
@@ -380,6 +443,9 @@ where
             _ => unreachable!("poll_read_body invalid state: {:?}", self.state.reading),
         };
 
+        #[cfg(feature = "ffi")]
+        self.state
+            .finish_request_stats(!matches!(ret, Poll::Ready(Some(Err(_)))));
         self.state.reading = reading;
         self.try_keep_alive(cx);
         ret
@@ -424,7 +490,18 @@ where
             return Poll::Ready(Err(crate::Error::new_unexpected_message()));
         }
 
-        let num_read = ready!(self.force_io_read(cx)).map_err(crate::Error::new_io)?;
+        let num_read = match self.force_io_read(cx) {
+            Poll::Ready(res) => res.map_err(crate::Error::new_io)?,
+            Poll::Pending => {
+                // Nothing is expected until the next request, which may be
+                // a long time away.
+                #[cfg(feature = "ffi")]
+                if self.state.release_idle_buffers {
+                    self.io.release_idle_buffers();
+                }
+                return Poll::Pending;
+            }
+        };
 
         if num_read == 0 {
             let ret = if self.should_error_on_eof() {
@@ -560,6 +637,16 @@ where
             } else {
                 Writing::KeepAlive
             };
+            self.pipeline_next();
+        }
+    }
+
+    /// Lets a pipelining client write the head of its next request right
+    /// behind the one just finished, instead of flushing in between.
+    fn pipeline_next(&mut self) {
+        #[cfg(feature = "ffi")]
+        if self.state.is_pipelining::<T>() {
+            self.state.try_pipeline();
         }
     }
 
@@ -574,9 +661,24 @@ where
             self.state.busy();
         }
 
+        // A pipelined request must not clobber the method of the response
+        // currently being read, so it is queued instead.
+        #[cfg(feature = "ffi")]
+        let reading_method = if self.state.is_pipelining::<T>() && self.state.in_flight > 0 {
+            Some(self.state.method.take())
+        } else {
+            None
+        };
+
         self.enforce_version(&mut head);
 
+        // Taken out first, since a server's encoding takes the extensions.
+        #[cfg(all(feature = "ffi", unix))]
+        let file = head.extensions.remove::<crate::ffi::SendFile>();
+
         let buf = self.io.headers_buf();
+        #[cfg(feature = "ffi")]
+        let headers_cap = buf.capacity();
         match super::role::encode_headers::<T>(
             Encode {
                 head: &mut head,
@@ -591,14 +693,47 @@ where
             buf,
         ) {
             Ok(encoder) => {
-                debug_assert!(self.state.cached_headers.is_none());
+                // A pipelining client may still have a map cached from an
+                // earlier request, waiting on its response.
+                debug_assert!(
+                    self.state.cached_headers.is_none() || self.state.is_pipelining::<T>()
+                );
                 debug_assert!(head.headers.is_empty());
-                self.state.cached_headers = Some(head.headers);
+                if self.state.cached_headers.is_none() {
+                    self.state.cached_headers = Some(head.headers);
+                }
 
                 #[cfg(feature = "ffi")]
                 {
-                    self.state.on_informational =
-                        head.extensions.remove::<crate::ffi::OnInformational>();
+                    self.io.record_headers_buf_growth(headers_cap);
+                    if let Some(reading_method) = reading_method {
+                        let sent = std::mem::replace(&mut self.state.method, reading_method);
+                        self.state.pipelined_methods.push_back(sent);
+                        self.state
+                            .pipelined_on_informational
+                            .push_back(head.extensions.remove::<crate::ffi::OnInformational>());
+                    } else {
+                        self.state.on_informational =
+                            head.extensions.remove::<crate::ffi::OnInformational>();
+                    }
+                    if self.state.is_pipelining::<T>() {
+                        self.state.in_flight += 1;
+                    }
+                    if !T::should_read_first() {
+                        self.state
+                            .request_stats
+                            .push_back(head.extensions.remove::<crate::ffi::RequestStats>());
+                    }
+                }
+
+                // A file body is handed to a transport that can send it
+                // itself, if the file is all of the body's content-length.
+                #[cfg(all(feature = "ffi", unix))]
+                {
+                    self.state.sendfile = file.filter(|file| {
+                        encoder.remaining_length() == Some(file.len)
+                            && self.io.sendfile_transport().is_some()
+                    });
                 }
 
                 Some(encoder)
@@ -674,6 +809,55 @@ where
         };
 
         self.state.writing = state;
+        self.pipeline_next();
+    }
+
+    /// Sends the body's file with the transport's `poll_sendfile`, if
+    /// `encode_head` found that it could, once everything buffered was
+    /// flushed.
+    ///
+    /// Returns `None` if the body isn't sent this way, and should be read
+    /// and written as usual. Otherwise returns whether the whole file has
+    /// been sent, and the body itself is never polled.
+    #[cfg(all(feature = "ffi", unix))]
+    pub(crate) fn poll_sendfile_body(
+        &mut self,
+        cx: &mut Context<'_>,
+    ) -> Poll<io::Result<Option<bool>>> {
+        debug_assert!(self.can_write_body());
+        let file = match self.state.sendfile {
+            Some(file) => file,
+            None => return Poll::Ready(Ok(None)),
+        };
+
+        ready!(self.poll_flush(cx))?;
+        let want = file.len.min(usize::MAX as u64) as usize;
+        let io = self
+            .io
+            .sendfile_transport()
+            .expect("sendfile body without a sendfile transport");
+        let n = ready!(io.poll_sendfile(cx, file.fd, file.offset, want))?;
+        trace!("sendfile write, len = {}", n);
+        if n == 0 {
+            self.state.sendfile = None;
+            return Poll::Ready(Err(io::Error::new(
+                io::ErrorKind::UnexpectedEof,
+                "file ended before the body length",
+            )));
+        }
+        match self.state.writing {
+            Writing::Body(ref mut encoder) => encoder.sent_directly(n as u64),
+            _ => unreachable!("poll_sendfile_body invalid state: {:?}", self.state.writing),
+        }
+
+        let n = n as u64;
+        self.state.sendfile = Some(crate::ffi::SendFile {
+            offset: file.offset + n,
+            len: file.len - n,
+            ..file
+        })
+        .filter(|file| file.len > 0);
+        Poll::Ready(Ok(Some(self.state.sendfile.is_none())))
     }
 
     pub(crate) fn write_trailers(&mut self, trailers: HeaderMap) {
@@ -695,6 +879,7 @@ where
                     } else {
                         Writing::KeepAlive
                     };
+                    self.pipeline_next();
                 }
             }
             _ => unreachable!("write_trailers invalid state: {:?}", self.state.writing),
@@ -719,6 +904,7 @@ where
         };
 
         self.state.writing = state;
+        self.pipeline_next();
     }
 
     pub(crate) fn end_body(&mut self) -> crate::Result<()> {
@@ -741,6 +927,7 @@ where
                 } else {
                     Writing::KeepAlive
                 };
+                self.pipeline_next();
 
                 Ok(())
             }
@@ -777,6 +964,14 @@ where
 
     pub(crate) fn poll_flush(&mut self, cx: &mut Context<'_>) -> Poll<io::Result<()>> {
         ready!(Pin::new(&mut self.io).poll_flush(cx))?;
+        // Everything buffered has been written, including the heads of any
+        // requests not yet timed.
+        #[cfg(feature = "ffi")]
+        for stats in self.state.request_stats.iter().rev().flatten() {
+            if !stats.record_head_written() {
+                break;
+            }
+        }
         self.try_keep_alive(cx);
         trace!("flushed({}): {:?}", T::LOG, self.state);
         Poll::Ready(Ok(()))
@@ -863,6 +1058,9 @@ struct State {
     allow_half_close: bool,
     /// Re-usable HeaderMap to reduce allocating new ones.
     cached_headers: Option<HeaderMap>,
+    /// Re-usable header indices, for when more headers are allowed than
+    /// fit on the stack while parsing.
+    header_indices: Vec<MaybeUninit<HeaderIndices>>,
     /// If an error occurs when there wasn't a direct way to return it
     /// back to the user, this is set.
     error: Option<crate::Error>,
@@ -895,6 +1093,31 @@ struct State {
     /// received.
     #[cfg(feature = "ffi")]
     on_informational: Option<crate::ffi::OnInformational>,
+    /// How many requests a client may have written before their responses
+    /// have been read. `1` disables pipelining.
+    #[cfg(feature = "ffi")]
+    pipeline_depth: usize,
+    /// Number of requests written whose responses haven't been fully read.
+    #[cfg(feature = "ffi")]
+    in_flight: usize,
+    /// Methods of pipelined requests, behind the one whose response is
+    /// currently being read.
+    #[cfg(feature = "ffi")]
+    pipelined_methods: VecDeque<Option<Method>>,
+    /// The `on_informational` callbacks of the same pipelined requests.
+    #[cfg(feature = "ffi")]
+    pipelined_on_informational: VecDeque<Option<crate::ffi::OnInformational>>,
+    /// Timings of the requests written whose responses haven't been fully
+    /// read, oldest first.
+    #[cfg(feature = "ffi")]
+    request_stats: VecDeque<Option<crate::ffi::RequestStats>>,
+    /// The file left to send as the body being written, with the
+    /// transport's sendfile.
+    #[cfg(all(feature = "ffi", unix))]
+    sendfile: Option<crate::ffi::SendFile>,
+    /// Whether to free the IO buffers while a client connection is idle.
+    #[cfg(feature = "ffi")]
+    release_idle_buffers: bool,
     /// Set to true when the Dispatcher should poll read operations
     /// again. See the `maybe_notify` method for more.
     notify_read: bool,
@@ -1020,6 +1243,11 @@ impl State {
     }
 
     fn try_keep_alive<T: Http1Transaction>(&mut self) {
+        #[cfg(feature = "ffi")]
+        if self.is_pipelining::<T>() {
+            self.try_pipeline();
+        }
+
         match (&self.reading, &self.writing) {
             (&Reading::KeepAlive, &Writing::KeepAlive) => {
                 if let KA::Busy = self.keep_alive.status() {
@@ -1040,6 +1268,66 @@ impl State {
         }
     }
 
+    /// Whether this is a client allowed to have more than one request
+    /// waiting on its response.
+    fn is_pipelining<T: Http1Transaction>(&self) -> bool {
+        #[cfg(feature = "ffi")]
+        {
+            !T::should_read_first() && self.pipeline_depth > 1
+        }
+        #[cfg(not(feature = "ffi"))]
+        {
+            false
+        }
+    }
+
+    /// Lets a pipelining client move on to the next request or response
+    /// without waiting for both sides of the current exchange to finish.
+    #[cfg(feature = "ffi")]
+    fn try_pipeline(&mut self) {
+        let busy = matches!(self.keep_alive.status(), KA::Busy);
+
+        if let Reading::KeepAlive = self.reading {
+            if self.in_flight > 1 {
+                if busy {
+                    trace!("pipelined response completed, reading next");
+                    self.in_flight -= 1;
+                    self.method = self.pipelined_methods.pop_front().flatten();
+                    self.on_informational = self.pipelined_on_informational.pop_front().flatten();
+                    self.reading = Reading::Init;
+                    self.notify_read = true;
+                } else {
+                    debug!(
+                        "connection closing with {} pipelined requests unanswered",
+                        self.in_flight - 1
+                    );
+                    self.error = Some(crate::Error::new_incomplete());
+                    self.close();
+                }
+            } else if let Writing::Init = self.writing {
+                // Nothing more was written after the last request, so
+                // the usual keep-alive (or close) rules apply.
+                self.writing = Writing::KeepAlive;
+            }
+        }
+
+        let awaiting_response = matches!(
+            self.reading,
+            Reading::Init | Reading::Continue(..) | Reading::Body(..)
+        );
+        if busy
+            && awaiting_response
+            && matches!(self.writing, Writing::KeepAlive)
+            && self.in_flight < self.pipeline_depth
+        {
+            trace!("request written, pipelining another");
+            self.writing = Writing::Init;
+            // As with going idle, the Dispatcher should poll the pending
+            // requests stream again.
+            self.notify_read = true;
+        }
+    }
+
     fn disable_keep_alive(&mut self) {
         self.keep_alive.disable()
     }
@@ -1051,10 +1339,25 @@ impl State {
         self.keep_alive.busy();
     }
 
+    /// Done with the timings of the response that was being read.
+    #[cfg(feature = "ffi")]
+    fn finish_request_stats(&mut self, complete: bool) {
+        if let Some(Some(stats)) = self.request_stats.pop_front() {
+            if complete {
+                stats.record_body_complete();
+            }
+        }
+    }
+
     fn idle<T: Http1Transaction>(&mut self) {
         debug_assert!(!self.is_idle(), "State::idle() called while idle");
 
         self.method = None;
+        #[cfg(feature = "ffi")]
+        {
+            self.in_flight = 0;
+            self.request_stats.clear();
+        }
         self.keep_alive.idle();
 
         if !self.is_idle() {
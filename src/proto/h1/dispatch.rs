@@ -50,16 +50,29 @@ cfg_server! {
 }
 
 cfg_client! {
-    pin_project_lite::pin_project! {
-        pub(crate) struct Client<B> {
-            callback: Option<crate::client::dispatch::Callback<Request<B>, http::Response<IncomingBody>>>,
-            #[pin]
-            rx: ClientRx<B>,
-            rx_closed: bool,
-        }
+    #[cfg(feature = "ffi")]
+    use std::collections::VecDeque;
+
+    // Not pinned, so that the pipelining fields can be left out of builds
+    // without `ffi`. Every field is `Unpin`.
+    pub(crate) struct Client<B> {
+        callback: Option<ClientCallback<B>>,
+        #[cfg(feature = "ffi")]
+        pipelined: Pipelined<B>,
+        /// How many requests may be waiting on their responses. `1` disables
+        /// pipelining.
+        #[cfg(feature = "ffi")]
+        pipeline_depth: usize,
+        rx: ClientRx<B>,
+        rx_closed: bool,
     }
 
     type ClientRx<B> = crate::client::dispatch::Receiver<Request<B>, http::Response<IncomingBody>>;
+    type ClientCallback<B> = crate::client::dispatch::Callback<Request<B>, http::Response<IncomingBody>>;
+
+    /// Callbacks of pipelined requests, behind `Client::callback`.
+    #[cfg(feature = "ffi")]
+    struct Pipelined<B>(VecDeque<ClientCallback<B>>);
 }
 
 impl<D, Bs, I, T> Dispatcher<D, Bs, I, T>
@@ -97,6 +110,12 @@ where
         }
     }
 
+    /// Lets the connection use what its IO can do as a C API `hyper_io`.
+    #[cfg(feature = "ffi")]
+    pub(crate) fn set_ffi_transport(&mut self, get: super::GetFfiTransport<I>) {
+        self.conn.set_ffi_transport(get);
+    }
+
     pub(crate) fn into_inner(self) -> (I, Bytes, D) {
         let (io, buf) = self.conn.into_inner();
         (io, buf, self.dispatch)
@@ -368,6 +387,19 @@ where
                         continue;
                     }
 
+                    #[cfg(all(feature = "ffi", unix))]
+                    if let Some(done) = ready!(self.conn.poll_sendfile_body(cx)).map_err(|err| {
+                        debug!("error writing: {}", err);
+                        *clear_body = true;
+                        crate::Error::new_body_write(err)
+                    })? {
+                        if done {
+                            *clear_body = true;
+                            self.conn.end_body()?;
+                        }
+                        continue;
+                    }
+
                     let item = ready!(body.as_mut().poll_frame(cx));
                     if let Some(item) = item {
                         let frame = item.map_err(|e| {
@@ -587,10 +619,31 @@ cfg_client! {
         pub(crate) fn new(rx: ClientRx<B>) -> Client<B> {
             Client {
                 callback: None,
+                #[cfg(feature = "ffi")]
+                pipelined: Pipelined(VecDeque::new()),
+                #[cfg(feature = "ffi")]
+                pipeline_depth: 1,
                 rx,
                 rx_closed: false,
             }
         }
+
+        #[cfg(feature = "ffi")]
+        pub(crate) fn set_pipeline_depth(&mut self, depth: usize) {
+            debug_assert!(depth > 0);
+            self.pipeline_depth = depth;
+        }
+    }
+
+    #[cfg(feature = "ffi")]
+    impl<B> Drop for Pipelined<B> {
+        fn drop(&mut self) {
+            // These requests were already written, so they can't be retried,
+            // but the connection closed before their responses arrived.
+            for cb in self.0.drain(..) {
+                cb.send(Err((crate::Error::new_incomplete(), None)));
+            }
+        }
     }
 
     impl<B> Dispatch for Client<B>
@@ -624,6 +677,11 @@ cfg_client! {
                                 headers: parts.headers,
                                 extensions: parts.extensions,
                             };
+                            #[cfg(feature = "ffi")]
+                            if this.callback.is_some() {
+                                this.pipelined.0.push_back(cb);
+                                return Poll::Ready(Some(Ok((head, body))));
+                            }
                             this.callback = Some(cb);
                             Poll::Ready(Some(Ok((head, body))))
                         }
@@ -645,6 +703,10 @@ cfg_client! {
                     if let Some(cb) = self.callback.take() {
                         let res = msg.into_response(body);
                         cb.send(Ok(res));
+                        #[cfg(feature = "ffi")]
+                        {
+                            self.callback = self.pipelined.0.pop_front();
+                        }
                         Ok(())
                     } else {
                         // Getting here is likely a bug! An error should have happened
@@ -689,6 +751,10 @@ cfg_client! {
         }
 
         fn should_poll(&self) -> bool {
+            #[cfg(feature = "ffi")]
+            if self.callback.is_some() {
+                return 1 + self.pipelined.0.len() < self.pipeline_depth;
+            }
             self.callback.is_none()
         }
     }
@@ -768,6 +834,48 @@ mod tests {
         assert!(!tx.is_ready());
     }
 
+    #[cfg(all(feature = "ffi", not(miri)))]
+    #[tokio::test]
+    async fn client_pipelines_requests() {
+        let _ = pretty_env_logger::try_init();
+
+        // Both requests must be written before any response is readable.
+        let (io, _handle) = tokio_test::io::Builder::new()
+            .write(b"GET /a HTTP/1.1\r\n\r\n")
+            .write(b"GET /b HTTP/1.1\r\n\r\n")
+            .read(b"HTTP/1.1 200 OK\r\ncontent-length: 0\r\n\r\n")
+            .read(b"HTTP/1.1 201 Created\r\ncontent-length: 0\r\n\r\n")
+            .wait(Duration::from_secs(2))
+            .build_with_handle();
+
+        let (mut tx, rx) = crate::client::dispatch::channel();
+        let mut conn = Conn::<_, bytes::Bytes, ClientTransaction>::new(Compat::new(io));
+        conn.set_pipeline_depth(2);
+        let mut client = Client::new(rx);
+        client.set_pipeline_depth(2);
+
+        let dispatcher = Dispatcher::new(client, conn);
+        let _dispatcher = tokio::spawn(async move { dispatcher.await });
+
+        let req = |path| {
+            crate::Request::builder()
+                .uri(path)
+                .body(IncomingBody::empty())
+                .unwrap()
+        };
+
+        let res_a = tx.try_send(req("/a")).unwrap();
+        futures_util::future::poll_fn(|cx| tx.poll_ready(cx))
+            .await
+            .expect("ready for pipelined request");
+        let res_b = tx.try_send(req("/b")).unwrap();
+
+        let res_a = res_a.await.expect("callback a").expect("response a");
+        assert_eq!(res_a.status(), crate::StatusCode::OK);
+        let res_b = res_b.await.expect("callback b").expect("response b");
+        assert_eq!(res_b.status(), crate::StatusCode::CREATED);
+    }
+
     #[cfg(not(miri))]
     #[tokio::test]
     async fn body_empty_chunks_ignored() {
@@ -113,6 +113,28 @@ impl Encoder {
         matches!(self.kind, Kind::Chunked(_))
     }
 
+    /// The bytes left of a body sent with a `content-length`.
+    #[cfg(all(feature = "ffi", unix))]
+    pub(crate) fn remaining_length(&self) -> Option<u64> {
+        match self.kind {
+            Kind::Length(remaining) => Some(remaining),
+            _ => None,
+        }
+    }
+
+    /// Counts `n` bytes of a `content-length` body that were written to the
+    /// transport directly, instead of being encoded.
+    #[cfg(all(feature = "ffi", unix))]
+    pub(crate) fn sent_directly(&mut self, n: u64) {
+        match self.kind {
+            Kind::Length(ref mut remaining) => {
+                debug_assert!(n <= *remaining, "sent past the body length");
+                *remaining -= n;
+            }
+            _ => unreachable!("sent_directly on {:?}", self.kind),
+        }
+    }
+
     pub(crate) fn end<B>(&self) -> Result<Option<EncodedBuf<B>>, NotEof> {
         match self.kind {
             Kind::Length(0) => Ok(None),
@@ -31,6 +31,48 @@ pub(crate) const DEFAULT_MAX_BUFFER_SIZE: usize = 8192 + 4096 * 100;
 /// forces a flush if the queue gets this big.
 const MAX_BUF_LIST_BUFFERS: usize = 16;
 
+/// What the C API's `hyper_io` can do besides `Read` and `Write`.
+///
+/// These stay off the public `rt` traits, so a connection only uses them if
+/// it was told how to get at them from its IO, with `set_ffi_transport`.
+#[cfg(feature = "ffi")]
+pub(crate) trait FfiTransport {
+    /// Attempts to take up to `max` bytes the transport already holds in a
+    /// buffer of its own, instead of copying them into the read buffer.
+    ///
+    /// Returns `Poll::Ready(Ok(None))` if the transport doesn't hand out its
+    /// buffers, in which case `poll_read` is used instead. Otherwise, empty
+    /// bytes mean EOF has been reached.
+    fn poll_read_owned(
+        &mut self,
+        cx: &mut Context<'_>,
+        max: usize,
+    ) -> Poll<io::Result<Option<Bytes>>>;
+
+    /// Returns whether the transport can send part of a file itself, with
+    /// `poll_sendfile`.
+    #[cfg(unix)]
+    fn is_sendfile(&self) -> bool;
+
+    /// Attempts to write up to `len` bytes of the file `fd`, starting at
+    /// `offset`, without them being read into a buffer first.
+    ///
+    /// This is only called if `is_sendfile` returns `true`. Returning
+    /// `Ok(0)` means the file ended before `len` bytes.
+    #[cfg(unix)]
+    fn poll_sendfile(
+        &mut self,
+        cx: &mut Context<'_>,
+        fd: std::os::raw::c_int,
+        offset: u64,
+        len: usize,
+    ) -> Poll<io::Result<usize>>;
+}
+
+/// Gets at the `FfiTransport` of a connection's IO.
+#[cfg(feature = "ffi")]
+pub(crate) type GetFfiTransport<T> = fn(&mut T) -> &mut dyn FfiTransport;
+
 pub(crate) struct Buffered<T, B> {
     flush_pipeline: bool,
     io: T,
@@ -38,6 +80,10 @@ pub(crate) struct Buffered<T, B> {
     read_buf: BytesMut,
     read_buf_strategy: ReadStrategy,
     write_buf: WriteBuf<B>,
+    #[cfg(feature = "ffi")]
+    stats: Option<std::sync::Arc<crate::ffi::ConnStats>>,
+    #[cfg(feature = "ffi")]
+    ffi_transport: Option<GetFfiTransport<T>>,
 }
 
 impl<T, B> fmt::Debug for Buffered<T, B>
@@ -71,6 +117,61 @@ where
             read_buf: BytesMut::with_capacity(0),
             read_buf_strategy: ReadStrategy::default(),
             write_buf,
+            #[cfg(feature = "ffi")]
+            stats: None,
+            #[cfg(feature = "ffi")]
+            ffi_transport: None,
+        }
+    }
+
+    #[cfg(feature = "ffi")]
+    pub(crate) fn set_stats(&mut self, stats: std::sync::Arc<crate::ffi::ConnStats>) {
+        self.stats = Some(stats);
+    }
+
+    #[cfg(feature = "ffi")]
+    pub(crate) fn set_ffi_transport(&mut self, get: GetFfiTransport<T>) {
+        self.ffi_transport = Some(get);
+    }
+
+    /// Returns the transport's `FfiTransport`, if it has been given one,
+    /// and it can send files itself.
+    #[cfg(all(feature = "ffi", unix))]
+    pub(crate) fn sendfile_transport(&mut self) -> Option<&mut dyn FfiTransport> {
+        let get = self.ffi_transport?;
+        Some(get(&mut self.io)).filter(|io| io.is_sendfile())
+    }
+
+    /// Counts it if encoding a message head grew the headers buffer past
+    /// `prev_cap`.
+    #[cfg(feature = "ffi")]
+    pub(crate) fn record_headers_buf_growth(&mut self, prev_cap: usize) {
+        if let Some(ref stats) = self.stats {
+            if self.write_buf.headers.bytes.capacity() > prev_cap {
+                stats.record_write_buf_grow();
+            }
+        }
+    }
+
+    /// Notes that the connection won't be kept alive after the current
+    /// message.
+    #[cfg(feature = "ffi")]
+    pub(crate) fn record_closing(&self) {
+        if let Some(ref stats) = self.stats {
+            stats.record_closing();
+        }
+    }
+
+    /// Frees the read and headers buffers, if they hold nothing, so an idle
+    /// connection doesn't keep them allocated. They are allocated again
+    /// once there is something to read or write.
+    #[cfg(feature = "ffi")]
+    pub(crate) fn release_idle_buffers(&mut self) {
+        if self.read_buf.is_empty() && self.read_buf.capacity() > 0 {
+            self.read_buf = BytesMut::new();
+        }
+        if !self.write_buf.headers.has_remaining() && self.write_buf.headers.bytes.capacity() > 0 {
+            self.write_buf.headers = Cursor::new(Vec::new());
         }
     }
 
@@ -180,6 +281,7 @@ where
                 &mut self.read_buf,
                 ParseContext {
                     cached_headers: parse_ctx.cached_headers,
+                    header_indices: parse_ctx.header_indices,
                     req_method: parse_ctx.req_method,
                     h1_parser_config: parse_ctx.h1_parser_config.clone(),
                     h1_max_headers: parse_ctx.h1_max_headers,
@@ -242,7 +344,17 @@ where
         self.read_blocked = false;
         let next = self.read_buf_strategy.next();
         if self.read_buf_remaining_mut() < next {
+            #[cfg(feature = "ffi")]
+            let prev_cap = self.read_buf.capacity();
             self.read_buf.reserve(next);
+            #[cfg(feature = "ffi")]
+            if let Some(ref stats) = self.stats {
+                // The first allocation isn't growth, and `reserve` may just
+                // reclaim space already read past.
+                if prev_cap > 0 && self.read_buf.capacity() > prev_cap {
+                    stats.record_read_buf_grow();
+                }
+            }
         }
 
         // SAFETY: ReadBuf and poll_read promise not to set any uninitialized
@@ -365,6 +477,24 @@ where
             let n = std::cmp::min(len, self.read_buf.len());
             Poll::Ready(Ok(self.read_buf.split_to(n).freeze()))
         } else {
+            // Take body data straight from a transport that owns its
+            // buffers, rather than copying it through `read_buf`.
+            #[cfg(feature = "ffi")]
+            if let Some(get) = self.ffi_transport {
+                match get(&mut self.io).poll_read_owned(cx, len) {
+                    Poll::Ready(Ok(Some(bytes))) => {
+                        trace!("received {} bytes", bytes.len());
+                        self.read_blocked = false;
+                        return Poll::Ready(Ok(bytes));
+                    }
+                    Poll::Ready(Ok(None)) => (),
+                    Poll::Ready(Err(e)) => return Poll::Ready(Err(e)),
+                    Poll::Pending => {
+                        self.read_blocked = true;
+                        return Poll::Pending;
+                    }
+                }
+            }
             let n = ready!(self.poll_read_from_io(cx))?;
             Poll::Ready(Ok(self.read_buf.split_to(::std::cmp::min(len, n)).freeze()))
         }
@@ -723,6 +853,7 @@ mod tests {
         futures_util::future::poll_fn(|cx| {
             let parse_ctx = ParseContext {
                 cached_headers: &mut None,
+                header_indices: &mut Vec::new(),
                 req_method: &mut None,
                 h1_parser_config: Default::default(),
                 h1_max_headers: None,
@@ -867,6 +998,25 @@ mod tests {
         buffered.buffer(Cursor::new(Vec::new()));
     }
 
+    #[cfg(feature = "ffi")]
+    #[test]
+    fn release_idle_buffers_keeps_pending_bytes() {
+        let mock = Mock::new().build();
+        let mut buffered = Buffered::<_, Cursor<Vec<u8>>>::new(Compat::new(mock));
+
+        buffered.read_buf.extend_from_slice(b"H");
+        buffered.headers_buf().extend(b"GET / HTTP/1.1\r\n");
+        buffered.release_idle_buffers();
+        assert!(buffered.read_buf.capacity() > 0);
+        assert!(buffered.write_buf.headers.has_remaining());
+
+        buffered.read_buf.clear();
+        buffered.write_buf.headers.bytes.clear();
+        buffered.release_idle_buffers();
+        assert_eq!(buffered.write_buf.headers.bytes.capacity(), 0);
+        assert_eq!(buffered.read_buf.capacity(), 0);
+    }
+
     /*
     TODO: needs tokio_test::io to allow configure write_buf calls
     #[test]
@@ -4,6 +4,7 @@ use std::{pin::Pin, time::Duration};
 use bytes::BytesMut;
 use http::{HeaderMap, Method};
 use httparse::ParserConfig;
+use std::mem::MaybeUninit;
 
 use crate::body::DecodedLength;
 #[cfg(feature = "server")]
@@ -16,6 +17,8 @@ pub(crate) use self::conn::Conn;
 pub(crate) use self::decode::Decoder;
 pub(crate) use self::dispatch::Dispatcher;
 pub(crate) use self::encode::{EncodedBuf, Encoder};
+#[cfg(feature = "ffi")]
+pub(crate) use self::io::{FfiTransport, GetFfiTransport};
 //TODO: move out of h1::io
 pub(crate) use self::io::MINIMUM_MAX_BUFFER_SIZE;
 
@@ -76,6 +79,7 @@ pub(crate) struct ParsedMessage<T> {
 
 pub(crate) struct ParseContext<'a> {
     cached_headers: &'a mut Option<HeaderMap>,
+    header_indices: &'a mut Vec<MaybeUninit<role::HeaderIndices>>,
     req_method: &'a mut Option<Method>,
     h1_parser_config: ParserConfig,
     h1_max_headers: Option<usize>,
@@ -142,11 +142,18 @@ impl Http1Transaction for Server {
         // but we *never* read any of it until after httparse has assigned
         // values into it. By not zeroing out the stack memory, this saves
         // a good ~5% on pipeline benchmarks.
-        let mut headers_indices: SmallVec<[MaybeUninit<HeaderIndices>; DEFAULT_MAX_HEADERS]> =
-            match ctx.h1_max_headers {
-                Some(cap) => smallvec![MaybeUninit::uninit(); cap],
-                None => smallvec_inline![MaybeUninit::uninit(); DEFAULT_MAX_HEADERS],
-            };
+        let mut inline_indices: SmallVec<[MaybeUninit<HeaderIndices>; DEFAULT_MAX_HEADERS]>;
+        let headers_indices: &mut [MaybeUninit<HeaderIndices>] = match ctx.h1_max_headers {
+            Some(cap) if cap > DEFAULT_MAX_HEADERS => reuse_header_indices(ctx.header_indices, cap),
+            Some(cap) => {
+                inline_indices = smallvec![MaybeUninit::uninit(); cap];
+                &mut inline_indices
+            }
+            None => {
+                inline_indices = smallvec_inline![MaybeUninit::uninit(); DEFAULT_MAX_HEADERS];
+                &mut inline_indices
+            }
+        };
         {
             let mut headers: SmallVec<[MaybeUninit<httparse::Header<'_>>; DEFAULT_MAX_HEADERS]> =
                 match ctx.h1_max_headers {
@@ -176,7 +183,7 @@ impl Http1Transaction for Server {
                         Version::HTTP_10
                     };
 
-                    record_header_indices(bytes, req.headers, &mut headers_indices)?;
+                    record_header_indices(bytes, req.headers, headers_indices)?;
                     headers_len = req.headers.len();
                 }
                 Ok(httparse::Status::Partial) => return Ok(None),
@@ -991,11 +998,20 @@ impl Http1Transaction for Client {
 
         // Loop to skip information status code headers (100 Continue, etc).
         loop {
-            let mut headers_indices: SmallVec<[MaybeUninit<HeaderIndices>; DEFAULT_MAX_HEADERS]> =
-                match ctx.h1_max_headers {
-                    Some(cap) => smallvec![MaybeUninit::uninit(); cap],
-                    None => smallvec_inline![MaybeUninit::uninit(); DEFAULT_MAX_HEADERS],
-                };
+            let mut inline_indices: SmallVec<[MaybeUninit<HeaderIndices>; DEFAULT_MAX_HEADERS]>;
+            let headers_indices: &mut [MaybeUninit<HeaderIndices>] = match ctx.h1_max_headers {
+                Some(cap) if cap > DEFAULT_MAX_HEADERS => {
+                    reuse_header_indices(ctx.header_indices, cap)
+                }
+                Some(cap) => {
+                    inline_indices = smallvec![MaybeUninit::uninit(); cap];
+                    &mut inline_indices
+                }
+                None => {
+                    inline_indices = smallvec_inline![MaybeUninit::uninit(); DEFAULT_MAX_HEADERS];
+                    &mut inline_indices
+                }
+            };
             let (len, status, reason, version, headers_len) = {
                 let mut headers: SmallVec<
                     [MaybeUninit<httparse::Header<'_>>; DEFAULT_MAX_HEADERS],
@@ -1030,7 +1046,7 @@ impl Http1Transaction for Client {
                         } else {
                             Version::HTTP_10
                         };
-                        record_header_indices(bytes, res.headers, &mut headers_indices)?;
+                        record_header_indices(bytes, res.headers, headers_indices)?;
                         let headers_len = res.headers.len();
                         (len, status, reason, version, headers_len)
                     }
@@ -1200,6 +1216,11 @@ impl Http1Transaction for Client {
             write_headers(&msg.head.headers, dst);
         }
 
+        #[cfg(feature = "ffi")]
+        if let Some(template) = msg.head.extensions.get::<crate::ffi::HeaderTemplate>() {
+            extend(dst, template.encoded());
+        }
+
         extend(dst, b"\r\n");
         msg.head.headers.clear(); //TODO: remove when switching to drain()
 
@@ -1504,11 +1525,25 @@ fn set_content_length(headers: &mut HeaderMap, len: u64) -> Encoder {
 }
 
 #[derive(Clone, Copy)]
-struct HeaderIndices {
+pub(crate) struct HeaderIndices {
     name: (usize, usize),
     value: (usize, usize),
 }
 
+/// Returns `cap` slots of the connection's header indices buffer.
+///
+/// Used when more headers are allowed than fit on the stack, so that the
+/// buffer is only allocated for the first message on a connection.
+fn reuse_header_indices(
+    indices: &mut Vec<MaybeUninit<HeaderIndices>>,
+    cap: usize,
+) -> &mut [MaybeUninit<HeaderIndices>] {
+    if indices.len() < cap {
+        indices.resize(cap, MaybeUninit::uninit());
+    }
+    &mut indices[..cap]
+}
+
 fn record_header_indices(
     bytes: &[u8],
     headers: &[httparse::Header<'_>],
@@ -1537,16 +1572,14 @@ fn record_header_indices(
 
 // Write header names as title case. The header name is assumed to be ASCII.
 fn title_case(dst: &mut Vec<u8>, name: &[u8]) {
-    dst.reserve(name.len());
-
-    // Ensure first character is uppercased
-    let mut prev = b'-';
-    for &(mut c) in name {
-        if prev == b'-' {
+    // Copy the name in one go, then uppercase the first character of each
+    // dash-separated word in place, rather than pushing byte by byte.
+    let start = dst.len();
+    dst.extend_from_slice(name);
+    for word in dst[start..].split_mut(|&c| c == b'-') {
+        if let Some(c) = word.first_mut() {
             c.make_ascii_uppercase();
         }
-        dst.push(c);
-        prev = c;
     }
 }
 
@@ -1644,6 +1677,7 @@ mod tests {
             &mut raw,
             ParseContext {
                 cached_headers: &mut None,
+                header_indices: &mut Vec::new(),
                 req_method: &mut method,
                 h1_parser_config: Default::default(),
                 h1_max_headers: None,
@@ -1676,6 +1710,7 @@ mod tests {
         let mut raw = BytesMut::from("HTTP/1.1 200 OK\r\nContent-Length: 0\r\n\r\n");
         let ctx = ParseContext {
             cached_headers: &mut None,
+            header_indices: &mut Vec::new(),
             req_method: &mut Some(crate::Method::GET),
             h1_parser_config: Default::default(),
             h1_max_headers: None,
@@ -1703,6 +1738,7 @@ mod tests {
         let mut raw = BytesMut::from("GET htt:p// HTTP/1.1\r\nHost: hyper.rs\r\n\r\n");
         let ctx = ParseContext {
             cached_headers: &mut None,
+            header_indices: &mut Vec::new(),
             req_method: &mut None,
             h1_parser_config: Default::default(),
             h1_max_headers: None,
@@ -1728,6 +1764,7 @@ mod tests {
         let mut raw = BytesMut::from(H09_RESPONSE);
         let ctx = ParseContext {
             cached_headers: &mut None,
+            header_indices: &mut Vec::new(),
             req_method: &mut Some(crate::Method::GET),
             h1_parser_config: Default::default(),
             h1_max_headers: None,
@@ -1755,6 +1792,7 @@ mod tests {
         let mut raw = BytesMut::from(H09_RESPONSE);
         let ctx = ParseContext {
             cached_headers: &mut None,
+            header_indices: &mut Vec::new(),
             req_method: &mut Some(crate::Method::GET),
             h1_parser_config: Default::default(),
             h1_max_headers: None,
@@ -1786,6 +1824,7 @@ mod tests {
         h1_parser_config.allow_spaces_after_header_name_in_responses(true);
         let ctx = ParseContext {
             cached_headers: &mut None,
+            header_indices: &mut Vec::new(),
             req_method: &mut Some(crate::Method::GET),
             h1_parser_config,
             h1_max_headers: None,
@@ -1814,6 +1853,7 @@ mod tests {
         let mut raw = BytesMut::from(RESPONSE_WITH_WHITESPACE_BETWEEN_HEADER_NAME_AND_COLON);
         let ctx = ParseContext {
             cached_headers: &mut None,
+            header_indices: &mut Vec::new(),
             req_method: &mut Some(crate::Method::GET),
             h1_parser_config: Default::default(),
             h1_max_headers: None,
@@ -1837,6 +1877,7 @@ mod tests {
             BytesMut::from("GET / HTTP/1.1\r\nHost: hyper.rs\r\nX-BREAD: baguette\r\n\r\n");
         let ctx = ParseContext {
             cached_headers: &mut None,
+            header_indices: &mut Vec::new(),
             req_method: &mut None,
             h1_parser_config: Default::default(),
             h1_max_headers: None,
@@ -1881,6 +1922,7 @@ mod tests {
                 &mut bytes,
                 ParseContext {
                     cached_headers: &mut None,
+                    header_indices: &mut Vec::new(),
                     req_method: &mut None,
                     h1_parser_config: Default::default(),
                     h1_max_headers: None,
@@ -1906,6 +1948,7 @@ mod tests {
                 &mut bytes,
                 ParseContext {
                     cached_headers: &mut None,
+                    header_indices: &mut Vec::new(),
                     req_method: &mut None,
                     h1_parser_config: Default::default(),
                     h1_max_headers: None,
@@ -2140,6 +2183,7 @@ mod tests {
                 &mut bytes,
                 ParseContext {
                     cached_headers: &mut None,
+                    header_indices: &mut Vec::new(),
                     req_method: &mut Some(Method::GET),
                     h1_parser_config: Default::default(),
                     h1_max_headers: None,
@@ -2165,6 +2209,7 @@ mod tests {
                 &mut bytes,
                 ParseContext {
                     cached_headers: &mut None,
+                    header_indices: &mut Vec::new(),
                     req_method: &mut Some(m),
                     h1_parser_config: Default::default(),
                     h1_max_headers: None,
@@ -2190,6 +2235,7 @@ mod tests {
                 &mut bytes,
                 ParseContext {
                     cached_headers: &mut None,
+                    header_indices: &mut Vec::new(),
                     req_method: &mut Some(Method::GET),
                     h1_parser_config: Default::default(),
                     h1_max_headers: None,
@@ -2753,6 +2799,7 @@ mod tests {
             &mut bytes,
             ParseContext {
                 cached_headers: &mut None,
+                header_indices: &mut Vec::new(),
                 req_method: &mut Some(Method::GET),
                 h1_parser_config: Default::default(),
                 h1_max_headers: None,
@@ -2800,6 +2847,7 @@ mod tests {
                     &mut bytes,
                     ParseContext {
                         cached_headers: &mut None,
+                        header_indices: &mut Vec::new(),
                         req_method: &mut None,
                         h1_parser_config: Default::default(),
                         h1_max_headers: max_headers,
@@ -2828,6 +2876,7 @@ mod tests {
                     &mut bytes,
                     ParseContext {
                         cached_headers: &mut None,
+                        header_indices: &mut Vec::new(),
                         req_method: &mut None,
                         h1_parser_config: Default::default(),
                         h1_max_headers: max_headers,
@@ -2979,6 +3028,7 @@ mod tests {
                 &mut raw,
                 ParseContext {
                     cached_headers: &mut headers,
+                    header_indices: &mut Vec::new(),
                     req_method: &mut None,
                     h1_parser_config: Default::default(),
                     h1_max_headers: None,
@@ -3028,6 +3078,7 @@ mod tests {
                 &mut raw,
                 ParseContext {
                     cached_headers: &mut headers,
+                    header_indices: &mut Vec::new(),
                     req_method: &mut None,
                     h1_parser_config: Default::default(),
                     h1_max_headers: None,
@@ -401,6 +401,8 @@ where
     body_tx: SendStream<SendBuf<B::Data>>,
     body: B,
     cb: Callback<Request<B>, Response<IncomingBody>>,
+    #[cfg(feature = "ffi")]
+    stats: Option<crate::ffi::RequestStats>,
 }
 
 impl<B: Body> Unpin for FutCtx<B> {}
@@ -520,6 +522,10 @@ where
                     fut: f.fut,
                     ping: Some(ping),
                     send_stream: Some(send_stream),
+                    #[cfg(feature = "ffi")]
+                    stats: f.stats,
+                    #[cfg(not(feature = "ffi"))]
+                    stats: (),
                 },
                 call_back: Some(f.cb),
             },
@@ -539,9 +545,16 @@ pin_project! {
         ping: Option<Recorder>,
         #[pin]
         send_stream: Option<Option<SendStream<SendBuf<<B as Body>::Data>>>>,
+        stats: ResponseStats,
     }
 }
 
+/// The timings of an FFI request, which record when its response arrives.
+#[cfg(feature = "ffi")]
+type ResponseStats = Option<crate::ffi::RequestStats>;
+#[cfg(not(feature = "ffi"))]
+type ResponseStats = ();
+
 impl<B> Future for ResponseFutMap<B>
 where
     B: Body + 'static,
@@ -560,6 +573,10 @@ where
             Ok(res) => {
                 // record that we got the response headers
                 ping.record_non_data();
+                #[cfg(feature = "ffi")]
+                if let Some(stats) = this.stats.take() {
+                    stats.record_headers_received();
+                }
 
                 let content_length = headers::content_length_parse_all(res.headers());
                 if let (Some(mut send_stream), StatusCode::OK) = (send_stream, res.status()) {
@@ -648,6 +665,8 @@ where
                     let (head, body) = req.into_parts();
                     let mut req = ::http::Request::from_parts(head, ());
                     super::strip_connection_headers(req.headers_mut(), true);
+                    #[cfg(feature = "ffi")]
+                    let stats = req.extensions_mut().remove::<crate::ffi::RequestStats>();
                     if let Some(len) = body.size_hint().exact() {
                         if len != 0 || headers::method_has_defined_payload_semantics(req.method()) {
                             headers::set_content_length_if_missing(req.headers_mut(), len);
@@ -682,6 +701,12 @@ where
                         }
                     };
 
+                    // The head is now in the connection's send buffer.
+                    #[cfg(feature = "ffi")]
+                    if let Some(ref stats) = stats {
+                        stats.record_head_written();
+                    }
+
                     let f = FutCtx {
                         is_connect,
                         eos,
@@ -689,6 +714,8 @@ where
                         body_tx,
                         body,
                         cb,
+                        #[cfg(feature = "ffi")]
+                        stats,
                     };
 
                     // Check poll_ready() again.
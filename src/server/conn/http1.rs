@@ -155,6 +155,12 @@ where
         }
     }
 
+    /// Lets the connection use what its IO can do as a C API `hyper_io`.
+    #[cfg(feature = "ffi")]
+    pub(crate) fn set_ffi_transport(&mut self, get: crate::proto::h1::GetFfiTransport<I>) {
+        self.conn.set_ffi_transport(get);
+    }
+
     /// Poll the connection for completion, but without calling `shutdown`
     /// on the underlying IO.
     ///
@@ -305,8 +311,9 @@ impl Builder {
     /// "431 Request Header Fields Too Large".
     ///
     /// Note that headers is allocated on the stack by default, which has higher performance. After
-    /// setting this value, headers will be allocated in heap memory, that is, heap memory
-    /// allocation will occur for each request, and there will be a performance drop of about 5%.
+    /// setting this value above 100, headers will be allocated in heap memory. Part of that memory
+    /// is kept by the connection and reused, but some heap memory allocation will still occur for
+    /// each request, and there will be a performance drop of about 5%.
     ///
     /// Default is 100.
     pub fn max_headers(&mut self, val: usize) -> &mut Self {